@@ -25,6 +25,12 @@ o/$(MODE)/embedfile/sqlite-csv.a: o/$(MODE)/embedfile/sqlite-csv.o
 o/$(MODE)/embedfile/sqlite-lines.o: embedfile/sqlite-lines.c
 o/$(MODE)/embedfile/sqlite-lines.a: o/$(MODE)/embedfile/sqlite-lines.o
 
+o/$(MODE)/embedfile/sqlite-json-read.o: embedfile/sqlite-json-read.c
+o/$(MODE)/embedfile/sqlite-json-read.a: o/$(MODE)/embedfile/sqlite-json-read.o
+
+o/$(MODE)/embedfile/sqlite-shards.o: embedfile/sqlite-shards.c
+o/$(MODE)/embedfile/sqlite-shards.a: o/$(MODE)/embedfile/sqlite-shards.o
+
 o/$(MODE)/embedfile/sqlite-lembed.o: embedfile/sqlite-lembed.c
 o/$(MODE)/embedfile/sqlite-lembed.a: o/$(MODE)/embedfile/sqlite-lembed.o o/$(MODE)/llama.cpp/llama.cpp.a
 
@@ -45,12 +51,22 @@ o/$(MODE)/embedfile/embedfile:					\
 		o/$(MODE)/embedfile/sqlite-csv.a \
 		o/$(MODE)/embedfile/sqlite-vec.a \
 		o/$(MODE)/embedfile/sqlite-lines.a \
+		o/$(MODE)/embedfile/sqlite-json-read.a \
+		o/$(MODE)/embedfile/sqlite-shards.a \
+		o/$(MODE)/embedfile/sqlite-lembed.a
+
+o/$(MODE)/embedfile/bench:					\
+		o/$(MODE)/embedfile/bench.o			\
+		o/$(MODE)/llama.cpp/llama.cpp.a \
+		o/$(MODE)/third_party/sqlite/sqlite3.a \
+		o/$(MODE)/embedfile/sqlite-vec.a \
 		o/$(MODE)/embedfile/sqlite-lembed.a
 
 $(LLAMA_CPP_EMBEDFILE_OBJS): private CCFLAGS += -DSQLITE_CORE
 
 .PHONY: o/$(MODE)/embedfile
 o/$(MODE)/embedfile:						\
-		o/$(MODE)/embedfile/embedfile
+		o/$(MODE)/embedfile/embedfile				\
+		o/$(MODE)/embedfile/bench
 
 $(LLAMA_CPP_EMBEDFILE_OBJS): llama.cpp/BUILD.mk embedfile/BUILD.mk
@@ -0,0 +1,817 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+#include "embedfile/embedfile.h"
+#include "embedfile/sqlite-lembed.h"
+#include "embedfile/sqlite-vec.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/version.h"
+#include "third_party/sqlite/sqlite3.h"
+
+#include <cosmo.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Measures the pieces embedfile is built from and prints the results as
+// a single JSON object on standard output, so runs can be compared across
+// releases:
+//
+//   - tokenize: llama_tokenize() throughput over the corpus
+//   - embed: lembed_batch() throughput for each batch size (n_ctx) and
+//     thread count
+//   - vec0: insert rate, KNN latency percentiles, recall@k against exact
+//     float32 search, and the latency of a query on a freshly opened index
+//     whose file was dropped from the page cache (cold) versus the same
+//     query again (warm), for each element type, metric, and chunk_size
+//
+// The vec0 benchmarks run on random unit vectors, and also on the corpus
+// embeddings when a model is given. Without --file, the corpus is made up
+// sentences. For example:
+//
+//     make -j8 o//embedfile/bench
+//     o//embedfile/bench -m all-MiniLM-L6-v2.F32.gguf -f corpus.txt > bench.json
+
+#define CHECK_SQLITE_NOT_OK(rc, db) \
+    do { \
+        if ((rc) != SQLITE_OK) { \
+            fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db)); \
+            exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+#define CHECK_SQLITE_NOT_DONE(rc, db) \
+    do { \
+        if ((rc) != SQLITE_DONE) { \
+            fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db)); \
+            exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+#define CHECK_SQLITE_NOT_ROW(rc, db) \
+    do { \
+        if ((rc) != SQLITE_ROW) { \
+            fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db)); \
+            exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+
+// Most values a comma separated list flag takes.
+#define BENCH_MAX_LIST 16
+
+// How long tokenizing the corpus is repeated for, in seconds.
+#define BENCH_TOKENIZE_SECONDS 1.0
+
+char *BENCH_MODEL = NULL;
+char *BENCH_FILE = NULL;
+int BENCH_DOCUMENTS = 1000;
+int BENCH_VECTORS = 20000;
+int BENCH_DIMENSIONS = 384;
+int BENCH_QUERIES = 100;
+int BENCH_K = 10;
+int BENCH_BATCHES[BENCH_MAX_LIST] = {512, 2048};
+int BENCH_BATCHES_COUNT = 2;
+int BENCH_THREADS[BENCH_MAX_LIST];
+int BENCH_THREADS_COUNT = 0;
+int BENCH_CHUNK_SIZES[BENCH_MAX_LIST] = {256, 1024, 4096};
+int BENCH_CHUNK_SIZES_COUNT = 3;
+
+typedef struct {
+    char **documents;
+    int *lengths;
+    int count;
+    int64_t bytes;
+} bench_corpus;
+
+typedef struct {
+    const char *name;
+    // count * dimensions unit vectors, the i-th stored with rowid i + 1
+    float *vectors;
+    int count;
+    // queries * dimensions unit vectors, searched for but not stored
+    float *queries;
+    int nqueries;
+    int dimensions;
+} bench_dataset;
+
+typedef enum {
+    BENCH_ELEMENT_TYPE_FLOAT32,
+    BENCH_ELEMENT_TYPE_INT8,
+    BENCH_ELEMENT_TYPE_BIT,
+} bench_element_type;
+
+typedef struct {
+    bench_element_type element_type;
+    // name of the element type in a vec0 column definition
+    const char *column_type;
+    const char *metric;
+    // vec0 column option for the metric, if it isn't the default
+    const char *column_option;
+    // wraps the bound vector so vec0 gets the right subtype
+    const char *wrap;
+} bench_index;
+
+static const bench_index BENCH_INDEXES[] = {
+    {BENCH_ELEMENT_TYPE_FLOAT32, "float", "l2", "", "?"},
+    {BENCH_ELEMENT_TYPE_FLOAT32, "float", "cosine", " distance_metric=cosine", "?"},
+    {BENCH_ELEMENT_TYPE_INT8, "int8", "l2", "", "vec_int8(?)"},
+    {BENCH_ELEMENT_TYPE_INT8, "int8", "cosine", " distance_metric=cosine", "vec_int8(?)"},
+    {BENCH_ELEMENT_TYPE_BIT, "bit", "hamming", "", "vec_bit(?)"},
+};
+
+static const char *bench_element_type_name(bench_element_type type) {
+    switch (type) {
+    case BENCH_ELEMENT_TYPE_FLOAT32:
+        return "float32";
+    case BENCH_ELEMENT_TYPE_INT8:
+        return "int8";
+    case BENCH_ELEMENT_TYPE_BIT:
+        return "bit";
+    }
+    return "";
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift64*, seeded the same way every run so results are comparable.
+static uint64_t bench_random_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t bench_random(void) {
+    bench_random_state ^= bench_random_state >> 12;
+    bench_random_state ^= bench_random_state << 25;
+    bench_random_state ^= bench_random_state >> 27;
+    return bench_random_state * 0x2545f4914f6cdd1dull;
+}
+
+static double bench_random_uniform(void) {
+    return ((bench_random() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static void bench_random_unit_vector(float *v, int dimensions) {
+    double norm = 0;
+    for (int i = 0; i < dimensions; i++) {
+        // Box-Muller, so the vectors are uniform on the sphere
+        v[i] = sqrt(-2 * log(bench_random_uniform())) * cos(2 * M_PI * bench_random_uniform());
+        norm += v[i] * v[i];
+    }
+    norm = sqrt(norm);
+    for (int i = 0; i < dimensions; i++) {
+        v[i] /= norm;
+    }
+}
+
+static void *bench_malloc(size_t n) {
+    void *p = malloc(n ? n : 1);
+    if (!p) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void bench_corpus_add(bench_corpus *c, const char *text, int length) {
+    c->documents = realloc(c->documents, (c->count + 1) * sizeof(char *));
+    c->lengths = realloc(c->lengths, (c->count + 1) * sizeof(int));
+    if (!c->documents || !c->lengths) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    c->documents[c->count] = bench_malloc(length + 1);
+    memcpy(c->documents[c->count], text, length);
+    c->documents[c->count][length] = 0;
+    c->lengths[c->count] = length;
+    c->bytes += length;
+    c->count++;
+}
+
+// Reads up to BENCH_DOCUMENTS non-empty lines of BENCH_FILE.
+static void bench_corpus_load(bench_corpus *c) {
+    FILE *f = fopen(BENCH_FILE, "r");
+    if (!f) {
+        perror(BENCH_FILE);
+        exit(EXIT_FAILURE);
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t n;
+    while (c->count < BENCH_DOCUMENTS && (n = getline(&line, &capacity, f)) >= 0) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+            n--;
+        }
+        if (n > 0) {
+            bench_corpus_add(c, line, n);
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+// Makes up BENCH_DOCUMENTS sentences of 8 to 40 common words.
+static void bench_corpus_synthesize(bench_corpus *c) {
+    static const char *words[] = {
+        "the",     "of",      "and",    "to",     "in",       "is",       "that",   "for",
+        "it",      "as",      "with",   "was",    "on",       "be",       "by",     "this",
+        "river",   "city",    "market", "engine", "protein",  "library",  "winter", "signal",
+        "council", "harvest", "orbit",  "ledger", "painting", "compiler", "storm",  "treaty",
+        "measure", "travel",  "grow",   "reduce", "describe", "announce", "build",  "study",
+        "quickly", "rarely",  "large",  "small",  "ancient",  "digital",  "public", "quiet",
+    };
+    int nwords = sizeof(words) / sizeof(words[0]);
+    char text[1024];
+    while (c->count < BENCH_DOCUMENTS) {
+        int n = 0;
+        int length = 8 + bench_random() % 33;
+        for (int i = 0; i < length; i++) {
+            n += snprintf(text + n, sizeof(text) - n, "%s%s", i ? " " : "",
+                          words[bench_random() % nwords]);
+        }
+        n += snprintf(text + n, sizeof(text) - n, ".");
+        text[0] = toupper(text[0]);
+        bench_corpus_add(c, text, n);
+    }
+}
+
+static void bench_print_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            printf("\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            printf("\\u%04x", *s);
+        } else {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static int bench_parse_list(const char *flag, const char *value, int *out) {
+    int count = 0;
+    for (const char *p = value; *p;) {
+        char *end;
+        long n = strtol(p, &end, 10);
+        if (end == p || n <= 0 || count == BENCH_MAX_LIST) {
+            fprintf(stderr, "Invalid value for %s: %s\n", flag, value);
+            exit(EXIT_FAILURE);
+        }
+        out[count++] = n;
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            fprintf(stderr, "Invalid value for %s: %s\n", flag, value);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return count;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, int p) {
+    return n ? sorted[(n - 1) * p / 100] : 0;
+}
+
+static sqlite3 *bench_open(const char *path) {
+    sqlite3 *db;
+    int rc = sqlite3_open(path, &db);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_vec_init(db, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_lembed_init(db, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    return db;
+}
+
+// Registers BENCH_MODEL as the default model. Zero leaves n_ctx or
+// n_threads at llama.cpp's default.
+static void bench_register_model(sqlite3 *db, int n_ctx, int n_threads) {
+    sqlite3_stmt *stmt;
+    char *zSql = sqlite3_mprintf("INSERT INTO temp.lembed_models(model, context_options) "
+                                 "VALUES (?1, lembed_context_options(%s%s%s))",
+                                 n_ctx ? "'n_ctx', ?2" : "", n_ctx && n_threads ? ", " : "",
+                                 n_threads ? "'n_threads', ?3" : "");
+    int rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    sqlite3_bind_text(stmt, 1, BENCH_MODEL, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, n_ctx);
+    sqlite3_bind_int(stmt, 3, n_threads);
+    rc = sqlite3_step(stmt);
+    CHECK_SQLITE_NOT_DONE(rc, db);
+    sqlite3_finalize(stmt);
+}
+
+// Stores the corpus as the JSON array lembed_batch() takes, in temp.input.
+static void bench_load_corpus(sqlite3 *db, const bench_corpus *c) {
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_exec(db,
+                          "CREATE TEMP TABLE documents(contents);"
+                          "CREATE TEMP TABLE input(json);",
+                          NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_prepare_v2(db, "INSERT INTO temp.documents(contents) VALUES (?1)", -1, &stmt,
+                            NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    for (int i = 0; i < c->count; i++) {
+        sqlite3_bind_text(stmt, 1, c->documents[i], c->lengths[i], SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        CHECK_SQLITE_NOT_DONE(rc, db);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    rc = sqlite3_exec(db,
+                      "INSERT INTO temp.input "
+                      "SELECT json_group_array(json_object('contents', contents)) "
+                      "FROM temp.documents",
+                      NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+}
+
+// Tokenizes the whole corpus over and over for BENCH_TOKENIZE_SECONDS,
+// and returns how many tokens one pass makes, special tokens included.
+static int64_t bench_tokenize(const bench_corpus *c) {
+    struct llama_model_params mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+    struct llama_model *model = llama_load_model_from_file(BENCH_MODEL, mparams);
+    if (!model) {
+        fprintf(stderr, "%s: Could not load model.\n", BENCH_MODEL);
+        exit(EXIT_FAILURE);
+    }
+    int capacity = 0;
+    for (int i = 0; i < c->count; i++) {
+        if (c->lengths[i] > capacity) {
+            capacity = c->lengths[i];
+        }
+    }
+    // every token takes at least a byte, plus the special tokens
+    capacity += 16;
+    llama_token *tokens = bench_malloc(capacity * sizeof(llama_token));
+
+    int64_t total = 0;
+    int64_t pass = 0;
+    int iterations = 0;
+    double started = now_seconds();
+    double elapsed;
+    do {
+        pass = 0;
+        for (int i = 0; i < c->count; i++) {
+            int n = llama_tokenize(model, c->documents[i], c->lengths[i], tokens, capacity,
+                                   true, false);
+            if (n < 0) {
+                fprintf(stderr, "Error: Could not tokenize document %d.\n", i);
+                exit(EXIT_FAILURE);
+            }
+            pass += n;
+        }
+        total += pass;
+        iterations++;
+    } while ((elapsed = now_seconds() - started) < BENCH_TOKENIZE_SECONDS);
+
+    printf("  \"tokenize\": {\"documents\": %d, \"bytes\": %lld, \"tokens\": %lld, "
+           "\"iterations\": %d, \"seconds\": %.6f, \"tokens_per_second\": %.1f, "
+           "\"megabytes_per_second\": %.3f},\n",
+           c->count, (long long)c->bytes, (long long)pass, iterations, elapsed,
+           total / elapsed, c->bytes * iterations / elapsed / 1e6);
+    free(tokens);
+    llama_free_model(model);
+    return pass;
+}
+
+// Embeds the corpus once per batch size and thread count, then once more
+// with the defaults to return its embeddings for the vec0 benchmarks.
+static void bench_embed(const bench_corpus *c, int64_t tokens, bench_dataset *out) {
+    int rc;
+    sqlite3_stmt *stmt;
+
+    // keeps the weights loaded between the connections below
+    sqlite3 *holder = bench_open(":memory:");
+    bench_register_model(holder, 0, 0);
+
+    printf("  \"embed\": [");
+    int first = 1;
+    for (int b = 0; b < BENCH_BATCHES_COUNT; b++) {
+        for (int t = 0; t < BENCH_THREADS_COUNT; t++) {
+            sqlite3 *db = bench_open(":memory:");
+            bench_register_model(db, BENCH_BATCHES[b], BENCH_THREADS[t]);
+            bench_load_corpus(db, c);
+            rc = sqlite3_prepare_v2(db,
+                                    "SELECT count(*) FROM lembed_batch("
+                                    "(SELECT json FROM temp.input))",
+                                    -1, &stmt, NULL);
+            CHECK_SQLITE_NOT_OK(rc, db);
+            double started = now_seconds();
+            rc = sqlite3_step(stmt);
+            CHECK_SQLITE_NOT_ROW(rc, db);
+            double elapsed = now_seconds() - started;
+            int embeddings = sqlite3_column_int(stmt, 0);
+            sqlite3_finalize(stmt);
+            sqlite3_close(db);
+
+            printf("%s\n    {\"n_ctx\": %d, \"n_threads\": %d, \"embeddings\": %d, "
+                   "\"seconds\": %.6f, \"embeddings_per_second\": %.1f, "
+                   "\"tokens_per_second\": %.1f}",
+                   first ? "" : ",", BENCH_BATCHES[b], BENCH_THREADS[t], embeddings, elapsed,
+                   embeddings / elapsed, tokens / elapsed);
+            fflush(stdout);
+            first = 0;
+        }
+    }
+    printf("\n  ],\n");
+
+    bench_load_corpus(holder, c);
+    rc = sqlite3_prepare_v2(holder,
+                            "SELECT embedding FROM lembed_batch((SELECT json FROM temp.input))",
+                            -1, &stmt, NULL);
+    CHECK_SQLITE_NOT_OK(rc, holder);
+    // hold out the first tenth of the corpus, up to BENCH_QUERIES, as queries
+    int nqueries = c->count / 10 < BENCH_QUERIES ? c->count / 10 : BENCH_QUERIES;
+    int i = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int dimensions = sqlite3_column_bytes(stmt, 0) / sizeof(float);
+        if (!i) {
+            out->name = "corpus";
+            out->dimensions = dimensions;
+            out->nqueries = nqueries;
+            out->count = c->count - nqueries;
+            out->queries = bench_malloc((size_t)c->count * dimensions * sizeof(float));
+            out->vectors = out->queries + (size_t)nqueries * dimensions;
+        }
+        if (i < c->count && dimensions == out->dimensions) {
+            memcpy(out->queries + (size_t)i * dimensions, sqlite3_column_blob(stmt, 0),
+                   dimensions * sizeof(float));
+        }
+        i++;
+    }
+    CHECK_SQLITE_NOT_DONE(rc, holder);
+    sqlite3_finalize(stmt);
+    sqlite3_close(holder);
+}
+
+static void bench_dataset_synthesize(bench_dataset *d) {
+    d->name = "synthetic";
+    d->dimensions = BENCH_DIMENSIONS;
+    d->count = BENCH_VECTORS;
+    d->nqueries = BENCH_QUERIES;
+    d->vectors = bench_malloc((size_t)d->count * d->dimensions * sizeof(float));
+    d->queries = bench_malloc((size_t)d->nqueries * d->dimensions * sizeof(float));
+    for (int i = 0; i < d->count; i++) {
+        bench_random_unit_vector(d->vectors + (size_t)i * d->dimensions, d->dimensions);
+    }
+    for (int i = 0; i < d->nqueries; i++) {
+        bench_random_unit_vector(d->queries + (size_t)i * d->dimensions, d->dimensions);
+    }
+}
+
+// Finds the exact BENCH_K nearest rowids of every query by brute force.
+// The vectors are normalized, so the largest dot products are both the
+// closest by L2 and by cosine distance.
+static int64_t *bench_ground_truth(const bench_dataset *d) {
+    int64_t *truth = bench_malloc((size_t)d->nqueries * BENCH_K * sizeof(int64_t));
+    float *best = bench_malloc(BENCH_K * sizeof(float));
+    for (int q = 0; q < d->nqueries; q++) {
+        const float *query = d->queries + (size_t)q * d->dimensions;
+        int64_t *rowids = truth + (size_t)q * BENCH_K;
+        int n = 0;
+        for (int i = 0; i < d->count; i++) {
+            const float *v = d->vectors + (size_t)i * d->dimensions;
+            float dot = 0;
+            for (int j = 0; j < d->dimensions; j++) {
+                dot += query[j] * v[j];
+            }
+            if (n == BENCH_K && dot <= best[n - 1]) {
+                continue;
+            }
+            int k = n < BENCH_K ? n++ : n - 1;
+            while (k > 0 && best[k - 1] < dot) {
+                best[k] = best[k - 1];
+                rowids[k] = rowids[k - 1];
+                k--;
+            }
+            best[k] = dot;
+            rowids[k] = i + 1;
+        }
+        for (; n < BENCH_K; n++) {
+            rowids[n] = 0;
+        }
+    }
+    free(best);
+    return truth;
+}
+
+// Converts a unit vector to what an index of the given type stores, and
+// returns its size in bytes.
+static int bench_encode(const float *v, int dimensions, bench_element_type type, void *out) {
+    switch (type) {
+    case BENCH_ELEMENT_TYPE_FLOAT32:
+        memcpy(out, v, dimensions * sizeof(float));
+        return dimensions * sizeof(float);
+    case BENCH_ELEMENT_TYPE_INT8:
+        for (int i = 0; i < dimensions; i++) {
+            float x = roundf(v[i] * 127);
+            ((int8_t *)out)[i] = x > 127 ? 127 : x < -127 ? -127 : x;
+        }
+        return dimensions;
+    case BENCH_ELEMENT_TYPE_BIT:
+        memset(out, 0, dimensions / 8);
+        for (int i = 0; i < dimensions; i++) {
+            if (v[i] > 0) {
+                ((uint8_t *)out)[i / 8] |= 1 << (i % 8);
+            }
+        }
+        return dimensions / 8;
+    }
+    return 0;
+}
+
+// Asks the kernel to forget the cached pages of path, so the next query
+// has to read the index from disk again.
+static void bench_drop_cache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static void bench_vec0(const bench_dataset *d, const int64_t *truth, const bench_index *index,
+                       int chunk_size, const char *path, int first) {
+    int rc;
+    sqlite3_stmt *stmt;
+    void *blob = bench_malloc(d->dimensions * sizeof(float));
+    double *latencies = bench_malloc(d->nqueries * sizeof(double));
+
+    unlink(path);
+    sqlite3 *db = bench_open(path);
+    char *zSql = sqlite3_mprintf("CREATE VIRTUAL TABLE v USING vec0(e %s[%d]%s, chunk_size=%d)",
+                                 index->column_type, d->dimensions, index->column_option,
+                                 chunk_size);
+    rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+
+    zSql = sqlite3_mprintf("INSERT INTO v(rowid, e) VALUES (?, %s)", index->wrap);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    double started = now_seconds();
+    rc = sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    for (int i = 0; i < d->count; i++) {
+        int n = bench_encode(d->vectors + (size_t)i * d->dimensions, d->dimensions,
+                             index->element_type, blob);
+        sqlite3_bind_int64(stmt, 1, i + 1);
+        sqlite3_bind_blob(stmt, 2, blob, n, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        CHECK_SQLITE_NOT_DONE(rc, db);
+        sqlite3_reset(stmt);
+    }
+    rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    double insertSeconds = now_seconds() - started;
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    struct stat st;
+    int64_t bytes = stat(path, &st) ? 0 : st.st_size;
+
+    // cold: opening the index and running the first query, with nothing
+    // of it in the page cache
+    bench_drop_cache(path);
+    zSql = sqlite3_mprintf("SELECT rowid FROM v WHERE e MATCH %s AND k = %d", index->wrap,
+                           BENCH_K);
+    started = now_seconds();
+    db = bench_open(path);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    int n = bench_encode(d->queries, d->dimensions, index->element_type, blob);
+    sqlite3_bind_blob(stmt, 1, blob, n, SQLITE_STATIC);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    }
+    CHECK_SQLITE_NOT_DONE(rc, db);
+    sqlite3_reset(stmt);
+    double coldSeconds = now_seconds() - started;
+
+    int64_t found = 0;
+    for (int q = 0; q < d->nqueries; q++) {
+        const int64_t *expected = truth + (size_t)q * BENCH_K;
+        n = bench_encode(d->queries + (size_t)q * d->dimensions, d->dimensions,
+                         index->element_type, blob);
+        started = now_seconds();
+        sqlite3_bind_blob(stmt, 1, blob, n, SQLITE_STATIC);
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            int64_t rowid = sqlite3_column_int64(stmt, 0);
+            for (int i = 0; i < BENCH_K; i++) {
+                if (expected[i] == rowid) {
+                    found++;
+                    break;
+                }
+            }
+        }
+        CHECK_SQLITE_NOT_DONE(rc, db);
+        sqlite3_reset(stmt);
+        latencies[q] = now_seconds() - started;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    unlink(path);
+
+    // the first query again, now that everything is cached
+    double warmSeconds = d->nqueries ? latencies[0] : 0;
+    double total = 0;
+    for (int q = 0; q < d->nqueries; q++) {
+        total += latencies[q];
+    }
+    qsort(latencies, d->nqueries, sizeof(double), compare_doubles);
+    int64_t expectedCount = 0;
+    for (size_t i = 0; i < (size_t)d->nqueries * BENCH_K; i++) {
+        expectedCount += truth[i] != 0;
+    }
+
+    printf("%s\n    {\"dataset\": \"%s\", \"vectors\": %d, \"dimensions\": %d, "
+           "\"queries\": %d, \"k\": %d, \"element_type\": \"%s\", \"metric\": \"%s\", "
+           "\"chunk_size\": %d, \"bytes\": %lld, \"insert_seconds\": %.6f, "
+           "\"inserts_per_second\": %.1f, \"cold_ms\": %.3f, \"warm_ms\": %.3f, "
+           "\"knn_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+           "\"max\": %.3f}, \"recall\": %.4f}",
+           first ? "" : ",", d->name, d->count, d->dimensions, d->nqueries, BENCH_K,
+           bench_element_type_name(index->element_type), index->metric, chunk_size,
+           (long long)bytes, insertSeconds, d->count / insertSeconds, coldSeconds * 1e3,
+           warmSeconds * 1e3, d->nqueries ? total / d->nqueries * 1e3 : 0,
+           percentile(latencies, d->nqueries, 50) * 1e3,
+           percentile(latencies, d->nqueries, 90) * 1e3,
+           percentile(latencies, d->nqueries, 99) * 1e3,
+           percentile(latencies, d->nqueries, 100) * 1e3,
+           expectedCount ? (double)found / expectedCount : 1.0);
+    fflush(stdout);
+    free(latencies);
+    free(blob);
+}
+
+static void bench_vec0_dataset(const bench_dataset *d, const char *path, int *first) {
+    int64_t *truth = bench_ground_truth(d);
+    for (size_t i = 0; i < sizeof(BENCH_INDEXES) / sizeof(BENCH_INDEXES[0]); i++) {
+        if (BENCH_INDEXES[i].element_type == BENCH_ELEMENT_TYPE_BIT && d->dimensions % 8) {
+            continue;
+        }
+        for (int c = 0; c < BENCH_CHUNK_SIZES_COUNT; c++) {
+            bench_vec0(d, truth, &BENCH_INDEXES[i], BENCH_CHUNK_SIZES[c], path, *first);
+            *first = 0;
+        }
+    }
+    free(truth);
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: bench [OPTIONS]\n"
+            "\n"
+            "Benchmarks tokenizing, embedding, and vec0 indexes, and prints JSON.\n"
+            "\n"
+            "  -m, --model FILE      embedding model; without it only vec0 is measured\n"
+            "  -f, --file FILE       corpus with one document per line (default: made up)\n"
+            "  --documents NUM       how many documents of the corpus to use (default: 1000)\n"
+            "  --vectors NUM         random vectors to index (default: 20000)\n"
+            "  --dimensions NUM      dimensions of the random vectors (default: 384)\n"
+            "  --queries NUM         KNN queries per index (default: 100)\n"
+            "  --k NUM               neighbors per query (default: 10)\n"
+            "  --batch LIST          n_ctx values to embed with (default: 512,2048)\n"
+            "  --threads LIST        thread counts to embed with (default: 1 and all cores)\n"
+            "  --chunk-sizes LIST    vec0 chunk_size values (default: 256,1024,4096)\n");
+}
+
+int main(int argc, char **argv) {
+    FLAG_log_disable = 1;
+    FLAGS_READY = 1;
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (!sqlite3_stricmp(arg, "-h") || !sqlite3_stricmp(arg, "--help")) {
+            usage();
+            return 0;
+        }
+        if (i + 1 == argc) {
+            fprintf(stderr, "Missing value for %s.\n", arg);
+            usage();
+            return 1;
+        }
+        char *value = argv[++i];
+        if (!sqlite3_stricmp(arg, "-m") || !sqlite3_stricmp(arg, "--model")) {
+            BENCH_MODEL = value;
+        } else if (!sqlite3_stricmp(arg, "-f") || !sqlite3_stricmp(arg, "--file")) {
+            BENCH_FILE = value;
+        } else if (!sqlite3_stricmp(arg, "--documents")) {
+            BENCH_DOCUMENTS = atoi(value);
+        } else if (!sqlite3_stricmp(arg, "--vectors")) {
+            BENCH_VECTORS = atoi(value);
+        } else if (!sqlite3_stricmp(arg, "--dimensions")) {
+            BENCH_DIMENSIONS = atoi(value);
+        } else if (!sqlite3_stricmp(arg, "--queries")) {
+            BENCH_QUERIES = atoi(value);
+        } else if (!sqlite3_stricmp(arg, "--k")) {
+            BENCH_K = atoi(value);
+        } else if (!sqlite3_stricmp(arg, "--batch")) {
+            BENCH_BATCHES_COUNT = bench_parse_list(arg, value, BENCH_BATCHES);
+        } else if (!sqlite3_stricmp(arg, "--threads")) {
+            BENCH_THREADS_COUNT = bench_parse_list(arg, value, BENCH_THREADS);
+        } else if (!sqlite3_stricmp(arg, "--chunk-sizes")) {
+            BENCH_CHUNK_SIZES_COUNT = bench_parse_list(arg, value, BENCH_CHUNK_SIZES);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            usage();
+            return 1;
+        }
+    }
+    if (BENCH_DOCUMENTS <= 0 || BENCH_VECTORS <= 0 || BENCH_DIMENSIONS <= 0 ||
+        BENCH_QUERIES <= 0 || BENCH_K <= 0) {
+        fprintf(stderr, "Error: --documents, --vectors, --dimensions, --queries, and --k "
+                        "must be positive.\n");
+        return 1;
+    }
+    for (int i = 0; i < BENCH_CHUNK_SIZES_COUNT; i++) {
+        if (BENCH_CHUNK_SIZES[i] % 8 || BENCH_CHUNK_SIZES[i] > 4096) {
+            fprintf(stderr, "Error: chunk sizes must be multiples of 8, up to 4096.\n");
+            return 1;
+        }
+    }
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    if (!BENCH_THREADS_COUNT) {
+        BENCH_THREADS[BENCH_THREADS_COUNT++] = 1;
+        if (cpus > 1) {
+            BENCH_THREADS[BENCH_THREADS_COUNT++] = cpus;
+        }
+    }
+
+    const char *tmpdir = getenv("TMPDIR");
+    char *path = sqlite3_mprintf("%s/embedfile-bench-%d.db", tmpdir && *tmpdir ? tmpdir : "/tmp",
+                                 getpid());
+
+    bench_corpus corpus = {0};
+    if (BENCH_FILE) {
+        bench_corpus_load(&corpus);
+    } else {
+        bench_corpus_synthesize(&corpus);
+    }
+
+    printf("{\n");
+    printf("  \"embedfile_version\": \"%s\",\n", EMBEDFILE_VERSION);
+    printf("  \"llamafile_version\": \"%s\",\n", LLAMAFILE_VERSION_STRING);
+    printf("  \"sqlite_version\": \"%s\",\n", sqlite3_libversion());
+    printf("  \"vec_version\": \"%s\",\n", SQLITE_VEC_VERSION);
+    printf("  \"lembed_version\": \"%s\",\n", SQLITE_LEMBED_VERSION);
+    printf("  \"cpus\": %d,\n", cpus);
+    printf("  \"model\": ");
+    if (BENCH_MODEL) {
+        bench_print_string(BENCH_MODEL);
+    } else {
+        printf("null");
+    }
+    printf(",\n  \"corpus\": ");
+    bench_print_string(BENCH_FILE ? BENCH_FILE : "synthetic");
+    printf(",\n");
+    fflush(stdout);
+
+    bench_dataset embedded = {0};
+    if (BENCH_MODEL) {
+        int64_t tokens = bench_tokenize(&corpus);
+        bench_embed(&corpus, tokens, &embedded);
+    }
+
+    bench_dataset synthetic = {0};
+    bench_dataset_synthesize(&synthetic);
+
+    int first = 1;
+    printf("  \"vec0\": [");
+    bench_vec0_dataset(&synthetic, path, &first);
+    if (embedded.count >= BENCH_K && embedded.nqueries > 0) {
+        bench_vec0_dataset(&embedded, path, &first);
+    }
+    printf("\n  ]\n}\n");
+
+    free(synthetic.vectors);
+    free(synthetic.queries);
+    free(embedded.queries);
+    for (int i = 0; i < corpus.count; i++) {
+        free(corpus.documents[i]);
+    }
+    free(corpus.documents);
+    free(corpus.lengths);
+    sqlite3_free(path);
+    return 0;
+}
@@ -3,17 +3,32 @@
 #include "embedfile/embedfile.h"
 #include "embedfile/shell.h"
 #include "embedfile/sqlite-csv.h"
+#include "embedfile/sqlite-json-read.h"
 #include "embedfile/sqlite-lembed.h"
 #include "embedfile/sqlite-lines.h"
+#include "embedfile/sqlite-shards.h"
 #include "embedfile/sqlite-vec.h"
+#include "llama.cpp/ggml.h"
 #include "llama.cpp/llama.h"
 #include "llamafile/version.h"
 #include "third_party/sqlite/sqlite3.h"
 #include <string.h>
 
 #include <cosmo.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <time.h>
+#include <unistd.h>
 
 #define CHECK_SQLITE_NOT_OK(rc, db) \
     do { \
@@ -51,42 +66,105 @@ int64_t time_ms(void) {
 }
 
 char *EMBEDFILE_MODEL = NULL;
+int64_t EMBEDFILE_DIMENSIONS = 0;
+char *EMBEDFILE_QUANTIZE = NULL;
+char *EMBEDFILE_SOCKET = NULL;
+char *EMBEDFILE_STORAGE_PROFILE = NULL;
+int EMBEDFILE_VERBOSE = 0;
+int64_t EMBEDFILE_STARTED_MS = 0;
 
 void embedfile_version(sqlite3_context *context, int argc, sqlite3_value **value) {
     sqlite3_result_text(context, EMBEDFILE_VERSION, -1, SQLITE_STATIC);
 }
 
-int embedfile_sqlite3_init(sqlite3 *db) {
+// Starts reading the model weights while the caller opens its database
+// and prepares statements, so registering the model later mostly waits
+// on a load that's already underway rather than starting one.
+void embedfile_preload_model(void) {
+    if (EMBEDFILE_MODEL) {
+        sqlite3_lembed_preload(EMBEDFILE_MODEL);
+    }
+}
+
+void embedfile_log_first_embedding(void) {
+    static int logged;
+    if (EMBEDFILE_VERBOSE && !logged) {
+        logged = 1;
+        fprintf(stderr, "embedfile: first embedding after %lld ms\n",
+                time_ms() - EMBEDFILE_STARTED_MS);
+    }
+}
+
+int embedfile_sqlite3_init_extensions(sqlite3 *db) {
     int rc;
 
     rc = sqlite3_vec_init(db, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_vec_numpy_init(db, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
     rc = sqlite3_lembed_init(db, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
     rc = sqlite3_csv_init(db, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
     rc = sqlite3_lines_init(db, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_json_read_init(db, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_shards_init(db, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
     rc = sqlite3_create_function_v2(db, "embedfile_version", 0, SQLITE_DETERMINISTIC | SQLITE_UTF8,
                                     NULL, embedfile_version, NULL, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
+    return rc;
+}
+
+// Registers EMBEDFILE_MODEL as the default model, which blocks until
+// its weights are loaded.
+int embedfile_sqlite3_init_model(sqlite3 *db) {
+    int rc;
+    int64_t started = time_ms();
 
     if (!EMBEDFILE_MODEL) {
         fprintf(stderr, "Error: No model provided.\n");
         exit(EXIT_FAILURE);
     }
     sqlite3_stmt *stmt;
-    rc =
-        sqlite3_prepare_v2(db, "insert into temp.lembed_models(model) values (?)", -1, &stmt, NULL);
+    sqlite3_str *sqlStr = sqlite3_str_new(NULL);
+    sqlite3_str_appendall(sqlStr, "insert into temp.lembed_models(model, context_options) "
+                                  "values (?1, lembed_context_options(");
+    if (EMBEDFILE_DIMENSIONS) {
+        sqlite3_str_appendf(sqlStr, "'dimensions', %lld", EMBEDFILE_DIMENSIONS);
+    }
+    if (EMBEDFILE_QUANTIZE) {
+        sqlite3_str_appendf(sqlStr, "%s'quantize', %Q", EMBEDFILE_DIMENSIONS ? ", " : "",
+                            EMBEDFILE_QUANTIZE);
+    }
+    sqlite3_str_appendall(sqlStr, "))");
+    char *zSql = sqlite3_str_finish(sqlStr);
+    CHECK_ZSQL_NOT_NULL(zSql);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
     CHECK_SQLITE_NOT_OK(rc, db);
     rc = sqlite3_bind_text(stmt, 1, EMBEDFILE_MODEL, -1, SQLITE_STATIC);
     CHECK_SQLITE_NOT_OK(rc, db);
-    sqlite3_step(stmt);
+    rc = sqlite3_step(stmt);
+    CHECK_SQLITE_NOT_DONE(rc, db);
     rc = sqlite3_finalize(stmt);
     CHECK_SQLITE_NOT_OK(rc, db);
+    if (EMBEDFILE_VERBOSE) {
+        fprintf(stderr, "embedfile: model ready after %lld ms (waited %lld ms)\n",
+                time_ms() - EMBEDFILE_STARTED_MS, time_ms() - started);
+    }
     return rc;
 }
 
+int embedfile_sqlite3_init(sqlite3 *db) {
+    int rc;
+    rc = embedfile_sqlite3_init_extensions(db);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    return embedfile_sqlite3_init_model(db);
+}
+
 int table_exists(sqlite3 *db, const char *table) {
     int rc;
     sqlite3_stmt *stmt;
@@ -125,35 +203,245 @@ void print_progress_bar(long long nEmbed, long long nTotal, long long elapsed_ms
     fflush(stdout);
 }
 
-int default_model_dimensions(sqlite3 *db, int64_t *dimensions) {
+// Gets the vec0 column type that holds what lembed() returns for the
+// default model, e.g. "float[768]", "int8[256]", or "bit[1024]".
+int default_model_vector_type(sqlite3 *db, char **type) {
     int rc;
     sqlite3_stmt *stmt;
-    rc = sqlite3_prepare_v2(db, "select dimensions from lembed_models where name = ?", -1, &stmt,
-                            NULL);
+    rc = sqlite3_prepare_v2(db,
+                            "select dimensions, element_type from lembed_models where name = ?",
+                            -1, &stmt, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
     rc = sqlite3_bind_text(stmt, 1, "default", -1, SQLITE_STATIC);
     CHECK_SQLITE_NOT_OK(rc, db);
     rc = sqlite3_step(stmt);
     if(rc == SQLITE_DONE) {
+      sqlite3_finalize(stmt);
       return SQLITE_EMPTY;
     }
     CHECK_SQLITE_NOT_ROW(rc, db);
-    *dimensions = sqlite3_column_int64(stmt, 0);
+    int64_t dimensions = sqlite3_column_int64(stmt, 0);
+    const char *element_type = (const char *)sqlite3_column_text(stmt, 1);
+    if (sqlite3_stricmp(element_type, "int8") == 0) {
+        *type = sqlite3_mprintf("int8[%lld]", dimensions);
+    } else if (sqlite3_stricmp(element_type, "bit") == 0) {
+        *type = sqlite3_mprintf("bit[%lld]", dimensions);
+    } else {
+        *type = sqlite3_mprintf("float[%lld]", dimensions);
+    }
     sqlite3_finalize(stmt);
+    CHECK_ZSQL_NOT_NULL(*type);
 
     return SQLITE_OK;
 }
 
-int cmd_search(char *dbPath, char *query, int k) {
+// Storage profiles are the pragmas an index database is opened with.
+// import builds with "build", and search and serve read with "read",
+// unless --storage-profile names another one, or "none" for SQLite's
+// defaults.
+#define STORAGE_MMAP_SIZE "1073741824"
+#define STORAGE_CHUNK_PAGES 64
+
+// The page size for a new index whose vec_items column has the given
+// type. A KNN query reads each chunk of vectors as a single blob of
+// vec0's default chunk_size of 1024 vectors, and pages of about 1/64th
+// of a blob keep its overflow chain short without making the pages of
+// the items table needlessly large. Returns 0 when the type is unknown.
+int storage_page_size(const char *vectorType) {
+    char element[16];
+    int dimensions;
+    if (!vectorType || sscanf(vectorType, "%15[a-z0-9][%d]", element, &dimensions) != 2) {
+        return 0;
+    }
+    int64_t bytes = !strcmp(element, "bit")    ? dimensions / 8
+                    : !strcmp(element, "int8") ? dimensions
+                                               : dimensions * 4;
+    int64_t wanted = bytes * 1024 / STORAGE_CHUNK_PAGES;
+    int pageSize = 4096;
+    while (pageSize < 65536 && pageSize < wanted) {
+        pageSize *= 2;
+    }
+    return pageSize;
+}
+
+// Applies the storage profile to the main database of db, or fallback
+// when none was chosen. With the build profile, a database without any
+// tables yet also gets the page size for vectorType, if one is given.
+void storage_profile_apply(sqlite3 *db, const char *fallback, const char *vectorType) {
+    int rc;
+    const char *profile = EMBEDFILE_STORAGE_PROFILE &&
+                                  sqlite3_stricmp(EMBEDFILE_STORAGE_PROFILE, "auto") != 0
+                              ? EMBEDFILE_STORAGE_PROFILE
+                              : fallback;
+    if (sqlite3_stricmp(profile, "build") == 0) {
+        // the page size can't change once the database is in WAL mode
+        int pageSize = storage_page_size(vectorType);
+        if (pageSize && !table_exists(db, "items") && !table_exists(db, "vec_items")) {
+            char *zSql = sqlite3_mprintf("PRAGMA main.page_size = %d", pageSize);
+            CHECK_ZSQL_NOT_NULL(zSql);
+            rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+            sqlite3_free(zSql);
+            CHECK_SQLITE_NOT_OK(rc, db);
+        }
+        // WAL stays on after the import, so searches can read the index
+        // while a later import writes to it, and synchronous=NORMAL only
+        // syncs at checkpoints rather than at every commit
+        rc = sqlite3_exec(db,
+                          "PRAGMA main.journal_mode = WAL;"
+                          "PRAGMA main.synchronous = NORMAL;"
+                          "PRAGMA main.cache_size = -262144;"
+                          "PRAGMA main.mmap_size = " STORAGE_MMAP_SIZE ";"
+                          "PRAGMA temp_store = MEMORY;",
+                          NULL, NULL, NULL);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    } else if (sqlite3_stricmp(profile, "read") == 0) {
+        rc = sqlite3_exec(db,
+                          "PRAGMA main.cache_size = -65536;"
+                          "PRAGMA main.mmap_size = " STORAGE_MMAP_SIZE ";"
+                          "PRAGMA temp_store = MEMORY;",
+                          NULL, NULL, NULL);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    }
+}
+
+int embedfile_client_search(const char *dbPath, const char *query, int k);
+char *embedfile_realpath(const char *path);
+
+// An index imported with --shards N keeps its vectors in N files next to
+// it, each with a vec_items table. The shards table of the index lists
+// their names, relative to the index, and rows go to shard rowid % N.
+char *embedfile_shard_name(const char *indexFile, int shard) {
+    const char *base = strrchr(indexFile, '/');
+    char *name = sqlite3_mprintf("%s-shard%d", base ? base + 1 : indexFile, shard);
+    CHECK_ZSQL_NOT_NULL(name);
+    return name;
+}
+
+char *embedfile_shard_path(const char *indexFile, const char *name) {
+    const char *base = strrchr(indexFile, '/');
+    char *path = base ? sqlite3_mprintf("%.*s%s", (int)(base + 1 - indexFile), indexFile, name)
+                      : sqlite3_mprintf("%s", name);
+    CHECK_ZSQL_NOT_NULL(path);
+    return path;
+}
+
+// Attaches the shards of the index as shard0, shard1, ..., unless they
+// already are, and returns the list of their vec_items tables that
+// vec0_sharded() takes.
+char *attach_shards(sqlite3 *db) {
     int rc;
-    sqlite3 *db;
     sqlite3_stmt *stmt;
-    rc = sqlite3_open(dbPath, &db);
+    const char *indexFile = sqlite3_db_filename(db, "main");
+    sqlite3_str *tables = sqlite3_str_new(NULL);
+    rc = sqlite3_prepare_v2(db, "SELECT id, path FROM shards ORDER BY id", -1, &stmt, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        char *schema = sqlite3_mprintf("shard%lld", sqlite3_column_int64(stmt, 0));
+        CHECK_ZSQL_NOT_NULL(schema);
+        if (!sqlite3_db_filename(db, schema)) {
+            char *path = embedfile_shard_path(indexFile, (const char *)sqlite3_column_text(stmt, 1));
+            char *zSql = sqlite3_mprintf("ATTACH DATABASE %Q AS \"%w\"", path, schema);
+            CHECK_ZSQL_NOT_NULL(zSql);
+            rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+            sqlite3_free(zSql);
+            sqlite3_free(path);
+            CHECK_SQLITE_NOT_OK(rc, db);
+        }
+        sqlite3_str_appendf(tables, "%s%s.vec_items", sqlite3_str_length(tables) ? ", " : "",
+                            schema);
+        sqlite3_free(schema);
+    }
+    CHECK_SQLITE_NOT_DONE(rc, db);
+    sqlite3_finalize(stmt);
+    char *result = sqlite3_str_finish(tables);
+    CHECK_ZSQL_NOT_NULL(result);
+    return result;
+}
 
-    rc = embedfile_sqlite3_init(db);
-    CHECK_SQLITE_NOT_OK(rc, db);
+// Collapses runs of whitespace and trims the ends, so that queries that
+// only differ in spacing share cache entries.
+void normalize_query(char *query) {
+    char *out = query;
+    for (char *p = query; *p; p++) {
+        if (isspace((unsigned char)*p)) {
+            if (out > query && out[-1] != ' ') {
+                *out++ = ' ';
+            }
+        } else {
+            *out++ = *p;
+        }
+    }
+    if (out > query && out[-1] == ' ') {
+        out--;
+    }
+    *out = 0;
+}
+
+// Identifies the flags that decide what lembed() returns, since cached
+// embeddings are only valid for the same model and settings.
+char *embedfile_settings_key(void) {
+    char *model = embedfile_realpath(EMBEDFILE_MODEL);
+    char *key = sqlite3_mprintf("%s %lld %s", model, EMBEDFILE_DIMENSIONS,
+                                EMBEDFILE_QUANTIZE ? EMBEDFILE_QUANTIZE : "none");
+    sqlite3_free(model);
+    CHECK_ZSQL_NOT_NULL(key);
+    return key;
+}
 
+// Gets the sqlite-vec function that gives a cached blob the subtype of
+// what lembed() would have returned.
+const char *embedfile_vector_function(void) {
+    if (EMBEDFILE_QUANTIZE && sqlite3_stricmp(EMBEDFILE_QUANTIZE, "int8") == 0) {
+        return "vec_int8";
+    }
+    if (EMBEDFILE_QUANTIZE && sqlite3_stricmp(EMBEDFILE_QUANTIZE, "bit") == 0) {
+        return "vec_bit";
+    }
+    return "vec_f32";
+}
+
+// Turns a search query into an FTS5 query that matches any of its
+// words, quoting each one so punctuation can't be taken for syntax.
+char *fts_query(const char *query) {
+    sqlite3_str *s = sqlite3_str_new(NULL);
+    const char *p = query;
+    while (*p) {
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        if (sqlite3_str_length(s)) {
+            sqlite3_str_appendall(s, " OR ");
+        }
+        sqlite3_str_appendchar(s, 1, '"');
+        for (; *p && !isspace((unsigned char)*p); p++) {
+            sqlite3_str_appendchar(s, *p == '"' ? 2 : 1, *p);
+        }
+        sqlite3_str_appendchar(s, 1, '"');
+    }
+    char *z = sqlite3_str_finish(s);
+    CHECK_ZSQL_NOT_NULL(z);
+    return z;
+}
+
+// How many candidates each retriever contributes per requested result
+// in hybrid search, and the constant from the reciprocal rank fusion
+// paper, which damps the weight of the very top ranks.
+#define HYBRID_DEPTH 4
+#define RRF_K 60
+
+// Prepares the KNN query over an index made by import, where match is
+// the SQL expression for the query vector in terms of ?1, and k is ?2.
+// In hybrid mode, ?3 is an FTS5 query over fts_items, and both result
+// lists are fused with reciprocal rank fusion.
+int search_prepare(sqlite3 *db, const char *match, int hybrid, sqlite3_stmt **out) {
+    int rc;
+    sqlite3_stmt *stmt;
+    // the vectors of an index imported with --shards are in other files,
+    // and are searched all at once with vec0_sharded()
+    char *shards = table_exists(db, "shards") ? attach_shards(db) : NULL;
     rc = sqlite3_prepare_v2(db, "\
     SELECT \
       substr(name, 1, instr(name, '_') - 1) AS source_column, \
@@ -170,6 +458,10 @@ int cmd_search(char *dbPath, char *query, int k) {
     char *embeddingsColumn = sqlite3_mprintf("%s", sqlite3_column_text(stmt, 1));
     sqlite3_finalize(stmt);
 
+    // an index imported with --chunk has a vec_items row per chunk, and
+    // the chunks table maps it to its item and the bytes it covers
+    int chunked = table_exists(db, "chunks");
+
     const char *zSql = sqlite3_mprintf("                               \
       SELECT                        \
         vec_items.rowid,                      \
@@ -177,72 +469,398 @@ int cmd_search(char *dbPath, char *query, int k) {
         vec_items.distance                    \
       FROM vec_items \
       LEFT JOIN items ON items.rowid = vec_items.rowid \
-      WHERE \"%w\" MATCH lembed(?)  \
-      AND k = ?   \
+      WHERE \"%w\" MATCH %s  \
+      AND k = ?2   \
     ",
-                                       sourceColumn, embeddingsColumn);
+                                       sourceColumn, embeddingsColumn, match);
+    if (chunked && !hybrid) {
+        sqlite3_free((void *)zSql);
+        zSql = sqlite3_mprintf(
+            "SELECT chunks.item,"
+            "  CAST(substr(CAST(items.\"%w\" AS BLOB), chunks.start + 1, chunks.length) AS TEXT),"
+            "  vec_items.distance"
+            "  FROM vec_items"
+            "  LEFT JOIN chunks ON chunks.id = vec_items.rowid"
+            "  LEFT JOIN items ON items.rowid = chunks.item"
+            "  WHERE \"%w\" MATCH %s AND k = ?2",
+            sourceColumn, embeddingsColumn, match);
+    }
+    if (shards && !hybrid) {
+        sqlite3_free((void *)zSql);
+        zSql = sqlite3_mprintf("SELECT knn.rowid, items.\"%w\", knn.distance"
+                               "  FROM vec0_sharded(%Q, %Q, %s, ?2) AS knn"
+                               "  LEFT JOIN items ON items.rowid = knn.rowid",
+                               sourceColumn, shards, embeddingsColumn, match);
+    }
+    if (hybrid) {
+        // with --chunk, items are ranked by their best chunk, since the
+        // full-text index has a row per item
+        char *vecSource = shards ? sqlite3_mprintf("vec0_sharded(%Q, %Q, %s, min(?2 * %d, 4096))",
+                                                   shards, embeddingsColumn, match, HYBRID_DEPTH)
+                          : chunked ? sqlite3_mprintf(
+                                        "(SELECT chunks.item AS rowid, min(knn.distance) AS distance"
+                                        "  FROM (SELECT rowid, distance FROM vec_items"
+                                        "    WHERE \"%w\" MATCH %s AND k = min(?2 * %d, 4096)) AS knn"
+                                        "  JOIN chunks ON chunks.id = knn.rowid GROUP BY chunks.item)",
+                                        embeddingsColumn, match, HYBRID_DEPTH)
+                                  : sqlite3_mprintf(
+                                        "vec_items WHERE \"%w\" MATCH %s AND k = min(?2 * %d, 4096)",
+                                        embeddingsColumn, match, HYBRID_DEPTH);
+        CHECK_ZSQL_NOT_NULL(vecSource);
+        sqlite3_free((void *)zSql);
+        zSql = sqlite3_mprintf(
+            "WITH vec AS ("
+            "  SELECT rowid, row_number() OVER (ORDER BY distance) AS rank"
+            "  FROM %s"
+            "), fts AS ("
+            "  SELECT rowid, row_number() OVER (ORDER BY rank) AS rank"
+            "  FROM fts_items WHERE fts_items MATCH ?3 ORDER BY rank LIMIT ?2 * %d"
+            "), fused AS ("
+            "  SELECT rowid, sum(1.0 / (%d + rank)) AS score"
+            "  FROM (SELECT * FROM vec UNION ALL SELECT * FROM fts) GROUP BY rowid"
+            ")"
+            "SELECT fused.rowid, items.\"%w\", fused.score FROM fused"
+            "  LEFT JOIN items ON items.rowid = fused.rowid"
+            "  ORDER BY fused.score DESC LIMIT ?2",
+            vecSource, HYBRID_DEPTH, RRF_K, sourceColumn);
+        sqlite3_free(vecSource);
+    }
     CHECK_ZSQL_NOT_NULL(zSql);
-    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    rc = sqlite3_prepare_v2(db, zSql, -1, out, NULL);
     sqlite3_free((void *)zSql);
+    sqlite3_free(sourceColumn);
+    sqlite3_free(embeddingsColumn);
+    sqlite3_free(shards);
+    return rc;
+}
+
+void search_append_row(sqlite3_str *out, sqlite3_stmt *stmt) {
+    sqlite3_str_appendf(out, "%lld %f %.*s\n", sqlite3_column_int64(stmt, 0),
+                        sqlite3_column_double(stmt, 2), sqlite3_column_bytes(stmt, 1),
+                        sqlite3_column_text(stmt, 1));
+}
+
+// Looks the query up in the index's embedfile_query_cache table, and
+// embeds and stores it there on a miss. Returns the embedding blob.
+void *search_cached_embedding(sqlite3 *db, const char *query, int *n) {
+    int rc;
+    sqlite3_stmt *stmt;
+    char *settings = embedfile_settings_key();
+    void *blob = NULL;
+
+    rc = sqlite3_exec(db,
+                      "create table if not exists embedfile_query_cache("
+                      "settings text, query text, embedding blob, "
+                      "primary key (settings, query)) without rowid",
+                      NULL, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
-    rc = sqlite3_bind_text(stmt, 1, query, strlen(query), SQLITE_STATIC);
+    rc = sqlite3_prepare_v2(
+        db, "select embedding from embedfile_query_cache where settings = ? and query = ?", -1,
+        &stmt, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
+    sqlite3_bind_text(stmt, 1, settings, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, query, -1, SQLITE_STATIC);
+    if ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        *n = sqlite3_column_bytes(stmt, 0);
+        if ((blob = sqlite3_malloc(*n ? *n : 1))) {
+            memcpy(blob, sqlite3_column_blob(stmt, 0), *n);
+        }
+    } else {
+        CHECK_SQLITE_NOT_DONE(rc, db);
+    }
+    sqlite3_finalize(stmt);
+    if (blob) {
+        sqlite3_free(settings);
+        return blob;
+    }
+
+    embedfile_preload_model();
+    rc = embedfile_sqlite3_init_model(db);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_prepare_v2(db,
+                            "insert or replace into embedfile_query_cache(settings, query, embedding) "
+                            "values (?1, ?2, lembed(?2)) returning embedding",
+                            -1, &stmt, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    sqlite3_bind_text(stmt, 1, settings, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, query, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    CHECK_SQLITE_NOT_ROW(rc, db);
+    *n = sqlite3_column_bytes(stmt, 0);
+    blob = sqlite3_malloc(*n ? *n : 1);
+    CHECK_ZSQL_NOT_NULL(blob);
+    memcpy(blob, sqlite3_column_blob(stmt, 0), *n);
+    rc = sqlite3_step(stmt);
+    CHECK_SQLITE_NOT_DONE(rc, db);
+    sqlite3_finalize(stmt);
+    sqlite3_free(settings);
+    return blob;
+}
+
+// Prints what the latest KNN query on db did to standard error, as the
+// JSON object from vec0_last_query_stats().
+void search_print_stats(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db, "select vec0_last_query_stats()", -1, &stmt, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_step(stmt);
+    CHECK_SQLITE_NOT_ROW(rc, db);
+    if (sqlite3_column_type(stmt, 0) == SQLITE_NULL) {
+        // vec0_sharded() runs the KNN queries on connections of its own
+        fprintf(stderr, "No vec0 statistics: %s\n",
+                table_exists(db, "shards") ? "sharded indexes are searched on other connections"
+                                           : "no KNN query ran");
+    } else {
+        fprintf(stderr, "%s\n", sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+}
+
+int cmd_search(char *dbPath, char *query, int k, int cache, int hybrid, int stats) {
+    int rc;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+
+    normalize_query(query);
+    // the daemon's connection has the statistics, so --stats searches here
+    if (!hybrid && !stats && embedfile_client_search(dbPath, query, k) == SQLITE_OK) {
+        return 0;
+    }
+    // with a persisted cache the model may not be needed at all
+    if (!cache) {
+        embedfile_preload_model();
+    }
+
+    rc = sqlite3_open(dbPath, &db);
+    CHECK_SQLITE_NOT_OK(rc, db);
+
+    // the model is registered only once the KNN query is prepared, so
+    // opening the index overlaps with loading the weights
+    rc = embedfile_sqlite3_init_extensions(db);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    storage_profile_apply(db, "read", NULL);
+    if (hybrid && !table_exists(db, "fts_items")) {
+        fprintf(stderr, "Error: %s has no full-text index, import it again with --fts.\n", dbPath);
+        exit(EXIT_FAILURE);
+    }
+
+    if (cache) {
+        int n;
+        void *embedding = search_cached_embedding(db, query, &n);
+        char *match = sqlite3_mprintf("%s(?1)", embedfile_vector_function());
+        CHECK_ZSQL_NOT_NULL(match);
+        rc = search_prepare(db, match, hybrid, &stmt);
+        sqlite3_free(match);
+        CHECK_SQLITE_NOT_OK(rc, db);
+        rc = sqlite3_bind_blob(stmt, 1, embedding, n, sqlite3_free);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    } else {
+        rc = search_prepare(db, "lembed(?1)", hybrid, &stmt);
+        CHECK_SQLITE_NOT_OK(rc, db);
+        rc = sqlite3_bind_text(stmt, 1, query, strlen(query), SQLITE_STATIC);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    }
     rc = sqlite3_bind_int64(stmt, 2, k);
     CHECK_SQLITE_NOT_OK(rc, db);
+    if (hybrid) {
+        rc = sqlite3_bind_text(stmt, 3, fts_query(query), -1, sqlite3_free);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    }
+
+    if (!cache) {
+        rc = embedfile_sqlite3_init_model(db);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    }
 
     while (1) {
         rc = sqlite3_step(stmt);
+        embedfile_log_first_embedding();
         if (rc == SQLITE_DONE) {
             break;
         }
         CHECK_SQLITE_NOT_ROW(rc, db);
 
-        printf("%lld %f %.*s\n", sqlite3_column_int64(stmt, 0), sqlite3_column_double(stmt, 2),
-               sqlite3_column_bytes(stmt, 1), sqlite3_column_text(stmt, 1));
+        sqlite3_str *row = sqlite3_str_new(db);
+        search_append_row(row, stmt);
+        fwrite(sqlite3_str_value(row), 1, sqlite3_str_length(row), stdout);
+        sqlite3_free(sqlite3_str_finish(row));
     }
 
     sqlite3_finalize(stmt);
-
-    sqlite3_free(sourceColumn);
-    sqlite3_free(embeddingsColumn);
+    if (stats) {
+        search_print_stats(db);
+    }
     sqlite3_close(db);
     return 0;
 }
 
-int cmd_embed(char *source) {
+typedef enum {
+    EF_EMBED_FORMAT_JSON,
+    EF_EMBED_FORMAT_NDJSON,
+    EF_EMBED_FORMAT_F32,
+    EF_EMBED_FORMAT_F16,
+    EF_EMBED_FORMAT_I8,
+    EF_EMBED_FORMAT_NPY
+} ef_embed_format;
+
+int parse_embed_format(const char *s, ef_embed_format *format) {
+    if (sqlite3_stricmp(s, "json") == 0) {
+        *format = EF_EMBED_FORMAT_JSON;
+    } else if (sqlite3_stricmp(s, "ndjson") == 0) {
+        *format = EF_EMBED_FORMAT_NDJSON;
+    } else if (sqlite3_stricmp(s, "f32") == 0) {
+        *format = EF_EMBED_FORMAT_F32;
+    } else if (sqlite3_stricmp(s, "f16") == 0) {
+        *format = EF_EMBED_FORMAT_F16;
+    } else if (sqlite3_stricmp(s, "i8") == 0) {
+        *format = EF_EMBED_FORMAT_I8;
+    } else if (sqlite3_stricmp(s, "npy") == 0) {
+        *format = EF_EMBED_FORMAT_NPY;
+    } else {
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+// Writes the header of a NumPy .npy file holding a C-ordered matrix of
+// little-endian float32, so rows * cols floats must follow it. Version
+// 1.0 headers are padded with spaces to a multiple of 64 bytes.
+void npy_write_header(FILE *f, int64_t rows, int64_t cols) {
+    char dict[128];
+    int n = snprintf(dict, sizeof(dict),
+                     "{'descr': '<f4', 'fortran_order': False, 'shape': (%lld, %lld), }",
+                     (long long)rows, (long long)cols);
+    int len = (10 + n + 1 + 63) / 64 * 64 - 10;
+    fwrite("\x93NUMPY\x01\x00", 1, 8, f);
+    fputc(len & 255, f);
+    fputc(len >> 8, f);
+    fwrite(dict, 1, n, f);
+    for (int i = n; i < len - 1; i++)
+        fputc(' ', f);
+    fputc('\n', f);
+}
+
+// Writes one embedding in a binary format. Embeddings are normalized,
+// so i8 scales each dimension from [-1,1] into [-127,127].
+void write_embedding(const float *v, int n, ef_embed_format format) {
+    switch (format) {
+    case EF_EMBED_FORMAT_F32:
+        fwrite(v, sizeof(float), n, stdout);
+        break;
+    case EF_EMBED_FORMAT_F16: {
+        ggml_fp16_t *h = malloc(sizeof(ggml_fp16_t) * n);
+        if (!h) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        ggml_fp32_to_fp16_row(v, h, n);
+        fwrite(h, sizeof(ggml_fp16_t), n, stdout);
+        free(h);
+        break;
+    }
+    case EF_EMBED_FORMAT_I8:
+        for (int i = 0; i < n; i++) {
+            float x = roundf(v[i] * 127);
+            fputc((int8_t)(x > 127 ? 127 : x < -127 ? -127 : x), stdout);
+        }
+        break;
+    default:
+        __builtin_unreachable();
+    }
+}
+
+// Writes one row of `embed` output, where p is the vec_to_json() text
+// for json and ndjson, and the float32 blob otherwise. npy is handled by
+// the caller since it needs a header.
+void write_embed_row(const void *p, int n, ef_embed_format format) {
+    switch (format) {
+    case EF_EMBED_FORMAT_JSON:
+        printf("%.*s", n, (const char *)p);
+        break;
+    case EF_EMBED_FORMAT_NDJSON:
+        printf("%.*s\n", n, (const char *)p);
+        break;
+    default:
+        write_embedding(p, n / sizeof(float), format);
+        break;
+    }
+}
+
+int embedfile_client_embed(const char *text, ef_embed_format format);
+
+int cmd_embed(char *source, ef_embed_format format) {
     int rc;
     sqlite3 *db;
     sqlite3_stmt *stmt;
+    int binary = format != EF_EMBED_FORMAT_JSON && format != EF_EMBED_FORMAT_NDJSON;
+
+    if (binary && EMBEDFILE_QUANTIZE && sqlite3_stricmp(EMBEDFILE_QUANTIZE, "none") != 0) {
+        fprintf(stderr, "Error: --quantize can't be used with binary formats, try --format i8.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (binary && isatty(1)) {
+        fprintf(stderr, "Error: Refusing to write binary embeddings to a terminal.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (source && embedfile_client_embed(source, format) == SQLITE_OK) {
+        return 0;
+    }
+    embedfile_preload_model();
 
     rc = sqlite3_open(":memory:", &db);
     CHECK_SQLITE_NOT_OK(rc, db);
 
-    rc = embedfile_sqlite3_init(db);
+    rc = embedfile_sqlite3_init_extensions(db);
     CHECK_SQLITE_NOT_OK(rc, db);
 
+    // binary formats take lembed()'s float32 blob as is, which skips
+    // formatting and parsing thousands of floats as text per embedding
+    const char *zSql;
+    if (source) {
+        zSql = binary ? "select lembed(?)" : "select vec_to_json(lembed(?))";
+    } else {
+        zSql = binary ? "select lembed(line) from lines_read('/dev/stdin')"
+                      : "select vec_to_json(lembed(line)) from lines_read('/dev/stdin')";
+    }
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
     if (source) {
-        rc = sqlite3_prepare_v2(db, "select vec_to_json(lembed(?))", -1, &stmt, NULL);
-        CHECK_SQLITE_NOT_OK(rc, db);
         rc = sqlite3_bind_text(stmt, 1, source, strlen(source), SQLITE_STATIC);
         CHECK_SQLITE_NOT_OK(rc, db);
-        rc = sqlite3_step(stmt);
-        CHECK_SQLITE_NOT_ROW(rc, db);
+    }
 
-        printf("%.*s", sqlite3_column_bytes(stmt, 0), sqlite3_column_text(stmt, 0));
-    } else {
-        rc = sqlite3_prepare_v2(
-            db, "select vec_to_json(lembed(line)) from lines_read('/dev/stdin')", -1, &stmt, NULL);
-        CHECK_SQLITE_NOT_OK(rc, db);
+    rc = embedfile_sqlite3_init_model(db);
+    CHECK_SQLITE_NOT_OK(rc, db);
 
-        while (1) {
-            rc = sqlite3_step(stmt);
-            if (rc == SQLITE_DONE) {
-                break;
-            }
-            CHECK_SQLITE_NOT_ROW(rc, db);
-            printf("%.*s", sqlite3_column_bytes(stmt, 0), sqlite3_column_text(stmt, 0));
+    // npy needs the row count up front, so rows are held until the end
+    sqlite3_str *npy = sqlite3_str_new(NULL);
+    int64_t rows = 0;
+    int64_t cols = 0;
+    while (1) {
+        rc = sqlite3_step(stmt);
+        if (rc == SQLITE_DONE) {
+            break;
         }
+        CHECK_SQLITE_NOT_ROW(rc, db);
+        embedfile_log_first_embedding();
+        const void *p = sqlite3_column_blob(stmt, 0);
+        int n = sqlite3_column_bytes(stmt, 0);
+        if (format == EF_EMBED_FORMAT_NPY) {
+            sqlite3_str_append(npy, p, n);
+            cols = n / sizeof(float);
+        } else {
+            write_embed_row(p, n, format);
+        }
+        rows++;
+    }
+    if (format == EF_EMBED_FORMAT_NPY) {
+        rc = sqlite3_str_errcode(npy);
+        CHECK_SQLITE_NOT_OK(rc, db);
+        npy_write_header(stdout, rows, cols);
+        fwrite(sqlite3_str_value(npy), 1, sqlite3_str_length(npy), stdout);
     }
+    sqlite3_free(sqlite3_str_finish(npy));
 
     sqlite3_finalize(stmt);
     sqlite3_close(db);
@@ -306,16 +924,294 @@ int monitor_stmt(sqlite3_stmt *stmt, int64_t total) {
     return sqlite3_finalize(stmt);
 }
 
+#define LIGHT_BLUE "\033[1;34m"
+#define GREEN "\033[0;32m"
+#define RESET "\033[0m"
+#define LIGHT_GREY "\033[0;37m"
+#define MAGENTA "\033[0;35m"
+
+// Embeds each row of temp.source in windows of at most maxTokens tokens,
+// which lembed_chunks() decodes from a single tokenization of the row.
+// The windows go in the chunks table, whose ids are the vec_items
+// rowids, along with the items row and the bytes of its column they
+// cover. The rows of temp.source were appended to items after
+// lastRowid. Returns how many were made.
+int64_t import_chunks(sqlite3 *db, const char *embedColumn, int maxTokens, int overlap,
+                      int64_t lastRowid, int64_t total) {
+    int rc;
+    sqlite3_stmt *stmt, *insertChunk, *insertVec;
+
+    rc = sqlite3_exec(db,
+                      "CREATE TABLE IF NOT EXISTS chunks("
+                      "id INTEGER PRIMARY KEY, item INTEGER, start INTEGER, length INTEGER)",
+                      NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+
+    char *zSql = sqlite3_mprintf("SELECT ?3 + source.rowid, chunk.start, chunk.length, "
+                                 "chunk.embedding "
+                                 "FROM temp.source AS source, "
+                                 "lembed_chunks(source.\"%w\", ?1, ?2) AS chunk",
+                                 embedColumn);
+    CHECK_ZSQL_NOT_NULL(zSql);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    sqlite3_bind_int(stmt, 1, maxTokens);
+    sqlite3_bind_int(stmt, 2, overlap);
+    sqlite3_bind_int64(stmt, 3, lastRowid);
+
+    rc = sqlite3_prepare_v2(db, "INSERT INTO chunks(item, start, length) VALUES (?, ?, ?)", -1,
+                            &insertChunk, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    // bound values lose their subtype, so the vector type is restated
+    zSql = sqlite3_mprintf("INSERT INTO vec_items VALUES (?1, %s(?2))",
+                           embedfile_vector_function());
+    CHECK_ZSQL_NOT_NULL(zSql);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &insertVec, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+
+    char *expanded = sqlite3_expanded_sql(stmt);
+    printf(LIGHT_BLUE "%s" RESET "\n", expanded);
+    sqlite3_free(expanded);
+
+    rc = sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    int64_t started_at = time_ms();
+    int64_t nChunks = 0;
+    int64_t nItems = 0;
+    int64_t lastItem = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t item = sqlite3_column_int64(stmt, 0);
+        if (nChunks && item != lastItem) {
+            print_progress_bar(++nItems, total, time_ms() - started_at);
+        }
+        lastItem = item;
+        sqlite3_bind_int64(insertChunk, 1, item);
+        sqlite3_bind_value(insertChunk, 2, sqlite3_column_value(stmt, 1));
+        sqlite3_bind_value(insertChunk, 3, sqlite3_column_value(stmt, 2));
+        rc = sqlite3_step(insertChunk);
+        CHECK_SQLITE_NOT_DONE(rc, db);
+        sqlite3_reset(insertChunk);
+
+        sqlite3_bind_int64(insertVec, 1, sqlite3_last_insert_rowid(db));
+        sqlite3_bind_value(insertVec, 2, sqlite3_column_value(stmt, 3));
+        rc = sqlite3_step(insertVec);
+        CHECK_SQLITE_NOT_DONE(rc, db);
+        sqlite3_reset(insertVec);
+        nChunks++;
+    }
+    CHECK_SQLITE_NOT_DONE(rc, db);
+    if (total) {
+        print_progress_bar(total, total, time_ms() - started_at);
+        printf("\n");
+    }
+    rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(insertChunk);
+    sqlite3_finalize(insertVec);
+    return nChunks;
+}
+
+typedef struct ef_shard_job {
+    const char *indexFile;
+    char *shardFile;
+    const char *embedColumn;
+    int shard;
+    int shards;
+    int64_t lastRowid;
+    atomic_llong *embedded;
+    atomic_int *finished;
+} ef_shard_job;
+
+// Embeds the items after lastRowid that belong to one shard into the
+// vec_items table of its file, over a connection of its own.
+void *import_shard_worker(void *arg) {
+    ef_shard_job *job = arg;
+    int rc;
+    sqlite3 *db;
+    sqlite3_stmt *stmt, *insert;
+
+    rc = sqlite3_open(job->shardFile, &db);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = embedfile_sqlite3_init(db);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    if (!table_exists(db, "vec_items")) {
+        char *vectorType;
+        rc = default_model_vector_type(db, &vectorType);
+        CHECK_SQLITE_NOT_OK(rc, db);
+        storage_profile_apply(db, "build", vectorType);
+        char *zSql = sqlite3_mprintf("CREATE VIRTUAL TABLE vec_items USING vec0( %w_embedding %s)",
+                                     job->embedColumn, vectorType);
+        sqlite3_free(vectorType);
+        CHECK_ZSQL_NOT_NULL(zSql);
+        rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+        sqlite3_free(zSql);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    } else {
+        storage_profile_apply(db, "build", NULL);
+    }
+    char *zSql = sqlite3_mprintf("ATTACH DATABASE %Q AS idx", job->indexFile);
+    CHECK_ZSQL_NOT_NULL(zSql);
+    rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+
+    zSql = sqlite3_mprintf("SELECT rowid, lembed(\"%w\") FROM idx.items "
+                           "WHERE rowid > ?1 AND rowid %% ?2 = ?3",
+                           job->embedColumn);
+    CHECK_ZSQL_NOT_NULL(zSql);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    sqlite3_bind_int64(stmt, 1, job->lastRowid);
+    sqlite3_bind_int(stmt, 2, job->shards);
+    sqlite3_bind_int(stmt, 3, job->shard);
+    // bound values lose their subtype, so the vector type is restated
+    zSql = sqlite3_mprintf("INSERT INTO vec_items VALUES (?1, %s(?2))",
+                           embedfile_vector_function());
+    CHECK_ZSQL_NOT_NULL(zSql);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &insert, NULL);
+    sqlite3_free(zSql);
+    CHECK_SQLITE_NOT_OK(rc, db);
+
+    rc = sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        sqlite3_bind_int64(insert, 1, sqlite3_column_int64(stmt, 0));
+        sqlite3_bind_value(insert, 2, sqlite3_column_value(stmt, 1));
+        rc = sqlite3_step(insert);
+        CHECK_SQLITE_NOT_DONE(rc, db);
+        sqlite3_reset(insert);
+        atomic_fetch_add(job->embedded, 1);
+    }
+    CHECK_SQLITE_NOT_DONE(rc, db);
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(insert);
+    rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    sqlite3_close(db);
+    atomic_fetch_add(job->finished, 1);
+    return NULL;
+}
+
+// Builds all shards of the index at once, each on its own thread, from
+// the items after lastRowid. The model's weights are shared, and every
+// thread embeds with a context of its own.
+void import_shards(sqlite3 *db, const char *embedColumn, int shards, int64_t lastRowid,
+                   int64_t total) {
+    const char *indexFile = sqlite3_db_filename(db, "main");
+    atomic_llong embedded = 0;
+    atomic_int finished = 0;
+    ef_shard_job *jobs = sqlite3_malloc(sizeof(ef_shard_job) * shards);
+    pthread_t *threads = sqlite3_malloc(sizeof(pthread_t) * shards);
+    CHECK_ZSQL_NOT_NULL(jobs);
+    CHECK_ZSQL_NOT_NULL(threads);
+
+    int64_t started_at = time_ms();
+    for (int i = 0; i < shards; i++) {
+        char *name = embedfile_shard_name(indexFile, i);
+        jobs[i] = (ef_shard_job){
+            .indexFile = indexFile,
+            .shardFile = embedfile_shard_path(indexFile, name),
+            .embedColumn = embedColumn,
+            .shard = i,
+            .shards = shards,
+            .lastRowid = lastRowid,
+            .embedded = &embedded,
+            .finished = &finished,
+        };
+        sqlite3_free(name);
+        if (pthread_create(&threads[i], NULL, import_shard_worker, &jobs[i])) {
+            fprintf(stderr, "Error: Could not start a thread for shard %d.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (atomic_load(&finished) < shards) {
+        if (total) {
+            print_progress_bar(atomic_load(&embedded), total, time_ms() - started_at);
+        }
+        usleep(100 * 1000);
+    }
+    for (int i = 0; i < shards; i++) {
+        pthread_join(threads[i], NULL);
+        sqlite3_free(jobs[i].shardFile);
+    }
+    if (total) {
+        print_progress_bar(atomic_load(&embedded), total, time_ms() - started_at);
+        printf("\n");
+    }
+    sqlite3_free(jobs);
+    sqlite3_free(threads);
+}
+
+// How many records of a JSON or NDJSON source are read to decide its
+// columns, unless overridden with --sample. 0 reads all of them.
+#define JSON_SAMPLE 100
+
+// How many tokens each chunk made by --chunk shares with the one before
+// it, as a fraction of the chunk size, unless overridden with --overlap.
+#define CHUNK_OVERLAP_DIVISOR 8
+
 int cmd_import(int argc, char *argv[]) {
     char *embedColumn = NULL;
     ef_import_source_type source_type = EF_IMPORT_SOURCE_TYPE_TXT;
     char *srcFile = NULL;
     char *indexFile = NULL;
     char *table = NULL;
+    int fts = 0;
+    int sample = JSON_SAMPLE;
+    int chunkTokens = 0;
+    int overlap = -1;
+    int shards = 0;
 
     for (int i = 1; i < argc; i++) {
         char *arg = argv[i];
-        if (sqlite3_stricmp(arg, "--embed") == 0) {
+        if (sqlite3_stricmp(arg, "--fts") == 0) {
+            fts = 1;
+        } else if (sqlite3_stricmp(arg, "--sample") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --sample.\n");
+                exit(EXIT_FAILURE);
+            }
+            sample = atoi(argv[i]);
+            if (sample < 0) {
+                fprintf(stderr, "Error: --sample must be 0 or more.\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (sqlite3_stricmp(arg, "--shards") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --shards.\n");
+                exit(EXIT_FAILURE);
+            }
+            shards = atoi(argv[i]);
+            if (shards <= 0) {
+                fprintf(stderr, "Error: --shards must be a positive integer.\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (sqlite3_stricmp(arg, "--chunk") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --chunk.\n");
+                exit(EXIT_FAILURE);
+            }
+            chunkTokens = atoi(argv[i]);
+            if (chunkTokens <= 0) {
+                fprintf(stderr, "Error: --chunk must be a positive integer.\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (sqlite3_stricmp(arg, "--overlap") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --overlap.\n");
+                exit(EXIT_FAILURE);
+            }
+            overlap = atoi(argv[i]);
+            if (overlap < 0) {
+                fprintf(stderr, "Error: --overlap must be 0 or more.\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (sqlite3_stricmp(arg, "--embed") == 0) {
             if (++i >= argc) {
                 fprintf(stderr, "Error: Missing value for --embed.\n");
                 exit(EXIT_FAILURE);
@@ -365,6 +1261,14 @@ int cmd_import(int argc, char *argv[]) {
         fprintf(stderr, "Error: Couldn't determine type of source file %s\n", srcFile);
     }
 
+    if (overlap >= 0 && !chunkTokens) {
+        fprintf(stderr, "Error: --overlap needs --chunk.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (overlap < 0) {
+        overlap = chunkTokens / CHUNK_OVERLAP_DIVISOR;
+    }
+
     if (source_type == EF_IMPORT_SOURCE_TYPE_TXT) {
         embedColumn = "line";
     } else {
@@ -381,6 +1285,15 @@ int cmd_import(int argc, char *argv[]) {
     rc = embedfile_sqlite3_init(db);
     CHECK_SQLITE_NOT_OK(rc, db);
 
+    // with --shards the vectors go in other files, so only their page
+    // size is matched to the vectors
+    char *vectorType = NULL;
+    if (shards || default_model_vector_type(db, &vectorType) != SQLITE_OK) {
+        vectorType = NULL;
+    }
+    storage_profile_apply(db, "build", vectorType);
+    sqlite3_free(vectorType);
+
     rc = sqlite3_fileio_init(db, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
 
@@ -395,68 +1308,24 @@ int cmd_import(int argc, char *argv[]) {
         CHECK_SQLITE_NOT_OK(rc, db);
         break;
     }
-    case EF_IMPORT_SOURCE_TYPE_JSON: {
-        sqlite3_stmt *innerStmt;
-        rc = sqlite3_prepare_v2(
-            db, "select fullkey, key from json_each(json_extract(readfile(?), '$[0]'))", -1,
-            &innerStmt, NULL);
-        CHECK_SQLITE_NOT_OK(rc, db);
-        rc = sqlite3_bind_text(innerStmt, 1, srcFile, strlen(srcFile), SQLITE_STATIC);
-        CHECK_SQLITE_NOT_OK(rc, db);
-
-        sqlite3_str *sqlStr = sqlite3_str_new(NULL);
-        sqlite3_str_appendf(sqlStr, "CREATE TABLE  temp.source AS SELECT rowid");
-        while (1) {
-            rc = sqlite3_step(innerStmt);
-            if (rc == SQLITE_DONE) {
-                break;
-            }
-            CHECK_SQLITE_NOT_ROW(rc, db);
-            sqlite3_str_appendf(sqlStr, ", value ->> %Q as \"%w\"",
-                                sqlite3_column_text(innerStmt, 0),
-                                sqlite3_column_text(innerStmt, 1));
-        }
-        sqlite3_finalize(innerStmt);
-
-        sqlite3_str_appendf(sqlStr, " FROM json_each(readfile(?))");
-        zSql = sqlite3_str_finish(sqlStr);
-        CHECK_ZSQL_NOT_NULL(zSql);
-        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
-        CHECK_SQLITE_NOT_OK(rc, db);
-        rc = sqlite3_bind_text(stmt, 1, srcFile, strlen(srcFile), SQLITE_STATIC);
-        CHECK_SQLITE_NOT_OK(rc, db);
-        break;
-    }
+    case EF_IMPORT_SOURCE_TYPE_JSON:
     case EF_IMPORT_SOURCE_TYPE_NDJSON: {
-        sqlite3_stmt *innerStmt;
-        rc = sqlite3_prepare_v2(
-            db, "select fullkey, key from json_each((select line from lines_read(?) limit 1))", -1,
-            &innerStmt, NULL);
-        CHECK_SQLITE_NOT_OK(rc, db);
-        rc = sqlite3_bind_text(innerStmt, 1, srcFile, strlen(srcFile), SQLITE_STATIC);
+        // parses every record once, with columns inferred from the first
+        // `sample` of them, rather than re-parsing each line per column
+        zSql = sqlite3_mprintf("CREATE VIRTUAL TABLE temp.source_reader USING %s(filename=%Q, "
+                               "sample=%d)",
+                               source_type == EF_IMPORT_SOURCE_TYPE_JSON ? "json_array_read"
+                                                                         : "json_lines_read",
+                               srcFile, sample);
+        CHECK_ZSQL_NOT_NULL(zSql);
+        rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
         CHECK_SQLITE_NOT_OK(rc, db);
+        sqlite3_free((void *)zSql);
 
-        sqlite3_str *sqlStr = sqlite3_str_new(NULL);
-        sqlite3_str_appendf(sqlStr, "CREATE TABLE  temp.source AS SELECT rowid");
-        while (1) {
-            rc = sqlite3_step(innerStmt);
-            if (rc == SQLITE_DONE) {
-                break;
-            }
-            CHECK_SQLITE_NOT_ROW(rc, db);
-            sqlite3_str_appendf(sqlStr, ", line ->> %Q as \"%w\"",
-                                sqlite3_column_text(innerStmt, 0),
-                                sqlite3_column_text(innerStmt, 1));
-        }
-        sqlite3_finalize(innerStmt);
-
-        sqlite3_str_appendf(sqlStr, " FROM lines_read(?)");
-        zSql = sqlite3_str_finish(sqlStr);
+        zSql = sqlite3_mprintf("CREATE TABLE temp.source AS SELECT rowid, * FROM temp.source_reader");
         CHECK_ZSQL_NOT_NULL(zSql);
         rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
         CHECK_SQLITE_NOT_OK(rc, db);
-        rc = sqlite3_bind_text(stmt, 1, srcFile, strlen(srcFile), SQLITE_STATIC);
-        CHECK_SQLITE_NOT_OK(rc, db);
         break;
     }
     case EF_IMPORT_SOURCE_TYPE_TXT: {
@@ -516,9 +1385,59 @@ int cmd_import(int argc, char *argv[]) {
     sqlite3_finalize(stmt);
     sqlite3_free((void *)zSql);
 
-    if (!table_exists(db, "vec_items")) {
-        int64_t dimensions;
-        rc = default_model_dimensions(db, &dimensions);
+    // with --chunk, vec_items rowids are chunks rather than items, so an
+    // index can't mix the two
+    if (table_exists(db, "vec_items") && table_exists(db, "chunks") != !!chunkTokens) {
+        fprintf(stderr, "Error: %s was imported %s --chunk.\n", indexFile,
+                chunkTokens ? "without" : "with");
+        exit(EXIT_FAILURE);
+    }
+
+    // an index that already has shards keeps adding to them
+    if (table_exists(db, "shards")) {
+        rc = sqlite3_prepare_v2(db, "SELECT count(*) FROM shards", -1, &stmt, NULL);
+        CHECK_SQLITE_NOT_OK(rc, db);
+        rc = sqlite3_step(stmt);
+        CHECK_SQLITE_NOT_ROW(rc, db);
+        int existing = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+        if (shards && shards != existing) {
+            fprintf(stderr, "Error: %s was imported with --shards %d.\n", indexFile, existing);
+            exit(EXIT_FAILURE);
+        }
+        shards = existing;
+    } else if (shards && table_exists(db, "vec_items")) {
+        fprintf(stderr, "Error: %s was imported without --shards.\n", indexFile);
+        exit(EXIT_FAILURE);
+    }
+    if (shards && chunkTokens) {
+        fprintf(stderr, "Error: --chunk can't be combined with --shards.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (shards > sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1)) {
+        fprintf(stderr, "Error: --shards must be at most %d.\n",
+                sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1));
+        exit(EXIT_FAILURE);
+    }
+
+    if (shards && !table_exists(db, "shards")) {
+        rc = sqlite3_exec(db, "CREATE TABLE shards(id INTEGER PRIMARY KEY, path TEXT)", NULL,
+                          NULL, NULL);
+        CHECK_SQLITE_NOT_OK(rc, db);
+        for (int i = 0; i < shards; i++) {
+            char *name = embedfile_shard_name(indexFile, i);
+            zSql = sqlite3_mprintf("INSERT INTO shards VALUES (%d, %Q)", i, name);
+            sqlite3_free(name);
+            CHECK_ZSQL_NOT_NULL(zSql);
+            rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+            sqlite3_free((void *)zSql);
+            CHECK_SQLITE_NOT_OK(rc, db);
+        }
+    }
+
+    if (!shards && !table_exists(db, "vec_items")) {
+        char *vectorType;
+        rc = default_model_vector_type(db, &vectorType);
         if(rc == SQLITE_EMPTY) {
           fprintf(stderr, "ERROR: No embeddings model registed with embedfile yet. Try with the `--model path/to/model.gguf` flag.");
           return 1;
@@ -526,8 +1445,9 @@ int cmd_import(int argc, char *argv[]) {
         CHECK_SQLITE_NOT_OK(rc, db);
 
         zSql =
-            sqlite3_mprintf("CREATE VIRTUAL TABLE vec_items USING vec0( %w_embedding float[%lld])",
-                            embedColumn, dimensions);
+            sqlite3_mprintf("CREATE VIRTUAL TABLE vec_items USING vec0( %w_embedding %s)",
+                            embedColumn, vectorType);
+        sqlite3_free(vectorType);
         CHECK_ZSQL_NOT_NULL(zSql);
         rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
         sqlite3_free((void *)zSql);
@@ -546,6 +1466,14 @@ int cmd_import(int argc, char *argv[]) {
         sqlite3_finalize(stmt);
     }
 
+    // the rows this import adds are the ones after it
+    rc = sqlite3_prepare_v2(db, "SELECT coalesce(max(rowid), 0) FROM items", -1, &stmt, NULL);
+    CHECK_SQLITE_NOT_OK(rc, db);
+    rc = sqlite3_step(stmt);
+    CHECK_SQLITE_NOT_ROW(rc, db);
+    int64_t lastRowid = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+
     zSql = sqlite3_mprintf("INSERT INTO items SELECT * FROM temp.source;", embedColumn);
     CHECK_ZSQL_NOT_NULL(zSql);
     rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
@@ -555,6 +1483,27 @@ int cmd_import(int argc, char *argv[]) {
     CHECK_SQLITE_NOT_DONE(rc, db);
     sqlite3_finalize(stmt);
 
+    // the full-text index reads its content from items, so it takes the
+    // rowids the rows just got there, which hybrid search fuses by
+    if (fts) {
+        if (!table_exists(db, "fts_items")) {
+            zSql = sqlite3_mprintf("CREATE VIRTUAL TABLE fts_items USING fts5(\"%w\", "
+                                   "content='items', content_rowid='rowid')",
+                                   embedColumn);
+            CHECK_ZSQL_NOT_NULL(zSql);
+            rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+            sqlite3_free((void *)zSql);
+            CHECK_SQLITE_NOT_OK(rc, db);
+        }
+        zSql = sqlite3_mprintf("INSERT INTO fts_items(rowid, \"%w\") "
+                               "SELECT %lld + rowid, \"%w\" FROM temp.source",
+                               embedColumn, (long long)lastRowid, embedColumn);
+        CHECK_ZSQL_NOT_NULL(zSql);
+        rc = sqlite3_exec(db, zSql, NULL, NULL, NULL);
+        sqlite3_free((void *)zSql);
+        CHECK_SQLITE_NOT_OK(rc, db);
+    }
+
     zSql = sqlite3_mprintf("SELECT COUNT(*) from temp.source;", embedColumn);
     CHECK_ZSQL_NOT_NULL(zSql);
     rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
@@ -568,18 +1517,30 @@ int cmd_import(int argc, char *argv[]) {
     rc = sqlite3_exec(db, "SELECT * FROM temp.source", NULL, NULL, NULL);
     CHECK_SQLITE_NOT_OK(rc, db);
 
+    if (shards) {
+        import_shards(db, embedColumn, shards, lastRowid, n);
+        printf(GREEN "\u2714" RESET " %s imported into %s, %lld items in %d shards\n", srcFile,
+               indexFile, (long long)n, shards);
+        sqlite3_close(db);
+        return 0;
+    }
+    if (chunkTokens) {
+        int64_t nChunks = import_chunks(db, embedColumn, chunkTokens, overlap, lastRowid, n);
+        printf(GREEN "\u2714" RESET " %s imported into %s, %lld items in %lld chunks\n", srcFile,
+               indexFile, (long long)n, (long long)nChunks);
+        sqlite3_close(db);
+        return 0;
+    }
+
     zSql = sqlite3_mprintf("INSERT INTO vec_items SELECT rowid, lembed(\"%w\") FROM temp.source;",
                            embedColumn);
     CHECK_ZSQL_NOT_NULL(zSql);
     rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
     sqlite3_free((void *)zSql);
     CHECK_SQLITE_NOT_OK(rc, db);
-#define LIGHT_BLUE "\033[1;34m"
-#define GREEN "\033[0;32m"
-#define RESET "\033[0m"
-#define LIGHT_GREY "\033[0;37m"
-#define MAGENTA "\033[0;35m"
-    printf(LIGHT_BLUE "%s" RESET "\n", sqlite3_expanded_sql(stmt));
+    char *expanded = sqlite3_expanded_sql(stmt);
+    printf(LIGHT_BLUE "%s" RESET "\n", expanded);
+    sqlite3_free(expanded);
 
     rc = monitor_stmt(stmt, n);
     CHECK_SQLITE_NOT_OK(rc, db);
@@ -591,6 +1552,633 @@ int cmd_import(int argc, char *argv[]) {
     return 0;
 }
 
+// `embedfile serve` keeps the model and an index open, and answers
+// search and embed requests over a Unix domain socket. search and embed
+// send their request there first, and only load the model themselves
+// when no daemon is listening or it was started with another model,
+// index, or flags.
+//
+// Requests and responses are sequences of netstrings, i.e. the length
+// in decimal, a colon, then that many bytes. A request is the command,
+// model path, dimensions, and quantize setting, followed by the index
+// path, k, and query for search, or the format kind and text for embed.
+// The response is a status of ok, mismatch, or error, followed by the
+// output to print or the error message.
+
+#define EMBEDFILE_MAX_FIELD (64 * 1024 * 1024)
+
+// How long the daemon waits on a client that stops sending or reading
+// before it drops the connection and frees the worker.
+#define EMBEDFILE_SERVE_TIMEOUT 5
+
+// The default socket lives in a directory only this user can enter,
+// $XDG_RUNTIME_DIR or else embedfile-UID under $TMPDIR or /tmp, which
+// serve creates when create is set. Another user could have made the
+// latter first, so the directory is only used if lstat() shows it's a
+// real directory that this user owns and nobody else can access.
+// Returns NULL if there's no such directory.
+char *embedfile_socket_path(int create) {
+    if (EMBEDFILE_SOCKET) {
+        return sqlite3_mprintf("%s", EMBEDFILE_SOCKET);
+    }
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    const char *tmp = getenv("TMPDIR");
+    char *dir = runtime && *runtime
+                    ? sqlite3_mprintf("%s", runtime)
+                    : sqlite3_mprintf("%s/embedfile-%d", tmp && *tmp ? tmp : "/tmp",
+                                      (int)getuid());
+    char *path = NULL;
+    struct stat st;
+    if (!dir) {
+        return NULL;
+    }
+    if (create) {
+        mkdir(dir, 0700);
+    }
+    if (!lstat(dir, &st) && S_ISDIR(st.st_mode) && st.st_uid == getuid() &&
+        !(st.st_mode & 077)) {
+        path = sqlite3_mprintf("%s/embedfile.sock", dir);
+    }
+    sqlite3_free(dir);
+    return path;
+}
+
+// Whether the process at the other end of a Unix socket runs as this
+// user. A path given with --socket may be in a directory others can
+// write to, so the client checks who it's talking to before sending the
+// query, and the daemon checks who it's answering.
+int embedfile_peer_is_me(int fd) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return !getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) && cred.uid == getuid();
+}
+
+// Canonicalizes a path so that client and daemon agree on what names
+// the same model or index, falling back to the path as given.
+char *embedfile_realpath(const char *path) {
+    char buf[PATH_MAX];
+    if (!path) {
+        return sqlite3_mprintf("");
+    }
+    return sqlite3_mprintf("%s", realpath(path, buf) ? buf : path);
+}
+
+void netstring_append(sqlite3_str *out, const void *p, int n) {
+    sqlite3_str_appendf(out, "%d:", n);
+    sqlite3_str_append(out, p, n);
+}
+
+// Reads one netstring, which is NUL terminated for convenience.
+char *netstring_read(FILE *f, int *n) {
+    int c;
+    long len = 0;
+    while ((c = fgetc(f)) != ':') {
+        if (c < '0' || c > '9' || (len = len * 10 + (c - '0')) > EMBEDFILE_MAX_FIELD) {
+            return NULL;
+        }
+    }
+    char *p = sqlite3_malloc(len + 1);
+    if (!p) {
+        return NULL;
+    }
+    if (fread(p, 1, len, f) != (size_t)len) {
+        sqlite3_free(p);
+        return NULL;
+    }
+    p[len] = 0;
+    *n = len;
+    return p;
+}
+
+int write_all(int fd, const char *p, int n) {
+    while (n > 0) {
+        ssize_t rc = write(fd, p, n);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += rc;
+        n -= rc;
+    }
+    return 0;
+}
+
+void embedfile_append_settings(sqlite3_str *req, const char *command) {
+    char *model = embedfile_realpath(EMBEDFILE_MODEL);
+    char *dimensions = sqlite3_mprintf("%lld", EMBEDFILE_DIMENSIONS);
+    const char *quantize = EMBEDFILE_QUANTIZE ? EMBEDFILE_QUANTIZE : "none";
+    netstring_append(req, command, strlen(command));
+    netstring_append(req, model, strlen(model));
+    netstring_append(req, dimensions, strlen(dimensions));
+    netstring_append(req, quantize, strlen(quantize));
+    sqlite3_free(dimensions);
+    sqlite3_free(model);
+}
+
+// Sends a request to the daemon. Returns SQLITE_OK with the output in
+// *body, SQLITE_ERROR with the daemon's error message in *body, or
+// SQLITE_NOTFOUND if the caller should do the work itself.
+int embedfile_client_request(sqlite3_str *req, char **body, int *body_len) {
+    char *path = embedfile_socket_path(0);
+    int reqLen = sqlite3_str_length(req);
+    char *zReq = sqlite3_str_finish(req);
+    int rc = SQLITE_NOTFOUND;
+    int fd = -1;
+    FILE *f = NULL;
+    struct sockaddr_un addr = {0};
+    *body = NULL;
+    if (!path || !zReq || strlen(path) >= sizeof(addr.sun_path)) {
+        goto done;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        goto done;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        !embedfile_peer_is_me(fd)) {
+        goto done;
+    }
+    if (write_all(fd, zReq, reqLen) == -1) {
+        goto done;
+    }
+    shutdown(fd, SHUT_WR);
+    if (!(f = fdopen(fd, "rb"))) {
+        goto done;
+    }
+    fd = -1;
+    int n;
+    char *status = netstring_read(f, &n);
+    if (!status) {
+        goto done;
+    }
+    if (!strcmp(status, "ok") || !strcmp(status, "error")) {
+        if ((*body = netstring_read(f, body_len))) {
+            rc = strcmp(status, "ok") ? SQLITE_ERROR : SQLITE_OK;
+        }
+    }
+    sqlite3_free(status);
+done:
+    if (f) {
+        fclose(f);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    sqlite3_free(zReq);
+    sqlite3_free(path);
+    return rc;
+}
+
+int embedfile_client_search(const char *dbPath, const char *query, int k) {
+    char *index = embedfile_realpath(dbPath);
+    char *zK = sqlite3_mprintf("%d", k);
+    sqlite3_str *req = sqlite3_str_new(NULL);
+    embedfile_append_settings(req, "search");
+    netstring_append(req, index, strlen(index));
+    netstring_append(req, zK, strlen(zK));
+    netstring_append(req, query, strlen(query));
+    sqlite3_free(zK);
+    sqlite3_free(index);
+    char *body;
+    int n;
+    int rc = embedfile_client_request(req, &body, &n);
+    if (rc == SQLITE_ERROR) {
+        fprintf(stderr, "Error: %s\n", body);
+        exit(EXIT_FAILURE);
+    }
+    if (rc == SQLITE_OK) {
+        fwrite(body, 1, n, stdout);
+    }
+    sqlite3_free(body);
+    return rc;
+}
+
+int embedfile_client_embed(const char *text, ef_embed_format format) {
+    int binary = format != EF_EMBED_FORMAT_JSON && format != EF_EMBED_FORMAT_NDJSON;
+    sqlite3_str *req = sqlite3_str_new(NULL);
+    embedfile_append_settings(req, "embed");
+    netstring_append(req, binary ? "blob" : "json", 4);
+    netstring_append(req, text, strlen(text));
+    char *body;
+    int n;
+    int rc = embedfile_client_request(req, &body, &n);
+    if (rc == SQLITE_ERROR) {
+        fprintf(stderr, "Error: %s\n", body);
+        exit(EXIT_FAILURE);
+    }
+    if (rc == SQLITE_OK) {
+        embedfile_log_first_embedding();
+        if (format == EF_EMBED_FORMAT_NPY) {
+            npy_write_header(stdout, 1, n / sizeof(float));
+            fwrite(body, 1, n, stdout);
+        } else {
+            write_embed_row(body, n, format);
+        }
+    }
+    sqlite3_free(body);
+    return rc;
+}
+
+static volatile sig_atomic_t g_serve_stop;
+
+static void embedfile_serve_stop(int sig) {
+    g_serve_stop = 1;
+}
+
+// The daemon also remembers the output of recent searches. lembed()
+// already caches query embeddings, but this skips the KNN scan as well.
+// Entries are dropped whenever another connection changes the index,
+// which PRAGMA data_version reports.
+#define EMBEDFILE_RESULT_CACHE_SIZE 64
+
+typedef struct {
+    char *query;
+    int64_t k;
+    char *body;
+    int body_len;
+    uint64_t used;
+} ef_cached_result;
+
+// Requests are answered by a pool of worker threads, each with a
+// read-only connection of its own to the index, so KNN scans run in
+// parallel. The connections all register the same model, so they share
+// its weights, and lembed() checks a context out of the model's pool for
+// each query. The accepting thread hands clients to the workers through
+// a queue of at most EMBEDFILE_SERVE_QUEUE sockets.
+#define EMBEDFILE_SERVE_QUEUE 64
+
+typedef struct {
+    char *model;
+    char *dimensions;
+    const char *quantize;
+    char *index;
+    // guards everything below
+    pthread_mutex_t lock;
+    uint64_t tick;
+    ef_cached_result results[EMBEDFILE_RESULT_CACHE_SIZE];
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    int queue[EMBEDFILE_SERVE_QUEUE];
+    int head;
+    int count;
+    int stop;
+} ef_server;
+
+typedef struct {
+    ef_server *s;
+    sqlite3 *db;
+    sqlite3_stmt *search;
+    sqlite3_stmt *embedJson;
+    sqlite3_stmt *embedBlob;
+    sqlite3_stmt *dataVersion;
+    int64_t version;
+    pthread_t thread;
+} ef_worker;
+
+// Must be called with s->lock held.
+void embedfile_serve_forget(ef_server *s) {
+    for (int i = 0; i < EMBEDFILE_RESULT_CACHE_SIZE; i++) {
+        sqlite3_free(s->results[i].query);
+        sqlite3_free(s->results[i].body);
+        memset(&s->results[i], 0, sizeof(s->results[i]));
+    }
+}
+
+// Reports whether another connection changed the index since the last
+// call on this worker. data_version is per connection, so each worker
+// keeps its own, and the first to notice a change drops the results.
+int embedfile_serve_changed(ef_worker *w) {
+    int64_t version = -1;
+    if (sqlite3_step(w->dataVersion) == SQLITE_ROW) {
+        version = sqlite3_column_int64(w->dataVersion, 0);
+    }
+    sqlite3_reset(w->dataVersion);
+    if (version == w->version) {
+        return 0;
+    }
+    w->version = version;
+    pthread_mutex_lock(&w->s->lock);
+    embedfile_serve_forget(w->s);
+    pthread_mutex_unlock(&w->s->lock);
+    return 1;
+}
+
+// Appends the remembered output of a search to body, if there is one.
+int embedfile_serve_cached(ef_worker *w, const char *query, int64_t k, sqlite3_str *body) {
+    ef_server *s = w->s;
+    int found = 0;
+    if (embedfile_serve_changed(w)) {
+        return 0;
+    }
+    pthread_mutex_lock(&s->lock);
+    for (int i = 0; i < EMBEDFILE_RESULT_CACHE_SIZE; i++) {
+        ef_cached_result *r = &s->results[i];
+        if (r->query && r->k == k && !strcmp(r->query, query)) {
+            r->used = ++s->tick;
+            sqlite3_str_append(body, r->body, r->body_len);
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+void embedfile_serve_remember(ef_worker *w, const char *query, int64_t k, sqlite3_str *body) {
+    ef_server *s = w->s;
+    // the output may predate a change made while the search ran
+    if (embedfile_serve_changed(w)) {
+        return;
+    }
+    char *zQuery = sqlite3_mprintf("%s", query);
+    char *zBody = sqlite3_malloc(sqlite3_str_length(body) + 1);
+    if (!zQuery || !zBody) {
+        sqlite3_free(zQuery);
+        sqlite3_free(zBody);
+        return;
+    }
+    memcpy(zBody, sqlite3_str_value(body), sqlite3_str_length(body));
+    pthread_mutex_lock(&s->lock);
+    ef_cached_result *r = &s->results[0];
+    for (int i = 1; i < EMBEDFILE_RESULT_CACHE_SIZE && r->query; i++) {
+        if (!s->results[i].query || s->results[i].used < r->used) {
+            r = &s->results[i];
+        }
+    }
+    sqlite3_free(r->query);
+    sqlite3_free(r->body);
+    r->query = zQuery;
+    r->k = k;
+    r->body = zBody;
+    r->body_len = sqlite3_str_length(body);
+    r->used = ++s->tick;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Runs one request read from f, and puts the status and output in out.
+void embedfile_serve_request(ef_worker *w, FILE *f, sqlite3_str *out) {
+    enum { MAX_FIELDS = 7 };
+    ef_server *s = w->s;
+    char *field[MAX_FIELDS] = {0};
+    int len[MAX_FIELDS] = {0};
+    int nfields = 0;
+    while (nfields < MAX_FIELDS && (field[nfields] = netstring_read(f, &len[nfields]))) {
+        nfields++;
+    }
+    const char *status = "error";
+    sqlite3_str *body = sqlite3_str_new(w->db);
+    sqlite3_stmt *stmt = NULL;
+    int rc;
+    if (nfields < 4) {
+        sqlite3_str_appendall(body, "malformed request");
+    } else if (strcmp(field[1], s->model) || strcmp(field[2], s->dimensions) ||
+               sqlite3_stricmp(field[3], s->quantize)) {
+        status = "mismatch";
+    } else if (!strcmp(field[0], "search") && nfields == 7) {
+        int64_t k = atoll(field[5]);
+        if (strcmp(field[4], s->index)) {
+            status = "mismatch";
+        } else if (embedfile_serve_cached(w, field[6], k, body)) {
+            status = "ok";
+        } else {
+            stmt = w->search;
+            sqlite3_bind_text(stmt, 1, field[6], len[6], SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 2, k);
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                search_append_row(body, stmt);
+            }
+            if (rc == SQLITE_DONE) {
+                embedfile_serve_remember(w, field[6], k, body);
+            }
+        }
+    } else if (!strcmp(field[0], "embed") && nfields == 6) {
+        stmt = !strcmp(field[4], "blob") ? w->embedBlob : w->embedJson;
+        sqlite3_bind_text(stmt, 1, field[5], len[5], SQLITE_STATIC);
+        if ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            sqlite3_str_append(body, sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0));
+            rc = SQLITE_DONE;
+        }
+    } else {
+        sqlite3_str_appendall(body, "unknown command");
+    }
+    if (stmt) {
+        if (rc == SQLITE_DONE) {
+            status = "ok";
+        } else {
+            sqlite3_str_reset(body);
+            sqlite3_str_appendall(body, sqlite3_errmsg(w->db));
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    if (EMBEDFILE_VERBOSE) {
+        fprintf(stderr, "embedfile: %s %s\n", nfields ? field[0] : "request", status);
+    }
+    netstring_append(out, status, strlen(status));
+    netstring_append(out, sqlite3_str_value(body), sqlite3_str_length(body));
+    sqlite3_free(sqlite3_str_finish(body));
+    for (int i = 0; i < nfields; i++) {
+        sqlite3_free(field[i]);
+    }
+}
+
+// Opens the worker's connection and prepares its statements. The
+// connection is read-only and used by this worker's thread alone.
+void embedfile_serve_worker_open(ef_worker *w, const char *dbPath) {
+    int rc = sqlite3_open_v2(dbPath, &w->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+    CHECK_SQLITE_NOT_OK(rc, w->db);
+    rc = embedfile_sqlite3_init_extensions(w->db);
+    CHECK_SQLITE_NOT_OK(rc, w->db);
+    storage_profile_apply(w->db, "read", NULL);
+    rc = search_prepare(w->db, "lembed(?1)", 0, &w->search);
+    CHECK_SQLITE_NOT_OK(rc, w->db);
+    rc = sqlite3_prepare_v2(w->db, "select vec_to_json(lembed(?))", -1, &w->embedJson, NULL);
+    CHECK_SQLITE_NOT_OK(rc, w->db);
+    rc = sqlite3_prepare_v2(w->db, "select lembed(?)", -1, &w->embedBlob, NULL);
+    CHECK_SQLITE_NOT_OK(rc, w->db);
+    rc = sqlite3_prepare_v2(w->db, "pragma data_version", -1, &w->dataVersion, NULL);
+    CHECK_SQLITE_NOT_OK(rc, w->db);
+    rc = embedfile_sqlite3_init_model(w->db);
+    CHECK_SQLITE_NOT_OK(rc, w->db);
+    w->version = -1;
+    embedfile_serve_changed(w);
+}
+
+void embedfile_serve_worker_close(ef_worker *w) {
+    sqlite3_finalize(w->search);
+    sqlite3_finalize(w->embedJson);
+    sqlite3_finalize(w->embedBlob);
+    sqlite3_finalize(w->dataVersion);
+    sqlite3_close(w->db);
+}
+
+void *embedfile_serve_worker(void *arg) {
+    ef_worker *w = arg;
+    ef_server *s = w->s;
+    while (1) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->count && !s->stop) {
+            pthread_cond_wait(&s->ready, &s->lock);
+        }
+        if (!s->count) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        int client = s->queue[s->head];
+        s->head = (s->head + 1) % EMBEDFILE_SERVE_QUEUE;
+        s->count--;
+        pthread_cond_signal(&s->space);
+        pthread_mutex_unlock(&s->lock);
+
+        FILE *f = fdopen(client, "rb");
+        if (!f) {
+            close(client);
+            continue;
+        }
+        sqlite3_str *out = sqlite3_str_new(w->db);
+        embedfile_serve_request(w, f, out);
+        write_all(client, sqlite3_str_value(out), sqlite3_str_length(out));
+        sqlite3_free(sqlite3_str_finish(out));
+        fclose(f);
+    }
+    return NULL;
+}
+
+int cmd_serve(char *dbPath, int workers) {
+    ef_server s = {0};
+    char *path = embedfile_socket_path(1);
+    struct sockaddr_un addr = {0};
+    if (!path) {
+        fprintf(stderr, "Error: Could not make a private directory for the socket, "
+                        "pass --socket PATH instead.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path %s is too long.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    // a socket file that nobody answers on was left by a daemon that
+    // died, so it's safe to replace
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "Error: embedfile is already serving on %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    unlink(path);
+
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.ready, NULL);
+    pthread_cond_init(&s.space, NULL);
+    s.model = embedfile_realpath(EMBEDFILE_MODEL);
+    s.dimensions = sqlite3_mprintf("%lld", EMBEDFILE_DIMENSIONS);
+    s.quantize = EMBEDFILE_QUANTIZE ? EMBEDFILE_QUANTIZE : "none";
+    s.index = embedfile_realpath(dbPath);
+
+    // the first worker waits for the weights, and the rest share them
+    ef_worker *pool = sqlite3_malloc(sizeof(ef_worker) * workers);
+    CHECK_ZSQL_NOT_NULL(pool);
+    memset(pool, 0, sizeof(ef_worker) * workers);
+    for (int i = 0; i < workers; i++) {
+        pool[i].s = &s;
+        embedfile_serve_worker_open(&pool[i], dbPath);
+    }
+
+    // the socket is created with its final permissions, so that nobody
+    // else can connect between bind() and a chmod()
+    mode_t oldUmask = umask(077);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 64) == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    umask(oldUmask);
+
+    struct sigaction sa = {0};
+    sa.sa_handler = embedfile_serve_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    // only this thread takes Ctrl-C, so that it interrupts accept()
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, &old);
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&pool[i].thread, NULL, embedfile_serve_worker, &pool[i])) {
+            fprintf(stderr, "Error: Could not start serve worker %d.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    fprintf(stderr, "embedfile: serving %s on %s with %d workers\n", dbPath, path, workers);
+
+    while (!g_serve_stop) {
+        int client = accept(fd, NULL, NULL);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        if (!embedfile_peer_is_me(client)) {
+            close(client);
+            continue;
+        }
+        struct timeval timeout = {EMBEDFILE_SERVE_TIMEOUT, 0};
+        if (setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ||
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout))) {
+            close(client);
+            continue;
+        }
+        pthread_mutex_lock(&s.lock);
+        while (s.count == EMBEDFILE_SERVE_QUEUE) {
+            pthread_cond_wait(&s.space, &s.lock);
+        }
+        s.queue[(s.head + s.count) % EMBEDFILE_SERVE_QUEUE] = client;
+        s.count++;
+        pthread_cond_signal(&s.ready);
+        pthread_mutex_unlock(&s.lock);
+    }
+
+    // workers finish the requests already queued, then exit
+    pthread_mutex_lock(&s.lock);
+    s.stop = 1;
+    pthread_cond_broadcast(&s.ready);
+    pthread_mutex_unlock(&s.lock);
+    for (int i = 0; i < workers; i++) {
+        pthread_join(pool[i].thread, NULL);
+        embedfile_serve_worker_close(&pool[i]);
+    }
+    sqlite3_free(pool);
+
+    close(fd);
+    unlink(path);
+    embedfile_serve_forget(&s);
+    pthread_cond_destroy(&s.space);
+    pthread_cond_destroy(&s.ready);
+    pthread_mutex_destroy(&s.lock);
+    sqlite3_free(s.model);
+    sqlite3_free(s.dimensions);
+    sqlite3_free(s.index);
+    sqlite3_free(path);
+    return 0;
+}
+
 int cmd_sh(int argc, char *argv[]) {
     return mn(argc, argv);
 }
@@ -600,6 +2188,7 @@ int main(int argc, char **argv) {
     sqlite3 *db;
     sqlite3_stmt *stmt;
 
+    EMBEDFILE_STARTED_MS = time_ms();
     FLAG_log_disable = 1;
     argc = cosmo_args("/zip/.args", &argv);
     FLAGS_READY = 1;
@@ -613,6 +2202,43 @@ int main(int argc, char **argv) {
                 exit(EXIT_FAILURE);
             }
             EMBEDFILE_MODEL = argv[i];
+        } else if (sqlite3_stricmp(arg, "--dimensions") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --dimensions.\n");
+                exit(EXIT_FAILURE);
+            }
+            EMBEDFILE_DIMENSIONS = atoll(argv[i]);
+            if (EMBEDFILE_DIMENSIONS <= 0) {
+                fprintf(stderr, "Error: --dimensions must be a positive integer.\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (sqlite3_stricmp(arg, "--quantize") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --quantize.\n");
+                exit(EXIT_FAILURE);
+            }
+            EMBEDFILE_QUANTIZE = argv[i];
+        } else if (sqlite3_stricmp(arg, "--socket") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --socket.\n");
+                exit(EXIT_FAILURE);
+            }
+            EMBEDFILE_SOCKET = argv[i];
+        } else if (sqlite3_stricmp(arg, "--storage-profile") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for --storage-profile.\n");
+                exit(EXIT_FAILURE);
+            }
+            EMBEDFILE_STORAGE_PROFILE = argv[i];
+            if (sqlite3_stricmp(EMBEDFILE_STORAGE_PROFILE, "auto") != 0 &&
+                sqlite3_stricmp(EMBEDFILE_STORAGE_PROFILE, "build") != 0 &&
+                sqlite3_stricmp(EMBEDFILE_STORAGE_PROFILE, "read") != 0 &&
+                sqlite3_stricmp(EMBEDFILE_STORAGE_PROFILE, "none") != 0) {
+                fprintf(stderr, "Error: --storage-profile must be auto, build, read, or none.\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (sqlite3_stricmp(arg, "--verbose") == 0) {
+            EMBEDFILE_VERBOSE = 1;
         } else if (sqlite3_stricmp(arg, "--version") == 0 || sqlite3_stricmp(arg, "-v") == 0) {
             fprintf(stderr,
                     "embedfile %s, llamafile %s, SQLite %s, sqlite-vec=%s, sqlite-lembed=%s\n",
@@ -628,13 +2254,37 @@ int main(int argc, char **argv) {
             fprintf(stderr, "Usage: embedfile [sh,embed,backfill,index]\n");
             return 0;
         } else if (sqlite3_stricmp(arg, "sh") == 0) {
+            embedfile_preload_model();
             return cmd_sh(argc - i, argv + i);
         } else if (sqlite3_stricmp(arg, "embed") == 0) {
-            return cmd_embed(i + 2 == argc ? argv[i + 1] : NULL);
+            char *source = NULL;
+            ef_embed_format format = EF_EMBED_FORMAT_JSON;
+            for (int j = i + 1; j < argc; j++) {
+                if (sqlite3_stricmp(argv[j], "--format") == 0) {
+                    if (j + 1 >= argc) {
+                        fprintf(stderr, "Error: Missing value for --format.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    if (parse_embed_format(argv[++j], &format) != SQLITE_OK) {
+                        fprintf(stderr,
+                                "Error: --format must be json, ndjson, f32, f16, i8, or npy.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                } else if (!source) {
+                    source = argv[j];
+                } else {
+                    fprintf(stderr, "Error: Unknown extra argument %s.\n", argv[j]);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            return cmd_embed(source, format);
         } else if (sqlite3_stricmp(arg, "search") == 0) {
             char *dbpath = NULL;
             char *query = NULL;
             int k = 10;
+            int cache = 0;
+            int hybrid = 0;
+            int stats = 0;
             for (int j = i + 1; j < argc; j++) {
                 if (sqlite3_stricmp(argv[j], "--k") == 0 || sqlite3_stricmp(argv[j], "-k") == 0) {
                     if (j + 1 >= argc) {
@@ -646,6 +2296,12 @@ int main(int argc, char **argv) {
                         fprintf(stderr, "Error: --k must be a positive integer.\n");
                         return 1;
                     }
+                } else if (sqlite3_stricmp(argv[j], "--cache") == 0) {
+                    cache = 1;
+                } else if (sqlite3_stricmp(argv[j], "--hybrid") == 0) {
+                    hybrid = 1;
+                } else if (sqlite3_stricmp(argv[j], "--stats") == 0) {
+                    stats = 1;
                 } else if (!dbpath) {
                     dbpath = argv[j];
                 } else if (!query) {
@@ -659,8 +2315,39 @@ int main(int argc, char **argv) {
                 fprintf(stderr, "Error: No database nor search query provided.\n");
                 exit(EXIT_FAILURE);
             }
-            return cmd_search(dbpath, query, k);
+            return cmd_search(dbpath, query, k, cache, hybrid, stats);
+        } else if (sqlite3_stricmp(arg, "serve") == 0) {
+            char *dbpath = NULL;
+            int workers = sysconf(_SC_NPROCESSORS_ONLN);
+            for (int j = i + 1; j < argc; j++) {
+                if (sqlite3_stricmp(argv[j], "--workers") == 0) {
+                    if (j + 1 >= argc) {
+                        fprintf(stderr, "Error: Missing value for --workers.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    workers = atoi(argv[++j]);
+                    if (workers <= 0) {
+                        fprintf(stderr, "Error: --workers must be a positive integer.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                } else if (!dbpath) {
+                    dbpath = argv[j];
+                } else {
+                    fprintf(stderr, "Error: serve takes exactly one INDEX_DB.\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (!dbpath) {
+                fprintf(stderr, "Error: serve takes exactly one INDEX_DB.\n");
+                exit(EXIT_FAILURE);
+            }
+            if (workers <= 0) {
+                workers = 1;
+            }
+            embedfile_preload_model();
+            return cmd_serve(dbpath, workers);
         } else if (sqlite3_stricmp(arg, "import") == 0) {
+            embedfile_preload_model();
             return cmd_import(argc - i, argv + i);
         } else {
             fprintf(stderr, "Error: Unknown argument %s.\n", arg);
@@ -668,6 +2355,6 @@ int main(int argc, char **argv) {
         }
     }
 
-    fprintf(stderr, "Usage: embedfile [--model MODEL_FILE] [embed [TEXT] | sh | import [--embed COLUMN] [--table NAME] SOURCE_FILE INDEX_DB | search [--k NUM] INDEX_DB QUERY]\n");
+    fprintf(stderr, "Usage: embedfile [--model MODEL_FILE] [--dimensions NUM] [--quantize none|int8|bit] [--socket PATH] [--storage-profile auto|build|read|none] [--verbose] [embed [--format FORMAT] [TEXT] | sh | import [--embed COLUMN] [--table NAME] [--fts] [--sample NUM] [--chunk TOKENS] [--overlap TOKENS] [--shards NUM] SOURCE_FILE INDEX_DB | search [--k NUM] [--cache] [--hybrid] [--stats] INDEX_DB QUERY | serve [--workers NUM] INDEX_DB]\n");
     return 0;
 }
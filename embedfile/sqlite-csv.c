@@ -36,6 +36,16 @@
 ** the number and names of the columns is determined by the first line of
 ** the CSV input.
 **
+** Regular files are memory mapped, and rows of mapped files (or of data=)
+** are split without copying: unquoted fields, and quoted fields with no
+** doubled quotes, are handed to SQLite straight from the mapping.
+**
+** To read a large file with several connections at once, give each one
+** the same parts=N and a different part=K, for K from 1 to N.  Each part
+** then covers a disjoint range of records, split at newlines that are not
+** inside a quoted field, and the rowid of a record becomes its byte offset
+** in the file plus one, so that rowids are unique across all of the parts.
+**
 ** Some extra debugging features (used for testing virtual tables) are available
 ** if this module is compiled with -DSQLITE_TEST.
 */
@@ -48,6 +58,11 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #ifndef SQLITE_OMIT_VIRTUALTABLE
 
@@ -83,6 +98,7 @@ struct CsvReader {
   size_t iIn;            /* Next unread character in the input buffer */
   size_t nIn;            /* Number of characters in the input buffer */
   char *zIn;             /* The input buffer */
+  int bMapped;           /* True if zIn is a mapping of the whole file */
   char zErr[CSV_MXERR];  /* Error message */
 };
 
@@ -96,6 +112,7 @@ static void csv_reader_init(CsvReader *p){
   p->bNotFirst = 0;
   p->nIn = 0;
   p->zIn = 0;
+  p->bMapped = 0;
   p->zErr[0] = 0;
 }
 
@@ -105,6 +122,9 @@ static void csv_reader_reset(CsvReader *p){
     fclose(p->in);
     sqlite3_free(p->zIn);
   }
+  if( p->bMapped ){
+    munmap(p->zIn, p->nIn);
+  }
   sqlite3_free(p->z);
   csv_reader_init(p);
 }
@@ -117,6 +137,29 @@ static void csv_errmsg(CsvReader *p, const char *zFormat, ...){
   va_end(ap);
 }
 
+/* Map a regular file into p->zIn, so that it can be read as if it had
+** been passed in with data=.  Return 0 if the file can't be mapped, in
+** which case it is read through stdio instead.
+*/
+static int csv_reader_map(CsvReader *p, const char *zFilename){
+  struct stat st;
+  void *pMap;
+  int fd = open(zFilename, O_RDONLY);
+  if( fd<0 ) return 0;
+  if( fstat(fd, &st)!=0 || !S_ISREG(st.st_mode) || st.st_size==0 ){
+    close(fd);
+    return 0;
+  }
+  pMap = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( pMap==MAP_FAILED ) return 0;
+  madvise(pMap, st.st_size, MADV_SEQUENTIAL);
+  p->zIn = (char*)pMap;
+  p->nIn = st.st_size;
+  p->bMapped = 1;
+  return 1;
+}
+
 /* Open the file associated with a CsvReader
 ** Return the number of errors.
 */
@@ -125,6 +168,10 @@ static int csv_reader_open(
   const char *zFilename,      /* Read from this filename */
   const char *zData           /*  ... or use this data */
 ){
+  p->nLine = 1;
+  if( zFilename && csv_reader_map(p, zFilename) ){
+    return 0;
+  }
   if( zFilename ){
     p->zIn = sqlite3_malloc( CSV_INBUFSZ );
     if( p->zIn==0 ){
@@ -223,7 +270,7 @@ static char *csv_read_one_field(CsvReader *p){
     pc = ppc = 0;
     while( 1 ){
       c = csv_getc(p);
-      if( c<='"' || pc=='"' ){
+      if( c<='"' || pc=='"' || ppc=='"' ){
         if( c=='\n' ) p->nLine++;
         if( c=='"' ){
           if( pc=='"' ){
@@ -240,12 +287,14 @@ static char *csv_read_one_field(CsvReader *p){
           p->cTerm = (char)c;
           break;
         }
-        if( pc=='"' && c!='\r' ){
+        /* As in csv_read_record(), a closing quote may only be followed
+        ** by a separator, a newline or a CRLF */
+        if( (pc=='"' && c!='\r') || ppc=='"' ){
           csv_errmsg(p, "line %d: unescaped %c character", p->nLine, '"');
           break;
         }
         if( c==EOF ){
-          csv_errmsg(p, "line %d: unterminated %c-quoted field\n",
+          csv_errmsg(p, "line %d: unterminated %c-quoted field",
                      startLine, '"');
           p->cTerm = (char)c;
           break;
@@ -287,6 +336,167 @@ static char *csv_read_one_field(CsvReader *p){
   return p->z;
 }
 
+/* Every byte of a 64-bit word set to 0x01 */
+#define CSV_ONES ((uint64_t)0x0101010101010101)
+
+/* Return the offset of the first ',' or '\n' in z[0..n), or n if there
+** is none.  Eight bytes are classified at a time, and the word that has a
+** match is then searched byte by byte, which keeps this endian neutral.
+*/
+static size_t csv_find_separator(const char *z, size_t n){
+  size_t i = 0;
+  while( i+8<=n ){
+    uint64_t w, c, l;
+    memcpy(&w, z+i, 8);
+    c = w ^ (CSV_ONES*',');
+    l = w ^ (CSV_ONES*'\n');
+    if( (((c-CSV_ONES) & ~c) | ((l-CSV_ONES) & ~l)) & (CSV_ONES<<7) ) break;
+    i += 8;
+  }
+  while( i<n && z[i]!=',' && z[i]!='\n' ) i++;
+  return i;
+}
+
+/* Read one record of an in-memory CSV (a mapped file or data=) starting
+** at p->iIn and ending at or before iEnd.  Column i of the record is left
+** in azOut[i] and anOut[i].  These point straight into p->zIn, except for
+** quoted fields with doubled quotes, which are unescaped into azBuf[i],
+** an sqlite3_malloc64() buffer of anBuf[i] bytes.  Columns the record is
+** missing are set to NULL and fields past nCol are ignored.
+**
+** Return 1 if a record was read, 0 at the end of input, or -1 with an
+** error message left in p->zErr.
+*/
+static int csv_read_record(
+  CsvReader *p,            /* The reader, which must have p->in==0 */
+  size_t iEnd,             /* Stop reading here */
+  int nCol,                /* Number of columns in the table */
+  const char **azOut,      /* OUT: Value of each column */
+  int *anOut,              /* OUT: Length of each column */
+  char **azBuf,            /* Buffers for unescaped quoted fields */
+  int *anBuf               /* Size of each azBuf[] entry */
+){
+  const char *z = p->zIn;
+  size_t i = p->iIn;
+  int iCol = 0;
+  if( i>=iEnd ) return 0;
+  /* Skip the UTF-8 BOM at the start of the input */
+  if( i==0 && iEnd>=3 && memcmp(z, "\xef\xbb\xbf", 3)==0 ) i = 3;
+  while( 1 ){
+    const char *zField;
+    size_t nField;
+    if( i<iEnd && z[i]=='"' ){
+      size_t iFirst = ++i;
+      int bEscaped = 0;
+      while( 1 ){
+        const char *q = memchr(z+i, '"', iEnd-i);
+        if( q==0 ){
+          csv_errmsg(p, "byte %lld: unterminated %c-quoted field",
+                     (sqlite3_int64)iFirst-1, '"');
+          return -1;
+        }
+        i = q-z+1;
+        if( i<iEnd && z[i]=='"' ){
+          bEscaped = 1;
+          i++;
+          continue;
+        }
+        break;
+      }
+      zField = z+iFirst;
+      nField = i-1-iFirst;
+      if( i+1<iEnd && z[i]=='\r' && z[i+1]=='\n' ) i++;
+      if( i<iEnd && z[i]!=',' && z[i]!='\n' ){
+        csv_errmsg(p, "byte %lld: unescaped %c character",
+                   (sqlite3_int64)i-1, '"');
+        return -1;
+      }
+      if( bEscaped && iCol<nCol ){
+        size_t j, k;
+        char *zOut;
+        if( anBuf[iCol]<(sqlite3_int64)nField+1 ){
+          zOut = sqlite3_realloc64(azBuf[iCol], nField+1);
+          if( zOut==0 ){
+            csv_errmsg(p, "out of memory");
+            return -1;
+          }
+          azBuf[iCol] = zOut;
+          anBuf[iCol] = (int)nField+1;
+        }
+        zOut = azBuf[iCol];
+        for(j=k=0; k<nField; k++){
+          zOut[j++] = zField[k];
+          if( zField[k]=='"' ) k++;
+        }
+        zField = zOut;
+        nField = j;
+      }
+    }else{
+      nField = csv_find_separator(z+i, iEnd-i);
+      zField = z+i;
+      i += nField;
+      if( i<iEnd && z[i]=='\n' && nField>0 && zField[nField-1]=='\r' ){
+        nField--;
+      }
+    }
+    if( iCol<nCol ){
+      azOut[iCol] = zField;
+      anOut[iCol] = (int)nField;
+    }
+    iCol++;
+    if( i>=iEnd ) break;
+    if( z[i++]!=',' ) break;
+    /* A separator right at the end of input doesn't start another field */
+    if( i>=iEnd ) break;
+  }
+  for(; iCol<nCol; iCol++){
+    azOut[iCol] = 0;
+    anOut[iCol] = 0;
+  }
+  p->iIn = i;
+  return 1;
+}
+
+/* Return the offset of the first record of part k (counting from 0) when
+** z[iStart..n) is split into nPart parts.  Parts start after the first
+** newline past their share of the bytes that isn't inside a quoted field.
+** As in csv_read_record(), a '"' only opens a quoted field at the start
+** of a field, so a stray quote such as 5" inside an unquoted field is
+** ordinary data and doesn't affect where later parts begin.
+*/
+static size_t csv_part_start(
+  const char *z,
+  size_t iStart,
+  size_t n,
+  int nPart,
+  int k
+){
+  size_t iTarget, i;
+  if( k<=0 ) return iStart;
+  if( k>=nPart ) return n;
+  iTarget = iStart + (n-iStart)/nPart*k;
+  i = iStart;
+  if( i==0 && n>=3 && memcmp(z, "\xef\xbb\xbf", 3)==0 ) i = 3;
+  while( i<n ){
+    if( z[i]=='"' ){
+      i++;
+      while( 1 ){
+        const char *q = memchr(z+i, '"', n-i);
+        if( q==0 ) return n;
+        i = q-z+1;
+        if( i<n && z[i]=='"' ){
+          i++;
+          continue;
+        }
+        break;
+      }
+    }
+    i += csv_find_separator(z+i, n-i);
+    if( i>=n ) return n;
+    if( z[i++]=='\n' && i>iTarget ) return i;
+  }
+  return n;
+}
 
 /* Forward references to the various virtual table methods implemented
 ** in this file. */
@@ -311,6 +521,8 @@ typedef struct CsvTable {
   char *zFilename;                /* Name of the CSV file */
   char *zData;                    /* Raw CSV data in lieu of zFilename */
   long iStart;                    /* Offset to start of data in zFilename */
+  sqlite3_int64 iEnd;             /* Offset to end of data, or 0 for all */
+  int bPart;                      /* True if reading one of parts=N */
   int nCol;                       /* Number of columns in the CSV file */
   unsigned int tstFlags;          /* Bit values used for testing */
 } CsvTable;
@@ -323,7 +535,10 @@ typedef struct CsvCursor {
   sqlite3_vtab_cursor base;       /* Base class.  Must be first */
   CsvReader rdr;                  /* The CsvReader object */
   char **azVal;                   /* Value of the current row */
+  const char **azPtr;             /* Each column, in azVal[] or the input */
   int *aLen;                      /* Length of each entry */
+  int *anPtr;                     /* Length of each azPtr[] entry */
+  size_t iEnd;                    /* End of the input for in-memory reads */
   sqlite3_int64 iRowid;           /* The current rowid.  Negative for EOF */
 } CsvCursor;
 
@@ -475,6 +690,8 @@ static int csv_boolean_parameter(
 **    header=YES|NO              First row of CSV defines the names of
 **                               columns if "yes".  Default "no".
 **    columns=N                  Assume the CSV file contains N columns.
+**    parts=N                    Split the records into N parts ...
+**    part=K                     ... and only read part K of them.
 **
 ** Only available if compiled with SQLITE_TEST:
 **
@@ -501,6 +718,8 @@ static int csvtabConnect(
 #endif
   int b;                     /* Value of a boolean parameter */
   int nCol = -99;            /* Value of the columns= parameter */
+  int nPart = 0;             /* Value of the parts= parameter */
+  int iPart = 0;             /* Value of the part= parameter */
   CsvReader sRdr;            /* A CSV file reader used to store an error
                              ** message and/or to count the number of columns */
   static const char *azParam[] = {
@@ -547,6 +766,20 @@ static int csvtabConnect(
         goto csvtab_connect_error;
       }
     }else
+    if( (zValue = csv_parameter("parts",5,z))!=0 ){
+      nPart = atoi(zValue);
+      if( nPart<=0 ){
+        csv_errmsg(&sRdr, "parts= value must be positive");
+        goto csvtab_connect_error;
+      }
+    }else
+    if( (zValue = csv_parameter("part",4,z))!=0 ){
+      iPart = atoi(zValue);
+      if( iPart<=0 ){
+        csv_errmsg(&sRdr, "part= value must be positive");
+        goto csvtab_connect_error;
+      }
+    }else
     {
       csv_errmsg(&sRdr, "bad parameter: '%s'", z);
       goto csvtab_connect_error;
@@ -556,12 +789,20 @@ static int csvtabConnect(
     csv_errmsg(&sRdr, "must specify either filename= or data= but not both");
     goto csvtab_connect_error;
   }
+  if( (nPart>0)!=(iPart>0) || iPart>nPart ){
+    csv_errmsg(&sRdr, "part=K needs parts=N, with K from 1 to N");
+    goto csvtab_connect_error;
+  }
 
-  if( (nCol<=0 || bHeader==1)
+  if( (nCol<=0 || bHeader==1 || nPart>0)
    && csv_reader_open(&sRdr, CSV_FILENAME, CSV_DATA)
   ){
     goto csvtab_connect_error;
   }
+  if( nPart>0 && sRdr.in!=0 ){
+    csv_errmsg(&sRdr, "parts= needs a regular file or data=");
+    goto csvtab_connect_error;
+  }
   pNew = sqlite3_malloc( sizeof(*pNew) );
   *ppVtab = (sqlite3_vtab*)pNew;
   if( pNew==0 ) goto csvtab_connect_oom;
@@ -613,6 +854,7 @@ static int csvtabConnect(
   }else{
     pNew->nCol = nCol;
   }
+  if( sRdr.zErr[0] ) goto csvtab_connect_error;
   pNew->zFilename = CSV_FILENAME;  CSV_FILENAME = 0;
   pNew->zData = CSV_DATA;          CSV_DATA = 0;
 #ifdef SQLITE_TEST
@@ -620,11 +862,19 @@ static int csvtabConnect(
 #endif
   if( bHeader!=1 ){
     pNew->iStart = 0;
-  }else if( pNew->zData ){
-    pNew->iStart = (int)sRdr.iIn;
+  }else if( sRdr.in==0 ){
+    pNew->iStart = (long)sRdr.iIn;
   }else{
     pNew->iStart = (int)(ftell(sRdr.in) - sRdr.nIn + sRdr.iIn);
   }
+  if( nPart>0 ){
+    size_t iFirst = csv_part_start(sRdr.zIn, pNew->iStart, sRdr.nIn,
+                                   nPart, iPart-1);
+    pNew->iEnd = csv_part_start(sRdr.zIn, pNew->iStart, sRdr.nIn,
+                                nPart, iPart);
+    pNew->iStart = (long)iFirst;
+    pNew->bPart = 1;
+  }
   csv_reader_reset(&sRdr);
   rc = sqlite3_declare_vtab(db, CSV_SCHEMA);
   if( rc ){
@@ -672,6 +922,7 @@ static void csvtabCursorRowReset(CsvCursor *pCur){
   for(i=0; i<pTab->nCol; i++){
     sqlite3_free(pCur->azVal[i]);
     pCur->azVal[i] = 0;
+    pCur->azPtr[i] = 0;
     pCur->aLen[i] = 0;
   }
 }
@@ -708,17 +959,23 @@ static int csvtabOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor){
   CsvTable *pTab = (CsvTable*)p;
   CsvCursor *pCur;
   size_t nByte;
-  nByte = sizeof(*pCur) + (sizeof(char*)+sizeof(int))*pTab->nCol;
+  nByte = sizeof(*pCur) + (sizeof(char*)+sizeof(int))*2*pTab->nCol;
   pCur = sqlite3_malloc64( nByte );
   if( pCur==0 ) return SQLITE_NOMEM;
   memset(pCur, 0, nByte);
   pCur->azVal = (char**)&pCur[1];
-  pCur->aLen = (int*)&pCur->azVal[pTab->nCol];
+  pCur->azPtr = (const char**)&pCur->azVal[pTab->nCol];
+  pCur->aLen = (int*)&pCur->azPtr[pTab->nCol];
+  pCur->anPtr = &pCur->aLen[pTab->nCol];
   *ppCursor = &pCur->base;
   if( csv_reader_open(&pCur->rdr, pTab->zFilename, pTab->zData) ){
     csv_xfer_error(pTab, &pCur->rdr);
     return SQLITE_ERROR;
   }
+  pCur->iEnd = pCur->rdr.nIn;
+  if( pTab->iEnd>0 && (size_t)pTab->iEnd<pCur->iEnd ){
+    pCur->iEnd = (size_t)pTab->iEnd;
+  }
   return SQLITE_OK;
 }
 
@@ -732,8 +989,29 @@ static int csvtabNext(sqlite3_vtab_cursor *cur){
   CsvTable *pTab = (CsvTable*)cur->pVtab;
   int i = 0;
   char *z;
+  if( pCur->rdr.in==0 ){
+    size_t iRecord = pCur->rdr.iIn;
+    int rc = csv_read_record(&pCur->rdr, pCur->iEnd, pTab->nCol,
+                             pCur->azPtr, pCur->anPtr, pCur->azVal, pCur->aLen);
+    if( rc<0 ){
+      csv_xfer_error(pTab, &pCur->rdr);
+      return SQLITE_ERROR;
+    }
+    if( rc==0 ){
+      pCur->iRowid = -1;
+    }else if( pTab->bPart ){
+      pCur->iRowid = (sqlite3_int64)iRecord + 1;
+    }else{
+      pCur->iRowid++;
+    }
+    return SQLITE_OK;
+  }
   do{
     z = csv_read_one_field(&pCur->rdr);
+    if( pCur->rdr.zErr[0] ){
+      csv_xfer_error(pTab, &pCur->rdr);
+      return SQLITE_ERROR;
+    }
     if( z==0 ){
       break;
     }
@@ -749,6 +1027,8 @@ static int csvtabNext(sqlite3_vtab_cursor *cur){
         pCur->aLen[i] = pCur->rdr.n+1;
       }
       memcpy(pCur->azVal[i], z, pCur->rdr.n+1);
+      pCur->azPtr[i] = pCur->azVal[i];
+      pCur->anPtr[i] = pCur->rdr.n;
       i++;
     }
   }while( pCur->rdr.cTerm==',' );
@@ -759,6 +1039,7 @@ static int csvtabNext(sqlite3_vtab_cursor *cur){
     while( i<pTab->nCol ){
       sqlite3_free(pCur->azVal[i]);
       pCur->azVal[i] = 0;
+      pCur->azPtr[i] = 0;
       pCur->aLen[i] = 0;
       i++;
     }
@@ -777,8 +1058,11 @@ static int csvtabColumn(
 ){
   CsvCursor *pCur = (CsvCursor*)cur;
   CsvTable *pTab = (CsvTable*)cur->pVtab;
-  if( i>=0 && i<pTab->nCol && pCur->azVal[i]!=0 ){
-    sqlite3_result_text(ctx, pCur->azVal[i], -1, SQLITE_TRANSIENT);
+  if( i>=0 && i<pTab->nCol && pCur->azPtr[i]!=0 ){
+    /* Fields outside of azVal[] point into data=, which the table owns,
+    ** or into the file's mapping, which lasts until the cursor closes */
+    sqlite3_result_text(ctx, pCur->azPtr[i], pCur->anPtr[i],
+        pCur->azPtr[i]==pCur->azVal[i] ? SQLITE_TRANSIENT : SQLITE_STATIC);
   }
   return SQLITE_OK;
 }
@@ -813,6 +1097,7 @@ static int csvtabFilter(
   CsvCursor *pCur = (CsvCursor*)pVtabCursor;
   CsvTable *pTab = (CsvTable*)pVtabCursor->pVtab;
   pCur->iRowid = 0;
+  pCur->rdr.zErr[0] = 0;
 
   /* Ensure the field buffer is always allocated. Otherwise, if the
   ** first field is zero bytes in size, this may be mistaken for an OOM
@@ -820,7 +1105,7 @@ static int csvtabFilter(
   if( csv_append(&pCur->rdr, 0) ) return SQLITE_NOMEM;
 
   if( pCur->rdr.in==0 ){
-    assert( pCur->rdr.zIn==pTab->zData );
+    assert( pCur->rdr.bMapped || pCur->rdr.zIn==pTab->zData );
     assert( pTab->iStart>=0 );
     assert( (size_t)pTab->iStart<=pCur->rdr.nIn );
     pCur->rdr.iIn = pTab->iStart;
@@ -0,0 +1,926 @@
+//#include "sqlite3ext.h"
+#include "sqlite-json-read.h"
+#include "third_party/sqlite/sqlite3.h"
+///SQLITE_EXTENSION_INIT1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// json_lines_read and json_array_read expose a newline delimited JSON
+// file, or a file holding one JSON array of objects, as a table whose
+// columns are the top-level keys of the records:
+//
+//     CREATE VIRTUAL TABLE temp.x USING json_lines_read(
+//       filename="data.ndjson", sample=100);
+//
+// the column list and declared types come from the first `sample`
+// records (0 scans the whole file). each record is scanned exactly once
+// when the cursor reaches it; values stay pointers into the mapped file
+// until a column is read, so unused keys are never decoded. files whose
+// records aren't objects get a single "value" column holding the record
+
+#define JSON_READ_DEFAULT_SAMPLE 100
+
+#define JSON_READ_KIND_NULL 0
+#define JSON_READ_KIND_TRUE 1
+#define JSON_READ_KIND_FALSE 2
+#define JSON_READ_KIND_INTEGER 3
+#define JSON_READ_KIND_REAL 4
+#define JSON_READ_KIND_TEXT 5
+#define JSON_READ_KIND_NESTED 6
+
+#pragma region scanner
+
+#define JSON_READ_ONES 0x0101010101010101ull
+#define JSON_READ_HIGHS 0x8080808080808080ull
+
+static int json_read_is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static const char *json_read_skip_space(const char *p, const char *end) {
+  while (p < end && json_read_is_space(*p))
+    p++;
+  return p;
+}
+
+// finds the first '"' or '\\' in [p,end), eight bytes at a time. string
+// bodies are where a JSON scanner spends nearly all of its time, and
+// neither byte can appear in them unless it ends or escapes something
+static const char *json_read_find_quote(const char *p, const char *end) {
+  while (end - p >= 8) {
+    uint64_t w, q, b, m;
+    memcpy(&w, p, 8);
+    q = w ^ (JSON_READ_ONES * '"');
+    b = w ^ (JSON_READ_ONES * '\\');
+    m = ((q - JSON_READ_ONES) & ~q) | ((b - JSON_READ_ONES) & ~b);
+    m &= JSON_READ_HIGHS;
+    if (m) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      return p + (__builtin_ctzll(m) >> 3);
+#else
+      return p + (__builtin_clzll(m) >> 3);
+#endif
+    }
+    p += 8;
+  }
+  while (p < end && *p != '"' && *p != '\\')
+    p++;
+  return p;
+}
+
+// p points at an opening quote. returns one past the closing quote, or
+// NULL if the string is unterminated. sets *escaped if it has escapes
+static const char *json_read_skip_string(const char *p, const char *end,
+                                         int *escaped) {
+  p++;
+  for (;;) {
+    p = json_read_find_quote(p, end);
+    if (p >= end)
+      return 0;
+    if (*p == '"')
+      return p + 1;
+    *escaped = 1;
+    p += 2;
+  }
+}
+
+// parses the integer in p[0..n), stopping at the first byte that isn't
+// a digit like strtoll() does. returns 0 if it doesn't fit in 64 bits
+static int json_read_int64(const char *p, int n, sqlite3_int64 *out) {
+  int neg = n > 0 && *p == '-';
+  uint64_t limit = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+  uint64_t v = 0;
+  for (int i = neg; i < n && p[i] >= '0' && p[i] <= '9'; i++) {
+    unsigned d = p[i] - '0';
+    if (v > (limit - d) / 10)
+      return 0;
+    v = v * 10 + d;
+  }
+  *out = !neg ? (sqlite3_int64)v : v ? -(sqlite3_int64)(v - 1) - 1 : 0;
+  return 1;
+}
+
+// p points at the first byte of a value. returns one past its end, or
+// NULL if it's malformed, and classifies it into *kind
+static const char *json_read_skip_value(const char *p, const char *end,
+                                        int *kind, int *escaped) {
+  int depth = 0;
+  const char *q;
+  if (p >= end)
+    return 0;
+  switch (*p) {
+  case '"':
+    *kind = JSON_READ_KIND_TEXT;
+    return json_read_skip_string(p, end, escaped);
+  case '{':
+  case '[':
+    *kind = JSON_READ_KIND_NESTED;
+    for (; p < end; p++) {
+      switch (*p) {
+      case '"': {
+        int ignored;
+        if (!(p = json_read_skip_string(p, end, &ignored)))
+          return 0;
+        p--;
+        break;
+      }
+      case '{':
+      case '[':
+        depth++;
+        break;
+      case '}':
+      case ']':
+        if (!--depth)
+          return p + 1;
+        break;
+      }
+    }
+    return 0;
+  default:
+    *kind = JSON_READ_KIND_INTEGER;
+    for (q = p; q < end; q++) {
+      char c = *q;
+      if (c == ',' || c == '}' || c == ']' || json_read_is_space(c))
+        break;
+      if (c == '.' || c == 'e' || c == 'E')
+        *kind = JSON_READ_KIND_REAL;
+    }
+    if (q == p)
+      return 0;
+    if (*p == 't' || *p == 'f' || *p == 'n') {
+      if (q - p == 4 && !memcmp(p, "true", 4))
+        *kind = JSON_READ_KIND_TRUE;
+      else if (q - p == 5 && !memcmp(p, "false", 5))
+        *kind = JSON_READ_KIND_FALSE;
+      else if (q - p == 4 && !memcmp(p, "null", 4))
+        *kind = JSON_READ_KIND_NULL;
+      else
+        return 0;
+    } else if (*p != '-' && (*p < '0' || *p > '9')) {
+      return 0;
+    } else if (*kind == JSON_READ_KIND_INTEGER) {
+      // integers that don't fit in 64 bits are approximated by strtod()
+      sqlite3_int64 v;
+      if (!json_read_int64(p, (int)(q - p), &v))
+        *kind = JSON_READ_KIND_REAL;
+    }
+    return q;
+  }
+}
+
+typedef void (*json_read_member_fn)(void *ctx, const char *key, int nKey,
+                                    const char *value, int nValue, int kind,
+                                    int escaped);
+
+// walks the members of the object at p, calling fn for each one.
+// returns one past the closing brace, or NULL if it's malformed
+static const char *json_read_object(const char *p, const char *end,
+                                    json_read_member_fn fn, void *ctx) {
+  p = json_read_skip_space(p + 1, end);
+  if (p < end && *p == '}')
+    return p + 1;
+  for (;;) {
+    const char *key, *value;
+    int nKey, kind, escaped = 0, keyEscaped = 0;
+    if (p >= end || *p != '"')
+      return 0;
+    key = p + 1;
+    if (!(p = json_read_skip_string(p, end, &keyEscaped)))
+      return 0;
+    nKey = (int)(p - key) - 1;
+    p = json_read_skip_space(p, end);
+    if (p >= end || *p != ':')
+      return 0;
+    value = json_read_skip_space(p + 1, end);
+    if (!(p = json_read_skip_value(value, end, &kind, &escaped)))
+      return 0;
+    fn(ctx, key, nKey, value, (int)(p - value), kind, escaped);
+    p = json_read_skip_space(p, end);
+    if (p < end && *p == ',') {
+      p = json_read_skip_space(p + 1, end);
+      continue;
+    }
+    if (p < end && *p == '}')
+      return p + 1;
+    return 0;
+  }
+}
+
+static void json_read_put_utf8(char **out, unsigned c) {
+  char *z = *out;
+  if (c < 0x80) {
+    *z++ = c;
+  } else if (c < 0x800) {
+    *z++ = 0xc0 | (c >> 6);
+    *z++ = 0x80 | (c & 0x3f);
+  } else if (c < 0x10000) {
+    *z++ = 0xe0 | (c >> 12);
+    *z++ = 0x80 | ((c >> 6) & 0x3f);
+    *z++ = 0x80 | (c & 0x3f);
+  } else {
+    *z++ = 0xf0 | (c >> 18);
+    *z++ = 0x80 | ((c >> 12) & 0x3f);
+    *z++ = 0x80 | ((c >> 6) & 0x3f);
+    *z++ = 0x80 | (c & 0x3f);
+  }
+  *out = z;
+}
+
+static int json_read_hex4(const char *p, const char *end, unsigned *c) {
+  *c = 0;
+  if (end - p < 4)
+    return 0;
+  for (int i = 0; i < 4; i++) {
+    char x = p[i];
+    *c <<= 4;
+    if (x >= '0' && x <= '9')
+      *c |= x - '0';
+    else if (x >= 'a' && x <= 'f')
+      *c |= x - 'a' + 10;
+    else if (x >= 'A' && x <= 'F')
+      *c |= x - 'A' + 10;
+    else
+      return 0;
+  }
+  return 1;
+}
+
+// decodes the escapes in a string body into out, which must hold at
+// least end-p bytes, since no escape is shorter than what it decodes to
+static int json_read_unescape(const char *p, const char *end, char *out) {
+  char *z = out;
+  while (p < end) {
+    unsigned c, lo;
+    if (*p != '\\') {
+      *z++ = *p++;
+      continue;
+    }
+    if (++p >= end)
+      break;
+    switch (*p++) {
+    case 'b':
+      *z++ = '\b';
+      break;
+    case 'f':
+      *z++ = '\f';
+      break;
+    case 'n':
+      *z++ = '\n';
+      break;
+    case 'r':
+      *z++ = '\r';
+      break;
+    case 't':
+      *z++ = '\t';
+      break;
+    case 'u':
+      if (!json_read_hex4(p, end, &c))
+        return -1;
+      p += 4;
+      if (c >= 0xd800 && c < 0xdc00 && end - p >= 6 && p[0] == '\\' &&
+          p[1] == 'u' && json_read_hex4(p + 2, end, &lo) && lo >= 0xdc00 &&
+          lo < 0xe000) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+        p += 6;
+      }
+      json_read_put_utf8(&z, c);
+      break;
+    default:
+      *z++ = p[-1];
+      break;
+    }
+  }
+  return (int)(z - out);
+}
+
+#pragma endregion
+
+#pragma region json_lines_read() and json_array_read() virtual tables
+
+typedef struct json_read_column json_read_column;
+struct json_read_column {
+  char *zName;
+  int nName;
+  // bitmask of the JSON_READ_KIND_* seen in the sample
+  int kinds;
+};
+
+typedef struct json_read_vtab json_read_vtab;
+struct json_read_vtab {
+  sqlite3_vtab base; /* Base class - must be first */
+  char *zFilename;
+  int isArray;
+  int nColumn;
+  json_read_column *aColumn;
+};
+
+typedef struct json_read_value json_read_value;
+struct json_read_value {
+  const char *p;
+  int n;
+  char kind;
+  char escaped;
+};
+
+typedef struct json_read_cursor json_read_cursor;
+struct json_read_cursor {
+  sqlite3_vtab_cursor base; /* Base class - must be first */
+  char *data;
+  size_t size;
+  int mapped;
+  // where the next record starts, and where the data ends
+  const char *next;
+  const char *end;
+  int eof;
+  // column the next member is expected to land in, since records tend
+  // to list their keys in the same order
+  int predicted;
+  json_read_value *aValue;
+  sqlite3_int64 iRowid;
+};
+
+static int json_read_open_file(const char *path, char **pData, size_t *pSize,
+                               int *pMapped, char **pzErr) {
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    *pzErr = sqlite3_mprintf("Error reading %s: %s", path, strerror(errno));
+    return SQLITE_ERROR;
+  }
+  *pData = 0;
+  *pSize = 0;
+  *pMapped = 0;
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode)) {
+    if (st.st_size) {
+      void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        *pData = map;
+        *pSize = st.st_size;
+        *pMapped = 1;
+      }
+    }
+    if (*pMapped || !st.st_size) {
+      close(fd);
+      return SQLITE_OK;
+    }
+  }
+  // pipes and other things that can't be mapped get read into memory
+  size_t cap = 0;
+  for (;;) {
+    ssize_t got;
+    if (*pSize == cap) {
+      char *p2 = sqlite3_realloc64(*pData, cap ? cap * 2 : 65536);
+      if (!p2) {
+        sqlite3_free(*pData);
+        close(fd);
+        return SQLITE_NOMEM;
+      }
+      *pData = p2;
+      cap = cap ? cap * 2 : 65536;
+    }
+    got = read(fd, *pData + *pSize, cap - *pSize);
+    if (got < 0) {
+      if (errno == EINTR)
+        continue;
+      *pzErr = sqlite3_mprintf("Error reading %s: %s", path, strerror(errno));
+      sqlite3_free(*pData);
+      close(fd);
+      return SQLITE_ERROR;
+    }
+    if (!got)
+      break;
+    *pSize += got;
+  }
+  close(fd);
+  return SQLITE_OK;
+}
+
+static void json_read_close_file(char *data, size_t size, int mapped) {
+  if (mapped)
+    munmap(data, size);
+  else
+    sqlite3_free(data);
+}
+
+// positions *pp at the first record, skipping the opening bracket of an
+// array. returns 0 if the data isn't shaped like the table expects
+static int json_read_begin(int isArray, const char **pp, const char *end) {
+  const char *p = json_read_skip_space(*pp, end);
+  if (isArray) {
+    if (p >= end || *p != '[')
+      return 0;
+    p = json_read_skip_space(p + 1, end);
+  }
+  *pp = p;
+  return 1;
+}
+
+// advances past one record at *pp, returning its extent in *pStart and
+// *pEnd. returns 1 for a record, 0 at the end, and -1 on malformed input
+static int json_read_step(int isArray, const char **pp, const char *end,
+                          const char **pStart, const char **pEnd, int *kind,
+                          int *escaped) {
+  const char *p = json_read_skip_space(*pp, end);
+  if (p >= end)
+    return isArray ? -1 : 0;
+  if (isArray && *p == ']')
+    return 0;
+  *pStart = p;
+  if (!(p = json_read_skip_value(p, end, kind, escaped)))
+    return -1;
+  *pEnd = p;
+  p = json_read_skip_space(p, end);
+  if (isArray) {
+    if (p < end && *p == ',')
+      p++;
+    else if (p >= end || *p != ']')
+      return -1;
+  }
+  *pp = p;
+  return 1;
+}
+
+static int json_read_find_column(json_read_column *aColumn, int nColumn,
+                                 int predicted, const char *key, int nKey) {
+  if (predicted < nColumn && aColumn[predicted].nName == nKey &&
+      !sqlite3_strnicmp(aColumn[predicted].zName, key, nKey))
+    return predicted;
+  for (int i = 0; i < nColumn; i++)
+    if (aColumn[i].nName == nKey && !sqlite3_strnicmp(aColumn[i].zName, key, nKey))
+      return i;
+  return -1;
+}
+
+typedef struct json_read_sampler json_read_sampler;
+struct json_read_sampler {
+  json_read_vtab *pTab;
+  int nAlloc;
+  int predicted;
+  int oom;
+};
+
+static void json_read_sample_member(void *ctx, const char *key, int nKey,
+                                    const char *value, int nValue, int kind,
+                                    int escaped) {
+  json_read_sampler *s = ctx;
+  json_read_vtab *pTab = s->pTab;
+  int i;
+  i = json_read_find_column(pTab->aColumn, pTab->nColumn, s->predicted, key,
+                            nKey);
+  if (i < 0) {
+    if (pTab->nColumn == s->nAlloc) {
+      int n = s->nAlloc ? s->nAlloc * 2 : 16;
+      json_read_column *a =
+          sqlite3_realloc64(pTab->aColumn, n * sizeof(json_read_column));
+      if (!a) {
+        s->oom = 1;
+        return;
+      }
+      pTab->aColumn = a;
+      s->nAlloc = n;
+    }
+    i = pTab->nColumn;
+    pTab->aColumn[i].zName = sqlite3_mprintf("%.*s", nKey, key);
+    pTab->aColumn[i].nName = nKey;
+    pTab->aColumn[i].kinds = 0;
+    if (!pTab->aColumn[i].zName) {
+      s->oom = 1;
+      return;
+    }
+    pTab->nColumn++;
+  }
+  pTab->aColumn[i].kinds |= 1 << kind;
+  s->predicted = i + 1;
+}
+
+static const char *json_read_declared_type(int kinds) {
+  int integer = 1 << JSON_READ_KIND_INTEGER | 1 << JSON_READ_KIND_TRUE |
+                1 << JSON_READ_KIND_FALSE;
+  int real = integer | 1 << JSON_READ_KIND_REAL;
+  kinds &= ~(1 << JSON_READ_KIND_NULL);
+  if (!kinds)
+    return "";
+  if (!(kinds & ~integer))
+    return " INTEGER";
+  if (!(kinds & ~real))
+    return " REAL";
+  if (kinds == 1 << JSON_READ_KIND_TEXT)
+    return " TEXT";
+  return "";
+}
+
+static int json_read_sample(json_read_vtab *pTab, int nSample, char **pzErr) {
+  json_read_sampler sampler = {pTab, 0, 0, 0};
+  const char *p, *end, *start, *stop;
+  char *data;
+  size_t size;
+  int mapped, rc, kind, escaped;
+
+  rc = json_read_open_file(pTab->zFilename, &data, &size, &mapped, pzErr);
+  if (rc != SQLITE_OK)
+    return rc;
+  p = data;
+  end = data + size;
+  if (!json_read_begin(pTab->isArray, &p, end)) {
+    *pzErr = sqlite3_mprintf("%s: expected a JSON array", pTab->zFilename);
+    json_read_close_file(data, size, mapped);
+    return SQLITE_ERROR;
+  }
+  for (int n = 0; !nSample || n < nSample; n++) {
+    rc = json_read_step(pTab->isArray, &p, end, &start, &stop, &kind,
+                        &escaped);
+    if (rc < 0) {
+      *pzErr = sqlite3_mprintf("%s: malformed JSON in record %d",
+                               pTab->zFilename, n + 1);
+      break;
+    }
+    if (!rc)
+      break;
+    if (*start == '{') {
+      sampler.predicted = 0;
+      json_read_object(start, stop, json_read_sample_member, &sampler);
+      if (sampler.oom)
+        break;
+    }
+  }
+  json_read_close_file(data, size, mapped);
+  if (sampler.oom)
+    return SQLITE_NOMEM;
+  return rc < 0 ? SQLITE_ERROR : SQLITE_OK;
+}
+
+static void json_read_free_vtab(json_read_vtab *pTab) {
+  for (int i = 0; i < pTab->nColumn; i++)
+    sqlite3_free(pTab->aColumn[i].zName);
+  sqlite3_free(pTab->aColumn);
+  sqlite3_free(pTab->zFilename);
+  sqlite3_free(pTab);
+}
+
+static void json_read_dequote(char *z) {
+  int j;
+  char cQuote = z[0];
+  size_t i, n;
+
+  if (cQuote != '\'' && cQuote != '"')
+    return;
+  n = strlen(z);
+  if (n < 2 || z[n - 1] != z[0])
+    return;
+  for (i = 1, j = 0; i < n - 1; i++) {
+    if (z[i] == cQuote && z[i + 1] == cQuote)
+      i++;
+    z[j++] = z[i];
+  }
+  z[j] = 0;
+}
+
+// returns the text after `zTag=` in a virtual table argument, or NULL
+static const char *json_read_parameter(const char *zTag, const char *z) {
+  int nTag = strlen(zTag);
+  while (json_read_is_space(*z))
+    z++;
+  if (strncmp(zTag, z, nTag))
+    return 0;
+  z += nTag;
+  while (json_read_is_space(*z))
+    z++;
+  if (*z != '=')
+    return 0;
+  z++;
+  while (json_read_is_space(*z))
+    z++;
+  return z;
+}
+
+static int json_read_connect(sqlite3 *db, void *pAux, int argc,
+                             const char *const *argv, sqlite3_vtab **ppVtab,
+                             char **pzErr) {
+  json_read_vtab *pTab;
+  sqlite3_str *schema;
+  int nSample = JSON_READ_DEFAULT_SAMPLE;
+  int rc;
+
+  pTab = sqlite3_malloc(sizeof(*pTab));
+  if (!pTab)
+    return SQLITE_NOMEM;
+  memset(pTab, 0, sizeof(*pTab));
+  pTab->isArray = pAux != 0;
+
+  for (int i = 3; i < argc; i++) {
+    const char *z;
+    if ((z = json_read_parameter("filename", argv[i]))) {
+      if (pTab->zFilename) {
+        *pzErr = sqlite3_mprintf("more than one 'filename' parameter");
+        json_read_free_vtab(pTab);
+        return SQLITE_ERROR;
+      }
+      pTab->zFilename = sqlite3_mprintf("%s", z);
+      if (!pTab->zFilename) {
+        json_read_free_vtab(pTab);
+        return SQLITE_NOMEM;
+      }
+      json_read_dequote(pTab->zFilename);
+    } else if ((z = json_read_parameter("sample", argv[i]))) {
+      nSample = atoi(z);
+      if (nSample < 0) {
+        *pzErr = sqlite3_mprintf("sample must be 0 or more, got %d", nSample);
+        json_read_free_vtab(pTab);
+        return SQLITE_ERROR;
+      }
+    } else {
+      *pzErr = sqlite3_mprintf("bad parameter: '%s'", argv[i]);
+      json_read_free_vtab(pTab);
+      return SQLITE_ERROR;
+    }
+  }
+  if (!pTab->zFilename) {
+    *pzErr = sqlite3_mprintf("%s requires a filename= parameter", argv[0]);
+    json_read_free_vtab(pTab);
+    return SQLITE_ERROR;
+  }
+
+  rc = json_read_sample(pTab, nSample, pzErr);
+  if (rc != SQLITE_OK) {
+    json_read_free_vtab(pTab);
+    return rc;
+  }
+
+  schema = sqlite3_str_new(0);
+  sqlite3_str_appendall(schema, "CREATE TABLE x(");
+  if (!pTab->nColumn)
+    sqlite3_str_appendall(schema, "value");
+  for (int i = 0; i < pTab->nColumn; i++)
+    sqlite3_str_appendf(schema, "%s\"%w\"%s", i ? ", " : "",
+                        pTab->aColumn[i].zName,
+                        json_read_declared_type(pTab->aColumn[i].kinds));
+  sqlite3_str_appendall(schema, ")");
+  char *zSchema = sqlite3_str_finish(schema);
+  if (!zSchema) {
+    json_read_free_vtab(pTab);
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_declare_vtab(db, zSchema);
+  sqlite3_free(zSchema);
+  if (rc != SQLITE_OK) {
+    json_read_free_vtab(pTab);
+    return rc;
+  }
+  *ppVtab = &pTab->base;
+  return SQLITE_OK;
+}
+
+static int json_read_disconnect(sqlite3_vtab *pVtab) {
+  json_read_free_vtab((json_read_vtab *)pVtab);
+  return SQLITE_OK;
+}
+
+static int json_read_best_index(sqlite3_vtab *pVtab,
+                                sqlite3_index_info *pIdxInfo) {
+  pIdxInfo->estimatedCost = 1000000;
+  return SQLITE_OK;
+}
+
+static int json_read_open(sqlite3_vtab *pVtab,
+                          sqlite3_vtab_cursor **ppCursor) {
+  json_read_vtab *pTab = (json_read_vtab *)pVtab;
+  json_read_cursor *pCur;
+  int nValue = pTab->nColumn ? pTab->nColumn : 1;
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if (!pCur)
+    return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  pCur->aValue = sqlite3_malloc64(nValue * sizeof(json_read_value));
+  if (!pCur->aValue) {
+    sqlite3_free(pCur);
+    return SQLITE_NOMEM;
+  }
+  pCur->eof = 1;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static void json_read_cursor_reset(json_read_cursor *pCur) {
+  if (pCur->data)
+    json_read_close_file(pCur->data, pCur->size, pCur->mapped);
+  pCur->data = 0;
+  pCur->size = 0;
+  pCur->eof = 1;
+}
+
+static int json_read_close(sqlite3_vtab_cursor *cur) {
+  json_read_cursor *pCur = (json_read_cursor *)cur;
+  json_read_cursor_reset(pCur);
+  sqlite3_free(pCur->aValue);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+static void json_read_record_member(void *ctx, const char *key, int nKey,
+                                    const char *value, int nValue, int kind,
+                                    int escaped) {
+  json_read_cursor *pCur = ctx;
+  json_read_vtab *pTab = (json_read_vtab *)pCur->base.pVtab;
+  int i;
+  i = json_read_find_column(pTab->aColumn, pTab->nColumn, pCur->predicted, key,
+                            nKey);
+  // keys that first show up after the sample have nowhere to go
+  if (i < 0)
+    return;
+  pCur->aValue[i].p = value;
+  pCur->aValue[i].n = nValue;
+  pCur->aValue[i].kind = kind;
+  pCur->aValue[i].escaped = escaped;
+  pCur->predicted = i + 1;
+}
+
+static int json_read_next(sqlite3_vtab_cursor *cur) {
+  json_read_cursor *pCur = (json_read_cursor *)cur;
+  json_read_vtab *pTab = (json_read_vtab *)cur->pVtab;
+  const char *start, *stop;
+  int rc, kind, escaped = 0;
+
+  rc = json_read_step(pTab->isArray, &pCur->next, pCur->end, &start, &stop,
+                      &kind, &escaped);
+  if (rc < 0) {
+    sqlite3_free(pTab->base.zErrMsg);
+    pTab->base.zErrMsg = sqlite3_mprintf("%s: malformed JSON in record %lld",
+                                         pTab->zFilename, pCur->iRowid + 1);
+    return SQLITE_ERROR;
+  }
+  if (!rc) {
+    pCur->eof = 1;
+    return SQLITE_OK;
+  }
+  pCur->iRowid++;
+  if (!pTab->nColumn) {
+    pCur->aValue[0].p = start;
+    pCur->aValue[0].n = (int)(stop - start);
+    pCur->aValue[0].kind = kind;
+    pCur->aValue[0].escaped = escaped;
+    return SQLITE_OK;
+  }
+  for (int i = 0; i < pTab->nColumn; i++)
+    pCur->aValue[i].kind = JSON_READ_KIND_NULL;
+  if (*start == '{') {
+    pCur->predicted = 0;
+    if (!json_read_object(start, stop, json_read_record_member, pCur)) {
+      sqlite3_free(pTab->base.zErrMsg);
+      pTab->base.zErrMsg = sqlite3_mprintf(
+          "%s: malformed JSON in record %lld", pTab->zFilename, pCur->iRowid);
+      return SQLITE_ERROR;
+    }
+  }
+  return SQLITE_OK;
+}
+
+static int json_read_filter(sqlite3_vtab_cursor *cur, int idxNum,
+                            const char *idxStr, int argc,
+                            sqlite3_value **argv) {
+  json_read_cursor *pCur = (json_read_cursor *)cur;
+  json_read_vtab *pTab = (json_read_vtab *)cur->pVtab;
+  int rc;
+
+  json_read_cursor_reset(pCur);
+  sqlite3_free(pTab->base.zErrMsg);
+  pTab->base.zErrMsg = 0;
+  rc = json_read_open_file(pTab->zFilename, &pCur->data, &pCur->size,
+                           &pCur->mapped, &pTab->base.zErrMsg);
+  if (rc != SQLITE_OK)
+    return rc;
+  pCur->next = pCur->data;
+  pCur->end = pCur->data + pCur->size;
+  pCur->iRowid = 0;
+  pCur->eof = 0;
+  if (!json_read_begin(pTab->isArray, &pCur->next, pCur->end)) {
+    sqlite3_free(pTab->base.zErrMsg);
+    pTab->base.zErrMsg =
+        sqlite3_mprintf("%s: expected a JSON array", pTab->zFilename);
+    return SQLITE_ERROR;
+  }
+  return json_read_next(cur);
+}
+
+static int json_read_eof(sqlite3_vtab_cursor *cur) {
+  return ((json_read_cursor *)cur)->eof;
+}
+
+static int json_read_column_value(sqlite3_vtab_cursor *cur,
+                                  sqlite3_context *context, int i) {
+  json_read_cursor *pCur = (json_read_cursor *)cur;
+  json_read_value *v = &pCur->aValue[i];
+  char buf[32];
+  switch (v->kind) {
+  case JSON_READ_KIND_NULL:
+    break;
+  case JSON_READ_KIND_TRUE:
+    sqlite3_result_int(context, 1);
+    break;
+  case JSON_READ_KIND_FALSE:
+    sqlite3_result_int(context, 0);
+    break;
+  case JSON_READ_KIND_INTEGER: {
+    sqlite3_int64 n = 0;
+    json_read_int64(v->p, v->n, &n);
+    sqlite3_result_int64(context, n);
+    break;
+  }
+  case JSON_READ_KIND_REAL: {
+    char *z = v->n < (int)sizeof(buf) ? buf : sqlite3_malloc(v->n + 1);
+    if (!z) {
+      sqlite3_result_error_nomem(context);
+      break;
+    }
+    memcpy(z, v->p, v->n);
+    z[v->n] = 0;
+    sqlite3_result_double(context, strtod(z, 0));
+    if (z != buf)
+      sqlite3_free(z);
+    break;
+  }
+  case JSON_READ_KIND_TEXT: {
+    if (!v->escaped) {
+      sqlite3_result_text(context, v->p + 1, v->n - 2, SQLITE_TRANSIENT);
+      break;
+    }
+    char *z = sqlite3_malloc(v->n);
+    if (!z) {
+      sqlite3_result_error_nomem(context);
+      break;
+    }
+    int n = json_read_unescape(v->p + 1, v->p + v->n - 1, z);
+    if (n < 0) {
+      sqlite3_free(z);
+      sqlite3_result_error(context, "malformed JSON string escape", -1);
+      break;
+    }
+    sqlite3_result_text(context, z, n, sqlite3_free);
+    break;
+  }
+  case JSON_READ_KIND_NESTED:
+    sqlite3_result_text(context, v->p, v->n, SQLITE_TRANSIENT);
+    break;
+  }
+  return SQLITE_OK;
+}
+
+static int json_read_rowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
+  *pRowid = ((json_read_cursor *)cur)->iRowid;
+  return SQLITE_OK;
+}
+
+static sqlite3_module jsonReadModule = {
+    0,                      /* iVersion */
+    json_read_connect,      /* xCreate */
+    json_read_connect,      /* xConnect */
+    json_read_best_index,   /* xBestIndex */
+    json_read_disconnect,   /* xDisconnect */
+    json_read_disconnect,   /* xDestroy */
+    json_read_open,         /* xOpen - open a cursor */
+    json_read_close,        /* xClose - close a cursor */
+    json_read_filter,       /* xFilter - configure scan constraints */
+    json_read_next,         /* xNext - advance a cursor */
+    json_read_eof,          /* xEof - check for end of scan */
+    json_read_column_value, /* xColumn - read data */
+    json_read_rowid,        /* xRowid - read data */
+    0,                      /* xUpdate */
+    0,                      /* xBegin */
+    0,                      /* xSync */
+    0,                      /* xCommit */
+    0,                      /* xRollback */
+    0,                      /* xFindMethod */
+    0,                      /* xRename */
+    0,                      /* xSavepoint */
+    0,                      /* xRelease */
+    0,                      /* xRollbackTo */
+    0                       /* xShadowName */
+};
+
+#pragma endregion
+
+#pragma region entry points
+
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int sqlite3_json_read_init(sqlite3 *db, char **pzErrMsg,
+                           const sqlite3_api_routines *pApi) {
+  int rc;
+  //SQLITE_EXTENSION_INIT2(pApi);
+  rc = sqlite3_create_module(db, "json_lines_read", &jsonReadModule, 0);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_module(db, "json_array_read", &jsonReadModule,
+                               (void *)1);
+  return rc;
+}
+
+#pragma endregion
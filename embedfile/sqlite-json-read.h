@@ -0,0 +1,15 @@
+#include "third_party/sqlite/sqlite3.h"
+//#include "sqlite3ext.h"
+
+#define SQLITE_JSON_READ_VERSION "v0.0.1"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sqlite3_json_read_init(sqlite3 *db, char **pzErrMsg,
+                           const sqlite3_api_routines *pApi);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,6 +2,7 @@
 #include "llama.cpp/llama.h"
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -15,6 +16,8 @@
 #endif
 
 #define SQLITE_VEC_FLOAT32_SUBTYPE 223
+#define SQLITE_VEC_BIT_SUBTYPE     224
+#define SQLITE_VEC_INT8_SUBTYPE    225
 
 void dummy_log(enum ggml_log_level level, const char *text, void *user_data) {}
 
@@ -31,22 +34,31 @@ static void normalize(float *vec, float *out, int n) {
 
 #define LEMBED_TOKEN_SUBTYPE 116 // ascii 't'
 
-int tokenize(struct llama_model *model, const char *input, size_t input_length,
-             int *token_count, llama_token **tokens) {
-  int input_token_count_estimate =
-      llama_tokenize(model, input, input_length, NULL, 0, true, true);
-  if (input_token_count_estimate >= 0) {
-    return SQLITE_ERROR;
-  }
-  *tokens =
-      sqlite3_malloc(sizeof(llama_token) * abs(input_token_count_estimate));
+// Tokenizes input, with the special tokens the model wraps every input
+// in when add_special is set. The tokens are freed with sqlite3_free().
+static int lembed_tokenize(struct llama_model *model, const char *input,
+                           size_t input_length, bool add_special,
+                           int *token_count, llama_token **tokens) {
+  // tokens rarely outnumber bytes, so one pass is almost always enough
+  int capacity = input_length + 8;
+  *tokens = sqlite3_malloc(sizeof(llama_token) * capacity);
   if (!(*tokens)) {
     return SQLITE_NOMEM;
   }
   int input_token_count =
-      llama_tokenize(model, input, input_length, *tokens,
-                     abs(input_token_count_estimate), true, true);
-  if (input_token_count != abs(input_token_count_estimate)) {
+      llama_tokenize(model, input, input_length, *tokens, capacity, add_special, true);
+  if (input_token_count < 0) {
+    capacity = -input_token_count;
+    llama_token *z = sqlite3_realloc(*tokens, sizeof(llama_token) * capacity);
+    if (!z) {
+      sqlite3_free(*tokens);
+      return SQLITE_NOMEM;
+    }
+    *tokens = z;
+    input_token_count =
+        llama_tokenize(model, input, input_length, *tokens, capacity, add_special, true);
+  }
+  if (input_token_count <= 0) {
     sqlite3_free(*tokens);
     return SQLITE_ERROR;
   }
@@ -55,6 +67,19 @@ int tokenize(struct llama_model *model, const char *input, size_t input_length,
   return SQLITE_OK;
 }
 
+int tokenize(struct llama_model *model, const char *input, size_t input_length,
+             int *token_count, llama_token **tokens) {
+  return lembed_tokenize(model, input, input_length, true, token_count, tokens);
+}
+
+
+// how many tokens a packed batch can hold: an encoder needs the whole
+// batch in one ubatch, and n_ctx may be padded past the n_ubatch asked for
+static uint32_t lembed_batch_capacity(struct llama_context *context) {
+  uint32_t n_ctx = llama_n_ctx(context);
+  uint32_t n_ubatch = llama_n_ubatch(context);
+  return n_ubatch < n_ctx ? n_ubatch : n_ctx;
+}
 
 int embed_single(struct llama_context *context,
                  const char *input, size_t input_length,
@@ -134,13 +159,407 @@ int embed_single(struct llama_context *context,
   return SQLITE_OK;
 }
 
+enum lembed_element_type {
+  LEMBED_ELEMENT_TYPE_FLOAT32,
+  LEMBED_ELEMENT_TYPE_INT8,
+  LEMBED_ELEMENT_TYPE_BIT,
+};
+
+#pragma region model registry
+
+// Weights are loaded once per process, on whichever thread registers
+// them first, or ahead of time by sqlite3_lembed_preload(). Every connection that registers
+// the same file with the same model options shares one llama_model, and
+// each shared model keeps a pool of idle contexts. lembed() and
+// lembed_batch check a context out for as long as they decode, so any
+// number of connections and threads can embed at once without loading
+// the weights again or sharing a KV cache.
+
+typedef struct lembed_pooled_context lembed_pooled_context;
+struct lembed_pooled_context {
+  struct llama_context *context;
+  struct llama_context_params cparams;
+  uint64_t memory;
+  lembed_pooled_context *next;
+};
+
+typedef struct lembed_shared_model lembed_shared_model;
+struct lembed_shared_model {
+  char *path;
+  int32_t n_gpu_layers;
+  struct llama_model *model;
+  // set while some thread is still reading the weights
+  int loading;
+  int refs;
+  // contexts alive for this model, whether idle or checked out
+  int contexts;
+  uint64_t context_memory;
+  lembed_pooled_context *idle;
+  lembed_shared_model *next;
+};
+
+static pthread_mutex_t lembed_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lembed_registry_loaded = PTHREAD_COND_INITIALIZER;
+static lembed_shared_model *lembed_registry;
+
+static void lembed_registry_release(lembed_shared_model *m);
+
+// Takes a reference on the registry entry for a model, adding one if
+// it's not there. Sets *must_load when the caller is the one who has to
+// read the weights, in which case it must call lembed_registry_wait().
+static lembed_shared_model *
+lembed_registry_reserve(const char *path,
+                        const struct llama_model_params *mparams,
+                        int *must_load) {
+  lembed_shared_model *m;
+  *must_load = 0;
+  pthread_mutex_lock(&lembed_registry_lock);
+  for (m = lembed_registry; m; m = m->next) {
+    if ((m->loading || m->model) && strcmp(m->path, path) == 0 &&
+        m->n_gpu_layers == mparams->n_gpu_layers) {
+      m->refs++;
+      break;
+    }
+  }
+  if (!m && (m = sqlite3_malloc(sizeof(*m)))) {
+    memset(m, 0, sizeof(*m));
+    if ((m->path = sqlite3_mprintf("%s", path))) {
+      m->n_gpu_layers = mparams->n_gpu_layers;
+      m->loading = 1;
+      m->refs = 1;
+      m->next = lembed_registry;
+      lembed_registry = m;
+      *must_load = 1;
+    } else {
+      sqlite3_free(m);
+      m = NULL;
+    }
+  }
+  pthread_mutex_unlock(&lembed_registry_lock);
+  return m;
+}
+
+// Loads the weights of a reserved entry, or waits for whoever is loading
+// them. Drops the reference and returns NULL if the load failed.
+static lembed_shared_model *
+lembed_registry_wait(lembed_shared_model *m,
+                     const struct llama_model_params *mparams, int must_load) {
+  if (must_load) {
+    struct llama_model *model = llama_load_model_from_file(m->path, *mparams);
+    pthread_mutex_lock(&lembed_registry_lock);
+    m->model = model;
+    m->loading = 0;
+    pthread_cond_broadcast(&lembed_registry_loaded);
+  } else {
+    pthread_mutex_lock(&lembed_registry_lock);
+    while (m->loading)
+      pthread_cond_wait(&lembed_registry_loaded, &lembed_registry_lock);
+  }
+  pthread_mutex_unlock(&lembed_registry_lock);
+  if (!m->model) {
+    lembed_registry_release(m);
+    return NULL;
+  }
+  return m;
+}
+
+static lembed_shared_model *
+lembed_registry_acquire(const char *path,
+                        const struct llama_model_params *mparams) {
+  int must_load;
+  lembed_shared_model *m = lembed_registry_reserve(path, mparams, &must_load);
+  return m ? lembed_registry_wait(m, mparams, must_load) : NULL;
+}
+
+static void lembed_registry_release(lembed_shared_model *m) {
+  pthread_mutex_lock(&lembed_registry_lock);
+  if (--m->refs) {
+    pthread_mutex_unlock(&lembed_registry_lock);
+    return;
+  }
+  for (lembed_shared_model **pp = &lembed_registry; *pp; pp = &(*pp)->next) {
+    if (*pp == m) {
+      *pp = m->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&lembed_registry_lock);
+  while (m->idle) {
+    lembed_pooled_context *c = m->idle;
+    m->idle = c->next;
+    llama_free(c->context);
+    sqlite3_free(c);
+  }
+  if (m->model)
+    llama_free_model(m->model);
+  sqlite3_free(m->path);
+  sqlite3_free(m);
+}
+
+static int lembed_cparams_equal(const struct llama_context_params *a,
+                                const struct llama_context_params *b) {
+  return a->seed == b->seed && a->n_ctx == b->n_ctx &&
+         a->rope_scaling_type == b->rope_scaling_type &&
+         a->rope_freq_scale == b->rope_freq_scale &&
+         a->n_batch == b->n_batch && a->n_ubatch == b->n_ubatch &&
+         a->n_threads == b->n_threads &&
+         a->n_threads_batch == b->n_threads_batch &&
+         a->embeddings == b->embeddings;
+}
+
+// Checks out an idle context created with the same parameters, or makes
+// a new one. Returns NULL if the context couldn't be created.
+static lembed_pooled_context *
+lembed_context_acquire(lembed_shared_model *m,
+                       const struct llama_context_params *cparams) {
+  pthread_mutex_lock(&lembed_registry_lock);
+  for (lembed_pooled_context **pp = &m->idle; *pp; pp = &(*pp)->next) {
+    if (lembed_cparams_equal(&(*pp)->cparams, cparams)) {
+      lembed_pooled_context *c = *pp;
+      *pp = c->next;
+      pthread_mutex_unlock(&lembed_registry_lock);
+      return c;
+    }
+  }
+  pthread_mutex_unlock(&lembed_registry_lock);
+
+  lembed_pooled_context *c = sqlite3_malloc(sizeof(*c));
+  if (!c)
+    return NULL;
+  c->cparams = *cparams;
+  c->context = llama_new_context_with_model(m->model, *cparams);
+  if (!c->context) {
+    sqlite3_free(c);
+    return NULL;
+  }
+  c->memory = llama_context_size(c->context);
+  c->next = NULL;
+  pthread_mutex_lock(&lembed_registry_lock);
+  m->contexts++;
+  m->context_memory += c->memory;
+  pthread_mutex_unlock(&lembed_registry_lock);
+  return c;
+}
+
+static void lembed_context_release(lembed_shared_model *m,
+                                   lembed_pooled_context *c) {
+  pthread_mutex_lock(&lembed_registry_lock);
+  c->next = m->idle;
+  m->idle = c;
+  pthread_mutex_unlock(&lembed_registry_lock);
+}
+
+typedef struct lembed_preload lembed_preload;
+struct lembed_preload {
+  lembed_shared_model *model;
+  struct llama_model_params mparams;
+};
+
+static void *lembed_preload_worker(void *arg) {
+  lembed_preload *p = arg;
+  // the reference is kept, so the weights outlive the connections
+  // that were opened while they loaded
+  lembed_registry_wait(p->model, &p->mparams, 1);
+  sqlite3_free(p);
+  return NULL;
+}
+
+int sqlite3_lembed_preload(const char *path) {
+  llama_backend_init();
+  llama_log_set(dummy_log, NULL);
+  lembed_preload *p = sqlite3_malloc(sizeof(*p));
+  if (!p)
+    return SQLITE_NOMEM;
+  p->mparams = llama_model_default_params();
+  int must_load;
+  p->model = lembed_registry_reserve(path, &p->mparams, &must_load);
+  if (!p->model) {
+    sqlite3_free(p);
+    return SQLITE_NOMEM;
+  }
+  if (!must_load) {
+    // already loaded or loading, so keep the existing reference
+    sqlite3_free(p);
+    return SQLITE_OK;
+  }
+  pthread_t th;
+  if (pthread_create(&th, NULL, lembed_preload_worker, p)) {
+    lembed_registry_wait(p->model, &p->mparams, 1);
+    sqlite3_free(p);
+    return SQLITE_OK;
+  }
+  pthread_detach(th);
+  return SQLITE_OK;
+}
+
+#pragma endregion
+
 typedef struct ApiModel ApiModel;
 struct ApiModel {
   char *name;
+  lembed_shared_model *shared;
   struct llama_model *model;
-  struct llama_context *context;
+  struct llama_context_params cparams;
+  uint32_t n_ctx;
+  // most tokens one packed batch can hold, see lembed_batch_capacity()
+  uint32_t n_batch;
+  enum llama_pooling_type pooling_type;
+  // leading dimensions kept from each embedding, at most llama_n_embd()
+  int dimensions;
+  enum lembed_element_type element_type;
+  // recently embedded inputs, see lembed_cache_get()
+  struct lembed_cache_entry *cache;
+  uint64_t cache_tick;
 };
 
+#pragma region embedding cache
+
+// Search traffic repeats the same few queries, so lembed() remembers the
+// embeddings of the last LEMBED_CACHE_SIZE distinct inputs per model and
+// skips tokenizing and decoding them again. Entries are found by a
+// linear scan of hashes, which costs nothing next to a decode, and the
+// least recently used one is replaced when the cache is full.
+
+#define LEMBED_CACHE_SIZE 256
+
+struct lembed_cache_entry {
+  uint64_t hash;
+  uint64_t used;
+  char *input;
+  int input_len;
+  float *embedding;
+};
+
+static uint64_t lembed_cache_hash(const char *p, int n) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < n; i++) {
+    h ^= (unsigned char)p[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+// Returns a copy of the cached embedding for input, or NULL.
+static float *lembed_cache_get(ApiModel *m, const char *input, int input_len) {
+  if (!m->cache)
+    return NULL;
+  uint64_t hash = lembed_cache_hash(input, input_len);
+  for (int i = 0; i < LEMBED_CACHE_SIZE; i++) {
+    struct lembed_cache_entry *e = &m->cache[i];
+    if (e->input && e->hash == hash && e->input_len == input_len &&
+        !memcmp(e->input, input, input_len)) {
+      float *copy = sqlite3_malloc(sizeof(float) * m->dimensions);
+      if (!copy)
+        return NULL;
+      memcpy(copy, e->embedding, sizeof(float) * m->dimensions);
+      e->used = ++m->cache_tick;
+      return copy;
+    }
+  }
+  return NULL;
+}
+
+static void lembed_cache_put(ApiModel *m, const char *input, int input_len,
+                             const float *embedding) {
+  if (!m->cache) {
+    m->cache = sqlite3_malloc(sizeof(*m->cache) * LEMBED_CACHE_SIZE);
+    if (!m->cache)
+      return;
+    memset(m->cache, 0, sizeof(*m->cache) * LEMBED_CACHE_SIZE);
+  }
+  struct lembed_cache_entry *e = &m->cache[0];
+  for (int i = 1; i < LEMBED_CACHE_SIZE && e->input; i++) {
+    if (!m->cache[i].input || m->cache[i].used < e->used)
+      e = &m->cache[i];
+  }
+  char *copy = sqlite3_malloc(input_len + 1);
+  float *embedding_copy = sqlite3_malloc(sizeof(float) * m->dimensions);
+  if (!copy || !embedding_copy) {
+    sqlite3_free(copy);
+    sqlite3_free(embedding_copy);
+    return;
+  }
+  memcpy(copy, input, input_len);
+  memcpy(embedding_copy, embedding, sizeof(float) * m->dimensions);
+  sqlite3_free(e->input);
+  sqlite3_free(e->embedding);
+  e->hash = lembed_cache_hash(input, input_len);
+  e->used = ++m->cache_tick;
+  e->input = copy;
+  e->input_len = input_len;
+  e->embedding = embedding_copy;
+}
+
+static void lembed_cache_free(ApiModel *m) {
+  if (!m->cache)
+    return;
+  for (int i = 0; i < LEMBED_CACHE_SIZE; i++) {
+    sqlite3_free(m->cache[i].input);
+    sqlite3_free(m->cache[i].embedding);
+  }
+  sqlite3_free(m->cache);
+  m->cache = NULL;
+}
+
+#pragma endregion
+
+static const char *lembed_element_type_name(enum lembed_element_type t) {
+  switch (t) {
+  case LEMBED_ELEMENT_TYPE_INT8:
+    return "int8";
+  case LEMBED_ELEMENT_TYPE_BIT:
+    return "bit";
+  default:
+    return "float32";
+  }
+}
+
+// Returns an embedding as the vector type its model was registered to
+// produce. Matryoshka models such as nomic-embed-text-v1.5 are trained
+// so a prefix of the embedding is itself a good embedding, once it gets
+// normalized again. int8 maps the normalized [-1,1] range to [-127,127]
+// and bit keeps the sign of each dimension, like vec_quantize_binary().
+// The embedding is modified in place.
+static void lembed_result_embedding(sqlite3_context *context, ApiModel *m,
+                                    float *embedding) {
+  int n = m->dimensions;
+  normalize(embedding, embedding, n);
+  switch (m->element_type) {
+  case LEMBED_ELEMENT_TYPE_INT8: {
+    int8_t *out = sqlite3_malloc(n);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    for (int i = 0; i < n; i++) {
+      float x = roundf(embedding[i] * 127);
+      out[i] = x > 127 ? 127 : x < -127 ? -127 : x;
+    }
+    sqlite3_result_blob(context, out, n, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_INT8_SUBTYPE);
+    break;
+  }
+  case LEMBED_ELEMENT_TYPE_BIT: {
+    uint8_t *out = sqlite3_malloc(n / 8);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    memset(out, 0, n / 8);
+    for (int i = 0; i < n; i++) {
+      out[i / 8] |= (embedding[i] > 0) << (i % 8);
+    }
+    sqlite3_result_blob(context, out, n / 8, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_BIT_SUBTYPE);
+    break;
+  }
+  default:
+    sqlite3_result_blob(context, embedding, sizeof(float) * n, SQLITE_TRANSIENT);
+    sqlite3_result_subtype(context, SQLITE_VEC_FLOAT32_SUBTYPE);
+    break;
+  }
+}
+
 #define MAX_MODELS 16
 struct Api {
   int default_index;
@@ -149,6 +568,14 @@ struct Api {
 
 void api_free(void *p) {
   struct Api *a = (struct Api *)p;
+  for (int i = 0; i < MAX_MODELS; i++) {
+    if (!a->models[i].name)
+      continue;
+    if (a->models[i].shared)
+      lembed_registry_release(a->models[i].shared);
+    lembed_cache_free(&a->models[i]);
+    sqlite3_free(a->models[i].name);
+  }
   llama_backend_free();
   sqlite3_free(a);
 }
@@ -165,7 +592,7 @@ static char *POINTER_NAME_MODEL_OPTIONS = "lembed_model_options";
 static void lembed_model_options_(sqlite3_context *context, int argc,
                                   sqlite3_value **argv) {
 
-  if(argc % 2 == 0) {
+  if(argc % 2 != 0) {
     sqlite3_result_error(context, "an even number of arguments are required in lembed_model_options, key-value pairs", -1);
     return;
   }
@@ -207,14 +634,17 @@ struct lembed_context_options {
   uint32_t n_ctx;
   enum llama_rope_scaling_type rope_scaling_type;
   float rope_freq_scale;
+  uint32_t dimensions;
+  enum lembed_element_type element_type;
+  uint32_t n_threads;
 
-  int8_t defined[4];
+  int8_t defined[7];
 };
 static char *POINTER_NAME_CONTEXT_OPTIONS = "lembed_context_options";
 
 static void lembed_context_options_(sqlite3_context *context, int argc,
                                     sqlite3_value **argv) {
-  if(argc % 2 == 0) {
+  if(argc % 2 != 0) {
     sqlite3_result_error(context, "an even number of arguments are required in lembed_context_options, key-value pairs", -1);
     return;
   }
@@ -269,6 +699,38 @@ static void lembed_context_options_(sqlite3_context *context, int argc,
     } else if (sqlite3_stricmp(k, "rope_freq_scale") == 0) {
       o->rope_freq_scale = sqlite3_value_double(value);
       o->defined[3] = 1;
+    } else if (sqlite3_stricmp(k, "dimensions") == 0) {
+      sqlite3_int64 v = sqlite3_value_int64(value);
+      if(v <= 0) {
+        sqlite3_result_error(context, "Expected positive value for dimensions", -1);
+        sqlite3_free(o);
+        return;
+      }
+      o->dimensions = v;
+      o->defined[4] = 1;
+    } else if (sqlite3_stricmp(k, "quantize") == 0) {
+      const char *v = (const char *)sqlite3_value_text(value);
+      if (v && sqlite3_stricmp(v, "none") == 0) {
+        o->element_type = LEMBED_ELEMENT_TYPE_FLOAT32;
+      } else if (v && sqlite3_stricmp(v, "int8") == 0) {
+        o->element_type = LEMBED_ELEMENT_TYPE_INT8;
+      } else if (v && sqlite3_stricmp(v, "bit") == 0) {
+        o->element_type = LEMBED_ELEMENT_TYPE_BIT;
+      } else {
+        sqlite3_result_error(context, "Expected none, int8, or bit for quantize", -1);
+        sqlite3_free(o);
+        return;
+      }
+      o->defined[5] = 1;
+    } else if (sqlite3_stricmp("n_threads", k) == 0) {
+      sqlite3_int64 v = sqlite3_value_int64(value);
+      if(v <= 0) {
+        sqlite3_result_error(context, "Expected positive value for n_threads", -1);
+        sqlite3_free(o);
+        return;
+      }
+      o->n_threads = v;
+      o->defined[6] = 1;
     } else {
       abort();
     }
@@ -294,43 +756,47 @@ static void _static_text_func(sqlite3_context *context, int argc,
   sqlite3_result_text(context, sqlite3_user_data(context), -1, SQLITE_STATIC);
 }
 
-int api_model_from_name(struct Api *api, const char *name, int name_length,
-                        struct llama_model **model,
-                        struct llama_context **context) {
+ApiModel *api_model_find(struct Api *api, const char *name, int name_length) {
   for (int i = 0; i < MAX_MODELS; i++) {
-    if (!api->models[i].name)
+    // a model is only usable once lembed_modelsUpdate() has loaded it
+    if (!api->models[i].name || !api->models[i].shared)
       continue;
     if (strncmp(api->models[i].name, name, name_length) == 0) {
-      *model = api->models[i].model;
-      if (context)
-        *context = api->models[i].context;
-      return SQLITE_OK;
+      return &api->models[i];
     }
   }
-  return SQLITE_ERROR;
+  return NULL;
+}
+
+int api_model_from_name(struct Api *api, const char *name, int name_length,
+                        struct llama_model **model) {
+  ApiModel *m = api_model_find(api, name, name_length);
+  if (!m)
+    return SQLITE_ERROR;
+  *model = m->model;
+  return SQLITE_OK;
 }
 static void lembed(sqlite3_context *context, int argc, sqlite3_value **argv) {
-  struct llama_model *model;
-  struct llama_context *ctx;
+  ApiModel *m;
   int rc;
   const char * input;
   sqlite3_int64 input_len;
   if(argc == 1) {
     input = (const char *)sqlite3_value_text(argv[0]);
     input_len = sqlite3_value_bytes(argv[0]);
-    rc = api_model_from_name((struct Api *)sqlite3_user_data(context), "default", strlen("default"), &model, &ctx);
-    if(rc != SQLITE_OK) {
+    m = api_model_find((struct Api *)sqlite3_user_data(context), "default", strlen("default"));
+    if(!m) {
       sqlite3_result_error(context, "No default model has been registered yet with lembed_models", -1);
       return;
     }
   }else {
     input = (const char *)sqlite3_value_text(argv[1]);
     input_len = sqlite3_value_bytes(argv[1]);
-    rc = api_model_from_name((struct Api *)sqlite3_user_data(context),
-                               (const char *)sqlite3_value_text(argv[0]),
-                               sqlite3_value_bytes(argv[0]), &model, &ctx);
+    m = api_model_find((struct Api *)sqlite3_user_data(context),
+                       (const char *)sqlite3_value_text(argv[0]),
+                       sqlite3_value_bytes(argv[0]));
 
-    if(rc != SQLITE_OK) {
+    if(!m) {
       char * zSql = sqlite3_mprintf("Unknown model name '%s'. Was it registered with lembed_models?", sqlite3_value_text(argv[0]));
       sqlite3_result_error(context, zSql, -1);
       sqlite3_free(zSql);
@@ -341,27 +807,38 @@ static void lembed(sqlite3_context *context, int argc, sqlite3_value **argv) {
   int dimensions;
   float *embedding;
   char * errmsg;
-  rc = embed_single(ctx, input, input_len, &embedding, &dimensions, &errmsg);
+  if((embedding = lembed_cache_get(m, input, input_len))) {
+    lembed_result_embedding(context, m, embedding);
+    sqlite3_free(embedding);
+    return;
+  }
+  lembed_pooled_context *c = lembed_context_acquire(m->shared, &m->cparams);
+  if(!c) {
+    sqlite3_result_error(context, "Could not create a context for the model", -1);
+    return;
+  }
+  rc = embed_single(c->context, input, input_len, &embedding, &dimensions, &errmsg);
+  lembed_context_release(m->shared, c);
   if(rc != SQLITE_OK) {
     sqlite3_result_error(context, sqlite3_mprintf("Error generating embedding: %z", errmsg), -1);
     return;
   }
-  sqlite3_result_blob(context, embedding, sizeof(float) * dimensions, sqlite3_free);
-  sqlite3_result_subtype(context, SQLITE_VEC_FLOAT32_SUBTYPE);
+  lembed_result_embedding(context, m, embedding);
+  lembed_cache_put(m, input, input_len, embedding);
+  sqlite3_free(embedding);
 }
 
 static void lembed_tokenize_json(sqlite3_context *context, int argc,
                                  sqlite3_value **argv) {
   int rc;
   struct llama_model *model;
-  struct llama_context *ctx;
   const char *input;
   sqlite3_int64 input_len;
 
   if(argc == 1) {
     input = (const char *)sqlite3_value_text(argv[0]);
     input_len = sqlite3_value_bytes(argv[0]);
-    rc = api_model_from_name((struct Api *)sqlite3_user_data(context), "default", strlen("default"), &model, &ctx);
+    rc = api_model_from_name((struct Api *)sqlite3_user_data(context), "default", strlen("default"), &model);
     if(rc != SQLITE_OK) {
       sqlite3_result_error(context, "No default model has been registered yet with lembed_models", -1);
       return;
@@ -371,7 +848,7 @@ static void lembed_tokenize_json(sqlite3_context *context, int argc,
     input_len = sqlite3_value_bytes(argv[1]);
     rc = api_model_from_name((struct Api *)sqlite3_user_data(context),
                                (const char *)sqlite3_value_text(argv[0]),
-                               sqlite3_value_bytes(argv[0]), &model, &ctx);
+                               sqlite3_value_bytes(argv[0]), &model);
 
     if(rc != SQLITE_OK) {
       char * zSql = sqlite3_mprintf("Unknown model name '%s'. Was it registered with lembed_models?", sqlite3_value_text(argv[0]));
@@ -411,7 +888,7 @@ static void lembed_token_score(sqlite3_context *context, int argc,
   struct llama_model *model;
   int rc = api_model_from_name((struct Api *)sqlite3_user_data(context),
                                (const char *)sqlite3_value_text(argv[0]),
-                               sqlite3_value_bytes(argv[0]), &model, NULL);
+                               sqlite3_value_bytes(argv[0]), &model);
 
   int32_t token = sqlite3_value_int(argv[1]);
 
@@ -423,7 +900,7 @@ static void lembed_token_to_piece_(sqlite3_context *context, int argc,
   struct llama_model *model;
   int rc = api_model_from_name((struct Api *)sqlite3_user_data(context),
                                (const char *)sqlite3_value_text(argv[0]),
-                               sqlite3_value_bytes(argv[0]), &model, NULL);
+                               sqlite3_value_bytes(argv[0]), &model);
 
   int32_t token = sqlite3_value_int(argv[1]);
 #define BUFLEN 256
@@ -479,10 +956,13 @@ static int lembed_modelsConnect(sqlite3 *db, void *pAux, int argc,
 #define LEMBED_MODELS_DIMENSIONS      3
 #define LEMBED_MODELS_N_CTX           4
 #define LEMBED_MODELS_POOLING_TYPE    5
-#define LEMBED_MODELS_MODEL_OPTIONS   6
-#define LEMBED_MODELS_CONTEXT_OPTIONS 7
-  rc = sqlite3_declare_vtab(db, "CREATE TABLE x(name, model, size, dimensions, n_ctx, pooling_type, model_options "
-                                "hidden, context_options hidden)");
+#define LEMBED_MODELS_ELEMENT_TYPE    6
+#define LEMBED_MODELS_CONTEXTS        7
+#define LEMBED_MODELS_MEMORY          8
+#define LEMBED_MODELS_MODEL_OPTIONS   9
+#define LEMBED_MODELS_CONTEXT_OPTIONS 10
+  rc = sqlite3_declare_vtab(db, "CREATE TABLE x(name, model, size, dimensions, n_ctx, pooling_type, element_type, "
+                                "contexts, memory, model_options hidden, context_options hidden)");
   if (rc == SQLITE_OK) {
     pNew = sqlite3_malloc(sizeof(*pNew));
     *ppVtab = (sqlite3_vtab *)pNew;
@@ -531,7 +1011,7 @@ static int lembed_modelsUpdate(sqlite3_vtab *pVTab, int argc,
       abort();
 
 
-    const char *modelPath;
+    const char *modelPath = NULL;
     if(sqlite3_value_subtype(columnValues[LEMBED_MODELS_MODEL]) == POINTER_SUBTYPE) {
       modelPath = sqlite3_value_pointer(columnValues[LEMBED_MODELS_MODEL], POINTER_NAME_MODEL_PATH);
     }
@@ -540,6 +1020,8 @@ static int lembed_modelsUpdate(sqlite3_vtab *pVTab, int argc,
     }
     if(!modelPath) {
       lembed_vtab_set_error(pVTab, "Could not resolve model path");
+      sqlite3_free(p->api->models[idx].name);
+      p->api->models[idx].name = NULL;
       return SQLITE_ERROR;
     }
 
@@ -559,18 +1041,19 @@ static int lembed_modelsUpdate(sqlite3_vtab *pVTab, int argc,
                                 POINTER_NAME_CONTEXT_OPTIONS);
     }
 
-    struct llama_model *model;
     struct llama_model_params mparams = llama_model_default_params();
     if (modelOptions && modelOptions->defined[0]) {
       mparams.n_gpu_layers = modelOptions->n_gpu_layers;
     }
 
-    model = llama_load_model_from_file(modelPath, mparams);
-    if (!model) {
+    lembed_shared_model *shared = lembed_registry_acquire(modelPath, &mparams);
+    if (!shared) {
+      sqlite3_free(p->api->models[idx].name);
+      p->api->models[idx].name = NULL;
       return SQLITE_ERROR;
     }
+    struct llama_model *model = shared->model;
 
-    struct llama_context *ctx;
     struct llama_context_params cparams = llama_context_default_params();
     cparams.embeddings = 1;
     //cparams.n_ubatch = cparams.n_batch = 4096;
@@ -579,7 +1062,11 @@ static int lembed_modelsUpdate(sqlite3_vtab *pVTab, int argc,
         cparams.seed = contextOptions->seed;
       }
       if (contextOptions->defined[1]) {
+        // batches are packed up to n_ctx tokens, and encoders need the
+        // whole batch in one ubatch. 0 means the model's training length
         cparams.n_ctx = contextOptions->n_ctx;
+        cparams.n_batch = cparams.n_ubatch =
+            contextOptions->n_ctx ? contextOptions->n_ctx : llama_n_ctx_train(model);
       }
       if (contextOptions->defined[2]) {
         cparams.rope_scaling_type = contextOptions->rope_scaling_type;
@@ -587,15 +1074,54 @@ static int lembed_modelsUpdate(sqlite3_vtab *pVTab, int argc,
       if (contextOptions->defined[3]) {
         cparams.rope_freq_scale = contextOptions->rope_freq_scale;
       }
+      if (contextOptions->defined[6]) {
+        cparams.n_threads = cparams.n_threads_batch = contextOptions->n_threads;
+      }
+    }
+
+    int dimensions = llama_n_embd(model);
+    enum lembed_element_type element_type = LEMBED_ELEMENT_TYPE_FLOAT32;
+    if (contextOptions) {
+      if (contextOptions->defined[4]) {
+        if (contextOptions->dimensions > dimensions) {
+          lembed_vtab_set_error(pVTab, "dimensions must be at most %d for this model", dimensions);
+          lembed_registry_release(shared);
+          sqlite3_free(p->api->models[idx].name);
+          p->api->models[idx].name = NULL;
+          return SQLITE_ERROR;
+        }
+        dimensions = contextOptions->dimensions;
+      }
+      if (contextOptions->defined[5]) {
+        element_type = contextOptions->element_type;
+      }
+    }
+    if (element_type == LEMBED_ELEMENT_TYPE_BIT && dimensions % 8) {
+      lembed_vtab_set_error(pVTab, "bit quantization requires dimensions divisible by 8");
+      lembed_registry_release(shared);
+      sqlite3_free(p->api->models[idx].name);
+      p->api->models[idx].name = NULL;
+      return SQLITE_ERROR;
     }
 
-    ctx = llama_new_context_with_model(model, cparams);
-    if (!ctx) {
-      llama_free_model(model);
+    // the first context learns n_ctx and pooling type, then waits in the
+    // pool for whoever embeds first
+    lembed_pooled_context *c = lembed_context_acquire(shared, &cparams);
+    if (!c) {
+      lembed_registry_release(shared);
+      sqlite3_free(p->api->models[idx].name);
+      p->api->models[idx].name = NULL;
       return SQLITE_ERROR;
     }
+    p->api->models[idx].n_ctx = llama_n_ctx(c->context);
+    p->api->models[idx].n_batch = lembed_batch_capacity(c->context);
+    p->api->models[idx].pooling_type = llama_pooling_type(c->context);
+    lembed_context_release(shared, c);
+    p->api->models[idx].shared = shared;
     p->api->models[idx].model = model;
-    p->api->models[idx].context = ctx;
+    p->api->models[idx].cparams = cparams;
+    p->api->models[idx].dimensions = dimensions;
+    p->api->models[idx].element_type = element_type;
     return SQLITE_OK;
   }
   // UPDATE operation
@@ -657,7 +1183,7 @@ static int lembed_modelsNext(sqlite3_vtab_cursor *cur) {
   lembed_models_vtab *p = (lembed_models_vtab *)pCur->base.pVtab;
   pCur->iRowid++;
   while (pCur->iRowid < MAX_MODELS) {
-    if (p->api->models[pCur->iRowid].name) {
+    if (p->api->models[pCur->iRowid].name && p->api->models[pCur->iRowid].shared) {
       return SQLITE_OK;
     }
     pCur->iRowid++;
@@ -683,13 +1209,32 @@ static int lembed_modelsColumn(sqlite3_vtab_cursor *cur,
     sqlite3_result_int64(context, llama_model_size(p->api->models[pCur->iRowid].model));
     break;
   case LEMBED_MODELS_DIMENSIONS:
-    sqlite3_result_int64(context, llama_n_embd(p->api->models[pCur->iRowid].model));
+    sqlite3_result_int64(context, p->api->models[pCur->iRowid].dimensions);
+    break;
+  case LEMBED_MODELS_ELEMENT_TYPE:
+    sqlite3_result_text(context, lembed_element_type_name(p->api->models[pCur->iRowid].element_type), -1, SQLITE_STATIC);
     break;
   case LEMBED_MODELS_N_CTX:
-    sqlite3_result_int64(context, llama_n_ctx(p->api->models[pCur->iRowid].context));
+    sqlite3_result_int64(context, p->api->models[pCur->iRowid].n_ctx);
+    break;
+  case LEMBED_MODELS_CONTEXTS: {
+    lembed_shared_model *m = p->api->models[pCur->iRowid].shared;
+    pthread_mutex_lock(&lembed_registry_lock);
+    int contexts = m->contexts;
+    pthread_mutex_unlock(&lembed_registry_lock);
+    sqlite3_result_int64(context, contexts);
+    break;
+  }
+  case LEMBED_MODELS_MEMORY: {
+    lembed_shared_model *m = p->api->models[pCur->iRowid].shared;
+    pthread_mutex_lock(&lembed_registry_lock);
+    uint64_t memory = m->context_memory;
+    pthread_mutex_unlock(&lembed_registry_lock);
+    sqlite3_result_int64(context, llama_model_size(m->model) + memory);
     break;
+  }
   case LEMBED_MODELS_POOLING_TYPE: {
-      switch(llama_pooling_type(p->api->models[pCur->iRowid].context)) {
+      switch(p->api->models[pCur->iRowid].pooling_type) {
         case LLAMA_POOLING_TYPE_NONE: {
           sqlite3_result_text(context, "none", -1, SQLITE_STATIC);
           break;
@@ -817,6 +1362,9 @@ typedef struct lembed_batch_cursor lembed_batch_cursor;
 struct lembed_batch_cursor {
   sqlite3_vtab_cursor base;
   struct Api * api;
+  ApiModel *model;
+  // checked out of the model's context pool until the cursor closes
+  lembed_pooled_context *pooled;
   struct llama_context *lctx;
   sqlite3_int64 iRowid;
   sqlite3_stmt * stmt;
@@ -830,8 +1378,25 @@ struct lembed_batch_cursor {
   struct Array contentsArray;
   struct Array contentLengthsArray;
   float * embeddings;
+
+  // rows read from stmt and tokenized, but not yet embedded
+  int pendingIdx;
+  struct Array pendingContentsArray;
+  struct Array pendingContentLengthsArray;
+  int32_t * pendingOffsets;
+  llama_token * pendingTokens;
+  int pendingTokensCapacity;
 };
 
+static void lembed_batch_pending_clear(lembed_batch_cursor *pCur) {
+  for(int i = pCur->pendingIdx; i < pCur->pendingContentsArray.length; i++) {
+    sqlite3_free(((char **)pCur->pendingContentsArray.z)[i]);
+  }
+  pCur->pendingContentsArray.length = 0;
+  pCur->pendingContentLengthsArray.length = 0;
+  pCur->pendingIdx = 0;
+}
+
 
 static int lembed_batchConnect(
   sqlite3 *db,
@@ -883,12 +1448,23 @@ static int lembed_batchOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor){
     NULL
   );
   assert(rc == SQLITE_OK);
+  rc = lembed_array_init(&pCur->pendingContentsArray, sizeof(char *), 32);
+  if(rc != SQLITE_OK) return rc;
+  rc = lembed_array_init(&pCur->pendingContentLengthsArray, sizeof(int), 32);
   return rc;
 }
 
 static int lembed_batchClose(sqlite3_vtab_cursor *cur){
   lembed_batch_cursor *pCur = (lembed_batch_cursor*)cur;
   sqlite3_finalize(pCur->stmt);
+  lembed_batch_pending_clear(pCur);
+  lembed_array_cleanup(&pCur->pendingContentsArray);
+  lembed_array_cleanup(&pCur->pendingContentLengthsArray);
+  sqlite3_free(pCur->pendingOffsets);
+  sqlite3_free(pCur->pendingTokens);
+  if(pCur->pooled) {
+    lembed_context_release(pCur->model->shared, pCur->pooled);
+  }
   sqlite3_free(pCur);
   return SQLITE_OK;
 }
@@ -923,38 +1499,122 @@ static int lembed_batchBestIndex(
   return SQLITE_OK;
 }
 
+// Rows are tokenized a chunk at a time with llama_tokenize_batch(), which
+// spreads the work over the thread pool, instead of one at a time on this
+// thread in between decodes. A chunk holds a few batches worth of text.
+#define LEMBED_BATCH_CHUNK_ROWS 256
+
+// SQLITE_ROW: tokenized more rows into pending
+// SQLITE_DONE: stmt has no more rows
+// else: error
+static int lembed_batch_tokenize_chunk(lembed_batch_cursor *pCur) {
+  uint32_t n_batch = lembed_batch_capacity(pCur->lctx);
+  size_t nbytes = 0;
+  int rc;
+
+  lembed_batch_pending_clear(pCur);
+  while(pCur->stmtRc == SQLITE_ROW &&
+        pCur->pendingContentsArray.length < LEMBED_BATCH_CHUNK_ROWS &&
+        nbytes < 8 * n_batch) {
+    char * s = (char *) sqlite3_column_text(pCur->stmt, 0);
+    int len = sqlite3_column_bytes(pCur->stmt, 0);
+    char * zCopy = sqlite3_mprintf("%.*s", len, s);
+    if(!zCopy) {
+      return SQLITE_NOMEM;
+    }
+    rc = lembed_array_append(&pCur->pendingContentsArray, &zCopy);
+    if(rc != SQLITE_OK) {
+      sqlite3_free(zCopy);
+      return rc;
+    }
+    rc = lembed_array_append(&pCur->pendingContentLengthsArray, &len);
+    if(rc != SQLITE_OK) {
+      return rc;
+    }
+    nbytes += len;
+    pCur->stmtRc = sqlite3_step(pCur->stmt);
+  }
+  int n = pCur->pendingContentsArray.length;
+  if(n == 0) {
+    return SQLITE_DONE;
+  }
+
+  int32_t * offsets = sqlite3_realloc(pCur->pendingOffsets, sizeof(int32_t) * (n + 1));
+  if(!offsets) {
+    return SQLITE_NOMEM;
+  }
+  pCur->pendingOffsets = offsets;
+
+  // when the buffer is too small, the rows that fit are kept, and only
+  // the rest are tokenized again into a buffer of the size reported
+  int capacity = nbytes + 8 * n;
+  int done = 0;
+  while(1) {
+    if(capacity > pCur->pendingTokensCapacity) {
+      llama_token * z = sqlite3_realloc(pCur->pendingTokens, sizeof(llama_token) * capacity);
+      if(!z) {
+        return SQLITE_NOMEM;
+      }
+      pCur->pendingTokens = z;
+      pCur->pendingTokensCapacity = capacity;
+    }
+    int32_t base = done ? offsets[done] : 0;
+    int ntokens = llama_tokenize_batch(
+      llama_get_model(pCur->lctx),
+      (const char **) pCur->pendingContentsArray.z + done,
+      (const int32_t *) pCur->pendingContentLengthsArray.z + done,
+      n - done,
+      pCur->pendingTokens + base,
+      pCur->pendingTokensCapacity - base,
+      offsets + done,
+      true,
+      true,
+      0
+    );
+    if(ntokens == INT32_MIN || (ntokens < 0 && -(int64_t)ntokens > INT32_MAX - base)) {
+      return SQLITE_TOOBIG;
+    }
+    for(int i = done; i <= n; i++) {
+      offsets[i] += base;
+    }
+    if(ntokens >= 0) {
+      break;
+    }
+    capacity = base - ntokens;
+    while(done < n && offsets[done + 1] <= pCur->pendingTokensCapacity) {
+      done++;
+    }
+  }
+  return SQLITE_ROW;
+}
+
 // SQLITE_ROW: embed some, stmt has more
 // SQLITE_DONE: done after this chunk
 // else: error
 int embed_batch(
   lembed_batch_cursor *pCur
   ) {
-  uint32_t n_batch = llama_n_ctx(pCur->lctx);
+  uint32_t n_batch = lembed_batch_capacity(pCur->lctx);
   struct llama_batch batch = llama_batch_init(n_batch, 0, 1);
   int nprocessed = 0;
   int rc;
 
   while(1) {
-    if(pCur->stmtRc == SQLITE_DONE) {
-      pCur->eof = 1;
-      break;
+    if(pCur->pendingIdx == pCur->pendingContentsArray.length) {
+      rc = lembed_batch_tokenize_chunk(pCur);
+      if(rc == SQLITE_DONE) {
+        pCur->eof = 1;
+        break;
+      }
+      assert(rc == SQLITE_ROW);
     }
-    assert(pCur->stmtRc == SQLITE_ROW);
-
-    char * s = (char *) sqlite3_column_text(pCur->stmt, 0);
-    int len = sqlite3_column_bytes(pCur->stmt, 0);
 
-    int input_token_count_estimate = llama_tokenize(llama_get_model(pCur->lctx), s, len, NULL, 0, true, true);
-    assert(input_token_count_estimate < 0);
-    llama_token *tokens = sqlite3_malloc(sizeof(llama_token) * abs(input_token_count_estimate));
-    assert(tokens);
-
-    int input_token_count = llama_tokenize(llama_get_model(pCur->lctx), s, len, tokens, abs(input_token_count_estimate), true, true);
-    assert(input_token_count == abs(input_token_count_estimate));
+    int idx = pCur->pendingIdx;
+    llama_token * tokens = pCur->pendingTokens + pCur->pendingOffsets[idx];
+    int input_token_count = pCur->pendingOffsets[idx + 1] - pCur->pendingOffsets[idx];
 
     if (batch.n_tokens + input_token_count > n_batch) {
       assert(nprocessed>0);
-      sqlite3_free(tokens);
       break;
     }
 
@@ -966,20 +1626,16 @@ int embed_batch(
         batch.logits  [batch.n_tokens] = i == (input_token_count - 1);
         batch.n_tokens++;
     }
-    sqlite3_free(tokens);
     nprocessed += 1;
-    char * zCopy = sqlite3_mprintf("%.*s", len, s);
-    assert(zCopy);
-    lembed_array_append(&pCur->contentsArray, &zCopy) == SQLITE_OK;//assert();
-    lembed_array_append(&pCur->contentLengthsArray, &len) == SQLITE_OK;//assert();
-    pCur->stmtRc = sqlite3_step(pCur->stmt);
+    lembed_array_append(&pCur->contentsArray, &((char **)pCur->pendingContentsArray.z)[idx]) == SQLITE_OK;//assert();
+    lembed_array_append(&pCur->contentLengthsArray, &((int *)pCur->pendingContentLengthsArray.z)[idx]) == SQLITE_OK;//assert();
+    pCur->pendingIdx++;
   }
   if(nprocessed==0) {
     pCur->batchSize = 0;
     pCur->batchIdx = 0;
     return SQLITE_DONE;
   }
-  printf("nprocessed=%d\n", nprocessed);
 
   float * embeddings = sqlite3_malloc(pCur->dimensions * sizeof(float) * nprocessed);
   assert(embeddings);
@@ -1015,15 +1671,24 @@ static int lembed_batchFilter(
   sqlite3_reset(pCur->stmt);
   sqlite3_clear_bindings(pCur->stmt);
   sqlite3_bind_text(pCur->stmt, 1, sqlite3_value_text(argv[0]), sqlite3_value_bytes(argv[0]), SQLITE_TRANSIENT);
+  lembed_batch_pending_clear(pCur);
   pCur->stmtRc = sqlite3_step(pCur->stmt);
   assert(pCur->stmtRc == SQLITE_ROW || pCur->stmtRc == SQLITE_DONE);
 
-  struct llama_model *model;
-  rc = api_model_from_name(pCur->api, "default", strlen("default"), &model, &pCur->lctx);
-  if(rc != SQLITE_OK) {
+  if(pCur->pooled) {
+    lembed_context_release(pCur->model->shared, pCur->pooled);
+    pCur->pooled = NULL;
+  }
+  pCur->model = api_model_find(pCur->api, "default", strlen("default"));
+  if(!pCur->model) {
     return SQLITE_ERROR;
   }
-  pCur->dimensions = llama_n_embd(model);
+  pCur->pooled = lembed_context_acquire(pCur->model->shared, &pCur->model->cparams);
+  if(!pCur->pooled) {
+    return SQLITE_NOMEM;
+  }
+  pCur->lctx = pCur->pooled->context;
+  pCur->dimensions = llama_n_embd(pCur->model->model);
   for(int i = 0; i < pCur->batchSize; i++) {
     sqlite3_free(((char **)pCur->contentsArray.z)[i]);
   }
@@ -1099,13 +1764,11 @@ static int lembed_batchColumn(
       );
       break;
     case LEMBED_BATCH_EMBEDDING:
-      sqlite3_result_blob(
+      lembed_result_embedding(
         context,
-        pCur->embeddings + (pCur->dimensions * pCur->batchIdx),
-        sizeof(float) * pCur->dimensions,
-        SQLITE_TRANSIENT
+        pCur->model,
+        pCur->embeddings + (pCur->dimensions * pCur->batchIdx)
       );
-      sqlite3_result_subtype(context, SQLITE_VEC_FLOAT32_SUBTYPE);
       break;
     default:
       sqlite3_result_null(context);
@@ -1146,6 +1809,566 @@ static sqlite3_module lembed_batchModule = {
 };
 #pragma endregion
 
+#pragma region lembed_chunks
+
+// lembed_chunks(text, max_tokens, overlap) splits a document that is too
+// long to embed at once into windows of at most max_tokens tokens, each
+// starting overlap tokens before the previous one ended. The text is
+// tokenized once, and the windows are decoded straight from those token
+// IDs, several to a batch, only if the embedding column is read.
+
+typedef struct lembed_chunk lembed_chunk;
+struct lembed_chunk {
+  // tokens [token_start, token_end) of the document
+  int token_start;
+  int token_end;
+  // bytes [start, start + length) of the document they were read from
+  int start;
+  int length;
+};
+
+typedef struct lembed_chunks_vtab lembed_chunks_vtab;
+struct lembed_chunks_vtab {
+  sqlite3_vtab base;
+  struct Api *api;
+};
+
+// most models wrap inputs in one or two special tokens, e.g. [CLS] [SEP]
+#define LEMBED_CHUNKS_MAX_SPECIAL 4
+
+typedef struct lembed_chunks_cursor lembed_chunks_cursor;
+struct lembed_chunks_cursor {
+  sqlite3_vtab_cursor base;
+  struct Api *api;
+  ApiModel *model;
+  char *text;
+  int textLength;
+  // the document's tokens without special tokens, and the bytes each
+  // one was read from
+  llama_token *tokens;
+  int nTokens;
+  int *tokenStarts;
+  int *tokenEnds;
+  llama_token prefix[LEMBED_CHUNKS_MAX_SPECIAL];
+  int nPrefix;
+  llama_token suffix[LEMBED_CHUNKS_MAX_SPECIAL];
+  int nSuffix;
+  struct Array chunks;
+  int iChunk;
+  // llama_n_embd() floats per chunk, computed on first use
+  float *embeddings;
+};
+
+static int lembed_chunksConnect(sqlite3 *db, void *pAux, int argc,
+                                const char *const *argv, sqlite3_vtab **ppVtab,
+                                char **pzErr) {
+  lembed_chunks_vtab *pNew;
+  int rc = sqlite3_declare_vtab(
+      db, "CREATE TABLE x(contents, start, length, tokens, embedding, "
+          "input hidden, max_tokens hidden, overlap hidden, model hidden)");
+#define LEMBED_CHUNKS_CONTENTS   0
+#define LEMBED_CHUNKS_START      1
+#define LEMBED_CHUNKS_LENGTH     2
+#define LEMBED_CHUNKS_TOKENS     3
+#define LEMBED_CHUNKS_EMBEDDING  4
+#define LEMBED_CHUNKS_INPUT      5
+#define LEMBED_CHUNKS_MAX_TOKENS 6
+#define LEMBED_CHUNKS_OVERLAP    7
+#define LEMBED_CHUNKS_MODEL      8
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  pNew = sqlite3_malloc(sizeof(*pNew));
+  if (!pNew) {
+    return SQLITE_NOMEM;
+  }
+  memset(pNew, 0, sizeof(*pNew));
+  pNew->api = pAux;
+  *ppVtab = (sqlite3_vtab *)pNew;
+  return SQLITE_OK;
+}
+
+static int lembed_chunksDisconnect(sqlite3_vtab *pVtab) {
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+static int lembed_chunksOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor) {
+  lembed_chunks_cursor *pCur = sqlite3_malloc(sizeof(*pCur));
+  if (!pCur) {
+    return SQLITE_NOMEM;
+  }
+  memset(pCur, 0, sizeof(*pCur));
+  pCur->api = ((lembed_chunks_vtab *)p)->api;
+  *ppCursor = &pCur->base;
+  return lembed_array_init(&pCur->chunks, sizeof(lembed_chunk), 8);
+}
+
+static void lembed_chunks_reset(lembed_chunks_cursor *pCur) {
+  sqlite3_free(pCur->text);
+  sqlite3_free(pCur->tokens);
+  sqlite3_free(pCur->tokenStarts);
+  sqlite3_free(pCur->tokenEnds);
+  sqlite3_free(pCur->embeddings);
+  pCur->text = NULL;
+  pCur->tokens = NULL;
+  pCur->tokenStarts = NULL;
+  pCur->tokenEnds = NULL;
+  pCur->embeddings = NULL;
+  pCur->nTokens = 0;
+  pCur->chunks.length = 0;
+  pCur->iChunk = 0;
+}
+
+static int lembed_chunksClose(sqlite3_vtab_cursor *cur) {
+  lembed_chunks_cursor *pCur = (lembed_chunks_cursor *)cur;
+  lembed_chunks_reset(pCur);
+  lembed_array_cleanup(&pCur->chunks);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+// idxNum has a bit set for each optional argument that was given, and
+// they're passed to xFilter after the input in column order.
+static int lembed_chunksBestIndex(sqlite3_vtab *pVTab,
+                                  sqlite3_index_info *pIdxInfo) {
+  int aIdx[4] = {-1, -1, -1, -1};
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
+    if (pCons->iColumn < LEMBED_CHUNKS_INPUT) {
+      continue;
+    }
+    if (!pCons->usable) {
+      return SQLITE_CONSTRAINT;
+    }
+    if (pCons->op != SQLITE_INDEX_CONSTRAINT_EQ) {
+      continue;
+    }
+    aIdx[pCons->iColumn - LEMBED_CHUNKS_INPUT] = i;
+  }
+  if (aIdx[0] < 0) {
+    lembed_vtab_set_error(pVTab, "input argument is required");
+    return SQLITE_ERROR;
+  }
+  int argvIndex = 0;
+  pIdxInfo->idxNum = 0;
+  for (int j = 0; j < 4; j++) {
+    if (aIdx[j] < 0) {
+      continue;
+    }
+    pIdxInfo->aConstraintUsage[aIdx[j]].argvIndex = ++argvIndex;
+    pIdxInfo->aConstraintUsage[aIdx[j]].omit = 1;
+    pIdxInfo->idxNum |= 1 << j;
+  }
+  pIdxInfo->estimatedCost = (double)10;
+  pIdxInfo->estimatedRows = 10;
+  return SQLITE_OK;
+}
+
+// Finds the special tokens the model puts before and after every input,
+// by tokenizing a single letter with and without them.
+static void lembed_chunks_special_tokens(lembed_chunks_cursor *pCur,
+                                         struct llama_model *model) {
+  llama_token with[2 * LEMBED_CHUNKS_MAX_SPECIAL + 4];
+  llama_token without[4];
+  int nWith = llama_tokenize(model, "x", 1, with, sizeof(with) / sizeof(with[0]),
+                             true, false);
+  int nWithout = llama_tokenize(model, "x", 1, without,
+                                sizeof(without) / sizeof(without[0]), false, false);
+  pCur->nPrefix = pCur->nSuffix = 0;
+  if (nWith < 0 || nWithout <= 0) {
+    return;
+  }
+  for (int k = 0; k + nWithout <= nWith; k++) {
+    if (memcmp(with + k, without, sizeof(llama_token) * nWithout) == 0) {
+      int nSuffix = nWith - nWithout - k;
+      if (k > LEMBED_CHUNKS_MAX_SPECIAL || nSuffix > LEMBED_CHUNKS_MAX_SPECIAL) {
+        return;
+      }
+      memcpy(pCur->prefix, with, sizeof(llama_token) * k);
+      memcpy(pCur->suffix, with + k + nWithout, sizeof(llama_token) * nSuffix);
+      pCur->nPrefix = k;
+      pCur->nSuffix = nSuffix;
+      return;
+    }
+  }
+}
+
+static int lembed_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+static int lembed_piece_matches(const char *text, int n, const char *piece,
+                                int m) {
+  if (m > n) {
+    return 0;
+  }
+  for (int i = 0; i < m; i++) {
+    char a = text[i], b = piece[i];
+    if (a >= 'A' && a <= 'Z')
+      a += 'a' - 'A';
+    if (b >= 'A' && b <= 'Z')
+      b += 'a' - 'A';
+    if (a != b)
+      return 0;
+  }
+  return 1;
+}
+
+// Finds the bytes of the text each token was read from, by matching the
+// pieces the tokens decode to against it. Tokenizers that normalize the
+// text, e.g. WordPiece lowercasing it and stripping accents, can make a
+// piece differ from its source, so case is ignored, a piece may be found
+// a little further ahead, and one that isn't found covers the next
+// character.
+static void lembed_chunks_align(lembed_chunks_cursor *pCur,
+                                struct llama_model *model) {
+  const char *text = pCur->text;
+  int len = pCur->textLength;
+  int p = 0;
+  char piece[64];
+  for (int i = 0; i < pCur->nTokens; i++) {
+    int m = llama_token_to_piece(model, pCur->tokens[i], piece, sizeof(piece),
+                                 0, false);
+    if (m < 0) {
+      m = 0;
+    }
+    // SentencePiece and WordPiece pieces start with the space they replace
+    int b = 0;
+    while (b < m && lembed_is_space(piece[b])) {
+      b++;
+    }
+    int q = p;
+    if (b == m) {
+      while (q < len && q - p < m && lembed_is_space(text[q])) {
+        q++;
+      }
+      pCur->tokenStarts[i] = p;
+      pCur->tokenEnds[i] = p = q;
+      continue;
+    }
+    while (q < len && lembed_is_space(text[q])) {
+      q++;
+    }
+    int end = -1;
+    for (int r = q; r < len && r <= q + 16; r++) {
+      if (lembed_piece_matches(text + r, len - r, piece + b, m - b)) {
+        end = r + m - b;
+        break;
+      }
+    }
+    if (end < 0) {
+      unsigned char c = q < len ? text[q] : 0;
+      end = q + (q == len ? 0 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1);
+      if (end > len) {
+        end = len;
+      }
+    }
+    pCur->tokenStarts[i] = q;
+    pCur->tokenEnds[i] = p = end;
+  }
+}
+
+// How good a place the end of token i is to end a chunk: 3 after a
+// blank line, 2 after a line break, 1 after a sentence, 0 elsewhere.
+static int lembed_chunks_break_score(lembed_chunks_cursor *pCur, int i) {
+  const char *text = pCur->text;
+  int a = pCur->tokenEnds[i];
+  int b = i + 1 < pCur->nTokens ? pCur->tokenStarts[i + 1] : pCur->textLength;
+  while (a > pCur->tokenStarts[i] && lembed_is_space(text[a - 1])) {
+    a--;
+  }
+  int newlines = 0;
+  for (int p = a; p < b; p++) {
+    newlines += text[p] == '\n';
+  }
+  if (newlines >= 2) {
+    return 3;
+  }
+  if (newlines) {
+    return 2;
+  }
+  if (a > 0 && (text[a - 1] == '.' || text[a - 1] == '!' || text[a - 1] == '?') &&
+      (b > a || i + 1 == pCur->nTokens)) {
+    return 1;
+  }
+  return 0;
+}
+
+// Splits the tokens into windows of at most budget tokens. A window
+// that doesn't reach the end of the document is cut at the best break
+// in its second half, and the latest one among equals, or else right
+// at the budget.
+static int lembed_chunks_split(lembed_chunks_cursor *pCur, int budget,
+                               int overlap) {
+  int start = 0;
+  while (start < pCur->nTokens) {
+    int end = start + budget;
+    if (end >= pCur->nTokens) {
+      end = pCur->nTokens;
+    } else {
+      int best = 0;
+      for (int i = start + budget / 2; i < end; i++) {
+        int score = lembed_chunks_break_score(pCur, i);
+        if (score && score >= best) {
+          best = score;
+          end = i + 1;
+        }
+      }
+      if (!best) {
+        end = start + budget;
+      }
+    }
+    lembed_chunk chunk;
+    chunk.token_start = start;
+    chunk.token_end = end;
+    chunk.start = pCur->tokenStarts[start];
+    chunk.length = pCur->tokenEnds[end - 1] - chunk.start;
+    int rc = lembed_array_append(&pCur->chunks, &chunk);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    if (end == pCur->nTokens) {
+      break;
+    }
+    start = end - overlap > start ? end - overlap : start + 1;
+  }
+  return SQLITE_OK;
+}
+
+static int lembed_chunksFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                               const char *idxStr, int argc,
+                               sqlite3_value **argv) {
+  lembed_chunks_cursor *pCur = (lembed_chunks_cursor *)pVtabCursor;
+  sqlite3_vtab *pVTab = pVtabCursor->pVtab;
+  int i = 1;
+  sqlite3_value *maxTokensValue = idxNum & 2 ? argv[i++] : NULL;
+  sqlite3_value *overlapValue = idxNum & 4 ? argv[i++] : NULL;
+  sqlite3_value *modelValue = idxNum & 8 ? argv[i++] : NULL;
+  int rc;
+
+  lembed_chunks_reset(pCur);
+  if (modelValue) {
+    pCur->model = api_model_find(pCur->api,
+                                 (const char *)sqlite3_value_text(modelValue),
+                                 sqlite3_value_bytes(modelValue));
+    if (!pCur->model) {
+      lembed_vtab_set_error(pVTab, "Unknown model name '%s'. Was it registered with lembed_models?",
+                            sqlite3_value_text(modelValue));
+      return SQLITE_ERROR;
+    }
+  } else {
+    pCur->model = api_model_find(pCur->api, "default", strlen("default"));
+    if (!pCur->model) {
+      lembed_vtab_set_error(pVTab, "No default model has been registered yet with lembed_models");
+      return SQLITE_ERROR;
+    }
+  }
+  struct llama_model *model = pCur->model->model;
+  lembed_chunks_special_tokens(pCur, model);
+
+  int maxTokens = maxTokensValue ? sqlite3_value_int(maxTokensValue)
+                                 : (int)pCur->model->n_batch;
+  int overlap = overlapValue ? sqlite3_value_int(overlapValue) : 0;
+  int budget = maxTokens - pCur->nPrefix - pCur->nSuffix;
+  if (maxTokens > (int)pCur->model->n_batch) {
+    lembed_vtab_set_error(pVTab, "max_tokens must be at most %d, the model's batch size",
+                          (int)pCur->model->n_batch);
+    return SQLITE_ERROR;
+  }
+  if (budget <= 0) {
+    lembed_vtab_set_error(pVTab, "max_tokens must be more than %d",
+                          pCur->nPrefix + pCur->nSuffix);
+    return SQLITE_ERROR;
+  }
+  if (overlap < 0 || overlap >= budget) {
+    lembed_vtab_set_error(pVTab, "overlap must be 0 or more, and less than %d", budget);
+    return SQLITE_ERROR;
+  }
+
+  pCur->textLength = sqlite3_value_bytes(argv[0]);
+  if (pCur->textLength == 0) {
+    return SQLITE_OK;
+  }
+  pCur->text = sqlite3_malloc(pCur->textLength);
+  if (!pCur->text) {
+    return SQLITE_NOMEM;
+  }
+  memcpy(pCur->text, sqlite3_value_text(argv[0]), pCur->textLength);
+
+  rc = lembed_tokenize(model, pCur->text, pCur->textLength, false,
+                       &pCur->nTokens, &pCur->tokens);
+  if (rc != SQLITE_OK) {
+    // nothing but whitespace, or tokens the model doesn't know
+    pCur->tokens = NULL;
+    pCur->nTokens = 0;
+    return rc == SQLITE_NOMEM ? rc : SQLITE_OK;
+  }
+  pCur->tokenStarts = sqlite3_malloc(sizeof(int) * pCur->nTokens);
+  pCur->tokenEnds = sqlite3_malloc(sizeof(int) * pCur->nTokens);
+  if (!pCur->tokenStarts || !pCur->tokenEnds) {
+    return SQLITE_NOMEM;
+  }
+  lembed_chunks_align(pCur, model);
+  return lembed_chunks_split(pCur, budget, overlap);
+}
+
+// Embeds every chunk of the document, packing as many into each batch
+// as the context holds, each as its own sequence.
+static int lembed_chunks_embed(lembed_chunks_cursor *pCur) {
+  ApiModel *m = pCur->model;
+  lembed_chunk *chunks = pCur->chunks.z;
+  int nChunks = pCur->chunks.length;
+  int dimensions = llama_n_embd(m->model);
+  int rc = SQLITE_OK;
+
+  pCur->embeddings = sqlite3_malloc64(sizeof(float) * dimensions * nChunks);
+  if (!pCur->embeddings) {
+    return SQLITE_NOMEM;
+  }
+  lembed_pooled_context *c = lembed_context_acquire(m->shared, &m->cparams);
+  if (!c) {
+    lembed_vtab_set_error(pCur->base.pVtab, "Could not create a context for the model");
+    return SQLITE_ERROR;
+  }
+  uint32_t n_batch = lembed_batch_capacity(c->context);
+  struct llama_batch batch = llama_batch_init(n_batch, 0, 1);
+
+  int i = 0;
+  while (i < nChunks && rc == SQLITE_OK) {
+    int first = i;
+    batch.n_tokens = 0;
+    for (; i < nChunks; i++) {
+      int n = pCur->nPrefix + chunks[i].token_end - chunks[i].token_start +
+              pCur->nSuffix;
+      if (batch.n_tokens + n > n_batch) {
+        break;
+      }
+      for (int j = 0; j < n; j++) {
+        int k = j - pCur->nPrefix;
+        int nBody = chunks[i].token_end - chunks[i].token_start;
+        batch.token[batch.n_tokens] =
+            k < 0 ? pCur->prefix[j]
+            : k < nBody ? pCur->tokens[chunks[i].token_start + k]
+                        : pCur->suffix[k - nBody];
+        batch.pos[batch.n_tokens] = j;
+        batch.n_seq_id[batch.n_tokens] = 1;
+        batch.seq_id[batch.n_tokens][0] = i - first;
+        batch.logits[batch.n_tokens] = j == n - 1;
+        batch.n_tokens++;
+      }
+    }
+    llama_kv_cache_clear(c->context);
+    if (llama_decode(c->context, batch) != 0) {
+      lembed_vtab_set_error(pCur->base.pVtab, "Could not decode batch");
+      rc = SQLITE_ERROR;
+      break;
+    }
+    for (int j = first; j < i; j++) {
+      float *embd = llama_get_embeddings_seq(c->context, j - first);
+      if (!embd) {
+        lembed_vtab_set_error(pCur->base.pVtab, "Could not find embedding");
+        rc = SQLITE_ERROR;
+        break;
+      }
+      memcpy(pCur->embeddings + (size_t)j * dimensions, embd,
+             sizeof(float) * dimensions);
+    }
+  }
+
+  llama_batch_free(batch);
+  lembed_context_release(m->shared, c);
+  if (rc != SQLITE_OK) {
+    sqlite3_free(pCur->embeddings);
+    pCur->embeddings = NULL;
+  }
+  return rc;
+}
+
+static int lembed_chunksEof(sqlite3_vtab_cursor *cur) {
+  lembed_chunks_cursor *pCur = (lembed_chunks_cursor *)cur;
+  return pCur->iChunk >= (int)pCur->chunks.length;
+}
+
+static int lembed_chunksNext(sqlite3_vtab_cursor *cur) {
+  lembed_chunks_cursor *pCur = (lembed_chunks_cursor *)cur;
+  pCur->iChunk++;
+  return SQLITE_OK;
+}
+
+static int lembed_chunksRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
+  lembed_chunks_cursor *pCur = (lembed_chunks_cursor *)cur;
+  *pRowid = pCur->iChunk + 1;
+  return SQLITE_OK;
+}
+
+static int lembed_chunksColumn(sqlite3_vtab_cursor *cur,
+                               sqlite3_context *context, int i) {
+  lembed_chunks_cursor *pCur = (lembed_chunks_cursor *)cur;
+  lembed_chunk *chunk = &((lembed_chunk *)pCur->chunks.z)[pCur->iChunk];
+  switch (i) {
+  case LEMBED_CHUNKS_CONTENTS:
+    sqlite3_result_text(context, pCur->text + chunk->start, chunk->length,
+                        SQLITE_TRANSIENT);
+    break;
+  case LEMBED_CHUNKS_START:
+    sqlite3_result_int(context, chunk->start);
+    break;
+  case LEMBED_CHUNKS_LENGTH:
+    sqlite3_result_int(context, chunk->length);
+    break;
+  case LEMBED_CHUNKS_TOKENS:
+    sqlite3_result_int(context, pCur->nPrefix + chunk->token_end -
+                                    chunk->token_start + pCur->nSuffix);
+    break;
+  case LEMBED_CHUNKS_EMBEDDING: {
+    if (!pCur->embeddings) {
+      int rc = lembed_chunks_embed(pCur);
+      if (rc != SQLITE_OK) {
+        return rc;
+      }
+    }
+    lembed_result_embedding(context, pCur->model,
+                            pCur->embeddings + (size_t)pCur->iChunk *
+                                                   llama_n_embd(pCur->model->model));
+    break;
+  }
+  default:
+    sqlite3_result_null(context);
+  }
+  return SQLITE_OK;
+}
+
+static sqlite3_module lembed_chunksModule = {
+  /* iVersion    */ 3,
+  /* xCreate     */ 0,
+  /* xConnect    */ lembed_chunksConnect,
+  /* xBestIndex  */ lembed_chunksBestIndex,
+  /* xDisconnect */ lembed_chunksDisconnect,
+  /* xDestroy    */ 0,
+  /* xOpen       */ lembed_chunksOpen,
+  /* xClose      */ lembed_chunksClose,
+  /* xFilter     */ lembed_chunksFilter,
+  /* xNext       */ lembed_chunksNext,
+  /* xEof        */ lembed_chunksEof,
+  /* xColumn     */ lembed_chunksColumn,
+  /* xRowid      */ lembed_chunksRowid,
+  /* xUpdate     */ 0,
+  /* xBegin      */ 0,
+  /* xSync       */ 0,
+  /* xCommit     */ 0,
+  /* xRollback   */ 0,
+  /* xFindMethod */ 0,
+  /* xRename     */ 0,
+  /* xSavepoint  */ 0,
+  /* xRelease    */ 0,
+  /* xRollbackTo */ 0,
+  /* xShadowName */ 0,
+  /* xIntegrity  */ 0
+};
+#pragma endregion
+
 #ifndef SQLITE_SUBTYPE
 #define SQLITE_SUBTYPE 0x000100000
 #endif
@@ -1232,5 +2455,6 @@ __declspec(dllexport)
 
   sqlite3_create_module_v2(db, "lembed_models", &lembed_modelsModule, a, NULL);
   sqlite3_create_module_v2(db, "lembed_batch",  &lembed_batchModule,  a, NULL);
+  sqlite3_create_module_v2(db, "lembed_chunks", &lembed_chunksModule, a, NULL);
   return SQLITE_OK;
 }
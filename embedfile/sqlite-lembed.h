@@ -18,6 +18,11 @@ __declspec(dllexport)
 #endif
 int sqlite3_lembed_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi);
 
+// Starts loading a model on a background thread. A later insert into
+// lembed_models with the same path and default model options waits for
+// that load rather than reading the weights again.
+int sqlite3_lembed_preload(const char *path);
+
 #ifdef __cplusplus
 }  /* end of the 'extern "C"' block */
 #endif
@@ -5,9 +5,13 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #pragma region sqlite - lines meta scalar functions
 
@@ -27,20 +31,60 @@ static void linesDebugFunc(sqlite3_context *context, int argc,
 
 #pragma region lines() and lines_read() table functions
 
+/*
+** lines_read() maps regular files and hands out lines as pointers into
+** the mapping, found with memchr(), so a scan costs one pass over the
+** page cache and no copies. Anything that can't be mapped, like a pipe
+** on /dev/stdin, is read through a buffer that refills as lines are
+** consumed, so rows still come out as soon as their line arrives.
+*/
+#define LINES_BUFFER_SIZE (64 * 1024)
+
+/*
+** A mapping that a cursor has moved past. Lines from it may still be
+** sitting in SQLite registers as SQLITE_STATIC text (an aggregate's
+** running max(line), say), so it stays mapped until the cursor closes.
+*/
+typedef struct lines_mapping lines_mapping;
+struct lines_mapping {
+  void *addr;
+  size_t size;
+  lines_mapping *next;
+};
+
+typedef struct lines_read_vtab lines_read_vtab;
+struct lines_read_vtab {
+  sqlite3_vtab base; /* Base class - must be first */
+  // Offsets of every line in the last file that was seeked into with a
+  // rowid or OFFSET constraint. It lives as long as the connection, and
+  // is rebuilt whenever the file's identity, size or mtime changes.
+  char *indexPath;
+  char indexDelim;
+  struct stat indexStat;
+  sqlite3_int64 *offsets;
+  sqlite3_int64 nOffsets;
+};
+
 typedef struct lines_cursor lines_cursor;
 struct lines_cursor {
   sqlite3_vtab_cursor base; /* Base class - must be first */
-  // File pointer of the file being "read" (or in memory file for lines())
-  FILE *fp;
-  // length of current line
+  // Either the mapped file, a copy of the document (lines()), or a
+  // buffer holding the unconsumed part of a stream
+  char *data;
+  size_t size;
+  size_t capacity;
+  int mapped;
+  // Stream still being read into data, or -1
+  int fd;
+  struct stat st;
+  lines_mapping *retired;
+  // Offset and length (including the delimiter) of the current line
+  size_t pos;
   size_t curLineLength;
-  char *curLineContents;
-  size_t curLineLen;
   char delim;
   int idxNum;
-  int rowid_eq_yielded;
-  // either the path to the file being read (lines_read()),
-  // or the contents of the "document" (lines())
+  int eof;
+  // the path to the file being read (lines_read()), or NULL for lines()
   char *in;
   sqlite3_int64 iRowid; /* The rowid */
 };
@@ -56,7 +100,8 @@ struct lines_cursor {
 #define LINES_IDXSTR_PATH 'P'
 #define LINES_IDXSTR_DELIMITER 'D'
 #define LINES_IDXSTR_ROWID 'R'
-#define LINES_IDXSTR_LENGTH 3
+#define LINES_IDXSTR_OFFSET 'O'
+#define LINES_IDXSTR_LENGTH 4
 /*
 ** The linesReadConnect() method is invoked to create a new
 ** lines_vtab that describes the lines_read virtual table.
@@ -99,6 +144,14 @@ static int linesDisconnect(sqlite3_vtab *pVtab) {
   return SQLITE_OK;
 }
 
+static int linesReadDisconnect(sqlite3_vtab *pVtab) {
+  lines_read_vtab *pTab = (lines_read_vtab *)pVtab;
+  sqlite3_free(pTab->indexPath);
+  sqlite3_free(pTab->offsets);
+  sqlite3_free(pTab);
+  return SQLITE_OK;
+}
+
 /*
 ** Constructor for a new lines_cursor object.
 */
@@ -109,32 +162,144 @@ static int linesOpen(sqlite3_vtab *pUnused, sqlite3_vtab_cursor **ppCursor) {
   if (pCur == 0)
     return SQLITE_NOMEM;
   memset(pCur, 0, sizeof(*pCur));
+  pCur->fd = -1;
+  pCur->eof = 1;
   *ppCursor = &pCur->base;
   return SQLITE_OK;
 }
 
+/*
+** Lets go of whatever the cursor was reading. Mappings are only retired
+** here, and unmapped when the cursor closes.
+*/
+static int linesReset(lines_cursor *pCur) {
+  if (pCur->fd != -1)
+    close(pCur->fd);
+  pCur->fd = -1;
+  if (pCur->mapped) {
+    lines_mapping *m = sqlite3_malloc(sizeof(*m));
+    if (m == 0) {
+      munmap(pCur->data, pCur->size);
+    } else {
+      m->addr = pCur->data;
+      m->size = pCur->size;
+      m->next = pCur->retired;
+      pCur->retired = m;
+    }
+  } else {
+    sqlite3_free(pCur->data);
+  }
+  pCur->data = 0;
+  pCur->size = 0;
+  pCur->capacity = 0;
+  pCur->mapped = 0;
+  pCur->pos = 0;
+  pCur->curLineLength = 0;
+  pCur->eof = 1;
+  return SQLITE_OK;
+}
+
 /*
 ** Destructor for a lines_cursor.
 */
 static int linesClose(sqlite3_vtab_cursor *cur) {
   lines_cursor *pCur = (lines_cursor *)cur;
-  if (pCur->curLineContents != NULL)
-    free(pCur->curLineContents);
-  if (pCur->fp != NULL)
-    fclose(pCur->fp);
+  linesReset(pCur);
+  sqlite3_free(pCur->in);
+  while (pCur->retired) {
+    lines_mapping *m = pCur->retired;
+    pCur->retired = m->next;
+    munmap(m->addr, m->size);
+    sqlite3_free(m);
+  }
   sqlite3_free(cur);
   return SQLITE_OK;
 }
 
+/*
+** Reads more of the stream behind the cursor into its buffer, first
+** dropping the lines that were already consumed. Closes the stream once
+** it's exhausted.
+*/
+static int linesFill(lines_cursor *pCur) {
+  if (pCur->pos) {
+    memmove(pCur->data, pCur->data + pCur->pos, pCur->size - pCur->pos);
+    pCur->size -= pCur->pos;
+    pCur->pos = 0;
+  }
+  if (pCur->size == pCur->capacity) {
+    size_t n = pCur->capacity ? pCur->capacity * 2 : LINES_BUFFER_SIZE;
+    char *p = sqlite3_realloc64(pCur->data, n);
+    if (p == 0)
+      return SQLITE_NOMEM;
+    pCur->data = p;
+    pCur->capacity = n;
+  }
+  for (;;) {
+    ssize_t got = read(pCur->fd, pCur->data + pCur->size,
+                       pCur->capacity - pCur->size);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got < 0) {
+      int errnum = errno;
+      sqlite3_free(pCur->base.pVtab->zErrMsg);
+      pCur->base.pVtab->zErrMsg =
+          sqlite3_mprintf("Error reading %s: %s", pCur->in, strerror(errnum));
+      return SQLITE_ERROR;
+    }
+    if (got == 0) {
+      close(pCur->fd);
+      pCur->fd = -1;
+    }
+    pCur->size += got;
+    return SQLITE_OK;
+  }
+}
+
+/*
+** Moves the cursor past its current line and finds the end of the next
+** one, refilling from the stream when the buffer runs dry.
+*/
+static int linesNextLine(lines_cursor *pCur) {
+  size_t searched = 0;
+  pCur->pos += pCur->curLineLength;
+  pCur->curLineLength = 0;
+  for (;;) {
+    size_t avail = pCur->size - pCur->pos;
+    const char *p = pCur->data + pCur->pos;
+    const char *e = avail > searched
+                        ? memchr(p + searched, pCur->delim, avail - searched)
+                        : NULL;
+    if (e != NULL) {
+      pCur->curLineLength = e - p + 1;
+      return SQLITE_OK;
+    }
+    searched = avail;
+    if (pCur->fd == -1) {
+      // the last line doesn't have to end with a delimiter
+      if (avail)
+        pCur->curLineLength = avail;
+      else
+        pCur->eof = 1;
+      return SQLITE_OK;
+    }
+    int rc = linesFill(pCur);
+    if (rc != SQLITE_OK)
+      return rc;
+  }
+}
+
 /*
 ** Advance a lines_cursor to its next row of output.
 */
 static int linesNext(sqlite3_vtab_cursor *cur) {
   lines_cursor *pCur = (lines_cursor *)cur;
+  if (pCur->idxNum == LINES_IDXNUM_ROWID_EQ) {
+    pCur->eof = 1;
+    return SQLITE_OK;
+  }
   pCur->iRowid++;
-  pCur->curLineLength = getdelim(&pCur->curLineContents, &pCur->curLineLen,
-                                 pCur->delim, pCur->fp);
-  return SQLITE_OK;
+  return linesNextLine(pCur);
 }
 
 /*
@@ -143,13 +308,7 @@ static int linesNext(sqlite3_vtab_cursor *cur) {
 */
 static int linesEof(sqlite3_vtab_cursor *cur) {
   lines_cursor *pCur = (lines_cursor *)cur;
-  if (pCur->idxNum == LINES_IDXNUM_ROWID_EQ) {
-    if (pCur->rowid_eq_yielded)
-      return 1;
-    pCur->rowid_eq_yielded = 1;
-    return 0;
-  }
-  return pCur->curLineLength == -1;
+  return pCur->eof;
 }
 
 /*
@@ -162,36 +321,35 @@ linesColumn(sqlite3_vtab_cursor *cur, /* The cursor */
             int i                 /* Which column to return */
 ) {
   lines_cursor *pCur = (lines_cursor *)cur;
-  sqlite3_int64 x = 0;
   switch (i) {
   case LINES_READ_COLUMN_LINE: {
     // If the line ends in the delimiter character, then shave it off.
     // If the delimter is '\n' and the line ends with '\r\n', then also
     // shave  off that '\r', to support CRLF files.
-    int trim = 0;
+    const char *line = pCur->data + pCur->pos;
+    size_t trim = 0;
     if (pCur->curLineLength > 0 &&
-        pCur->curLineContents[pCur->curLineLength - 1] == pCur->delim) {
-      if (pCur->curLineLength > 1 &&
-          pCur->curLineContents[pCur->curLineLength - 1] == '\n' &&
-          pCur->curLineContents[pCur->curLineLength - 2] == '\r')
+        line[pCur->curLineLength - 1] == pCur->delim) {
+      if (pCur->curLineLength > 1 && line[pCur->curLineLength - 1] == '\n' &&
+          line[pCur->curLineLength - 2] == '\r')
         trim = 2;
       else
         trim = 1;
     }
     sqlite3 *db = sqlite3_context_db_handle(ctx);
     int mxBlob = sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1);
-    if (pCur->curLineLength > mxBlob) {
+    if (pCur->curLineLength - trim > (size_t)mxBlob) {
+      char *zErr = sqlite3_mprintf(
+          "line %lld has a size of %lld bytes, but SQLITE_LIMIT_LENGTH is %d",
+          pCur->iRowid, (sqlite3_int64)(pCur->curLineLength - trim), mxBlob);
+      sqlite3_result_error(ctx, zErr, -1);
       sqlite3_result_error_code(ctx, SQLITE_TOOBIG);
-      sqlite3_result_error(
-          ctx,
-          sqlite3_mprintf(
-              "line %d has a size of %d bytes, but SQLITE_LIMIT_LENGTH is %d",
-              pCur->iRowid, pCur->curLineLength, mxBlob),
-          -1);
+      sqlite3_free(zErr);
       return SQLITE_ERROR;
     }
-    sqlite3_result_text(ctx, pCur->curLineContents, pCur->curLineLength - trim,
-                        SQLITE_TRANSIENT);
+    // mapped lines stay put until the cursor closes, see linesReset()
+    sqlite3_result_text(ctx, line, pCur->curLineLength - trim,
+                        pCur->mapped ? SQLITE_STATIC : SQLITE_TRANSIENT);
     break;
   }
   case LINES_READ_COLUMN_DELIM: {
@@ -199,7 +357,7 @@ linesColumn(sqlite3_vtab_cursor *cur, /* The cursor */
     break;
   }
   case LINES_READ_COLUMN_PATH: {
-    sqlite3_result_text(ctx, pCur->in, -1, SQLITE_TRANSIENT);
+    sqlite3_result_text(ctx, pCur->in ? pCur->in : "", -1, SQLITE_TRANSIENT);
     break;
   }
   }
@@ -231,7 +389,7 @@ static int linesRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
     LINES_IDXNUM_ROWID_EQ: Only read a single line, defined by a "rowid = :x"
   constraint
 
-  idxStr is a 3-character string that denotes which argv option cooresponds
+  idxStr is a 4-character string that denotes which argv option cooresponds
   to which column constraint. The i-th character in the string cooresponds
   to the i-th argv option in the xFilter functions.
 
@@ -240,6 +398,8 @@ static int linesRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
   itself LINES_IDXSTR_DELIMITER: argv[i] will be text of delimiter to use
     LINES_IDXSTR_ROWID: argv[i] is integer of rowid to filter to, with
   LINES_IDXNUM_ROWID_EQ
+    LINES_IDXSTR_OFFSET: argv[i] is the OFFSET of a full scan, which
+  lines_read() can jump to without reading the lines before it
 
 */
 
@@ -247,14 +407,16 @@ static int linesBestIndex(sqlite3_vtab *pVTab, sqlite3_index_info *pIdxInfo) {
   int hasPath = 0;
   int hasDelim = 0;
   int hasRowidEq = 0;
+  int iOffset = -1;
   int argv = 1;
 
-  pIdxInfo->idxStr = sqlite3_mprintf("000");
+  pIdxInfo->idxStr = sqlite3_mprintf("0000");
 
   if (pIdxInfo->idxStr == NULL) {
     pVTab->zErrMsg = sqlite3_mprintf("unable to allocate memory for idxStr");
     return SQLITE_NOMEM;
   }
+  pIdxInfo->needToFreeIdxStr = 1;
 
   for (int i = 0; i < pIdxInfo->nConstraint; i++) {
     const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
@@ -262,9 +424,18 @@ static int linesBestIndex(sqlite3_vtab *pVTab, sqlite3_index_info *pIdxInfo) {
     printf("i=%d iColumn=%d, op=%d, usable=%d\n", i, pCons->iColumn, pCons->op,
            pCons->usable);
 #endif
+    // LIMIT and OFFSET have no column, so don't let them reach the switch
+    if (pCons->op == SQLITE_INDEX_CONSTRAINT_LIMIT)
+      continue;
+    if (pCons->op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
+      if (pCons->usable)
+        iOffset = i;
+      continue;
+    }
     switch (pCons->iColumn) {
     case LINES_READ_COLUMN_ROWID: {
-      if (pCons->op == SQLITE_INDEX_CONSTRAINT_EQ && pCons->usable) {
+      if (pCons->op == SQLITE_INDEX_CONSTRAINT_EQ && pCons->usable &&
+          !hasRowidEq) {
         hasRowidEq = 1;
         pIdxInfo->aConstraintUsage[i].argvIndex = argv;
         pIdxInfo->aConstraintUsage[i].omit = 1;
@@ -303,164 +474,254 @@ static int linesBestIndex(sqlite3_vtab *pVTab, sqlite3_index_info *pIdxInfo) {
     pIdxInfo->idxNum = LINES_IDXNUM_ROWID_EQ;
     pIdxInfo->estimatedCost = (double)1;
     pIdxInfo->estimatedRows = 1;
-    // pIdxInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+    pIdxInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
     return SQLITE_OK;
   }
+  // SQLite only offers OFFSET when the whole WHERE clause was consumed,
+  // and skips applying it itself when it's omitted here
+  if (iOffset != -1) {
+    pIdxInfo->aConstraintUsage[iOffset].argvIndex = argv;
+    pIdxInfo->aConstraintUsage[iOffset].omit = 1;
+    pIdxInfo->idxStr[argv - 1] = LINES_IDXSTR_OFFSET;
+    argv++;
+  }
   pIdxInfo->idxNum = LINES_IDXNUM_FULL;
-  pIdxInfo->needToFreeIdxStr = 1;
   pIdxInfo->estimatedCost = (double)100000;
   pIdxInfo->estimatedRows = 100000;
 
   return SQLITE_OK;
 }
 
+static int linesSameFile(const struct stat *a, const struct stat *b) {
+  return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+         a->st_size == b->st_size && a->st_mtime == b->st_mtime;
+}
+
 /*
-** This method is called to "rewind" the lines_cursor object back
-** to the first row of output.  This method is always called at least
-** once prior to any call to xColumn() or xRowid() or xEof().
-**
-** This routine should initialize the cursor and position it so that it
-** is pointing at the first row, or pointing off the end of the table
-** (so that xEof() will return true) if the table is empty.
+** Builds the line index of the file pCur just mapped, unless the one
+** the table already has is for the same file, unchanged.
 */
-static int linesFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
-                       const char *idxStr, int argc, sqlite3_value **argv) {
-  int targetRowid;
-  char delim = '\n';
-  lines_cursor *pCur = (lines_cursor *)pVtabCursor;
-  if (pCur->fp != NULL) {
-    fclose(pCur->fp);
-  }
-  if (pCur->curLineContents != NULL)
-    free(pCur->curLineContents);
+static int linesReadIndex(lines_read_vtab *pTab, lines_cursor *pCur) {
+  if (pTab->offsets && pTab->indexDelim == pCur->delim &&
+      !strcmp(pTab->indexPath, pCur->in) &&
+      linesSameFile(&pTab->indexStat, &pCur->st))
+    return SQLITE_OK;
 
-  for (int i = 0; i < LINES_IDXSTR_LENGTH; i++) {
-    switch (idxStr[i]) {
-    case LINES_IDXSTR_ROWID: {
-      targetRowid = sqlite3_value_int64(argv[i]);
-      break;
-    }
-    case LINES_IDXSTR_PATH: {
-      int nByte = sqlite3_value_bytes(argv[i]);
-      void *pData = (void *)sqlite3_value_blob(argv[i]);
-      int errnum;
-      pCur->fp = fmemopen(pData, nByte, "r");
-      if (pCur->fp == NULL) {
-        int errnum;
-        errnum = errno;
-        pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf(
-            "Error reading document, size=%d: %s", nByte, strerror(errnum));
-        return SQLITE_ERROR;
-      }
-      break;
-    }
-    case LINES_IDXSTR_DELIMITER: {
-      int nByte = sqlite3_value_bytes(argv[i]);
-      if (nByte != 1) {
-        pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf(
-            "Delimiter must be 1 character long, got %d characters", nByte);
-        return SQLITE_ERROR;
+  sqlite3_free(pTab->indexPath);
+  sqlite3_free(pTab->offsets);
+  pTab->indexPath = 0;
+  pTab->offsets = 0;
+  pTab->nOffsets = 0;
+
+  sqlite3_int64 n = 0, capacity = 1024;
+  sqlite3_int64 *offsets = sqlite3_malloc64(capacity * sizeof(*offsets));
+  if (offsets == 0)
+    return SQLITE_NOMEM;
+  const char *p = pCur->data;
+  const char *end = pCur->data + pCur->size;
+  while (p < end) {
+    if (n == capacity) {
+      sqlite3_int64 *o =
+          sqlite3_realloc64(offsets, capacity * 2 * sizeof(*offsets));
+      if (o == 0) {
+        sqlite3_free(offsets);
+        return SQLITE_NOMEM;
       }
-      const char *s = (const char *)sqlite3_value_text(argv[i]);
-      delim = s[0];
-      break;
-    }
+      offsets = o;
+      capacity *= 2;
     }
+    offsets[n++] = p - pCur->data;
+    const char *e = memchr(p, pCur->delim, end - p);
+    p = e ? e + 1 : end;
   }
-
-  pCur->curLineContents = 0;
-  pCur->curLineLength =
-      getdelim(&pCur->curLineContents, &pCur->curLineLen, delim, pCur->fp);
-  pCur->iRowid = 1;
-  pCur->delim = delim;
-  pCur->idxNum = idxNum;
-  pCur->in = "";
-
-  if (pCur->idxNum == LINES_IDXNUM_ROWID_EQ) {
-    pCur->rowid_eq_yielded = 0;
-    while (pCur->iRowid < targetRowid && pCur->curLineLength >= 0) {
-      pCur->curLineLength =
-          getdelim(&pCur->curLineContents, &pCur->curLineLen, delim, pCur->fp);
-      pCur->iRowid++;
-    }
+  pTab->indexPath = sqlite3_mprintf("%s", pCur->in);
+  if (pTab->indexPath == 0) {
+    sqlite3_free(offsets);
+    return SQLITE_NOMEM;
   }
+  pTab->offsets = offsets;
+  pTab->nOffsets = n;
+  pTab->indexDelim = pCur->delim;
+  pTab->indexStat = pCur->st;
   return SQLITE_OK;
 }
 
-static int linesReadFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
-                           const char *idxStr, int argc, sqlite3_value **argv) {
-  int targetRowid;
-  char delim = '\n';
-
-  lines_cursor *pCur = (lines_cursor *)pVtabCursor;
-  if (pCur->fp != NULL) {
-    fclose(pCur->fp);
+/*
+** Puts the cursor on the given 1-based row. Mapped files jump straight
+** there with the line index, anything else reads its way forward.
+*/
+static int linesSeek(lines_cursor *pCur, lines_read_vtab *pTab,
+                     sqlite3_int64 row) {
+  int rc;
+  if (row < 1) {
+    pCur->eof = 1;
+    return SQLITE_OK;
+  }
+  if (pTab && pCur->mapped) {
+    rc = linesReadIndex(pTab, pCur);
+    if (rc != SQLITE_OK)
+      return rc;
+    if (row > pTab->nOffsets) {
+      pCur->eof = 1;
+      return SQLITE_OK;
+    }
+    pCur->pos = pTab->offsets[row - 1];
+    pCur->curLineLength = 0;
+    pCur->iRowid = row;
+    return linesNextLine(pCur);
+  }
+  rc = linesNextLine(pCur);
+  pCur->iRowid = 1;
+  while (rc == SQLITE_OK && !pCur->eof && pCur->iRowid < row) {
+    rc = linesNextLine(pCur);
+    pCur->iRowid++;
   }
-  if (pCur->curLineContents != NULL)
-    free(pCur->curLineContents);
+  return rc;
+}
 
-  for (int i = 0; i < LINES_IDXSTR_LENGTH; i++) {
+/*
+** Reads the idxStr arguments shared by lines() and lines_read() into
+** their cursor, returning the path or document argument.
+*/
+static int linesArguments(lines_cursor *pCur, const char *idxStr, int argc,
+                          sqlite3_value **argv, sqlite3_int64 *pRow,
+                          sqlite3_value **pIn) {
+  pCur->delim = '\n';
+  *pRow = 1;
+  *pIn = 0;
+  for (int i = 0; i < LINES_IDXSTR_LENGTH && i < argc; i++) {
     switch (idxStr[i]) {
     case LINES_IDXSTR_ROWID: {
-      targetRowid = sqlite3_value_int64(argv[i]);
+      *pRow = sqlite3_value_int64(argv[i]);
+      break;
+    }
+    case LINES_IDXSTR_OFFSET: {
+      sqlite3_int64 offset = sqlite3_value_int64(argv[i]);
+      if (offset > 0)
+        *pRow = offset + 1;
       break;
     }
     case LINES_IDXSTR_PATH: {
-      if (sqlite3_value_type(argv[i]) == SQLITE_NULL) {
-        pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf("path is null");
-        return SQLITE_ERROR;
-      }
-      char *path = (char *)sqlite3_value_text(argv[i]);
-      // TODO should we free this later?
-      pCur->in = (char *)path;
-
-      int errnum;
-      pCur->fp = fopen(path, "r");
-      if (pCur->fp == NULL) {
-        int errnum;
-        errnum = errno;
-        pVtabCursor->pVtab->zErrMsg =
-            sqlite3_mprintf("Error reading %s: %s", path, strerror(errnum));
-        return SQLITE_ERROR;
-      }
+      *pIn = argv[i];
       break;
     }
     case LINES_IDXSTR_DELIMITER: {
       int nByte = sqlite3_value_bytes(argv[i]);
       if (nByte != 1) {
-        pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf(
+        pCur->base.pVtab->zErrMsg = sqlite3_mprintf(
             "Delimiter must be 1 character long, got %d characters", nByte);
         return SQLITE_ERROR;
       }
       const char *s = (const char *)sqlite3_value_text(argv[i]);
-      delim = s[0];
+      pCur->delim = s[0];
       break;
     }
     }
   }
+  return SQLITE_OK;
+}
 
-  pCur->curLineContents = 0;
-  pCur->curLineLength =
-      getdelim(&pCur->curLineContents, &pCur->curLineLen, delim, pCur->fp);
-  pCur->iRowid = 1;
-  pCur->delim = delim;
+/*
+** This method is called to "rewind" the lines_cursor object back
+** to the first row of output.  This method is always called at least
+** once prior to any call to xColumn() or xRowid() or xEof().
+**
+** This routine should initialize the cursor and position it so that it
+** is pointing at the first row, or pointing off the end of the table
+** (so that xEof() will return true) if the table is empty.
+*/
+static int linesFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                       const char *idxStr, int argc, sqlite3_value **argv) {
+  lines_cursor *pCur = (lines_cursor *)pVtabCursor;
+  sqlite3_int64 row;
+  sqlite3_value *document;
+  int rc;
+
+  linesReset(pCur);
+  rc = linesArguments(pCur, idxStr, argc, argv, &row, &document);
+  if (rc != SQLITE_OK)
+    return rc;
+
+  // the document is copied, since it may not outlive this call
+  int nByte = sqlite3_value_bytes(document);
+  const void *pData = sqlite3_value_blob(document);
+  pCur->data = sqlite3_malloc64(nByte + 1);
+  if (pCur->data == NULL)
+    return SQLITE_NOMEM;
+  if (nByte)
+    memcpy(pCur->data, pData, nByte);
+  pCur->size = nByte;
+  pCur->capacity = nByte + 1;
   pCur->idxNum = idxNum;
+  pCur->eof = 0;
+  return linesSeek(pCur, 0, row);
+}
 
-  if (pCur->idxNum == LINES_IDXNUM_ROWID_EQ) {
-    pCur->rowid_eq_yielded = 0;
-    while (pCur->iRowid < targetRowid && pCur->curLineLength >= 0) {
-      pCur->curLineLength =
-          getdelim(&pCur->curLineContents, &pCur->curLineLen, delim, pCur->fp);
-      pCur->iRowid++;
+static int linesReadFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                           const char *idxStr, int argc, sqlite3_value **argv) {
+  lines_cursor *pCur = (lines_cursor *)pVtabCursor;
+  lines_read_vtab *pTab = (lines_read_vtab *)pVtabCursor->pVtab;
+  sqlite3_int64 row;
+  sqlite3_value *pathValue;
+  struct stat st;
+  int rc, fd;
+
+  rc = linesArguments(pCur, idxStr, argc, argv, &row, &pathValue);
+  if (rc != SQLITE_OK)
+    return rc;
+  if (sqlite3_value_type(pathValue) == SQLITE_NULL) {
+    pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf("path is null");
+    return SQLITE_ERROR;
+  }
+  const char *path = (const char *)sqlite3_value_text(pathValue);
+  if (path == NULL)
+    return SQLITE_NOMEM;
+
+  fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    int errnum;
+    errnum = errno;
+    pVtabCursor->pVtab->zErrMsg =
+        sqlite3_mprintf("Error reading %s: %s", path, strerror(errnum));
+    return SQLITE_ERROR;
+  }
+  if (fstat(fd, &st) != 0)
+    memset(&st, 0, sizeof(st));
+  if (pCur->mapped && linesSameFile(&pCur->st, &st)) {
+    // joins look rows up in the same file over and over, so keep it mapped
+    close(fd);
+  } else {
+    linesReset(pCur);
+    pCur->st = st;
+    pCur->fd = fd;
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        if (idxNum == LINES_IDXNUM_FULL && row == 1)
+          madvise(map, st.st_size, MADV_SEQUENTIAL);
+        close(fd);
+        pCur->fd = -1;
+        pCur->data = map;
+        pCur->size = st.st_size;
+        pCur->mapped = 1;
+      }
     }
   }
-  return SQLITE_OK;
+  sqlite3_free(pCur->in);
+  pCur->in = sqlite3_mprintf("%s", path);
+  if (pCur->in == NULL)
+    return SQLITE_NOMEM;
+  pCur->pos = 0;
+  pCur->curLineLength = 0;
+  pCur->idxNum = idxNum;
+  pCur->eof = 0;
+  return linesSeek(pCur, pTab, row);
 }
 
 static int linesReadConnect(sqlite3 *db, void *pUnused, int argcUnused,
                             const char *const *argvUnused,
                             sqlite3_vtab **ppVtab, char **pzErrUnused) {
-  sqlite3_vtab *pNew;
+  lines_read_vtab *pNew;
   int rc;
   (void)pUnused;
   (void)argcUnused;
@@ -470,7 +731,8 @@ static int linesReadConnect(sqlite3 *db, void *pUnused, int argcUnused,
   rc = sqlite3_declare_vtab(db, "CREATE TABLE x(line text,"
                                 "path hidden, delimiter hidden)");
   if (rc == SQLITE_OK) {
-    pNew = *ppVtab = sqlite3_malloc(sizeof(*pNew));
+    pNew = sqlite3_malloc(sizeof(*pNew));
+    *ppVtab = (sqlite3_vtab *)pNew;
     if (pNew == 0)
       return SQLITE_NOMEM;
     memset(pNew, 0, sizeof(*pNew));
@@ -507,30 +769,30 @@ static sqlite3_module linesModule = {
 };
 
 static sqlite3_module linesReadModule = {
-    0,                /* iVersion */
-    0,                /* xCreate */
-    linesReadConnect, /* xConnect */
-    linesBestIndex,   /* xBestIndex */
-    linesDisconnect,  /* xDisconnect */
-    0,                /* xDestroy */
-    linesOpen,        /* xOpen - open a cursor */
-    linesClose,       /* xClose - close a cursor */
-    linesReadFilter,  /* xFilter - configure scan constraints */
-    linesNext,        /* xNext - advance a cursor */
-    linesEof,         /* xEof - check for end of scan */
-    linesColumn,      /* xColumn - read data */
-    linesRowid,       /* xRowid - read data */
-    0,                /* xUpdate */
-    0,                /* xBegin */
-    0,                /* xSync */
-    0,                /* xCommit */
-    0,                /* xRollback */
-    0,                /* xFindMethod */
-    0,                /* xRename */
-    0,                /* xSavepoint */
-    0,                /* xRelease */
-    0,                /* xRollbackTo */
-    0                 /* xShadowName */
+    0,                   /* iVersion */
+    0,                   /* xCreate */
+    linesReadConnect,    /* xConnect */
+    linesBestIndex,      /* xBestIndex */
+    linesReadDisconnect, /* xDisconnect */
+    0,                   /* xDestroy */
+    linesOpen,           /* xOpen - open a cursor */
+    linesClose,          /* xClose - close a cursor */
+    linesReadFilter,     /* xFilter - configure scan constraints */
+    linesNext,           /* xNext - advance a cursor */
+    linesEof,            /* xEof - check for end of scan */
+    linesColumn,         /* xColumn - read data */
+    linesRowid,          /* xRowid - read data */
+    0,                   /* xUpdate */
+    0,                   /* xBegin */
+    0,                   /* xSync */
+    0,                   /* xCommit */
+    0,                   /* xRollback */
+    0,                   /* xFindMethod */
+    0,                   /* xRename */
+    0,                   /* xSavepoint */
+    0,                   /* xRelease */
+    0,                   /* xRollbackTo */
+    0                    /* xShadowName */
 };
 
 #pragma endregion
@@ -0,0 +1,471 @@
+//#include "sqlite3ext.h"
+#include "sqlite-shards.h"
+#include "sqlite-vec.h"
+#include "third_party/sqlite/sqlite3.h"
+///SQLITE_EXTENSION_INIT1
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// vec0_sharded runs one KNN query against several vec0 tables, usually
+// in databases attached from separate files, and merges the nearest
+// neighbors of all of them:
+//
+//     SELECT rowid, shard, distance
+//       FROM vec0_sharded('shard0.vec_items, shard1.vec_items',
+//                         'contents_embedding', :vector, 10);
+//
+// every table in a file database is searched by a thread of its own,
+// over a read-only connection to that file which is kept open as long
+// as the calling connection is, so the shards are searched concurrently
+// and only see committed rows. tables in memory or temp databases can't
+// be opened again and are searched in turn on the calling connection.
+// rowids are returned as is, so they should be unique across the tables
+
+// vector subtypes of sqlite-vec, which are lost once a vector is bound to
+// another connection's statement, so the query restates them
+#define SHARDS_VEC_BIT_SUBTYPE 224
+#define SHARDS_VEC_INT8_SUBTYPE 225
+
+#pragma region search
+
+typedef struct shards_hit shards_hit;
+struct shards_hit {
+  sqlite3_int64 rowid;
+  double distance;
+  int target;
+};
+
+typedef struct shards_target shards_target;
+struct shards_target {
+  char *schema;
+  char *table;
+  // the calling connection, or a worker connection to the schema's file
+  sqlite3 *db;
+  int worker;
+  // the query, shared by all targets
+  const char *column;
+  const void *vector;
+  int nVector;
+  int isBlob;
+  const char *wrap;
+  int k;
+  // results
+  shards_hit *hits;
+  int nHits;
+  int rc;
+  char *zErr;
+  pthread_t thread;
+  int threaded;
+};
+
+static void shards_search(shards_target *t) {
+  // a worker connection has the schema's file as main
+  char *zSql = sqlite3_mprintf(
+      "SELECT rowid, distance FROM \"%w\".\"%w\" WHERE \"%w\" MATCH %s(?1) "
+      "AND k = ?2",
+      t->worker ? "main" : t->schema, t->table, t->column, t->wrap);
+  if (!zSql) {
+    t->rc = SQLITE_NOMEM;
+    return;
+  }
+  sqlite3_stmt *stmt;
+  t->rc = sqlite3_prepare_v2(t->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (t->rc != SQLITE_OK) {
+    t->zErr = sqlite3_mprintf("%s: %s", t->schema, sqlite3_errmsg(t->db));
+    return;
+  }
+  if (t->isBlob) {
+    sqlite3_bind_blob(stmt, 1, t->vector, t->nVector, SQLITE_STATIC);
+  } else {
+    sqlite3_bind_text(stmt, 1, t->vector, t->nVector, SQLITE_STATIC);
+  }
+  sqlite3_bind_int(stmt, 2, t->k);
+
+  t->hits = sqlite3_malloc64(sizeof(shards_hit) * (t->k ? t->k : 1));
+  if (!t->hits) {
+    sqlite3_finalize(stmt);
+    t->rc = SQLITE_NOMEM;
+    return;
+  }
+  t->nHits = 0;
+  while ((t->rc = sqlite3_step(stmt)) == SQLITE_ROW && t->nHits < t->k) {
+    shards_hit *hit = &t->hits[t->nHits++];
+    hit->rowid = sqlite3_column_int64(stmt, 0);
+    hit->distance = sqlite3_column_double(stmt, 1);
+  }
+  if (t->rc == SQLITE_ROW || t->rc == SQLITE_DONE) {
+    t->rc = SQLITE_OK;
+  } else {
+    t->zErr = sqlite3_mprintf("%s: %s", t->schema, sqlite3_errmsg(t->db));
+  }
+  sqlite3_finalize(stmt);
+}
+
+static void *shards_search_worker(void *arg) {
+  shards_search(arg);
+  return NULL;
+}
+
+static int shards_hit_cmp(const void *a, const void *b) {
+  double x = ((const shards_hit *)a)->distance;
+  double y = ((const shards_hit *)b)->distance;
+  return x < y ? -1 : x > y;
+}
+
+#pragma endregion
+
+#pragma region vec0_sharded
+
+typedef struct shards_conn shards_conn;
+struct shards_conn {
+  char *path;
+  sqlite3 *db;
+};
+
+typedef struct shards_vtab shards_vtab;
+struct shards_vtab {
+  sqlite3_vtab base;
+  sqlite3 *db;
+  // worker connections, one per file searched so far
+  shards_conn *conns;
+  int nConns;
+};
+
+typedef struct shards_cursor shards_cursor;
+struct shards_cursor {
+  sqlite3_vtab_cursor base;
+  shards_target *targets;
+  int nTargets;
+  shards_hit *hits;
+  int nHits;
+  int iHit;
+};
+
+#define SHARDS_SHARD 0
+#define SHARDS_DISTANCE 1
+#define SHARDS_TABLES 2
+#define SHARDS_COLUMN 3
+#define SHARDS_VECTOR 4
+#define SHARDS_K 5
+
+static int shardsConnect(sqlite3 *db, void *pAux, int argc,
+                         const char *const *argv, sqlite3_vtab **ppVtab,
+                         char **pzErr) {
+  shards_vtab *pNew;
+  int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(shard, distance, "
+                                    "tables hidden, \"column\" hidden, "
+                                    "vector hidden, k hidden)");
+  if (rc != SQLITE_OK)
+    return rc;
+  pNew = sqlite3_malloc(sizeof(*pNew));
+  if (!pNew)
+    return SQLITE_NOMEM;
+  memset(pNew, 0, sizeof(*pNew));
+  pNew->db = db;
+  *ppVtab = &pNew->base;
+  return SQLITE_OK;
+}
+
+static int shardsDisconnect(sqlite3_vtab *pVtab) {
+  shards_vtab *p = (shards_vtab *)pVtab;
+  for (int i = 0; i < p->nConns; i++) {
+    sqlite3_close(p->conns[i].db);
+    sqlite3_free(p->conns[i].path);
+  }
+  sqlite3_free(p->conns);
+  sqlite3_free(p);
+  return SQLITE_OK;
+}
+
+// Returns the worker connection to the file at path, opening it the
+// first time, or NULL if it can't be opened.
+static sqlite3 *shards_conn_get(shards_vtab *p, const char *path) {
+  for (int i = 0; i < p->nConns; i++) {
+    if (strcmp(p->conns[i].path, path) == 0)
+      return p->conns[i].db;
+  }
+  shards_conn *conns =
+      sqlite3_realloc64(p->conns, sizeof(shards_conn) * (p->nConns + 1));
+  if (!conns)
+    return NULL;
+  p->conns = conns;
+  sqlite3 *db;
+  if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                      NULL) != SQLITE_OK ||
+      sqlite3_vec_init(db, NULL, NULL) != SQLITE_OK) {
+    sqlite3_close(db);
+    return NULL;
+  }
+  char *zPath = sqlite3_mprintf("%s", path);
+  if (!zPath) {
+    sqlite3_close(db);
+    return NULL;
+  }
+  conns[p->nConns].path = zPath;
+  conns[p->nConns].db = db;
+  p->nConns++;
+  return db;
+}
+
+static int shardsBestIndex(sqlite3_vtab *pVTab, sqlite3_index_info *pIdxInfo) {
+  int aIdx[4] = {-1, -1, -1, -1};
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
+    if (pCons->iColumn < SHARDS_TABLES)
+      continue;
+    if (!pCons->usable)
+      return SQLITE_CONSTRAINT;
+    if (pCons->op == SQLITE_INDEX_CONSTRAINT_EQ)
+      aIdx[pCons->iColumn - SHARDS_TABLES] = i;
+  }
+  for (int j = 0; j < 4; j++) {
+    if (aIdx[j] < 0) {
+      sqlite3_free(pVTab->zErrMsg);
+      pVTab->zErrMsg = sqlite3_mprintf(
+          "vec0_sharded needs the tables, column, vector, and k arguments");
+      return SQLITE_ERROR;
+    }
+    pIdxInfo->aConstraintUsage[aIdx[j]].argvIndex = j + 1;
+    pIdxInfo->aConstraintUsage[aIdx[j]].omit = 1;
+  }
+  pIdxInfo->estimatedCost = 1000;
+  pIdxInfo->estimatedRows = 10;
+  return SQLITE_OK;
+}
+
+static int shardsOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor) {
+  shards_cursor *pCur = sqlite3_malloc(sizeof(*pCur));
+  if (!pCur)
+    return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static void shardsReset(shards_cursor *pCur) {
+  for (int i = 0; i < pCur->nTargets; i++) {
+    sqlite3_free(pCur->targets[i].schema);
+    sqlite3_free(pCur->targets[i].table);
+    sqlite3_free(pCur->targets[i].hits);
+    sqlite3_free(pCur->targets[i].zErr);
+  }
+  sqlite3_free(pCur->targets);
+  sqlite3_free(pCur->hits);
+  pCur->targets = NULL;
+  pCur->nTargets = 0;
+  pCur->hits = NULL;
+  pCur->nHits = 0;
+  pCur->iHit = 0;
+}
+
+static int shardsClose(sqlite3_vtab_cursor *cur) {
+  shards_cursor *pCur = (shards_cursor *)cur;
+  shardsReset(pCur);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+// Splits "schema.table, table, ..." into targets, where a table without
+// a schema is in main.
+static int shards_parse_tables(shards_cursor *pCur, const char *z) {
+  int n = 1;
+  for (const char *p = z; *p; p++)
+    n += *p == ',';
+  pCur->targets = sqlite3_malloc64(sizeof(shards_target) * n);
+  if (!pCur->targets)
+    return SQLITE_NOMEM;
+  memset(pCur->targets, 0, sizeof(shards_target) * n);
+  while (*z) {
+    while (*z == ' ' || *z == ',')
+      z++;
+    const char *end = z;
+    while (*end && *end != ',')
+      end++;
+    const char *last = end;
+    while (last > z && last[-1] == ' ')
+      last--;
+    if (last > z) {
+      shards_target *t = &pCur->targets[pCur->nTargets++];
+      const char *dot = memchr(z, '.', last - z);
+      if (dot) {
+        t->schema = sqlite3_mprintf("%.*s", (int)(dot - z), z);
+        t->table = sqlite3_mprintf("%.*s", (int)(last - dot - 1), dot + 1);
+      } else {
+        t->schema = sqlite3_mprintf("main");
+        t->table = sqlite3_mprintf("%.*s", (int)(last - z), z);
+      }
+      if (!t->schema || !t->table)
+        return SQLITE_NOMEM;
+    }
+    z = end;
+  }
+  return SQLITE_OK;
+}
+
+static int shardsFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                        const char *idxStr, int argc, sqlite3_value **argv) {
+  shards_cursor *pCur = (shards_cursor *)pVtabCursor;
+  shards_vtab *p = (shards_vtab *)pVtabCursor->pVtab;
+  int rc;
+
+  shardsReset(pCur);
+  const char *zTables = (const char *)sqlite3_value_text(argv[0]);
+  const char *zColumn = (const char *)sqlite3_value_text(argv[1]);
+  int k = sqlite3_value_int(argv[3]);
+  if (!zTables || !zColumn) {
+    sqlite3_free(p->base.zErrMsg);
+    p->base.zErrMsg = sqlite3_mprintf("tables and column must be text");
+    return SQLITE_ERROR;
+  }
+  if (k <= 0)
+    return SQLITE_OK;
+  rc = shards_parse_tables(pCur, zTables);
+  if (rc != SQLITE_OK)
+    return rc;
+
+  // the vector is read here, since threads mustn't touch sqlite3_value
+  int isBlob = sqlite3_value_type(argv[2]) == SQLITE_BLOB;
+  const void *vector = isBlob ? sqlite3_value_blob(argv[2])
+                              : (const void *)sqlite3_value_text(argv[2]);
+  int nVector = sqlite3_value_bytes(argv[2]);
+  const char *wrap = "";
+  if (isBlob && sqlite3_value_subtype(argv[2]) == SHARDS_VEC_BIT_SUBTYPE)
+    wrap = "vec_bit";
+  if (isBlob && sqlite3_value_subtype(argv[2]) == SHARDS_VEC_INT8_SUBTYPE)
+    wrap = "vec_int8";
+
+  for (int i = 0; i < pCur->nTargets; i++) {
+    shards_target *t = &pCur->targets[i];
+    t->column = zColumn;
+    t->vector = vector;
+    t->nVector = nVector;
+    t->isBlob = isBlob;
+    t->wrap = wrap;
+    t->k = k;
+    t->db = p->db;
+    const char *path = sqlite3_db_filename(p->db, t->schema);
+    if (path && *path) {
+      sqlite3 *db = shards_conn_get(p, path);
+      // a connection can only serve one thread, so another table in
+      // the same file is searched here
+      for (int j = 0; j < i && db; j++) {
+        if (pCur->targets[j].db == db)
+          db = NULL;
+      }
+      if (db) {
+        t->db = db;
+        t->worker = 1;
+        t->threaded = !pthread_create(&t->thread, NULL, shards_search_worker, t);
+      }
+    }
+  }
+  // the rest run here while the threads work
+  for (int i = 0; i < pCur->nTargets; i++) {
+    if (!pCur->targets[i].threaded)
+      shards_search(&pCur->targets[i]);
+  }
+  int nHits = 0;
+  for (int i = 0; i < pCur->nTargets; i++) {
+    shards_target *t = &pCur->targets[i];
+    if (t->threaded)
+      pthread_join(t->thread, NULL);
+    nHits += t->nHits;
+  }
+  for (int i = 0; i < pCur->nTargets; i++) {
+    shards_target *t = &pCur->targets[i];
+    if (t->rc != SQLITE_OK) {
+      sqlite3_free(p->base.zErrMsg);
+      p->base.zErrMsg = t->zErr ? sqlite3_mprintf("%s", t->zErr) : NULL;
+      return t->rc;
+    }
+  }
+
+  pCur->hits = sqlite3_malloc64(sizeof(shards_hit) * (nHits ? nHits : 1));
+  if (!pCur->hits)
+    return SQLITE_NOMEM;
+  for (int i = 0; i < pCur->nTargets; i++) {
+    shards_target *t = &pCur->targets[i];
+    for (int j = 0; j < t->nHits; j++) {
+      t->hits[j].target = i;
+      pCur->hits[pCur->nHits++] = t->hits[j];
+    }
+  }
+  qsort(pCur->hits, pCur->nHits, sizeof(shards_hit), shards_hit_cmp);
+  if (pCur->nHits > k)
+    pCur->nHits = k;
+  return SQLITE_OK;
+}
+
+static int shardsNext(sqlite3_vtab_cursor *cur) {
+  ((shards_cursor *)cur)->iHit++;
+  return SQLITE_OK;
+}
+
+static int shardsEof(sqlite3_vtab_cursor *cur) {
+  shards_cursor *pCur = (shards_cursor *)cur;
+  return pCur->iHit >= pCur->nHits;
+}
+
+static int shardsRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
+  shards_cursor *pCur = (shards_cursor *)cur;
+  *pRowid = pCur->hits[pCur->iHit].rowid;
+  return SQLITE_OK;
+}
+
+static int shardsColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx,
+                        int i) {
+  shards_cursor *pCur = (shards_cursor *)cur;
+  shards_hit *hit = &pCur->hits[pCur->iHit];
+  switch (i) {
+  case SHARDS_SHARD:
+    sqlite3_result_text(ctx, pCur->targets[hit->target].schema, -1,
+                        SQLITE_TRANSIENT);
+    break;
+  case SHARDS_DISTANCE:
+    sqlite3_result_double(ctx, hit->distance);
+    break;
+  default:
+    sqlite3_result_null(ctx);
+  }
+  return SQLITE_OK;
+}
+
+static sqlite3_module shardsModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ shardsConnect,
+    /* xBestIndex  */ shardsBestIndex,
+    /* xDisconnect */ shardsDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ shardsOpen,
+    /* xClose      */ shardsClose,
+    /* xFilter     */ shardsFilter,
+    /* xNext       */ shardsNext,
+    /* xEof        */ shardsEof,
+    /* xColumn     */ shardsColumn,
+    /* xRowid      */ shardsRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0};
+
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int sqlite3_shards_init(sqlite3 *db, char **pzErrMsg,
+                        const sqlite3_api_routines *pApi) {
+  //SQLITE_EXTENSION_INIT2(pApi);
+  return sqlite3_create_module(db, "vec0_sharded", &shardsModule, 0);
+}
+
+#pragma endregion
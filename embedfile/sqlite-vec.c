@@ -10,9 +10,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #ifndef SQLITE_VEC_OMIT_FS
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #ifndef SQLITE_CORE
@@ -2735,15 +2740,24 @@ int npy_scanner_next(struct NpyScanner *scanner, struct NpyToken *out) {
 }
 
 #define NPY_PARSE_ERROR "Error parsing numpy array: "
-int parse_npy_header(sqlite3_vtab *pVTab, const unsigned char *header,
-                     size_t headerLength,
-                     enum VectorElementType *out_element_type,
-                     int *fortran_order, size_t *numElements,
-                     size_t *numDimensions) {
+/**
+ * @brief Parse the header dictionary of a .npy file.
+ *
+ * @param descr: when not NULL, the quoted dtype the array must have, ex
+ * "'<i8'", and out_element_type is left alone. When NULL, the dtype must be
+ * one vec0 can store: '<f4', '|i1', or '|u1' for bit vectors, in which case
+ * the second dimension is counted in bits rather than bytes.
+ */
+static int npy_parse_header(sqlite3_vtab *pVTab, const unsigned char *header,
+                            size_t headerLength, const char *descr,
+                            enum VectorElementType *out_element_type,
+                            int *fortran_order, size_t *numElements,
+                            size_t *numDimensions) {
 
   struct NpyScanner scanner;
   struct NpyToken token;
   int rc;
+  int isBit = 0;
   npy_scanner_init(&scanner, header, headerLength);
 
   if (npy_scanner_next(&scanner, &token) != VEC0_TOKEN_RESULT_SOME &&
@@ -2785,13 +2799,24 @@ int parse_npy_header(sqlite3_vtab *pVTab, const unsigned char *header,
                        "expected a string value after 'descr' key");
         return SQLITE_ERROR;
       }
-      if (strncmp((char *)token.start, "'<f4'", strlen("'<f4'")) != 0) {
-        vtab_set_error(
-            pVTab, NPY_PARSE_ERROR
-            "Only '<f4' values are supported in sqlite-vec numpy functions");
+      if (descr) {
+        if (strncmp((char *)token.start, descr, strlen(descr)) != 0) {
+          vtab_set_error(pVTab, NPY_PARSE_ERROR "Expected a %s array", descr);
+          return SQLITE_ERROR;
+        }
+      } else if (strncmp((char *)token.start, "'<f4'", strlen("'<f4'")) == 0) {
+        *out_element_type = SQLITE_VEC_ELEMENT_TYPE_FLOAT32;
+      } else if (strncmp((char *)token.start, "'|i1'", strlen("'|i1'")) == 0) {
+        *out_element_type = SQLITE_VEC_ELEMENT_TYPE_INT8;
+      } else if (strncmp((char *)token.start, "'|u1'", strlen("'|u1'")) == 0) {
+        *out_element_type = SQLITE_VEC_ELEMENT_TYPE_BIT;
+        isBit = 1;
+      } else {
+        vtab_set_error(pVTab, NPY_PARSE_ERROR
+                       "Only '<f4', '|i1', and '|u1' values are supported in "
+                       "sqlite-vec numpy functions");
         return SQLITE_ERROR;
       }
-      *out_element_type = SQLITE_VEC_ELEMENT_TYPE_FLOAT32;
     } else if (strncmp((char *)key, "'fortran_order'",
                        strlen("'fortran_order'")) == 0) {
       rc = npy_scanner_next(&scanner, &token);
@@ -2868,9 +2893,21 @@ int parse_npy_header(sqlite3_vtab *pVTab, const unsigned char *header,
     }
   }
 
+  if (isBit) {
+    *numDimensions *= CHAR_BIT;
+  }
   return SQLITE_OK;
 }
 
+int parse_npy_header(sqlite3_vtab *pVTab, const unsigned char *header,
+                     size_t headerLength,
+                     enum VectorElementType *out_element_type,
+                     int *fortran_order, size_t *numElements,
+                     size_t *numDimensions) {
+  return npy_parse_header(pVTab, header, headerLength, NULL, out_element_type,
+                          fortran_order, numElements, numDimensions);
+}
+
 typedef struct vec_npy_each_vtab vec_npy_each_vtab;
 struct vec_npy_each_vtab {
   sqlite3_vtab base;
@@ -3427,6 +3464,7 @@ static sqlite3_module vec_npy_eachModule = {
 #define REPORT_URL "https://github.com/asg017/sqlite-vec/issues/new"
 
 typedef struct vec0_vtab vec0_vtab;
+typedef struct vec0_query_stats vec0_query_stats;
 
 #define VEC0_MAX_VECTOR_COLUMNS   16
 #define VEC0_MAX_PARTITION_COLUMNS 4
@@ -3570,6 +3608,11 @@ struct vec0_vtab {
    * Must be cleaned up with sqlite3_finalize().
    */
   sqlite3_stmt *stmtRowidsGetChunkPosition;
+
+  // Where the counters of the latest KNN query on this connection go, for
+  // vec0_last_query_stats(). Shared by every vec0 table of the connection,
+  // and NULL when the module was registered without one.
+  vec0_query_stats *lastQueryStats;
 };
 
 /**
@@ -4559,6 +4602,42 @@ void vec0_query_fullscan_data_clear(
   }
 }
 
+// Counters for a single KNN query, filled in by vec0Filter_knn().
+struct vec0_query_stats {
+  // set once a KNN query has run
+  int valid;
+  char tableName[64];
+  char columnName[64];
+  i64 k;
+  i64 k_used;
+  // chunks whose vectors were read and compared
+  i64 chunks_scanned;
+  // chunks where no row was left after validity, rowid, and metadata
+  // filters, so their vectors were never read
+  i64 chunks_skipped;
+  i64 vectors_compared;
+  // bytes of validity, rowid, vector, and metadata blobs read
+  i64 bytes_read;
+  // nanoseconds spent stepping _chunks and reading vector blobs, applying
+  // rowid and metadata filters, computing distances, and merging the
+  // top k of each chunk, and in the whole of xFilter
+  i64 read_ns;
+  i64 filter_ns;
+  i64 distance_ns;
+  i64 merge_ns;
+  i64 total_ns;
+};
+
+static i64 vec0_clock_ns(void) {
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  timespec_get(&ts, TIME_UTC);
+#endif
+  return (i64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 struct vec0_query_knn_data {
   i64 k;
   i64 k_used;
@@ -4567,6 +4646,7 @@ struct vec0_query_knn_data {
   // Array of distances of size k. Must be freed with sqlite3_free().
   f32 *distances;
   i64 current_idx;
+  struct vec0_query_stats stats;
 };
 void vec0_query_knn_data_clear(struct vec0_query_knn_data *knn_data) {
   if (!knn_data)
@@ -4635,7 +4715,6 @@ void vec0_cursor_clear(vec0_cursor *pCur) {
 #define VEC_CONSTRUCTOR_ERROR "vec0 constructor error: "
 static int vec0_init(sqlite3 *db, void *pAux, int argc, const char *const *argv,
                      sqlite3_vtab **ppVtab, char **pzErr, bool isCreate) {
-  UNUSED_PARAMETER(pAux);
   vec0_vtab *pNew;
   int rc;
   const char *zSql;
@@ -4922,6 +5001,7 @@ static int vec0_init(sqlite3 *db, void *pAux, int argc, const char *const *argv,
   const char *tableName = argv[2];
 
   pNew->db = db;
+  pNew->lastQueryStats = pAux;
   pNew->pkIsText = pkColumnType == SQLITE_TEXT;
   pNew->schemaName = sqlite3_mprintf("%s", schemaName);
   if (!pNew->schemaName) {
@@ -6452,7 +6532,8 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
                                struct Array * aMetadataIn,
                                const char * idxStr, int argc, sqlite3_value ** argv,
                                void *queryVector, i64 k, i64 **out_topk_rowids,
-                               f32 **out_topk_distances, i64 *out_used) {
+                               f32 **out_topk_distances, i64 *out_used,
+                               struct vec0_query_stats *stats) {
   // for each chunk, get top min(k, chunk_size) rowid + distances to query vec.
   // then reconcile all topk_chunks for a true top k.
   // output only rowids + distances for now
@@ -6568,6 +6649,7 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
   }
 
   while (true) {
+    i64 chunkStarted = vec0_clock_ns();
     rc = sqlite3_step(stmtChunks);
     if (rc == SQLITE_DONE) {
       break;
@@ -6608,36 +6690,9 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
       goto cleanup;
     }
 
-    // open the vector chunk blob for the current chunk
-    rc = sqlite3_blob_open(p->db, p->schemaName,
-                           p->shadowVectorChunksNames[vectorColumnIdx],
-                           "vectors", chunk_id, 0, &blobVectors);
-    if (rc != SQLITE_OK) {
-      vtab_set_error(&p->base, "could not open vectors blob for chunk %lld",
-                     chunk_id);
-      rc = SQLITE_ERROR;
-      goto cleanup;
-    }
-
-    i64 currentBaseVectorsSize = sqlite3_blob_bytes(blobVectors);
-    i64 expectedBaseVectorsSize =
-        p->chunk_size * vector_column_byte_size(*vector_column);
-    if (currentBaseVectorsSize != expectedBaseVectorsSize) {
-      // IMP: V16465_00535
-      vtab_set_error(
-          &p->base,
-          "vectors blob size doesn't match - expected %lld, found %lld",
-          expectedBaseVectorsSize, currentBaseVectorsSize);
-      rc = SQLITE_ERROR;
-      goto cleanup;
-    }
-    rc = sqlite3_blob_read(blobVectors, baseVectors, currentBaseVectorsSize, 0);
-
-    if (rc != SQLITE_OK) {
-      vtab_set_error(&p->base, "vectors blob read error for %lld", chunk_id);
-      rc = SQLITE_ERROR;
-      goto cleanup;
-    }
+    stats->bytes_read += validitySize + rowidsSize;
+    i64 filterStarted = vec0_clock_ns();
+    stats->read_ns += filterStarted - chunkStarted;
 
     bitmap_copy(b, chunkValidity, p->chunk_size);
     if (arrayRowidsIn) {
@@ -6682,14 +6737,66 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
           }
         }
         bitmap_and_inplace(b, bmMetadata, p->chunk_size);
+        stats->bytes_read += sqlite3_blob_bytes(metadataBlobs[metadata_idx]);
+      }
+    }
+
+    // nothing in this chunk can match, so don't read its vectors
+    i64 readStarted = vec0_clock_ns();
+    stats->filter_ns += readStarted - filterStarted;
+    int candidates = 0;
+    for (int i = 0; i < p->chunk_size / CHAR_BIT; i++) {
+      if (b[i]) {
+        candidates = 1;
+        break;
       }
     }
+    if (!candidates) {
+      stats->chunks_skipped++;
+      continue;
+    }
+
+    // open the vector chunk blob for the current chunk
+    rc = sqlite3_blob_open(p->db, p->schemaName,
+                           p->shadowVectorChunksNames[vectorColumnIdx],
+                           "vectors", chunk_id, 0, &blobVectors);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&p->base, "could not open vectors blob for chunk %lld",
+                     chunk_id);
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
+
+    i64 currentBaseVectorsSize = sqlite3_blob_bytes(blobVectors);
+    i64 expectedBaseVectorsSize =
+        p->chunk_size * vector_column_byte_size(*vector_column);
+    if (currentBaseVectorsSize != expectedBaseVectorsSize) {
+      // IMP: V16465_00535
+      vtab_set_error(
+          &p->base,
+          "vectors blob size doesn't match - expected %lld, found %lld",
+          expectedBaseVectorsSize, currentBaseVectorsSize);
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
+    rc = sqlite3_blob_read(blobVectors, baseVectors, currentBaseVectorsSize, 0);
+
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&p->base, "vectors blob read error for %lld", chunk_id);
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
 
+    stats->bytes_read += currentBaseVectorsSize;
+    stats->chunks_scanned++;
+    i64 distanceStarted = vec0_clock_ns();
+    stats->read_ns += distanceStarted - readStarted;
 
     for (int i = 0; i < p->chunk_size; i++) {
       if (!bitmap_get(b, i)) {
         continue;
       };
+      stats->vectors_compared++;
 
       f32 result;
       switch (vector_column->element_type) {
@@ -6750,6 +6857,8 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
       chunk_distances[i] = result;
     }
 
+    i64 mergeStarted = vec0_clock_ns();
+    stats->distance_ns += mergeStarted - distanceStarted;
     int used1;
     min_idx(chunk_distances, p->chunk_size, b, chunk_topk_idxs,
             min(k, p->chunk_size), bTaken, &used1);
@@ -6769,6 +6878,7 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
     // fails.
     sqlite3_blob_close(blobVectors);
     blobVectors = NULL;
+    stats->merge_ns += vec0_clock_ns() - mergeStarted;
   }
 
   *out_topk_rowids = topk_rowids;
@@ -6804,6 +6914,7 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
   assert(argc == (strlen(idxStr)-1) / 4);
   int rc;
   struct vec0_query_knn_data *knn_data;
+  i64 started = vec0_clock_ns();
 
   int vectorColumnIdx = idxNum;
   struct VectorColumnDefinition *vector_column =
@@ -7044,7 +7155,7 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
   i64 k_used = 0;
   rc = vec0Filter_knn_chunks_iter(p, stmtChunks, vector_column, vectorColumnIdx,
                                   arrayRowidsIn, aMetadataIn, idxStr, argc, argv, queryVector, k, &topk_rowids,
-                                  &topk_distances, &k_used);
+                                  &topk_distances, &k_used, &knn_data->stats);
   if (rc != SQLITE_OK) {
     goto cleanup;
   }
@@ -7055,6 +7166,19 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
   knn_data->distances = topk_distances;
   knn_data->k_used = k_used;
 
+  struct vec0_query_stats *stats = &knn_data->stats;
+  stats->valid = 1;
+  sqlite3_snprintf(sizeof(stats->tableName), stats->tableName, "%s",
+                   p->tableName);
+  sqlite3_snprintf(sizeof(stats->columnName), stats->columnName, "%.*s",
+                   vector_column->name_length, vector_column->name);
+  stats->k = k;
+  stats->k_used = k_used;
+  stats->total_ns = vec0_clock_ns() - started;
+  if (p->lastQueryStats) {
+    *p->lastQueryStats = *stats;
+  }
+
   pCur->knn_data = knn_data;
   pCur->query_plan = VEC0_QUERY_PLAN_KNN;
   rc = SQLITE_OK;
@@ -8913,6 +9037,58 @@ static int vec0Rollback(sqlite3_vtab *pVTab) {
   return SQLITE_OK;
 }
 
+static void vec0_str_append_json_string(sqlite3_str *str, const char *z) {
+  sqlite3_str_appendchar(str, 1, '"');
+  for (; *z; z++) {
+    if (*z == '"' || *z == '\\') {
+      sqlite3_str_appendchar(str, 1, '\\');
+      sqlite3_str_appendchar(str, 1, *z);
+    } else if ((unsigned char)*z < 0x20) {
+      sqlite3_str_appendf(str, "\\u%04x", *z);
+    } else {
+      sqlite3_str_appendchar(str, 1, *z);
+    }
+  }
+  sqlite3_str_appendchar(str, 1, '"');
+}
+
+// vec0_last_query_stats(): a JSON object of the counters of the latest
+// KNN query on this connection, or NULL before the first one. Times are
+// in milliseconds.
+static void vec0_last_query_stats(sqlite3_context *context, int argc,
+                                  sqlite3_value **argv) {
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+  vec0_query_stats *stats = sqlite3_user_data(context);
+  if (!stats->valid) {
+    sqlite3_result_null(context);
+    return;
+  }
+  sqlite3_str *str = sqlite3_str_new(sqlite3_context_db_handle(context));
+  sqlite3_str_appendall(str, "{\"table\":");
+  vec0_str_append_json_string(str, stats->tableName);
+  sqlite3_str_appendall(str, ",\"column\":");
+  vec0_str_append_json_string(str, stats->columnName);
+  sqlite3_str_appendf(
+      str,
+      ",\"k\":%lld,\"k_used\":%lld,\"chunks_scanned\":%lld,"
+      "\"chunks_skipped\":%lld,\"vectors_compared\":%lld,\"bytes_read\":%lld,"
+      "\"ms\":{\"total\":%.3f,\"read\":%.3f,\"filter\":%.3f,"
+      "\"distance\":%.3f,\"merge\":%.3f}}",
+      stats->k, stats->k_used, stats->chunks_scanned, stats->chunks_skipped,
+      stats->vectors_compared, stats->bytes_read, stats->total_ns / 1e6,
+      stats->read_ns / 1e6, stats->filter_ns / 1e6, stats->distance_ns / 1e6,
+      stats->merge_ns / 1e6);
+  int n = sqlite3_str_length(str);
+  char *z = sqlite3_str_finish(str);
+  if (!z) {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  sqlite3_result_text(context, z, n, sqlite3_free);
+  sqlite3_result_subtype(context, JSON_SUBTYPE);
+}
+
 static sqlite3_module vec0Module = {
     /* iVersion      */ 3,
     /* xCreate       */ vec0Create,
@@ -8944,6 +9120,898 @@ static sqlite3_module vec0Module = {
 };
 #pragma endregion
 
+#ifndef SQLITE_VEC_OMIT_FS
+#pragma region vec0_export() and vec0_import()
+
+typedef enum {
+  VEC0_IO_FORMAT_NPY,
+  VEC0_IO_FORMAT_FVECS,
+} vec0_io_format;
+
+// What vec0_export() and vec0_import() need to know about a vec0 table,
+// parsed from its CREATE VIRTUAL TABLE statement the same way vec0_init()
+// parses its arguments.
+struct vec0_io_table {
+  // Both must be freed with sqlite3_free()
+  char *schemaName;
+  char *tableName;
+
+  // The first vector column. Its name must be freed with sqlite3_free()
+  struct VectorColumnDefinition vector;
+  int numVectorColumns;
+
+  // Partition key, auxiliary, and metadata columns, which are stored in
+  // shadow tables that vec0_import() doesn't fill.
+  int numOtherColumns;
+
+  int pkIsText;
+  int chunk_size;
+};
+
+static void vec0_io_table_clear(struct vec0_io_table *t) {
+  sqlite3_free(t->schemaName);
+  sqlite3_free(t->tableName);
+  sqlite3_free(t->vector.name);
+  memset(t, 0, sizeof(*t));
+}
+
+static int vec0_io_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int vec0_io_table_argument(struct vec0_io_table *t, const char *arg,
+                                  int n, char **pzErr) {
+  struct VectorColumnDefinition vecColumn;
+  vec0_metadata_column_kind kind;
+  char *cName;
+  int cNameLength;
+  int cType;
+  char *key;
+  char *value;
+  int keyLength, valueLength;
+  int rc;
+
+  while (n > 0 && vec0_io_is_space(arg[0])) {
+    arg++;
+    n--;
+  }
+  while (n > 0 && vec0_io_is_space(arg[n - 1])) {
+    n--;
+  }
+  if (n == 0) {
+    return SQLITE_OK;
+  }
+
+  rc = vec0_parse_vector_column(arg, n, &vecColumn);
+  if (rc == SQLITE_ERROR) {
+    *pzErr = sqlite3_mprintf("could not parse vector column '%.*s'", n, arg);
+    return SQLITE_ERROR;
+  }
+  if (rc == SQLITE_OK) {
+    if (t->numVectorColumns++ == 0) {
+      memcpy(&t->vector, &vecColumn, sizeof(vecColumn));
+    } else {
+      sqlite3_free(vecColumn.name);
+    }
+    return SQLITE_OK;
+  }
+  if (vec0_parse_partition_key_definition(arg, n, &cName, &cNameLength,
+                                          &cType) == SQLITE_OK) {
+    t->numOtherColumns++;
+    return SQLITE_OK;
+  }
+  if (vec0_parse_primary_key_definition(arg, n, &cName, &cNameLength,
+                                        &cType) == SQLITE_OK) {
+    t->pkIsText = cType == SQLITE_TEXT;
+    return SQLITE_OK;
+  }
+  if (vec0_parse_auxiliary_column_definition(arg, n, &cName, &cNameLength,
+                                             &cType) == SQLITE_OK ||
+      vec0_parse_metadata_column_definition(arg, n, &cName, &cNameLength,
+                                            &kind) == SQLITE_OK) {
+    t->numOtherColumns++;
+    return SQLITE_OK;
+  }
+  if (vec0_parse_table_option(arg, n, &key, &keyLength, &value,
+                              &valueLength) == SQLITE_OK &&
+      sqlite3_strnicmp(key, "chunk_size", keyLength) == 0) {
+    t->chunk_size = atoi(value);
+  }
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Look up the vec0 table zTable, which may be qualified with a schema
+ * name, searching temp, main, then attached schemas like SQLite does, and read
+ * its columns and chunk size.
+ *
+ * @param t: filled in on success, must be cleaned up with
+ * vec0_io_table_clear() either way
+ * @param pzErr: on SQLITE_ERROR, may be set to an error message that must be
+ * freed with sqlite3_free()
+ */
+static int vec0_io_table_describe(sqlite3 *db, const char *zTable,
+                                  struct vec0_io_table *t, char **pzErr) {
+  sqlite3_stmt *stmt = NULL;
+  char *zSql;
+  int rc;
+
+  memset(t, 0, sizeof(*t));
+  t->chunk_size = 1024;
+
+  rc = sqlite3_prepare_v2(
+      db,
+      "SELECT schema, name FROM pragma_table_list "
+      "WHERE (name = ?1 OR schema || '.' || name = ?1) AND type = 'virtual' "
+      "ORDER BY schema <> 'temp', schema <> 'main' LIMIT 1",
+      -1, &stmt, NULL);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  sqlite3_bind_text(stmt, 1, zTable, -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    *pzErr = sqlite3_mprintf("no such vec0 table: %s", zTable);
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  t->schemaName = sqlite3_mprintf("%s", sqlite3_column_text(stmt, 0));
+  t->tableName = sqlite3_mprintf("%s", sqlite3_column_text(stmt, 1));
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+  if (!t->schemaName || !t->tableName) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+
+  zSql = sqlite3_mprintf("SELECT sql FROM \"%w\".sqlite_schema "
+                         "WHERE type = 'table' AND name = ?1",
+                         t->schemaName);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  sqlite3_bind_text(stmt, 1, t->tableName, -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    *pzErr = sqlite3_mprintf("no such vec0 table: %s", zTable);
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  const char *sql = (const char *)sqlite3_column_text(stmt, 0);
+  int n = sqlite3_column_bytes(stmt, 0);
+
+  // The module arguments are everything between "vec0(" and the last ")".
+  const char *start = NULL;
+  const char *end = sql ? sql + n - 1 : NULL;
+  for (int i = 0; sql && i + 4 <= n && !start; i++) {
+    if (sqlite3_strnicmp(&sql[i], "vec0", 4) == 0) {
+      int j = i + 4;
+      while (j < n && vec0_io_is_space(sql[j])) {
+        j++;
+      }
+      if (j < n && sql[j] == '(') {
+        start = &sql[j + 1];
+      }
+    }
+  }
+  while (start && end >= start && *end != ')') {
+    end--;
+  }
+  if (!start || end < start) {
+    *pzErr = sqlite3_mprintf("%s is not a vec0 table", zTable);
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+
+  // Split on the commas that aren't quoted or inside parentheses. Like in
+  // SQL, [...] quotes too.
+  const char *arg = start;
+  char quote = 0;
+  int depth = 0;
+  for (const char *c = start;; c++) {
+    if (c == end || (!quote && !depth && *c == ',')) {
+      rc = vec0_io_table_argument(t, arg, c - arg, pzErr);
+      if (rc != SQLITE_OK || c == end) {
+        break;
+      }
+      arg = c + 1;
+    } else if (quote) {
+      if (*c == quote) {
+        quote = 0;
+      }
+    } else if (*c == '\'' || *c == '"' || *c == '`') {
+      quote = *c;
+    } else if (*c == '[') {
+      quote = ']';
+    } else if (*c == '(') {
+      depth++;
+    } else if (*c == ')') {
+      depth--;
+    }
+  }
+
+done:
+  sqlite3_finalize(stmt);
+  return rc;
+}
+
+static int vec0_io_format_parse(sqlite3_context *context, int argc,
+                                sqlite3_value **argv, vec0_io_format *out) {
+  const char *zPath = (const char *)sqlite3_value_text(argv[1]);
+  const char *zFormat = argc > 2 ? (const char *)sqlite3_value_text(argv[2])
+                                 : NULL;
+  if (!zFormat) {
+    size_t n = zPath ? strlen(zPath) : 0;
+    zFormat = n > 6 && sqlite3_stricmp(&zPath[n - 6], ".fvecs") == 0 ? "fvecs"
+                                                                      : "npy";
+  }
+  if (sqlite3_stricmp(zFormat, "npy") == 0) {
+    *out = VEC0_IO_FORMAT_NPY;
+  } else if (sqlite3_stricmp(zFormat, "fvecs") == 0) {
+    *out = VEC0_IO_FORMAT_FVECS;
+  } else {
+    char *zErr = sqlite3_mprintf(
+        "Unknown format '%s', expected 'npy' or 'fvecs'", zFormat);
+    sqlite3_result_error(context, zErr, -1);
+    sqlite3_free(zErr);
+    return SQLITE_ERROR;
+  }
+  return SQLITE_OK;
+}
+
+// Vectors are written in chunk order rather than rowid order, so the rowid of
+// each one goes in a 1-D '<i8' array next to it: "items.npy" or "items.fvecs"
+// keeps its rowids in "items.rowids.npy".
+static char *vec0_io_rowids_path(const char *zPath, vec0_io_format format) {
+  const char *ext = format == VEC0_IO_FORMAT_NPY ? ".npy" : ".fvecs";
+  size_t n = strlen(zPath);
+  size_t e = strlen(ext);
+  if (n > e && sqlite3_stricmp(&zPath[n - e], ext) == 0) {
+    n -= e;
+  }
+  return sqlite3_mprintf("%.*s.rowids.npy", (int)n, zPath);
+}
+
+// Writes a version 1.0 .npy header, padded so the data is 64-byte aligned.
+// cols < 0 makes it a 1-D array.
+static void vec0_io_npy_header(FILE *f, const char *descr, i64 rows,
+                               i64 cols) {
+  char dict[128];
+  if (cols < 0) {
+    sqlite3_snprintf(sizeof(dict), dict,
+                     "{'descr': '%s', 'fortran_order': False, "
+                     "'shape': (%lld,), }",
+                     descr, rows);
+  } else {
+    sqlite3_snprintf(sizeof(dict), dict,
+                     "{'descr': '%s', 'fortran_order': False, "
+                     "'shape': (%lld, %lld), }",
+                     descr, rows, cols);
+  }
+  int n = strlen(dict);
+  int len = (10 + n + 1 + 63) / 64 * 64 - 10;
+  fwrite(NPY_MAGIC, 1, sizeof(NPY_MAGIC), f);
+  fputc(1, f);
+  fputc(0, f);
+  fputc(len & 0xff, f);
+  fputc(len >> 8, f);
+  fwrite(dict, 1, n, f);
+  for (int i = n; i < len - 1; i++) {
+    fputc(' ', f);
+  }
+  fputc('\n', f);
+}
+
+// Maps all of zPath read-only. *out is NULL for an empty file.
+static int vec0_io_map(const char *zPath, const unsigned char **out,
+                       size_t *outLength) {
+  struct stat st;
+  int fd = open(zPath, O_RDONLY);
+  if (fd < 0) {
+    return SQLITE_CANTOPEN;
+  }
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return SQLITE_IOERR;
+  }
+  *out = NULL;
+  *outLength = st.st_size;
+  if (st.st_size > 0) {
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      return SQLITE_IOERR;
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    *out = p;
+  }
+  close(fd);
+  return SQLITE_OK;
+}
+
+static void vec0_io_unmap(const unsigned char *p, size_t n) {
+  if (p) {
+    munmap((void *)p, n);
+  }
+}
+
+/**
+ * @brief Find the array data of a mapped .npy file of any version.
+ *
+ * @param descr: see npy_parse_header()
+ * @param data: output, the first byte after the header
+ */
+static int vec0_io_npy_data(sqlite3_vtab *pVTab, const unsigned char *p,
+                            size_t n, const char *descr,
+                            enum VectorElementType *element_type,
+                            size_t *numElements, size_t *numDimensions,
+                            const unsigned char **data) {
+  size_t headerLength;
+  size_t offset;
+  int fortran_order;
+  int rc;
+
+  if (n < 10 || memcmp(p, NPY_MAGIC, sizeof(NPY_MAGIC)) != 0) {
+    vtab_set_error(pVTab,
+                   "numpy array file does not contain the 'magic' header");
+    return SQLITE_ERROR;
+  }
+  if (p[6] == 1) {
+    uint16_t len;
+    memcpy(&len, &p[8], sizeof(len));
+    headerLength = len;
+    offset = 10;
+  } else {
+    uint32_t len = 0;
+    if (n >= 12) {
+      memcpy(&len, &p[8], sizeof(len));
+    }
+    headerLength = len;
+    offset = 12;
+  }
+  if (offset + headerLength > n) {
+    vtab_set_error(pVTab, "numpy array file header length is invalid");
+    return SQLITE_ERROR;
+  }
+  rc = npy_parse_header(pVTab, &p[offset], headerLength, descr, element_type,
+                        &fortran_order, numElements, numDimensions);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  *data = &p[offset + headerLength];
+  return SQLITE_OK;
+}
+
+static const char *vec0_io_npy_descr(enum VectorElementType element_type) {
+  switch (element_type) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
+    return "<f4";
+  case SQLITE_VEC_ELEMENT_TYPE_INT8:
+    return "|i1";
+  case SQLITE_VEC_ELEMENT_TYPE_BIT:
+    return "|u1";
+  }
+  return NULL;
+}
+
+/**
+ * @brief vec0_export(table, path [, format]) writes every vector of a vec0
+ * table to path, along with their rowids, and returns how many it wrote.
+ *
+ * format is 'npy' (the default, any element type) or 'fvecs' (float32 only),
+ * and is guessed from a .fvecs extension when left out. Vectors are copied
+ * from the chunk blobs a run of valid rows at a time, which for a full chunk
+ * is a single fwrite().
+ */
+static void vec0_export(sqlite3_context *context, int argc,
+                        sqlite3_value **argv) {
+  sqlite3 *db = sqlite3_context_db_handle(context);
+  const char *zTable = (const char *)sqlite3_value_text(argv[0]);
+  const char *zPath = (const char *)sqlite3_value_text(argv[1]);
+  struct vec0_io_table t;
+  vec0_io_format format;
+  sqlite3_stmt *stmt = NULL;
+  FILE *out = NULL;
+  FILE *outRowids = NULL;
+  char *zRowids = NULL;
+  char *zErr = NULL;
+  char *zSql;
+  i64 count = 0;
+  i64 written = 0;
+  int rc;
+
+  memset(&t, 0, sizeof(t));
+  if (!zTable || !zPath) {
+    sqlite3_result_error(context, "vec0_export() needs a table and a path",
+                         -1);
+    return;
+  }
+  if (vec0_io_format_parse(context, argc, argv, &format) != SQLITE_OK) {
+    return;
+  }
+  rc = vec0_io_table_describe(db, zTable, &t, &zErr);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  if (t.numVectorColumns != 1 || t.pkIsText) {
+    zErr = sqlite3_mprintf("vec0_export() only supports tables with a single "
+                           "vector column and an integer primary key");
+    goto done;
+  }
+  if (format == VEC0_IO_FORMAT_FVECS &&
+      t.vector.element_type != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+    zErr = sqlite3_mprintf("fvecs files can only hold float32 vectors");
+    goto done;
+  }
+  size_t vectorSize = vector_column_byte_size(t.vector);
+
+  // The .npy header comes first, so count the valid rows of every chunk.
+  zSql = sqlite3_mprintf("SELECT validity FROM " VEC0_SHADOW_CHUNKS_NAME,
+                         t.schemaName, t.tableName);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const u8 *validity = sqlite3_column_blob(stmt, 0);
+    int n = sqlite3_column_bytes(stmt, 0);
+    for (int i = 0; i < n; i++) {
+      count += __builtin_popcountl(validity[i]);
+    }
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+  if (rc != SQLITE_DONE) {
+    goto done;
+  }
+
+  zRowids = vec0_io_rowids_path(zPath, format);
+  if (!zRowids) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  out = fopen(zPath, "wb");
+  outRowids = out ? fopen(zRowids, "wb") : NULL;
+  if (!outRowids) {
+    zErr = sqlite3_mprintf("Could not open %s for writing",
+                           out ? zRowids : zPath);
+    goto done;
+  }
+  setvbuf(out, NULL, _IOFBF, 1 << 20);
+  if (format == VEC0_IO_FORMAT_NPY) {
+    // Bit vectors are stored as '|u1' bytes.
+    i64 cols = t.vector.element_type == SQLITE_VEC_ELEMENT_TYPE_BIT
+                   ? t.vector.dimensions / CHAR_BIT
+                   : t.vector.dimensions;
+    vec0_io_npy_header(out, vec0_io_npy_descr(t.vector.element_type), count,
+                       cols);
+  }
+  vec0_io_npy_header(outRowids, "<i8", count, -1);
+
+  zSql = sqlite3_mprintf("SELECT chunks.validity, chunks.rowids, "
+                         "vectors.vectors FROM " VEC0_SHADOW_CHUNKS_NAME
+                         " AS chunks JOIN " VEC0_SHADOW_VECTOR_N_NAME
+                         " AS vectors ON vectors.rowid = chunks.chunk_id "
+                         "ORDER BY chunks.chunk_id",
+                         t.schemaName, t.tableName, t.schemaName, t.tableName,
+                         0);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    u8 *validity = (u8 *)sqlite3_column_blob(stmt, 0);
+    size_t n = sqlite3_column_bytes(stmt, 0) * CHAR_BIT;
+    const u8 *rowids = sqlite3_column_blob(stmt, 1);
+    n = min(n, sqlite3_column_bytes(stmt, 1) / sizeof(i64));
+    const u8 *vectors = sqlite3_column_blob(stmt, 2);
+    n = min(n, sqlite3_column_bytes(stmt, 2) / vectorSize);
+
+    size_t i = 0;
+    while (i < n) {
+      if (!bitmap_get(validity, i)) {
+        i++;
+        continue;
+      }
+      size_t j = i + 1;
+      while (j < n && bitmap_get(validity, j)) {
+        j++;
+      }
+      if (format == VEC0_IO_FORMAT_NPY) {
+        fwrite(&vectors[i * vectorSize], vectorSize, j - i, out);
+      } else {
+        i32 dimensions = t.vector.dimensions;
+        for (size_t k = i; k < j; k++) {
+          fwrite(&dimensions, sizeof(dimensions), 1, out);
+          fwrite(&vectors[k * vectorSize], vectorSize, 1, out);
+        }
+      }
+      fwrite(&rowids[i * sizeof(i64)], sizeof(i64), j - i, outRowids);
+      written += j - i;
+      i = j;
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto done;
+  }
+  rc = SQLITE_OK;
+  if (written != count) {
+    zErr = sqlite3_mprintf("%s has chunks without vectors", zTable);
+    goto done;
+  }
+
+done:
+  sqlite3_finalize(stmt);
+  if (out && fclose(out) != 0 && rc == SQLITE_OK && !zErr) {
+    zErr = sqlite3_mprintf("Could not write %s", zPath);
+  }
+  if (outRowids && fclose(outRowids) != 0 && rc == SQLITE_OK && !zErr) {
+    zErr = sqlite3_mprintf("Could not write %s", zRowids);
+  }
+  if (zErr) {
+    sqlite3_result_error(context, zErr, -1);
+  } else if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+  } else {
+    sqlite3_result_int64(context, written);
+  }
+  sqlite3_free(zErr);
+  sqlite3_free(zRowids);
+  vec0_io_table_clear(&t);
+}
+
+/**
+ * @brief vec0_import(table, path [, format]) appends the vectors in a file
+ * written by vec0_export() or numpy to a vec0 table, and returns how many it
+ * imported.
+ *
+ * Rather than going through vec0's INSERT one row at a time, the file is
+ * mapped into memory and written into new chunks directly, so a full chunk of
+ * a .npy file goes from the mapping into its _vector_chunks blob without a
+ * copy. Rowids come from the "*.rowids.npy" file next to path when there is
+ * one, and continue after the table's largest rowid otherwise. Only tables
+ * with a single vector column and an integer primary key are supported. The
+ * whole import is rolled back on any error, such as a rowid that's taken.
+ */
+static void vec0_import(sqlite3_context *context, int argc,
+                        sqlite3_value **argv) {
+  sqlite3 *db = sqlite3_context_db_handle(context);
+  const char *zTable = (const char *)sqlite3_value_text(argv[0]);
+  const char *zPath = (const char *)sqlite3_value_text(argv[1]);
+  struct vec0_io_table t;
+  vec0_io_format format;
+  // Collects npy_parse_header() errors.
+  sqlite3_vtab errors;
+  const unsigned char *source = NULL;
+  size_t sourceLength = 0;
+  const unsigned char *sourceRowids = NULL;
+  size_t sourceRowidsLength = 0;
+  const unsigned char *vectors = NULL;
+  const unsigned char *rowids = NULL;
+  sqlite3_stmt *stmtChunk = NULL;
+  sqlite3_stmt *stmtVectors = NULL;
+  sqlite3_stmt *stmtRowid = NULL;
+  u8 *validity = NULL;
+  i64 *chunkRowids = NULL;
+  u8 *chunkVectors = NULL;
+  char *zRowids = NULL;
+  char *zErr = NULL;
+  char *zSql;
+  size_t count = 0;
+  size_t imported = 0;
+  i64 nextRowid = 1;
+  int savepoint = 0;
+  int rc;
+
+  memset(&t, 0, sizeof(t));
+  memset(&errors, 0, sizeof(errors));
+  if (!zTable || !zPath) {
+    sqlite3_result_error(context, "vec0_import() needs a table and a path",
+                         -1);
+    return;
+  }
+  if (vec0_io_format_parse(context, argc, argv, &format) != SQLITE_OK) {
+    return;
+  }
+  rc = vec0_io_table_describe(db, zTable, &t, &zErr);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  if (t.numVectorColumns != 1 || t.numOtherColumns || t.pkIsText) {
+    zErr = sqlite3_mprintf("vec0_import() only supports tables with a single "
+                           "vector column and an integer primary key");
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  size_t vectorSize = vector_column_byte_size(t.vector);
+  size_t recordSize = vectorSize;
+
+  rc = vec0_io_map(zPath, &source, &sourceLength);
+  if (rc != SQLITE_OK) {
+    zErr = sqlite3_mprintf("Could not open %s", zPath);
+    goto done;
+  }
+  if (format == VEC0_IO_FORMAT_NPY) {
+    enum VectorElementType element_type;
+    size_t dimensions;
+    rc = vec0_io_npy_data(&errors, source, sourceLength, NULL, &element_type,
+                          &count, &dimensions, &vectors);
+    if (rc != SQLITE_OK) {
+      zErr = sqlite3_mprintf("%s: %s", zPath, errors.zErrMsg);
+      goto done;
+    }
+    if (count && (element_type != t.vector.element_type ||
+                  dimensions != t.vector.dimensions)) {
+      zErr = sqlite3_mprintf("The vectors in %s don't have the element type "
+                             "and dimensions of %s",
+                             zPath, zTable);
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    if ((size_t)(source + sourceLength - vectors) != count * vectorSize) {
+      zErr = sqlite3_mprintf("%s: Expected a data size of %lld, found %lld",
+                             zPath, (i64)(count * vectorSize),
+                             (i64)(source + sourceLength - vectors));
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+  } else {
+    if (t.vector.element_type != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+      zErr = sqlite3_mprintf("fvecs files can only hold float32 vectors");
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    // Each vector is prefixed with its number of dimensions as an int32.
+    recordSize = sizeof(i32) + vectorSize;
+    if (sourceLength % recordSize) {
+      zErr = sqlite3_mprintf("%s is not a .fvecs file of %lld dimensional "
+                             "vectors",
+                             zPath, (i64)t.vector.dimensions);
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    count = sourceLength / recordSize;
+    vectors = source;
+  }
+
+  zRowids = vec0_io_rowids_path(zPath, format);
+  if (!zRowids) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  if (access(zRowids, F_OK) == 0) {
+    enum VectorElementType unused;
+    size_t numElements;
+    size_t numDimensions;
+    size_t numRowids;
+    rc = vec0_io_map(zRowids, &sourceRowids, &sourceRowidsLength);
+    if (rc != SQLITE_OK) {
+      zErr = sqlite3_mprintf("Could not open %s", zRowids);
+      goto done;
+    }
+    rc = vec0_io_npy_data(&errors, sourceRowids, sourceRowidsLength, "'<i8'",
+                          &unused, &numElements, &numDimensions, &rowids);
+    if (rc != SQLITE_OK) {
+      zErr = sqlite3_mprintf("%s: %s", zRowids, errors.zErrMsg);
+      goto done;
+    }
+    // npy_parse_header() reads a 1-D (N,) shape as a single N dimensional
+    // vector, but (N, 1) is fine too.
+    numRowids = numDimensions == 1 ? numElements : numDimensions;
+    if ((numElements > 1 && numDimensions > 1) || numRowids != count ||
+        (size_t)(sourceRowids + sourceRowidsLength - rowids) !=
+            count * sizeof(i64)) {
+      zErr = sqlite3_mprintf("%s does not hold one rowid for each of the "
+                             "%lld vectors in %s",
+                             zRowids, (i64)count, zPath);
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+  } else {
+    // Continue after the largest rowid the table has ever had, like its
+    // AUTOINCREMENT _rowids table would.
+    zSql = sqlite3_mprintf(
+        "SELECT max(coalesce((SELECT max(rowid) FROM " VEC0_SHADOW_ROWIDS_NAME
+        "), 0), coalesce((SELECT seq FROM \"%w\".sqlite_sequence "
+        "WHERE name = ?1 || '_rowids'), 0)) + 1",
+        t.schemaName, t.tableName, t.schemaName);
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto done;
+    }
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmtRowid, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+    sqlite3_bind_text(stmtRowid, 1, t.tableName, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmtRowid);
+    if (rc != SQLITE_ROW) {
+      goto done;
+    }
+    nextRowid = sqlite3_column_int64(stmtRowid, 0);
+    sqlite3_finalize(stmtRowid);
+    stmtRowid = NULL;
+  }
+
+  rc = sqlite3_exec(db, "SAVEPOINT vec0_import", NULL, NULL, NULL);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  savepoint = 1;
+
+  zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_CHUNKS_NAME
+                         "(size, validity, rowids) VALUES (?1, ?2, ?3)",
+                         t.schemaName, t.tableName);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &stmtChunk, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_VECTOR_N_NAME
+                         "(rowid, vectors) VALUES (?1, ?2)",
+                         t.schemaName, t.tableName, 0);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &stmtVectors, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_ROWIDS_NAME
+                         "(rowid, chunk_id, chunk_offset) VALUES (?1, ?2, ?3)",
+                         t.schemaName, t.tableName);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &stmtRowid, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+
+  validity = sqlite3_malloc(t.chunk_size / CHAR_BIT);
+  chunkRowids = sqlite3_malloc(t.chunk_size * sizeof(i64));
+  chunkVectors = sqlite3_malloc64(t.chunk_size * vectorSize);
+  if (!validity || !chunkRowids || !chunkVectors) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+
+  while (imported < count) {
+    size_t n = min((size_t)t.chunk_size, count - imported);
+    const void *chunk = chunkVectors;
+
+    memset(validity, 0, t.chunk_size / CHAR_BIT);
+    memset(validity, 0xff, n / CHAR_BIT);
+    if (n % CHAR_BIT) {
+      validity[n / CHAR_BIT] = (1 << (n % CHAR_BIT)) - 1;
+    }
+
+    memset(chunkRowids, 0, t.chunk_size * sizeof(i64));
+    if (rowids) {
+      memcpy(chunkRowids, &rowids[imported * sizeof(i64)], n * sizeof(i64));
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        chunkRowids[i] = nextRowid++;
+      }
+    }
+
+    if (format == VEC0_IO_FORMAT_NPY && n == (size_t)t.chunk_size) {
+      chunk = &vectors[imported * vectorSize];
+    } else {
+      memset(chunkVectors, 0, t.chunk_size * vectorSize);
+      for (size_t i = 0; i < n; i++) {
+        const unsigned char *record = &vectors[(imported + i) * recordSize];
+        if (format == VEC0_IO_FORMAT_FVECS) {
+          i32 dimensions;
+          memcpy(&dimensions, record, sizeof(dimensions));
+          if (dimensions < 0 || (size_t)dimensions != t.vector.dimensions) {
+            zErr = sqlite3_mprintf("Vector %lld of %s has %d dimensions, "
+                                   "expected %lld",
+                                   (i64)(imported + i), zPath, dimensions,
+                                   (i64)t.vector.dimensions);
+            rc = SQLITE_ERROR;
+            goto done;
+          }
+          record += sizeof(dimensions);
+        }
+        memcpy(&chunkVectors[i * vectorSize], record, vectorSize);
+      }
+    }
+
+    sqlite3_bind_int64(stmtChunk, 1, t.chunk_size);
+    sqlite3_bind_blob(stmtChunk, 2, validity, t.chunk_size / CHAR_BIT,
+                      SQLITE_STATIC);
+    sqlite3_bind_blob(stmtChunk, 3, chunkRowids, t.chunk_size * sizeof(i64),
+                      SQLITE_STATIC);
+    rc = sqlite3_step(stmtChunk);
+    sqlite3_reset(stmtChunk);
+    if (rc != SQLITE_DONE) {
+      goto done;
+    }
+    i64 chunkId = sqlite3_last_insert_rowid(db);
+
+    sqlite3_bind_int64(stmtVectors, 1, chunkId);
+    sqlite3_bind_blob64(stmtVectors, 2, chunk, t.chunk_size * vectorSize,
+                        SQLITE_STATIC);
+    rc = sqlite3_step(stmtVectors);
+    sqlite3_reset(stmtVectors);
+    if (rc != SQLITE_DONE) {
+      goto done;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      sqlite3_bind_int64(stmtRowid, 1, chunkRowids[i]);
+      sqlite3_bind_int64(stmtRowid, 2, chunkId);
+      sqlite3_bind_int64(stmtRowid, 3, i);
+      rc = sqlite3_step(stmtRowid);
+      sqlite3_reset(stmtRowid);
+      if (rc != SQLITE_DONE) {
+        goto done;
+      }
+    }
+    imported += n;
+  }
+  rc = SQLITE_OK;
+
+done:
+  if (rc != SQLITE_OK && !zErr) {
+    zErr = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+  }
+  sqlite3_finalize(stmtChunk);
+  sqlite3_finalize(stmtVectors);
+  sqlite3_finalize(stmtRowid);
+  if (savepoint) {
+    if (rc != SQLITE_OK) {
+      sqlite3_exec(db, "ROLLBACK TO vec0_import", NULL, NULL, NULL);
+    }
+    if (sqlite3_exec(db, "RELEASE vec0_import", NULL, NULL, NULL) !=
+            SQLITE_OK &&
+        !zErr) {
+      zErr = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+    }
+  }
+  if (zErr) {
+    sqlite3_result_error(context, zErr, -1);
+  } else {
+    sqlite3_result_int64(context, imported);
+  }
+  sqlite3_free(validity);
+  sqlite3_free(chunkRowids);
+  sqlite3_free(chunkVectors);
+  sqlite3_free(zErr);
+  sqlite3_free(zRowids);
+  sqlite3_free(errors.zErrMsg);
+  vec0_io_unmap(source, sourceLength);
+  vec0_io_unmap(sourceRowids, sourceRowidsLength);
+  vec0_io_table_clear(&t);
+}
+
+#pragma endregion
+#endif
+
 static char *POINTER_NAME_STATIC_BLOB_DEF = "vec0-static_blob_def";
 struct static_blob_definition {
   void *p;
@@ -9667,7 +10735,6 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
     void (*xDestroy)(void *);
   } aMod[] = {
       // clang-format off
-    {"vec0",          &vec0Module,          NULL, NULL},
     {"vec_each",      &vec_eachModule,      NULL, NULL},
       // clang-format on
   };
@@ -9683,6 +10750,30 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
     }
   }
 
+  // vec0 tables record the counters of each KNN query here, and
+  // vec0_last_query_stats() reads them back
+  vec0_query_stats *lastQueryStats = sqlite3_malloc(sizeof(*lastQueryStats));
+  if (!lastQueryStats) {
+    return SQLITE_NOMEM;
+  }
+  memset(lastQueryStats, 0, sizeof(*lastQueryStats));
+  rc = sqlite3_create_module_v2(db, "vec0", &vec0Module, lastQueryStats,
+                                sqlite3_free);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Error creating module vec0: %s",
+                                sqlite3_errmsg(db));
+    return rc;
+  }
+  rc = sqlite3_create_function_v2(db, "vec0_last_query_stats", 0,
+                                  SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE,
+                                  lastQueryStats, vec0_last_query_stats, NULL,
+                                  NULL, NULL);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Error creating function %s: %s",
+                                "vec0_last_query_stats", sqlite3_errmsg(db));
+    return rc;
+  }
+
   for (unsigned long i = 0; i < countof(aMod) && rc == SQLITE_OK; i++) {
     rc = sqlite3_create_module_v2(db, aMod[i].name, aMod[i].module, NULL, NULL);
     if (rc != SQLITE_OK) {
@@ -9709,6 +10800,20 @@ SQLITE_VEC_API int sqlite3_vec_numpy_init(sqlite3 *db, char **pzErrMsg,
     return rc;
   }
   rc = sqlite3_create_module_v2(db, "vec_npy_each", &vec_npy_eachModule, NULL, NULL);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+  // Both read or write files, so they can't be called from triggers or views.
+  for (int nArg = 2; nArg <= 3 && rc == SQLITE_OK; nArg++) {
+    rc = sqlite3_create_function_v2(db, "vec0_export", nArg,
+                                    SQLITE_UTF8 | SQLITE_DIRECTONLY, NULL,
+                                    vec0_export, NULL, NULL, NULL);
+    if (rc == SQLITE_OK) {
+      rc = sqlite3_create_function_v2(db, "vec0_import", nArg,
+                                      SQLITE_UTF8 | SQLITE_DIRECTONLY, NULL,
+                                      vec0_import, NULL, NULL, NULL);
+    }
+  }
   return rc;
 }
 #endif
@@ -34,6 +34,11 @@ extern "C" {
 SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
                   const sqlite3_api_routines *pApi);
 
+#ifndef SQLITE_VEC_OMIT_FS
+SQLITE_VEC_API int sqlite3_vec_numpy_init(sqlite3 *db, char **pzErrMsg,
+                  const sqlite3_api_routines *pApi);
+#endif
+
 #ifdef __cplusplus
 }  /* end of the 'extern "C"' block */
 #endif
@@ -0,0 +1,74 @@
+.mode qbox
+.header on
+.echo on
+.bail on
+
+create virtual table temp.whole using csv(header=yes, data='id,size,notes
+1,"5"" screen",plain
+2,5" screen,"first line
+second line"
+3,12" pizza,"says ""hi""
+then leaves"
+4,"two
+lines",plain
+');
+
+select rowid, * from temp.whole;
+
+create virtual table temp.part1 using csv(header=yes, parts=3, part=1, data='id,size,notes
+1,"5"" screen",plain
+2,5" screen,"first line
+second line"
+3,12" pizza,"says ""hi""
+then leaves"
+4,"two
+lines",plain
+');
+
+create virtual table temp.part2 using csv(header=yes, parts=3, part=2, data='id,size,notes
+1,"5"" screen",plain
+2,5" screen,"first line
+second line"
+3,12" pizza,"says ""hi""
+then leaves"
+4,"two
+lines",plain
+');
+
+create virtual table temp.part3 using csv(header=yes, parts=3, part=3, data='id,size,notes
+1,"5"" screen",plain
+2,5" screen,"first line
+second line"
+3,12" pizza,"says ""hi""
+then leaves"
+4,"two
+lines",plain
+');
+
+select 1 as part, rowid, * from temp.part1
+union all select 2, rowid, * from temp.part2
+union all select 3, rowid, * from temp.part3;
+
+.bail off
+
+-- a quote can only open a field, or close one right before a separator or
+-- a newline, and that holds whether the input is in memory or a pipe
+create virtual table temp.unescaped using csv(data='a,"b"c,d
+');
+
+select * from temp.unescaped;
+
+create virtual table temp.unterminated using csv(columns=2, data='a,"b
+c,d
+');
+
+select * from temp.unterminated;
+
+-- snapshot.sh feeds the same two documents through pipes on fd 3 and 4
+create virtual table temp.unescaped_pipe using csv(columns=3, filename='/dev/fd/3');
+
+select * from temp.unescaped_pipe;
+
+create virtual table temp.unterminated_pipe using csv(columns=2, filename='/dev/fd/4');
+
+select * from temp.unterminated_pipe;
@@ -0,0 +1,65 @@
+.mode qbox
+.header on
+.echo on
+.bail on
+
+-- snapshot.sh runs this in an empty directory, where the files are written
+
+-- 21 rows in chunks of 8 leave the last chunk partly filled, and the
+-- deletes leave holes in the validity bitmaps of all three chunks. The 17
+-- rows that are left don't fill the last chunk of the copy either
+create virtual table items using vec0(embedding float[3], chunk_size=8);
+
+insert into items(rowid, embedding)
+select value, json_array(value, value % 5, -value / 4.0)
+from generate_series(1, 21);
+
+delete from items where rowid in (2, 3, 9, 20);
+
+select vec0_export('items', 'items.npy');
+
+-- the vectors come out in chunk order, which is rowid order here
+select rowid, vec_to_json(vector) from vec_npy_each(vec_npy_file('items.npy'))
+limit 4;
+
+-- and the rowids of the rows that are left go next to them, as 17 int64
+-- after a header padded to 128 bytes
+select length(readfile('items.rowids.npy')) as bytes,
+  rtrim(cast(substr(readfile('items.rowids.npy'), 11, 118) as text),
+        ' ' || char(10)) as header;
+
+select count(*) from vec_npy_each(vec_npy_file('items.npy'));
+
+create virtual table copy using vec0(embedding float[3], chunk_size=8);
+
+select vec0_import('copy', 'items.npy');
+
+-- the copy keeps the rowids, holes included
+select
+  (select group_concat(rowid) from items) as items,
+  (select group_concat(rowid) from copy) as copy;
+
+select count(*) from (
+  select rowid, vec_to_json(embedding) from items
+  except
+  select rowid, vec_to_json(embedding) from copy
+);
+
+-- and finds the same neighbors at the same distances
+select rowid, distance from items
+where embedding match '[10, 1, -2]' and k = 5;
+
+select rowid, distance from copy
+where embedding match '[10, 1, -2]' and k = 5;
+
+-- new rows continue after the imported ones
+insert into copy(embedding) values ('[0, 0, 0]');
+
+select max(rowid) from copy;
+
+.bail off
+
+-- the rowids were taken by the first import, so a second one is rolled back
+select vec0_import('copy', 'items.npy');
+
+select count(*) from copy;
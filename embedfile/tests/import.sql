@@ -0,0 +1,17 @@
+.mode qbox
+.header on
+.echo on
+.bail on
+
+select count(*) from items;
+
+select count(*) from vec_items;
+
+-- the second import appends its items, and its chunks point at them
+select chunks.id, chunks.item, items.line
+from chunks
+join items on items.rowid = chunks.item
+order by chunks.id;
+
+-- and the full-text index returns them by their items rowid
+select rowid, line from fts_items where fts_items match 'chess OR violin' order by rowid;
@@ -0,0 +1,31 @@
+.mode qbox
+.header on
+.echo on
+.bail on
+
+create virtual table temp.lines using json_lines_read(filename='data/records.ndjson');
+
+select name, type from pragma_table_info('lines', 'temp');
+
+-- escapes and surrogate pairs are decoded, nested values stay JSON
+select rowid, id, name, tags, meta from temp.lines;
+
+-- integers are kept exactly while they fit in 64 bits
+select id, big, typeof(big) from temp.lines;
+
+create virtual table temp.array using json_array_read(filename='data/records.json');
+
+select rowid, * from temp.array;
+
+create virtual table temp.scalars using json_array_read(filename='data/values.json');
+
+select rowid, value, typeof(value) from temp.scalars;
+
+.bail off
+
+-- malformed records are reported while sampling, or while reading
+create virtual table temp.sampled using json_lines_read(filename='data/malformed.ndjson');
+
+create virtual table temp.malformed using json_lines_read(filename='data/malformed.ndjson', sample=1);
+
+select id from temp.malformed;
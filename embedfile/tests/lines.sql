@@ -0,0 +1,43 @@
+.mode qbox
+.header on
+.echo on
+.bail on
+
+-- CRLF endings are trimmed and the last line needs no newline
+select rowid, line, length(line) from lines_read('data/crlf.txt');
+
+select rowid, line from lines('one
+two' || char(13, 10) || 'three');
+
+select count(*) from lines_read('data/empty.txt');
+
+select count(*) from lines('');
+
+-- LIMIT and OFFSET jump into the file instead of reading up to them
+select rowid, line from lines_read('data/crlf.txt') limit 2 offset 1;
+
+select rowid, line from lines_read('data/crlf.txt') limit 10 offset 5;
+
+select rowid, line from lines_read('data/crlf.txt') where rowid = 4;
+
+select rowid, line from lines_read('data/crlf.txt') where rowid = 6;
+
+select rowid, line from lines('a
+b
+c') where rowid = 2;
+
+-- a join looks up each line by rowid
+select value, line
+from generate_series(5, 1, -2)
+join lines_read('data/crlf.txt') on lines_read.rowid = value;
+
+-- snapshot.sh opens fd 3 on a file of 100000 numbered lines, and fd 4 on
+-- a pipe carrying the same lines, which is read through a 64KiB buffer
+select count(*), sum(length(line)), max(rowid) from lines_read('/dev/fd/3');
+
+select rowid, line from lines_read('/dev/fd/3') where rowid = 99999;
+
+select rowid, line from lines_read('/dev/fd/3') limit 3 offset 65535;
+
+select count(*), sum(length(line)), max(rowid), max(cast(line as integer))
+from lines_read('/dev/fd/4');
@@ -0,0 +1,73 @@
+.mode qbox
+.header on
+.echo on
+.bail on
+
+-- snapshot.sh runs this in an empty directory, where the shards are created
+create virtual table temp.whole using vec0(embedding float[2]);
+
+insert into temp.whole(rowid, embedding)
+select value, json_array(value, value * value % 17)
+from generate_series(1, 30);
+
+attach 'shard0.db' as shard0;
+attach 'shard1.db' as shard1;
+attach 'shard2.db' as shard2;
+
+create virtual table shard0.items using vec0(embedding float[2]);
+create virtual table shard1.items using vec0(embedding float[2]);
+create virtual table shard2.items using vec0(embedding float[2]);
+
+insert into shard0.items select rowid, embedding from temp.whole where rowid % 3 = 0;
+insert into shard1.items select rowid, embedding from temp.whole where rowid % 3 = 1;
+insert into shard2.items select rowid, embedding from temp.whole where rowid % 3 = 2;
+
+select
+  (select count(*) from shard0.items) as shard0,
+  (select count(*) from shard1.items) as shard1,
+  (select count(*) from shard2.items) as shard2;
+
+-- each shard file is searched by a thread of its own, and the merged
+-- neighbors are the ones of the table that holds every row
+select rowid, shard, distance
+from vec0_sharded('shard0.items, shard1.items, shard2.items', 'embedding',
+                  '[12.5, 4.25]', 5);
+
+select rowid, distance from temp.whole
+where embedding match '[12.5, 4.25]' and k = 5;
+
+-- k larger than any one shard holds takes rows from all of them, and k
+-- larger than all of them together returns every row
+create temp table sharded as
+select 15 as k, rowid as id, distance
+from vec0_sharded('shard0.items, shard1.items, shard2.items', 'embedding',
+                  '[12.5, 4.25]', 15)
+union all
+select 50, rowid, distance
+from vec0_sharded('shard0.items, shard1.items, shard2.items', 'embedding',
+                  '[12.5, 4.25]', 50);
+
+create temp table single as
+select 15 as k, rowid as id, distance from temp.whole
+where embedding match '[12.5, 4.25]' and k = 15
+union all
+select 50, rowid, distance from temp.whole
+where embedding match '[12.5, 4.25]' and k = 50;
+
+select
+  k,
+  count(*) as rows,
+  count(distinct id) as rowids,
+  (select count(*) from temp.single where single.k = sharded.k) as single_rows,
+  (select count(*) from (
+    select id, distance from temp.sharded as s where s.k = sharded.k
+    except
+    select id, distance from temp.single as s where s.k = sharded.k
+  )) as mismatches
+from temp.sharded
+group by k;
+
+select rowid, shard, distance
+from vec0_sharded('shard0.items, shard1.items, shard2.items', 'embedding',
+                  '[12.5, 4.25]', 15)
+limit 5 offset 10;
@@ -4,3 +4,33 @@ TESTS_DIR=$(dirname "$(realpath "$0")")
 EMBEDFILE=$(realpath "$TESTS_DIR/../../../o/embedfile/embedfile")
 
 "$EMBEDFILE" sh < $TESTS_DIR/env.sql > $TESTS_DIR/__snapshots__/env.out
+"$EMBEDFILE" sh < $TESTS_DIR/stats.sql > $TESTS_DIR/__snapshots__/stats.out
+"$EMBEDFILE" sh < $TESTS_DIR/csv.sql > $TESTS_DIR/__snapshots__/csv.out 2>&1 \
+  3< <(printf 'a,"b"c,d\n') 4< <(printf 'a,"b\nc,d\n')
+
+# the file readers take paths relative to the tests directory
+(cd $TESTS_DIR && "$EMBEDFILE" sh < json.sql > __snapshots__/json.out 2>&1)
+
+LINES_TXT=$(mktemp)
+seq 1 100000 > $LINES_TXT
+(cd $TESTS_DIR && "$EMBEDFILE" sh < lines.sql > __snapshots__/lines.out \
+  3< $LINES_TXT 4< <(seq 1 100000))
+rm $LINES_TXT
+
+SHARDS_DIR=$(mktemp -d)
+(cd $SHARDS_DIR && "$EMBEDFILE" sh < $TESTS_DIR/shards.sql > $TESTS_DIR/__snapshots__/shards.out)
+rm -r $SHARDS_DIR
+
+EXPORT_DIR=$(mktemp -d)
+(cd $EXPORT_DIR && "$EMBEDFILE" sh < $TESTS_DIR/export.sql > $TESTS_DIR/__snapshots__/export.out 2>&1)
+rm -r $EXPORT_DIR
+
+# importing needs a model, e.g. EMBEDFILE_TEST_MODEL=all-MiniLM-L6-v2.Q8_0.gguf
+if [ -n "$EMBEDFILE_TEST_MODEL" ]; then
+  IMPORT_DB=$(mktemp -d)/import.db
+  for f in first second; do
+    "$EMBEDFILE" --model "$EMBEDFILE_TEST_MODEL" import --fts --chunk 64 $TESTS_DIR/data/$f.txt $IMPORT_DB > /dev/null
+  done
+  "$EMBEDFILE" sh $IMPORT_DB < $TESTS_DIR/import.sql > $TESTS_DIR/__snapshots__/import.out
+  rm -r $(dirname $IMPORT_DB)
+fi
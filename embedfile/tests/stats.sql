@@ -0,0 +1,69 @@
+.mode qbox
+.header on
+.echo on
+.bail on
+
+-- 5 chunks of 8 rows, one group per chunk
+create virtual table temp.items using vec0(
+  embedding float[2] distance_metric=l2,
+  grp integer,
+  chunk_size=8
+);
+
+insert into temp.items(rowid, embedding, grp)
+select value, json_array(value, value % 7), (value - 1) / 8
+from generate_series(1, 40);
+
+create view temp.last_stats as
+select
+  json_extract(vec0_last_query_stats(), '$.k') as k,
+  json_extract(vec0_last_query_stats(), '$.chunks_scanned') as chunks_scanned,
+  json_extract(vec0_last_query_stats(), '$.chunks_skipped') as chunks_skipped,
+  json_extract(vec0_last_query_stats(), '$.vectors_compared') as vectors_compared;
+
+select vec0_last_query_stats();
+
+-- no filter reads every chunk
+select rowid, distance from temp.items
+where embedding match '[20, 3]' and k = 3;
+
+select * from temp.last_stats;
+
+-- a metadata filter that only one chunk can satisfy skips the other four,
+-- and gives the same neighbors as a brute force search
+select rowid, distance from temp.items
+where embedding match '[20, 3]' and k = 3 and grp = 3;
+
+select * from temp.last_stats;
+
+select rowid, vec_distance_l2(embedding, '[20, 3]') as distance
+from temp.items where grp = 3
+order by distance limit 3;
+
+-- a rowid filter skips the chunks none of its rowids are in
+select rowid, distance from temp.items
+where embedding match '[20, 3]' and k = 3 and rowid in (2, 5, 33, 40);
+
+select * from temp.last_stats;
+
+select rowid, vec_distance_l2(embedding, '[20, 3]') as distance
+from temp.items where rowid in (2, 5, 33, 40)
+order by distance limit 3;
+
+-- deleting a whole chunk empties its validity bitmap, so it's skipped too
+delete from temp.items where grp = 2;
+
+select rowid, distance from temp.items
+where embedding match '[20, 3]' and k = 3;
+
+select * from temp.last_stats;
+
+select rowid, vec_distance_l2(embedding, '[20, 3]') as distance
+from temp.items
+order by distance limit 3;
+
+-- no rows left to compare at all
+select rowid, distance from temp.items
+where embedding match '[20, 3]' and k = 3 and grp = 2;
+
+select * from temp.last_stats;
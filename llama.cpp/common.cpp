@@ -243,6 +243,10 @@ bool gpt_params_find_arg(int argc, char ** argv, const std::string & arg, gpt_pa
         llamafile_trapping_enabled(+1);
         return true;
     }
+    if (arg == "--pin-threads") {
+        FLAG_pin_threads = true;
+        return true;
+    }
     if (arg == "--unsecure") {
         FLAG_unsecure = true;
         return true;
@@ -899,6 +903,7 @@ bool gpt_params_find_arg(int argc, char ** argv, const std::string & arg, gpt_pa
         /**/ if (value == "distribute" || value == "") { params.numa = GGML_NUMA_STRATEGY_DISTRIBUTE; }
         else if (value == "isolate") { params.numa = GGML_NUMA_STRATEGY_ISOLATE; }
         else if (value == "numactl") { params.numa = GGML_NUMA_STRATEGY_NUMACTL; }
+        else if (value == "interleave") { params.numa = GGML_NUMA_STRATEGY_INTERLEAVE; }
         else { invalid_param = true; }
         return true;
     }
@@ -1575,6 +1580,7 @@ void gpt_params_print_usage(int /*argc*/, char ** argv, const gpt_params & param
                                                                         "  - distribute: spread execution evenly over all nodes\n"
                                                                         "  - isolate: only spawn threads on CPUs on the node that execution started on\n"
                                                                         "  - numactl: use the CPU map provided by numactl\n"
+                                                                        "  - interleave: like distribute, but also spread model weights over all nodes\n"
                                                                         "if run without this previously, it is recommended to drop the system page cache before using this\n"
                                                                         "see https://github.com/ggerganov/llama.cpp/issues/1437" });
 
@@ -731,6 +731,7 @@ struct ggml_backend_cpu_context {
     int n_threads;
     void * work_data;
     size_t work_size;
+    struct ggml_threadpool * threadpool;
 
     ggml_abort_callback abort_callback;
     void *              abort_callback_data;
@@ -744,11 +745,28 @@ GGML_CALL static const char * ggml_backend_cpu_name(ggml_backend_t backend) {
 
 GGML_CALL static void ggml_backend_cpu_free(ggml_backend_t backend) {
     struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+    ggml_threadpool_free(cpu_ctx->threadpool);
     free(cpu_ctx->work_data);
     free(cpu_ctx);
     free(backend);
 }
 
+// returns threads that stay resident for the lifetime of this backend
+// so that generating each token doesn't need to spawn n_threads-1 tasks
+static struct ggml_threadpool * ggml_backend_cpu_get_threadpool(struct ggml_backend_cpu_context * cpu_ctx, int n_threads) {
+    if (n_threads <= 1) {
+        return NULL;
+    }
+    if (cpu_ctx->threadpool && ggml_threadpool_get_n_threads(cpu_ctx->threadpool) < n_threads) {
+        ggml_threadpool_free(cpu_ctx->threadpool);
+        cpu_ctx->threadpool = NULL;
+    }
+    if (!cpu_ctx->threadpool) {
+        cpu_ctx->threadpool = ggml_threadpool_new(n_threads);
+    }
+    return cpu_ctx->threadpool;
+}
+
 GGML_CALL static ggml_backend_buffer_type_t ggml_backend_cpu_get_default_buffer_type(ggml_backend_t backend) {
     return ggml_backend_cpu_buffer_type();
 
@@ -792,11 +810,12 @@ GGML_CALL static void ggml_backend_cpu_graph_plan_free(ggml_backend_t backend, g
 }
 
 GGML_CALL static enum ggml_status ggml_backend_cpu_graph_plan_compute(ggml_backend_t backend, ggml_backend_graph_plan_t plan) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
     struct ggml_backend_plan_cpu * cpu_plan = (struct ggml_backend_plan_cpu *)plan;
 
-    return ggml_graph_compute(&cpu_plan->cgraph, &cpu_plan->cplan);
+    cpu_plan->cplan.threadpool = ggml_backend_cpu_get_threadpool(cpu_ctx, cpu_plan->cplan.n_threads);
 
-    GGML_UNUSED(backend);
+    return ggml_graph_compute(&cpu_plan->cgraph, &cpu_plan->cplan);
 }
 
 GGML_CALL static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t backend, struct ggml_cgraph * cgraph) {
@@ -818,6 +837,8 @@ GGML_CALL static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t
     cplan.abort_callback      = cpu_ctx->abort_callback;
     cplan.abort_callback_data = cpu_ctx->abort_callback_data;
 
+    cplan.threadpool = ggml_backend_cpu_get_threadpool(cpu_ctx, cplan.n_threads);
+
     return ggml_graph_compute(cgraph, &cplan);
 }
 
@@ -881,6 +902,7 @@ ggml_backend_t ggml_backend_cpu_init(void) {
     ctx->n_threads           = GGML_DEFAULT_N_THREADS;
     ctx->work_data           = NULL;
     ctx->work_size           = 0;
+    ctx->threadpool          = NULL;
     ctx->abort_callback      = NULL;
     ctx->abort_callback_data = NULL;
 
@@ -1548,6 +1548,10 @@ struct ggml_compute_state_shared {
 
     atomic_int current_chunk; // currently processing chunk during mul_mat, shared between all the threads
 
+    const bool * sync; // sync[i] is true if threads must rendezvous after node i
+
+    int numa_node; // node threads should run on, or -1 to follow numa strategy
+
     enum ggml_status ec;
 };
 
@@ -1557,6 +1561,7 @@ struct ggml_compute_state {
     struct ggml_compute_state_shared * shared;
     enum ggml_status ec;
     bool is_main_thread; // [jart]
+    struct ggml_threadpool * threadpool;
 };
 
 //
@@ -1932,6 +1937,26 @@ bool ggml_is_numa(void) {
     return g_state.numa.n_nodes > 1;
 }
 
+bool ggml_is_numa_interleaved(void) {
+    return ggml_is_numa() && g_state.numa.numa_strategy == GGML_NUMA_STRATEGY_INTERLEAVE;
+}
+
+int ggml_numa_get_n_nodes(void) {
+    return ggml_is_numa() ? (int)g_state.numa.n_nodes : 1;
+}
+
+int ggml_numa_get_n_cpus(int node) {
+    if (!ggml_is_numa() || node < 0 || (unsigned)node >= g_state.numa.n_nodes)
+        return 0;
+    return g_state.numa.nodes[node].n_cpus;
+}
+
+static _Thread_local int g_numa_node = -1;
+
+void ggml_numa_set_node(int node) {
+    g_numa_node = node;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void ggml_print_object(const struct ggml_object * obj) {
@@ -5038,9 +5063,10 @@ static struct ggml_tensor * ggml_soft_max_impl(
     if (mask) {
         GGML_ASSERT(mask->type == GGML_TYPE_F16 || mask->type == GGML_TYPE_F32);
         GGML_ASSERT(ggml_is_contiguous(mask));
-        GGML_ASSERT(ggml_is_matrix(mask));
         GGML_ASSERT(mask->ne[0] == a->ne[0]);
         GGML_ASSERT(mask->ne[1] >= a->ne[1]);
+        GGML_ASSERT(a->ne[2] % mask->ne[2] == 0);
+        GGML_ASSERT(a->ne[3] % mask->ne[3] == 0);
     }
 
     if (max_bias > 0.0f) {
@@ -11184,6 +11210,14 @@ UseGgmlGemm2:;
     int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
     int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
 
+    // [jart] prefer smaller chunks to per-thread ranges, so threads that
+    //        finish early can steal work from ones that got descheduled
+    while (nchunk0 * nchunk1 < nth * 4 && chunk_size > 8) {
+        chunk_size /= 2;
+        nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
+        nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+    }
+
     // If the chunking is poor for the number of threads on this setup, scrap the whole plan.  Re-chunk it by thread.
     //   Also, chunking by thread was measured to have perform better on NUMA systems.  See https://github.com/ggerganov/llama.cpp/pull/6915
     //   In theory, chunking should be just as useful on NUMA and non NUMA systems, but testing disagreed with that.
@@ -12482,8 +12516,11 @@ static void ggml_compute_forward_soft_max_f32(
         float * dp = (float *)((char *)  dst->data +  i1*dst->nb[1]);
 
         // broadcast the mask across rows
-        ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data) + (i1%ne01)*ne00 : NULL;
-        float       * mp_f32 = src1 ? (float       *)((char *) src1->data) + (i1%ne01)*ne00 : NULL;
+        const size_t mo = src1 ? (i1%ne01)*src1->nb[1] +
+                                 (h%src1->ne[2])*src1->nb[2] +
+                                 (i1/(ne01*ne02)%src1->ne[3])*src1->nb[3] : 0;
+        ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data + mo) : NULL;
+        float       * mp_f32 = src1 ? (float       *)((char *) src1->data + mo) : NULL;
 
         ggml_vec_cpy_f32  (nc, wp, sp);
         ggml_vec_scale_f32(nc, wp, scale);
@@ -15488,6 +15525,116 @@ static bool ggml_is_noop(enum ggml_op op) { // [jart]
     }
 }
 
+// returns true if op only touches its own inputs and outputs, in which
+// case threads may move on to the next node without a barrier. ops that
+// have barriers of their own or share state like current_chunk between
+// threads must always be fenced on both sides.
+static bool ggml_is_barrier_free(enum ggml_op op) {
+    switch (op) {
+        case GGML_OP_DUP:
+        case GGML_OP_ADD:
+        case GGML_OP_ADD1:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+        case GGML_OP_SQR:
+        case GGML_OP_SQRT:
+        case GGML_OP_LOG:
+        case GGML_OP_SCALE:
+        case GGML_OP_NORM:
+        case GGML_OP_RMS_NORM:
+        case GGML_OP_CPY:
+        case GGML_OP_CONT:
+        case GGML_OP_GET_ROWS:
+        case GGML_OP_SOFT_MAX:
+        case GGML_OP_ROPE:
+        case GGML_OP_CLAMP:
+        case GGML_OP_CONCAT:
+        case GGML_OP_UNARY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// returns true if op may use a slice of the shared work buffer
+static bool ggml_uses_wdata(enum ggml_op op) {
+    switch (op) {
+        case GGML_OP_DUP:
+        case GGML_OP_ADD:
+        case GGML_OP_ADD1:
+        case GGML_OP_CPY:
+        case GGML_OP_SOFT_MAX:
+        case GGML_OP_ROPE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool ggml_overlaps(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    if (!a || !b || !a->data || !b->data)
+        return false;
+    const char * a0 = a->data;
+    const char * b0 = b->data;
+    return a0 < b0 + ggml_nbytes(b) && b0 < a0 + ggml_nbytes(a);
+}
+
+static bool ggml_depends(const struct ggml_tensor * node, const struct ggml_tensor * prev) {
+    if (ggml_overlaps(node, prev))
+        return true; // write after write
+    for (int i = 0; i < GGML_MAX_SRC; ++i) {
+        if (ggml_overlaps(node->src[i], prev))
+            return true; // read after write
+        if (ggml_overlaps(node, prev->src[i]))
+            return true; // write after read
+    }
+    return false;
+}
+
+#define GGML_MAX_UNFENCED 8
+
+// decides which nodes need a barrier after them. a barrier is elided
+// when the next node neither reads, nor overwrites, memory that's used
+// by any node computed since the last barrier. this lets a thread start
+// on the next small op while its siblings are still finishing the last.
+static void ggml_graph_plan_sync(const struct ggml_cgraph * cgraph, bool * sync) {
+    int n = 0;
+    bool wdata = false;
+    const struct ggml_tensor * pending[GGML_MAX_UNFENCED];
+    for (int i = 0; i < cgraph->n_nodes; ++i) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+        sync[i] = true;
+        if (ggml_is_noop(node->op))
+            continue;
+        if (n && ggml_is_barrier_free(node->op) && n < GGML_MAX_UNFENCED &&
+            !(wdata && ggml_uses_wdata(node->op))) {
+            bool ok = true;
+            for (int j = 0; j < n && ok; ++j)
+                ok = !ggml_depends(node, pending[j]);
+            if (ok) {
+                // let previous node run into this one
+                for (int j = i - 1; j >= 0; --j) {
+                    if (!ggml_is_noop(cgraph->nodes[j]->op)) {
+                        sync[j] = false;
+                        break;
+                    }
+                }
+            } else {
+                n = 0;
+                wdata = false;
+            }
+        } else {
+            n = 0;
+            wdata = false;
+        }
+        if (ggml_is_barrier_free(node->op)) {
+            pending[n++] = node;
+            wdata |= ggml_uses_wdata(node->op);
+        }
+    }
+}
+
 static void ggml_compute_forward(struct ggml_compute_params * params, struct ggml_tensor * tensor) {
     GGML_ASSERT(params);
 
@@ -17185,47 +17332,76 @@ typedef int ggml_lock_t;
 #endif
 
 // Android's libc implementation "bionic" does not support setting affinity
-#if defined(__gnu_linux__)
-static void set_numa_thread_affinity(int thread_n) {
+#if defined(__gnu_linux__) || defined(__COSMOPOLITAN__)
+
+// affinity last applied to this thread, so threads that stay resident
+// between graphs don't need a system call each time. zero means unset
+static _Thread_local int g_numa_affinity;
+
+static void set_numa_thread_affinity(int thread_n, int node_num) {
     if (!ggml_is_numa()) {
         return;
     }
 
-    int node_num;
     int rv;
     size_t setsize = CPU_ALLOC_SIZE(g_state.numa.total_cpus);
 
-    switch(g_state.numa.numa_strategy) {
-        case GGML_NUMA_STRATEGY_DISTRIBUTE:
-            // run thread on node_num thread_n / (threads per node)
-            node_num = thread_n % g_state.numa.n_nodes;
-            break;
-        case GGML_NUMA_STRATEGY_ISOLATE:
-            // run thread on current_node
-            node_num = g_state.numa.current_node;
-            break;
-        case GGML_NUMA_STRATEGY_NUMACTL:
-            // use the cpuset that numactl gave us
-            rv = pthread_setaffinity_np(pthread_self(), setsize, &g_state.numa.cpuset);
-            if (rv) {
-                fprintf(stderr, "warning: pthread_setaffinity_np() failed: %s\n",strerror(rv));
-            }
-            return;
-        default:
-            return;
+    if (node_num < 0 || (unsigned)node_num >= g_state.numa.n_nodes) {
+        switch(g_state.numa.numa_strategy) {
+            case GGML_NUMA_STRATEGY_DISTRIBUTE:
+            case GGML_NUMA_STRATEGY_INTERLEAVE:
+                // run thread on node_num thread_n / (threads per node)
+                node_num = thread_n % g_state.numa.n_nodes;
+                thread_n = thread_n / g_state.numa.n_nodes;
+                break;
+            case GGML_NUMA_STRATEGY_ISOLATE:
+                // run thread on current_node
+                node_num = g_state.numa.current_node;
+                break;
+            case GGML_NUMA_STRATEGY_NUMACTL:
+                // use the cpuset that numactl gave us
+                rv = pthread_setaffinity_np(pthread_self(), setsize, &g_state.numa.cpuset);
+                if (rv) {
+                    fprintf(stderr, "warning: pthread_setaffinity_np() failed: %s\n",strerror(rv));
+                }
+                return;
+            default:
+                return;
+        }
     }
 
     struct ggml_numa_node * node = &g_state.numa.nodes[node_num];
+    if (!node->n_cpus) {
+        return;
+    }
+
+    // with --pin-threads each thread gets a core on its node to itself
+    // otherwise it may float among the cores of its node
+    int key;
+    if (FLAG_pin_threads) {
+        key = 1 + (node_num << 16 | (thread_n % node->n_cpus));
+    } else {
+        key = -1 - node_num;
+    }
+    if (key == g_numa_affinity) {
+        return;
+    }
 
     cpu_set_t * cpus = CPU_ALLOC(g_state.numa.total_cpus);
     CPU_ZERO_S(setsize, cpus);
-    for (size_t i = 0; i < node->n_cpus; ++i) {
-        CPU_SET_S(node->cpus[i], setsize, cpus);
+    if (FLAG_pin_threads) {
+        CPU_SET_S(node->cpus[thread_n % node->n_cpus], setsize, cpus);
+    } else {
+        for (size_t i = 0; i < node->n_cpus; ++i) {
+            CPU_SET_S(node->cpus[i], setsize, cpus);
+        }
     }
 
     rv = pthread_setaffinity_np(pthread_self(), setsize, cpus);
     if (rv) {
             fprintf(stderr, "warning: pthread_setaffinity_np() failed: %s\n", strerror(rv));
+    } else {
+        g_numa_affinity = key;
     }
 
     CPU_FREE(cpus);
@@ -17248,16 +17424,71 @@ static void clear_numa_thread_affinity(void) {
     if (rv) {
         fprintf(stderr, "warning: pthread_setaffinity_np() failed: %s\n", strerror(rv));
     }
+    g_numa_affinity = 0;
 
     CPU_FREE(cpus);
 }
 #else
 // TODO: Windows etc.
 // (the linux implementation may also work on BSD, someone should test)
-static void set_numa_thread_affinity(int thread_n) { UNUSED(thread_n);  }
+static void set_numa_thread_affinity(int thread_n, int node_num) { UNUSED(thread_n); UNUSED(node_num); }
 static void clear_numa_thread_affinity(void) {}
 #endif
 
+struct ggml_numa_toucher {
+    pthread_t th;
+    int node;
+    char * addr;
+    size_t size;
+};
+
+#define GGML_NUMA_STRIPE (2 * 1024 * 1024)
+
+static void * ggml_numa_touch(void * arg) {
+    struct ggml_numa_toucher * t = arg;
+    size_t pagesz = sysconf(_SC_PAGESIZE);
+    unsigned n_nodes = g_state.numa.n_nodes;
+    set_numa_thread_affinity(0, t->node);
+    for (char * p = t->addr; p < t->addr + t->size;) {
+        char * next = (char *)(((uintptr_t)p + pagesz) & -pagesz);
+        if (((uintptr_t)p / GGML_NUMA_STRIPE) % n_nodes == (unsigned)t->node) {
+            // first touch decides which node backs the page
+            *(volatile char *)p = 0;
+        }
+        p = next;
+    }
+    return 0;
+}
+
+// places fresh memory so that consecutive 2mb stripes alternate between
+// the numa nodes. this way no node's memory controller becomes the sole
+// bottleneck when every thread streams through the model weights. this
+// needs to be called after allocation and before anything is written.
+bool ggml_numa_interleave(void * addr, size_t size) {
+    if (!ggml_is_numa_interleaved() || !addr || !size) {
+        return false;
+    }
+    int n_nodes = g_state.numa.n_nodes;
+    struct ggml_numa_toucher * t = calloc(n_nodes, sizeof(struct ggml_numa_toucher));
+    if (!t) {
+        return false;
+    }
+    int n = 0;
+    for (; n < n_nodes; ++n) {
+        t[n].node = n;
+        t[n].addr = addr;
+        t[n].size = size;
+        if (pthread_create(&t[n].th, NULL, ggml_numa_touch, &t[n])) {
+            break;
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        pthread_join(t[i].th, NULL);
+    }
+    free(t);
+    return n == n_nodes;
+}
+
 static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
     int n_tasks = 0;
 
@@ -17637,7 +17868,7 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
     const struct ggml_cgraph * cgraph = state->shared->cgraph;
     const struct ggml_cplan  * cplan  = state->shared->cplan;
 
-    set_numa_thread_affinity(state->ith);
+    set_numa_thread_affinity(state->ith, state->shared->numa_node);
 
 #ifdef LLAMAFILE_DEBUG // [jart]
     if (FLAG_trap && !state->is_main_thread) {
@@ -17671,11 +17902,20 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
 
         ggml_compute_forward(&params, node);
 
+        if (state->shared->sync && !state->shared->sync[node_n]) // [jart]
+            continue;
+
         if (state->ith == 0 && cplan->abort_callback && cplan->abort_callback(cplan->abort_callback_data)) {
             state->shared->ec = GGML_STATUS_ABORTED;
         }
 
-        ggml_barrier(&params);
+        if (FLAG_trace) {
+            llamafile_trace_begin("barrier");
+            ggml_barrier(&params);
+            llamafile_trace_end("barrier");
+        } else {
+            ggml_barrier(&params);
+        }
 
         if (state->shared->ec != GGML_STATUS_SUCCESS) {
             break;
@@ -17706,6 +17946,245 @@ static void ggml_compute_canceled(void *arg) {
     }
 }
 
+//
+// persistent compute threads
+//
+// spawning n_threads-1 tasks and joining them for every graph costs a
+// mutex/condvar handoff per thread per token. a threadpool instead owns
+// its worker threads for the lifetime of a context. each worker spins
+// on an epoch counter for a little while after finishing a graph, then
+// parks on a condition variable. the epoch and the number of threads
+// participating in that graph are packed into one atomic word so that
+// a worker that isn't needed never touches the caller's stack frame.
+//
+
+#define GGML_THREADPOOL_SPIN 20000 // pause iterations before parking
+
+struct ggml_threadpool {
+    int n_threads; // including the caller, which is always thread 0
+    bool pin;
+    bool running;
+
+    alignas(64) atomic_ullong job; // (epoch << 32) | n_threads
+    alignas(64) atomic_int n_pending; // workers still inside current graph
+    atomic_int n_parked;
+    atomic_bool stop;
+
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+
+    struct ggml_compute_state_shared * shared;
+    struct ggml_compute_state * workers;
+    pthread_t * threads;
+};
+
+static void ggml_threadpool_pin(int ith) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask))
+        return;
+    int n = CPU_COUNT(&mask);
+    if (n <= 0)
+        return;
+    int want = ith % n;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &mask) && !want--) {
+            CPU_ZERO(&mask);
+            CPU_SET(cpu, &mask);
+            pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+            return;
+        }
+    }
+}
+
+static void ggml_threadpool_unlock(void * arg) {
+    pthread_mutex_unlock((pthread_mutex_t *)arg);
+}
+
+static void * ggml_threadpool_worker(void * arg) {
+    struct ggml_compute_state * state = arg;
+    struct ggml_threadpool * pool = state->threadpool;
+    unsigned long long last = atomic_load_explicit(&pool->job, memory_order_acquire);
+
+    if (pool->pin && !ggml_is_numa())
+        ggml_threadpool_pin(state->ith);
+
+    for (;;) {
+        unsigned long long job;
+
+        // stay hot for a while since the next graph usually follows
+        // immediately, e.g. when generating tokens one at a time
+        for (int i = 0;; ++i) {
+            job = atomic_load_explicit(&pool->job, memory_order_acquire);
+            if (job != last || atomic_load_explicit(&pool->stop, memory_order_relaxed))
+                break;
+            if (i == GGML_THREADPOOL_SPIN) {
+                pthread_mutex_lock(&pool->mu);
+                pthread_cleanup_push(ggml_threadpool_unlock, &pool->mu);
+                atomic_fetch_add(&pool->n_parked, 1);
+                while ((job = atomic_load(&pool->job)) == last &&
+                       !atomic_load(&pool->stop))
+                    pthread_cond_wait(&pool->cv, &pool->mu);
+                atomic_fetch_sub(&pool->n_parked, 1);
+                pthread_cleanup_pop(true);
+                break;
+            }
+            if (!(i & 1023))
+                pthread_testcancel();
+            pthread_pause_np();
+        }
+
+        if (atomic_load_explicit(&pool->stop, memory_order_relaxed))
+            break;
+
+        last = job;
+        if (state->ith >= (int)(job & 0xffffffff))
+            continue; // not needed for this graph
+
+        struct ggml_compute_state worker = *state;
+        worker.shared = pool->shared;
+        ggml_graph_compute_thread(&worker);
+        atomic_fetch_sub_explicit(&pool->n_pending, 1, memory_order_release);
+    }
+
+    return 0;
+}
+
+static void ggml_threadpool_stop(struct ggml_threadpool * pool, bool cancel) {
+    if (!pool->running)
+        return;
+    pool->running = false;
+    pthread_mutex_lock(&pool->mu);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->cv);
+    pthread_mutex_unlock(&pool->mu);
+    for (int j = 1; j < pool->n_threads; ++j) {
+        if (cancel)
+            pthread_cancel(pool->threads[j]);
+        pthread_join(pool->threads[j], NULL);
+    }
+}
+
+static bool ggml_threadpool_start(struct ggml_threadpool * pool) {
+    if (pool->running)
+        return true;
+    atomic_store(&pool->stop, false);
+    atomic_store(&pool->n_pending, 0);
+    atomic_store(&pool->n_parked, 0);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 128 * 1024);
+    pthread_attr_setguardsize(&attr, sysconf(_SC_PAGESIZE));
+    pthread_attr_setsigaltstacksize_np(&attr, sysconf(_SC_MINSIGSTKSZ) + 32768);
+    int j;
+    for (j = 1; j < pool->n_threads; ++j) {
+        pool->workers[j] = (struct ggml_compute_state) {
+            .thrd   = 0,
+            .ith    = j,
+            .shared = NULL,
+            .is_main_thread = false,
+            .threadpool = pool,
+        };
+        if (pthread_create(&pool->threads[j], &attr, ggml_threadpool_worker, &pool->workers[j]))
+            break;
+    }
+    pthread_attr_destroy(&attr);
+    if (j < pool->n_threads) {
+        int n = pool->n_threads;
+        pool->n_threads = j;
+        pool->running = true;
+        ggml_threadpool_stop(pool, false);
+        pool->n_threads = n;
+        return false;
+    }
+    pool->running = true;
+    return true;
+}
+
+struct ggml_threadpool * ggml_threadpool_new(int n_threads) {
+    GGML_ASSERT(n_threads > 0);
+    struct ggml_threadpool * pool = calloc(1, sizeof(struct ggml_threadpool));
+    if (!pool)
+        return NULL;
+    pool->n_threads = n_threads;
+    pool->pin = FLAG_pin_threads;
+    pthread_mutex_init(&pool->mu, NULL);
+    pthread_cond_init(&pool->cv, NULL);
+    pool->workers = calloc(n_threads, sizeof(struct ggml_compute_state));
+    pool->threads = calloc(n_threads, sizeof(pthread_t));
+    if (!pool->workers || !pool->threads || !ggml_threadpool_start(pool)) {
+        ggml_threadpool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void ggml_threadpool_free(struct ggml_threadpool * pool) {
+    if (!pool)
+        return;
+    ggml_threadpool_stop(pool, false);
+    pthread_cond_destroy(&pool->cv);
+    pthread_mutex_destroy(&pool->mu);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
+
+int ggml_threadpool_get_n_threads(const struct ggml_threadpool * pool) {
+    return pool->n_threads;
+}
+
+static void ggml_threadpool_canceled(void * arg) {
+    struct ggml_threadpool * pool = arg;
+    clear_numa_thread_affinity();
+    // the workers may be stuck at a barrier waiting on us, so they need
+    // to be killed. they'll be respawned by the next graph computation.
+    ggml_threadpool_stop(pool, true);
+}
+
+static enum ggml_status ggml_threadpool_compute(struct ggml_threadpool * pool,
+                                                struct ggml_compute_state_shared * shared) {
+    int n_threads = shared->n_threads;
+
+    if (!ggml_threadpool_start(pool))
+        return GGML_STATUS_FAILED;
+
+    struct ggml_compute_state worker = {
+        .thrd   = 0,
+        .ith    = 0,
+        .shared = shared,
+        .is_main_thread = true,
+    };
+
+    pthread_cleanup_push(ggml_threadpool_canceled, pool);
+
+    // dispatch by bumping the epoch
+    pool->shared = shared;
+    atomic_store_explicit(&pool->n_pending, n_threads - 1, memory_order_relaxed);
+    unsigned long long job = atomic_load_explicit(&pool->job, memory_order_relaxed);
+    job = ((job >> 32) + 1) << 32 | (unsigned)n_threads;
+    atomic_store(&pool->job, job);
+    if (atomic_load(&pool->n_parked)) {
+        pthread_mutex_lock(&pool->mu);
+        pthread_cond_broadcast(&pool->cv);
+        pthread_mutex_unlock(&pool->mu);
+    }
+
+    // this is a work thread too
+    ggml_graph_compute_thread(&worker);
+
+    // wait for stragglers to leave the final barrier
+    while (atomic_load_explicit(&pool->n_pending, memory_order_acquire))
+        pthread_pause_np();
+
+    pthread_cleanup_pop(false);
+
+    // don't leave affinity set on the main thread
+    clear_numa_thread_affinity();
+
+    return shared->ec;
+}
+
 enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cplan * cplan) {
     GGML_ASSERT(cplan);
     GGML_ASSERT(cplan->n_threads > 0);
@@ -17724,6 +18203,12 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
             (struct ggml_phaser *)(((uintptr_t)mem + az) & -az);
     memset(n_barrier_passed, 0, pz * n_threads);
 
+    bool *sync = NULL;
+    if (n_threads > 1) {
+        sync = alloca(cgraph->n_nodes + 1);
+        ggml_graph_plan_sync(cgraph, sync);
+    }
+
     struct ggml_compute_state_shared state_shared = {
         /*.cgraph                  =*/ cgraph,
         /*.cgraph_plan             =*/ cplan,
@@ -17733,6 +18218,8 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
         /*.abort_callback          =*/ NULL,
         /*.abort_callback_data     =*/ NULL,
         /*.current_chunk           =*/ 0,
+        /*.sync                    =*/ sync,
+        /*.numa_node               =*/ g_numa_node,
         /*.ec                      =*/ GGML_STATUS_SUCCESS,
     };
 
@@ -17740,6 +18227,10 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
     llamafile_debug_graph = cgraph;
 #endif
 
+    if (cplan->threadpool && n_threads > 1 && n_threads <= cplan->threadpool->n_threads) {
+        return ggml_threadpool_compute(cplan->threadpool, &state_shared);
+    }
+
 #ifdef GGML_USE_OPENMP
     if (n_threads > 1) {
         #pragma omp parallel num_threads(n_threads)
@@ -629,11 +629,14 @@ extern "C" {
 
     // the compute plan that needs to be prepared for ggml_graph_compute()
     // since https://github.com/ggerganov/ggml/issues/287
+    struct ggml_threadpool; // persistent compute threads
+
     struct ggml_cplan {
         size_t    work_size; // size of work buffer, calculated by `ggml_graph_plan()`
         uint8_t * work_data; // work buffer, to be allocated by caller before calling to `ggml_graph_compute()`
 
         int n_threads;
+        struct ggml_threadpool * threadpool; // NULL means spawn n_threads-1 tasks per graph
 
         // abort ggml_graph_compute when true
         ggml_abort_callback abort_callback;
@@ -690,6 +693,7 @@ extern "C" {
         GGML_NUMA_STRATEGY_ISOLATE    = 2,
         GGML_NUMA_STRATEGY_NUMACTL    = 3,
         GGML_NUMA_STRATEGY_MIRROR     = 4,
+        GGML_NUMA_STRATEGY_INTERLEAVE = 5,
         GGML_NUMA_STRATEGY_COUNT
     };
 
@@ -731,6 +735,11 @@ extern "C" {
 
     GGML_API void    ggml_numa_init(enum ggml_numa_strategy numa); // call once for better performance on NUMA systems
     GGML_API bool    ggml_is_numa(void); // true if init detected that system has >1 NUMA node
+    GGML_API bool    ggml_is_numa_interleaved(void); // true if weights should be spread across nodes
+    GGML_API int     ggml_numa_get_n_nodes(void); // number of NUMA nodes, or 1
+    GGML_API int     ggml_numa_get_n_cpus(int node); // hardware threads on node
+    GGML_API void    ggml_numa_set_node(int node); // run graphs computed by calling thread on node, or -1 for any
+    GGML_API bool    ggml_numa_interleave(void * addr, size_t size); // fault in fresh memory round robin across nodes
 
     GGML_API void    ggml_print_object (const struct ggml_object * obj);
     GGML_API void    ggml_print_objects(const struct ggml_context * ctx);
@@ -1460,6 +1469,8 @@ extern "C" {
 
     // fused soft_max(a*scale + mask*(ALiBi slope))
     // mask is optional
+    // mask rows are broadcast across heads (a->ne[2]) and batches (a->ne[3]);
+    // a 3d/4d mask (CPU only) repeats along those dims instead
     // max_bias = 0.0f for no ALiBi
     GGML_API struct ggml_tensor * ggml_soft_max_ext(
             struct ggml_context * ctx,
@@ -2045,6 +2056,12 @@ extern "C" {
     // note: the drawback of this API is that you must have ensured that the context has enough memory for the work data
     GGML_API enum ggml_status  ggml_graph_compute_with_ctx(struct ggml_context * ctx, struct ggml_cgraph * cgraph, int n_threads);
 
+    // threads that stay resident between calls to ggml_graph_compute()
+    // graphs may use fewer threads than the pool has, but never more
+    GGML_API struct ggml_threadpool * ggml_threadpool_new(int n_threads);
+    GGML_API void                     ggml_threadpool_free(struct ggml_threadpool * threadpool);
+    GGML_API int                      ggml_threadpool_get_n_threads(const struct ggml_threadpool * threadpool);
+
     GGML_API struct ggml_tensor * ggml_graph_get_tensor(struct ggml_cgraph * cgraph, const char * name);
 
     GGML_API void                 ggml_graph_export(const struct ggml_cgraph * cgraph, const char * fname);
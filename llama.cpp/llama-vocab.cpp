@@ -4,8 +4,12 @@
 
 #include "unicode.h"
 #include "string.h"
+#include "cores.h"
+
+#include "llamafile/pool.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cfloat>
 #include <climits>
@@ -82,6 +86,58 @@ struct naive_trie {
 // impl
 //
 
+static void llama_token_trie_build(
+        llama_token_trie & trie,
+        const std::vector<std::pair<std::string, llama_token>> & keys,
+        uint32_t n, size_t lo, size_t hi, size_t depth) {
+    // keys are sorted, so the one ending here (if any) comes first
+    if (lo < hi && keys[lo].first.size() == depth) {
+        trie.nodes[n].id = keys[lo].second;
+        ++lo;
+    }
+
+    const uint32_t edges = trie.bytes.size();
+    for (size_t i = lo; i < hi;) {
+        const uint8_t c = keys[i].first[depth];
+        while (i < hi && (uint8_t) keys[i].first[depth] == c) {
+            ++i;
+        }
+        trie.bytes.push_back(c);
+        trie.next.push_back(0);
+    }
+    trie.nodes[n].edges = edges;
+    trie.nodes[n].count = trie.bytes.size() - edges;
+
+    uint32_t e = edges;
+    for (size_t i = lo; i < hi;) {
+        const size_t j0 = i;
+        const uint8_t c = keys[i].first[depth];
+        while (i < hi && (uint8_t) keys[i].first[depth] == c) {
+            ++i;
+        }
+        const uint32_t child = trie.nodes.size();
+        trie.nodes.push_back({0, 0, -1});
+        trie.next[e++] = child;
+        llama_token_trie_build(trie, keys, child, j0, i, depth + 1);
+    }
+}
+
+void llama_token_trie::build(const std::unordered_map<std::string, llama_token> & tokens) {
+    std::vector<std::pair<std::string, llama_token>> keys(tokens.begin(), tokens.end());
+    std::sort(keys.begin(), keys.end(), [](const auto & a, const auto & b) {
+        // compare as unsigned bytes, so that children come out sorted
+        return std::lexicographical_compare(
+            (const uint8_t *) a.first.data(), (const uint8_t *) a.first.data() + a.first.size(),
+            (const uint8_t *) b.first.data(), (const uint8_t *) b.first.data() + b.first.size());
+    });
+
+    nodes.clear();
+    bytes.clear();
+    next.clear();
+    nodes.push_back({0, 0, -1});
+    llama_token_trie_build(*this, keys, 0, 0, keys.size(), 0);
+}
+
 int llama_vocab::find_bpe_rank(const std::string & token_left, const std::string & token_right) const {
     GGML_ASSERT(token_left.find(' ')   == std::string::npos);
     GGML_ASSERT(token_left.find('\n')  == std::string::npos);
@@ -645,46 +701,42 @@ private:
 struct llm_tokenizer_wpm {
     llm_tokenizer_wpm(const llama_vocab & vocab): vocab(vocab) {}
 
-    void tokenize(const std::string & text, std::vector<llama_vocab::id> & output) const {
-        const auto & token_map = vocab.token_to_id;
+    void tokenize(const std::string & text, std::vector<llama_vocab::id> & output) {
+        const auto & trie = vocab.wpm_trie;
+        GGML_ASSERT(!trie.nodes.empty());
 
         // normalize and split by whitespace
-        std::vector<std::string> words = preprocess(text);
+        preprocess(text);
 
         // bos token prepended already
 
         // find the longest tokens that form the words
-        for (const std::string & word : words) {
-            // skip empty words
-            if (word.size() == 0) {
-                continue;
-            }
-
-            // prepend phantom space
-            const std::string word1 = "\xe2\x96\x81" + word;
-            const int n = word1.size();
-
+        for (const auto & word : words) {
             const size_t current_tokens = output.size();
 
-            // we're at the start of a new word
-            // move through character position in word
-            for (int i = 0; i < n; ++i) {
-                // loop through possible match length
-                bool match = false;
-                for (int j = std::min(n, i + vocab.max_token_len + 1); j > i; j--) {
-                    auto it = token_map.find(word1.substr(i, j - i));
-                    if (it != token_map.end()) {
-                        output.push_back(it->second);
-                        match = true;
-                        i = j - 1;
+            // walk the trie from each position in the word, which starts
+            // with its phantom space, and move past the longest match
+            for (uint32_t i = word.first; i < word.second;) {
+                llama_token id  = -1;
+                uint32_t    end = i;
+                uint32_t    n   = 0;
+                for (uint32_t j = i; j < word.second; ++j) {
+                    if (!(n = trie.step(n, buf[j]))) {
                         break;
                     }
+                    if (trie.nodes[n].id != -1) {
+                        id  = trie.nodes[n].id;
+                        end = j + 1;
+                    }
                 }
 
-                if (!match) { // discard all
+                if (id == -1) { // discard all
                     output.resize(current_tokens);
                     break;  // and discard next tokens
                 }
+
+                output.push_back(id);
+                i = end;
             }
 
             // we didn't find any matches for this word
@@ -694,18 +746,32 @@ struct llm_tokenizer_wpm {
         }
     }
 
-    // TODO: reduce string copies by using cpts_offs array
-    std::vector<std::string> preprocess(const std::string & text) const {
+    // normalizes text into buf, where each word is preceded by a phantom
+    // space, and sets words to the [begin, end) byte range of each word
+    void preprocess(const std::string & text) {
         const std::vector<uint32_t> cpts_nfd = unicode_cpts_normalize_nfd(unicode_cpts_from_utf8(text));
-        std::vector<std::string> words(1, "");
+
+        buf.clear();
+        words.clear();
+
+        bool in_word = false;
+        auto start_word = [&]() {
+            words.emplace_back(buf.size(), 0);
+            buf += "\xe2\x96\x81";
+            in_word = true;
+        };
+        auto finish_word = [&]() {
+            if (in_word) {
+                words.back().second = buf.size();
+                in_word = false;
+            }
+        };
 
         for (const uint32_t cpt : cpts_nfd) {
             const auto flags = unicode_cpt_flags(cpt);
 
             if (flags.is_whitespace) {
-                if (words.back().size()) {  // finish previous word if any
-                    words.emplace_back();
-                }
+                finish_word();
                 continue;
             }
 
@@ -714,23 +780,20 @@ struct llm_tokenizer_wpm {
                 continue;
             }
 
-            const std::string s = unicode_cpt_to_utf8(unicode_tolower(cpt));
             if (flags.is_punctuation || ( cpt < 0x7F && flags.is_symbol ) || is_chinese_char(cpt)) {
-                if (words.back().size()) {  // finish previous word if any
-                    words.emplace_back();
-                }
-                words.back() = s;       // single char word
-                words.emplace_back();   // start a new word
+                finish_word();
+                start_word();
+                buf += unicode_cpt_to_utf8(unicode_tolower(cpt)); // single char word
+                finish_word();
             } else {
-                words.back() += s;  // append char to word
+                if (!in_word) {
+                    start_word();
+                }
+                buf += unicode_cpt_to_utf8(unicode_tolower(cpt)); // append char to word
             }
         }
 
-        if (!words.back().size()) {
-            words.pop_back();
-        }
-
-        return words;
+        finish_word();
     }
 
     static bool is_chinese_char(uint32_t cpt) {
@@ -748,6 +811,9 @@ struct llm_tokenizer_wpm {
     }
 
     const llama_vocab & vocab;
+
+    std::string buf;
+    std::vector<std::pair<uint32_t, uint32_t>> words;
 };
 
 //
@@ -1528,6 +1594,98 @@ int32_t llama_tokenize_impl(
     return res.size();
 }
 
+struct llama_tokenize_batch_state {
+    const llama_vocab * vocab;
+    const char ** texts;
+    const int32_t * text_lens;
+    int32_t n_texts;
+    bool add_special;
+    bool parse_special;
+    std::atomic<int32_t> next;
+    std::vector<std::vector<llama_vocab::id>> res;
+};
+
+static void * llama_tokenize_batch_worker(void * arg) {
+    auto * state = (llama_tokenize_batch_state *) arg;
+    for (;;) {
+        int32_t i = state->next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= state->n_texts) {
+            break;
+        }
+        const char * text = state->texts[i];
+        size_t len = state->text_lens ? state->text_lens[i] : strlen(text);
+        state->res[i] = llama_tokenize_internal(*state->vocab, std::string(text, len),
+                                                state->add_special, state->parse_special);
+    }
+    return nullptr;
+}
+
+int32_t llama_tokenize_batch_impl(
+    const struct llama_vocab & vocab,
+                 const char ** texts,
+               const int32_t * text_lens,
+                     int32_t   n_texts,
+                 llama_token * tokens,
+                     int32_t   n_tokens_max,
+                     int32_t * offsets,
+                        bool   add_special,
+                        bool   parse_special,
+                     int32_t   n_threads) {
+    llama_tokenize_batch_state state;
+    state.vocab = &vocab;
+    state.texts = texts;
+    state.text_lens = text_lens;
+    state.n_texts = n_texts;
+    state.add_special = add_special;
+    state.parse_special = parse_special;
+    state.next = 0;
+    state.res.resize(n_texts);
+
+    // tokenizing a few kilobytes takes less time than waking a thread,
+    // so only fan out when there's enough text to keep workers busy
+    if (n_threads <= 0) {
+        int64_t n_bytes = 0;
+        for (int32_t i = 0; i < n_texts; i++) {
+            n_bytes += text_lens ? text_lens[i] : strlen(texts[i]);
+        }
+        n_threads = std::min<int64_t>(cpu_get_num_math(), 1 + n_bytes / 16384);
+    }
+    n_threads = std::max(1, std::min(n_threads, n_texts));
+
+    // the calling thread works too, so failing to spawn a helper only
+    // costs parallelism
+    std::vector<llamafile_task_t> workers;
+    for (int32_t i = 1; i < n_threads; i++) {
+        llamafile_task_t task;
+        if (llamafile_task_create(&task, llama_tokenize_batch_worker, &state)) {
+            break;
+        }
+        workers.push_back(task);
+    }
+    llama_tokenize_batch_worker(&state);
+    for (llamafile_task_t task : workers) {
+        llamafile_task_join(task, nullptr);
+    }
+
+    int64_t n_tokens = 0;
+    for (int32_t i = 0; i < n_texts; i++) {
+        offsets[i] = n_tokens;
+        n_tokens += state.res[i].size();
+        if (n_tokens > INT32_MAX) {
+            return INT32_MIN;
+        }
+    }
+    offsets[n_texts] = n_tokens;
+
+    // the texts that fit are stored even when the rest don't, so that the
+    // caller only has to tokenize the rest again into a bigger buffer
+    for (int32_t i = 0; i < n_texts && offsets[i + 1] <= n_tokens_max; i++) {
+        std::copy(state.res[i].begin(), state.res[i].end(), tokens + offsets[i]);
+    }
+
+    return n_tokens_max < n_tokens ? -n_tokens : n_tokens;
+}
+
 static std::string llama_decode_text(const std::string & text) {
     std::string decoded_text;
 
@@ -4,11 +4,36 @@
 
 #include "llama-impl.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <map>
 
+// flat byte trie for finding the longest token that prefixes a string,
+// without the allocations of probing token_to_id with substrings
+struct llama_token_trie {
+    struct node {
+        uint32_t    edges; // index of first child in bytes/next
+        uint32_t    count; // number of children, sorted by byte
+        llama_token id;    // token spelled by the path to here, or -1
+    };
+
+    std::vector<node>     nodes; // nodes[0] is the root
+    std::vector<uint8_t>  bytes;
+    std::vector<uint32_t> next;
+
+    void build(const std::unordered_map<std::string, llama_token> & tokens);
+
+    // returns child of node n along byte c, or 0 if there is none
+    uint32_t step(uint32_t n, uint8_t c) const {
+        const uint8_t * lo = bytes.data() + nodes[n].edges;
+        const uint8_t * hi = lo + nodes[n].count;
+        const uint8_t * it = std::lower_bound(lo, hi, c);
+        return it != hi && *it == c ? next[it - bytes.data()] : 0;
+    }
+};
+
 struct llama_vocab {
     using id    = llama_token;
     using token = std::string;
@@ -33,6 +58,8 @@ struct llama_vocab {
 
     std::map<std::pair<std::string, std::string>, int> bpe_ranks;
 
+    llama_token_trie wpm_trie; // token_to_id, for LLAMA_VOCAB_TYPE_WPM
+
     // default LLaMA special tokens
     id special_bos_id  = 1;
     id special_eos_id  = 2;
@@ -115,6 +142,18 @@ int32_t llama_tokenize_impl(
                             bool   add_special,
                             bool   parse_special);
 
+int32_t llama_tokenize_batch_impl(
+        const struct llama_vocab & vocab,
+                     const char ** texts,
+                   const int32_t * text_lens,
+                         int32_t   n_texts,
+                     llama_token * tokens,
+                         int32_t   n_tokens_max,
+                         int32_t * offsets,
+                            bool   add_special,
+                            bool   parse_special,
+                         int32_t   n_threads);
+
 // does not write null-terminator to buf
 int32_t llama_token_to_piece_impl(
         const struct llama_vocab & vocab,
@@ -1685,7 +1685,9 @@ struct llama_mmap {
 
         // report terminal progress of loading weights off the disk into
         // the cpu. if we're using gpu inference, then don't even bother
-        if (!llamafile_has_gpu()) {
+        // on numa systems we let the compute threads fault pages in, so
+        // they end up on the nodes of the threads that actually use them
+        if (!llamafile_has_gpu() && !numa) {
             llamafile_schlep(addr, size);
         }
 
@@ -1707,6 +1709,21 @@ struct llama_mmap {
         }
     }
 
+    // advise the kernel to start reading [first, last) off the disk
+    void prefetch(size_t first, size_t last) const {
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        last = std::min(last, size);
+        if (last <= first) {
+            return;
+        }
+        uintptr_t beg = ((uintptr_t) addr + first) & ~(page_size - 1);
+        uintptr_t end = (uintptr_t) addr + last;
+        if (posix_madvise((void *) beg, end - beg, POSIX_MADV_WILLNEED)) {
+            LLAMA_LOG_WARN("warning: posix_madvise(.., POSIX_MADV_WILLNEED) failed: %s\n",
+                    strerror(errno));
+        }
+    }
+
     // partially unmap the file in the range [first, last)
     void unmap_fragment(size_t first, size_t last) {
         if (!is_owned)
@@ -2595,6 +2612,12 @@ struct llama_context {
     std::vector<float> embd_enc;
     std::vector<std::set<llama_seq_id>> seq_ids_enc;
 
+    // layout of a packed embedding ubatch as n_seg blocks of n_seg_len
+    // tokens, one block per sequence (see llama_batch_segments)
+    int32_t n_seg     = 0; // 0 if the ubatch is laid out densely
+    int32_t n_seg_len = 0;
+    bool    seg_attn  = false; // attention is computed per block
+
     // memory buffers used to evaluate the model
     std::vector<uint8_t> buf_compute_meta;
     ggml_backend_sched_t sched = nullptr;
@@ -2618,6 +2641,10 @@ struct llama_context {
     struct ggml_tensor * inp_pos_bucket;    // I32 [n_batch|n_kv, n_batch]
     struct ggml_tensor * inp_embd_enc;      // F32 [n_embd, n_outputs_enc]
     struct ggml_tensor * inp_KQ_mask_cross; // F32 [n_outputs_enc, n_batch]
+    struct ggml_tensor * inp_seg_gather;    // I32 [n_seg_len*n_seg]
+    struct ggml_tensor * inp_seg_scatter;   // I32 [n_batch]
+    struct ggml_tensor * inp_KQ_mask_seg;   // F32 [n_seg_len, n_seg_len, 1, n_seg]
+    struct ggml_tensor * inp_mean_seg;      // F32 [n_seg_len, 1, n_seg]
 };
 
 struct llama_lora_weight {
@@ -3713,6 +3740,13 @@ struct llama_model_loader {
             use_mmap = false;
         }
 
+        // pages of a shared file mapping stay wherever the page cache put
+        // them, so weights must be copied into anonymous memory we place
+        if (use_mmap && ggml_is_numa_interleaved()) {
+            LLAMA_LOG_INFO("%s: not using mmap so weights can be interleaved across numa nodes\n", __func__);
+            use_mmap = false;
+        }
+
         this->use_mmap = use_mmap;
         this->check_tensors = check_tensors;
     }
@@ -4152,6 +4186,19 @@ struct llama_model_loader {
         }
 // #endif
 
+        // queue readahead tensor by tensor, in the order they were created,
+        // which is the order the graph consumes them. the first layers then
+        // arrive off the disk first, instead of wherever the kernel starts
+        // when asked for the whole file at once
+        if (use_mmap && !ggml_is_numa()) {
+            for (struct ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+                const auto * weight = get_weight(ggml_get_name(cur));
+                if (weight != nullptr) {
+                    mappings.at(weight->idx)->prefetch(weight->offs, weight->offs + ggml_nbytes(cur));
+                }
+            }
+        }
+
         for (struct ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
             const auto * weight = get_weight(ggml_get_name(cur));
             if (weight == nullptr) {
@@ -5686,6 +5733,11 @@ static void llm_load_vocab(
         LLAMA_LOG_INFO("%s: token to piece cache size = %.4f MB\n", __func__, size_cache / 1024.0 / 1024.0);
     }
 
+    // build the trie the wordpiece tokenizer matches tokens with
+    if (vocab.type == LLAMA_VOCAB_TYPE_WPM) {
+        vocab.wpm_trie.build(vocab.token_to_id);
+    }
+
     // Handle per token attributes
     //NOTE: Each model customizes per token attributes.
     //NOTE: Per token attributes are missing from the GGUF file.
@@ -7747,7 +7799,7 @@ static bool llm_load_tensors(
 
     ml.done_getting_tensors();
 
-    ml.init_mappings(true, use_mlock ? &model.mlock_mmaps : nullptr);
+    ml.init_mappings(false, use_mlock ? &model.mlock_mmaps : nullptr); // load_all_data() prefetches
     model.mappings.reserve(ml.mappings.size());
 
     // create the backend buffers
@@ -7816,6 +7868,10 @@ static bool llm_load_tensors(
                 throw std::runtime_error("unable to allocate backend buffer");
             }
             model.bufs.push_back(buf);
+            if (ggml_backend_buffer_is_host(buf)) {
+                ggml_numa_interleave(ggml_backend_buffer_get_base(buf),
+                                     ggml_backend_buffer_get_size(buf));
+            }
             if (use_mlock && ggml_backend_buffer_is_host(buf)) {
                 model.mlock_bufs.emplace_back(new llama_mlock);
                 auto & mlock_buf = model.mlock_bufs.back();
@@ -8653,6 +8709,10 @@ struct llm_build_context {
         lctx.inp_pos_bucket    = nullptr;
         lctx.inp_embd_enc      = nullptr;
         lctx.inp_KQ_mask_cross = nullptr;
+        lctx.inp_seg_gather    = nullptr;
+        lctx.inp_seg_scatter   = nullptr;
+        lctx.inp_KQ_mask_seg   = nullptr;
+        lctx.inp_mean_seg      = nullptr;
     }
 
     void free() {
@@ -8842,6 +8902,83 @@ struct llm_build_context {
         return lctx.inp_mean;
     }
 
+    struct ggml_tensor * build_inp_seg_gather() {
+        if (!lctx.inp_seg_gather) {
+            lctx.inp_seg_gather = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, lctx.n_seg_len*lctx.n_seg);
+            cb(lctx.inp_seg_gather, "inp_seg_gather", -1);
+            ggml_set_input(lctx.inp_seg_gather);
+        }
+        return lctx.inp_seg_gather;
+    }
+
+    struct ggml_tensor * build_inp_seg_scatter() {
+        if (!lctx.inp_seg_scatter) {
+            lctx.inp_seg_scatter = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, n_tokens);
+            cb(lctx.inp_seg_scatter, "inp_seg_scatter", -1);
+            ggml_set_input(lctx.inp_seg_scatter);
+        }
+        return lctx.inp_seg_scatter;
+    }
+
+    struct ggml_tensor * build_inp_KQ_mask_seg() {
+        lctx.inp_KQ_mask_seg = ggml_new_tensor_4d(ctx0, GGML_TYPE_F32, lctx.n_seg_len, lctx.n_seg_len, 1, lctx.n_seg);
+        cb(lctx.inp_KQ_mask_seg, "KQ_mask_seg", -1);
+        ggml_set_input(lctx.inp_KQ_mask_seg);
+        return lctx.inp_KQ_mask_seg;
+    }
+
+    struct ggml_tensor * build_inp_mean_seg() {
+        lctx.inp_mean_seg = ggml_new_tensor_3d(ctx0, GGML_TYPE_F32, lctx.n_seg_len, 1, lctx.n_seg);
+        cb(lctx.inp_mean_seg, "inp_mean_seg", -1);
+        ggml_set_input(lctx.inp_mean_seg);
+        return lctx.inp_mean_seg;
+    }
+
+    // non-causal attention within each sequence of a packed batch. the
+    // tokens are gathered into one block per sequence, so that the cost
+    // is n_seg*n_seg_len^2 rather than n_tokens^2, and scattered back
+    struct ggml_tensor * build_seg_attn(
+             struct ggml_tensor * Qcur,
+             struct ggml_tensor * Kcur,
+             struct ggml_tensor * Vcur,
+             struct ggml_tensor * KQ_mask,
+                          float   kq_scale,
+                            int   il) {
+        const int64_t n_seg     = lctx.n_seg;
+        const int64_t n_seg_len = lctx.n_seg_len;
+
+        struct ggml_tensor * inp_seg_gather = build_inp_seg_gather();
+
+        struct ggml_tensor * q = ggml_get_rows(ctx0, ggml_reshape_2d(ctx0, Qcur, n_embd_head_k*n_head, n_tokens), inp_seg_gather);
+        q = ggml_permute(ctx0, ggml_reshape_4d(ctx0, q, n_embd_head_k, n_head, n_seg_len, n_seg), 0, 2, 1, 3);
+        cb(q, "q", il);
+
+        struct ggml_tensor * k = ggml_get_rows(ctx0, ggml_reshape_2d(ctx0, Kcur, n_embd_k_gqa, n_tokens), inp_seg_gather);
+        k = ggml_cont(ctx0, ggml_permute(ctx0, ggml_reshape_4d(ctx0, k, n_embd_head_k, n_head_kv, n_seg_len, n_seg), 0, 2, 1, 3));
+        cb(k, "k", il);
+
+        struct ggml_tensor * kq = ggml_mul_mat(ctx0, k, q);
+        cb(kq, "kq", il);
+
+        kq = ggml_soft_max_ext(ctx0, kq, KQ_mask, kq_scale, hparams.f_max_alibi_bias);
+        cb(kq, "kq_soft_max_ext", il);
+
+        struct ggml_tensor * v = ggml_get_rows(ctx0, ggml_reshape_2d(ctx0, Vcur, n_embd_v_gqa, n_tokens), inp_seg_gather);
+        v = ggml_cont(ctx0, ggml_permute(ctx0, ggml_reshape_4d(ctx0, v, n_embd_head_v, n_head_kv, n_seg_len, n_seg), 1, 2, 0, 3));
+        cb(v, "v", il);
+
+        struct ggml_tensor * kqv = ggml_mul_mat(ctx0, v, kq);
+        cb(kqv, "kqv", il);
+
+        struct ggml_tensor * kqv_merged = ggml_permute(ctx0, kqv, 0, 2, 1, 3);
+        cb(kqv_merged, "kqv_merged", il);
+
+        struct ggml_tensor * cur = ggml_cont_2d(ctx0, kqv_merged, n_embd_head_v*n_head, n_seg_len*n_seg);
+        cb(cur, "kqv_merged_cont", il);
+
+        return ggml_get_rows(ctx0, cur, build_inp_seg_scatter());
+    }
+
     struct ggml_tensor * build_inp_cls() {
         lctx.inp_cls = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, n_tokens);
         cb(lctx.inp_cls, "inp_cls", -1);
@@ -8888,8 +9025,16 @@ struct llm_build_context {
         switch (pooling_type) {
             case LLAMA_POOLING_TYPE_MEAN:
                 {
-                    struct ggml_tensor * inp_mean = build_inp_mean();
-                    cur = ggml_mul_mat(ctx0, ggml_cont(ctx0, ggml_transpose(ctx0, inp)), inp_mean);
+                    if (lctx.n_seg) {
+                        // average each block of a packed batch on its own
+                        cur = ggml_get_rows(ctx0, inp, build_inp_seg_gather());
+                        cur = ggml_reshape_3d(ctx0, cur, inp->ne[0], lctx.n_seg_len, lctx.n_seg);
+                        cur = ggml_mul_mat(ctx0, ggml_cont(ctx0, ggml_transpose(ctx0, cur)), build_inp_mean_seg());
+                        cur = ggml_reshape_2d(ctx0, cur, inp->ne[0], lctx.n_seg);
+                    } else {
+                        struct ggml_tensor * inp_mean = build_inp_mean();
+                        cur = ggml_mul_mat(ctx0, ggml_cont(ctx0, ggml_transpose(ctx0, inp)), inp_mean);
+                    }
                 } break;
             case LLAMA_POOLING_TYPE_CLS:
             case LLAMA_POOLING_TYPE_LAST:
@@ -9975,7 +10120,7 @@ struct llm_build_context {
         cb(inpL, "inp_norm", -1);
 
         // KQ_mask (mask for 1 head, it will be broadcasted to all heads)
-        struct ggml_tensor * KQ_mask = build_inp_KQ_mask(false);
+        struct ggml_tensor * KQ_mask = lctx.seg_attn ? build_inp_KQ_mask_seg() : build_inp_KQ_mask(false);
 
         // iterate layers
         for (int il = 0; il < n_layer; ++il) {
@@ -10039,26 +10184,30 @@ struct llm_build_context {
                 cb(Kcur, "Kcur", il);
             }
 
-            struct ggml_tensor * q =                 ggml_permute(ctx0, Qcur, 0, 2, 1, 3);
-            struct ggml_tensor * k = ggml_cont(ctx0, ggml_permute(ctx0, Kcur, 0, 2, 1, 3));
+            if (lctx.seg_attn) {
+                cur = build_seg_attn(Qcur, Kcur, Vcur, KQ_mask, 1.0f/sqrtf(float(n_embd_head)), il);
+            } else {
+                struct ggml_tensor * q =                 ggml_permute(ctx0, Qcur, 0, 2, 1, 3);
+                struct ggml_tensor * k = ggml_cont(ctx0, ggml_permute(ctx0, Kcur, 0, 2, 1, 3));
 
-            struct ggml_tensor * kq = ggml_mul_mat(ctx0, k, q);
-            cb(kq, "kq", il);
+                struct ggml_tensor * kq = ggml_mul_mat(ctx0, k, q);
+                cb(kq, "kq", il);
 
-            kq = ggml_soft_max_ext(ctx0, kq, KQ_mask, 1.0f/sqrtf(float(n_embd_head)), hparams.f_max_alibi_bias);
-            cb(kq, "kq_soft_max_ext", il);
+                kq = ggml_soft_max_ext(ctx0, kq, KQ_mask, 1.0f/sqrtf(float(n_embd_head)), hparams.f_max_alibi_bias);
+                cb(kq, "kq_soft_max_ext", il);
 
-            struct ggml_tensor * v = ggml_cont(ctx0, ggml_transpose(ctx0, ggml_reshape_2d(ctx0, Vcur, n_embd_gqa, n_tokens)));
-            cb(v, "v", il);
+                struct ggml_tensor * v = ggml_cont(ctx0, ggml_transpose(ctx0, ggml_reshape_2d(ctx0, Vcur, n_embd_gqa, n_tokens)));
+                cb(v, "v", il);
 
-            struct ggml_tensor * kqv = ggml_mul_mat(ctx0, ggml_reshape_3d(ctx0, v, n_tokens, n_embd_head, n_head_kv), kq);
-            cb(kqv, "kqv", il);
+                struct ggml_tensor * kqv = ggml_mul_mat(ctx0, ggml_reshape_3d(ctx0, v, n_tokens, n_embd_head, n_head_kv), kq);
+                cb(kqv, "kqv", il);
 
-            struct ggml_tensor * kqv_merged = ggml_permute(ctx0, kqv, 0, 2, 1, 3);
-            cb(kqv_merged, "kqv_merged", il);
+                struct ggml_tensor * kqv_merged = ggml_permute(ctx0, kqv, 0, 2, 1, 3);
+                cb(kqv_merged, "kqv_merged", il);
 
-            cur = ggml_cont_2d(ctx0, kqv_merged, n_embd_gqa, n_tokens);
-            cb(cur, "kqv_merged_cont", il);
+                cur = ggml_cont_2d(ctx0, kqv_merged, n_embd_gqa, n_tokens);
+                cb(cur, "kqv_merged_cont", il);
+            }
 
             ggml_build_forward_expand(gf, cur);
 
@@ -14636,12 +14785,72 @@ static struct ggml_cgraph * llama_build_graph_s_copy(llama_context & lctx) {
     return result;
 }
 
+// decides whether a non-causal ubatch can be laid out as one block per
+// sequence, which is how embedding callers pack many short texts into a
+// single batch. block s holds the tokens of sequence s in batch order,
+// so that attention and mean pooling only need to look within a block
+static void llama_batch_segments(llama_context & lctx, const llama_batch & batch) {
+    lctx.n_seg     = 0;
+    lctx.n_seg_len = 0;
+    lctx.seg_attn  = false;
+
+    if (lctx.cparams.causal_attn || !batch.n_seq_id || !batch.seq_id) {
+        return;
+    }
+
+    std::vector<int32_t> len;
+    for (int i = 0; i < batch.n_tokens; ++i) {
+        if (batch.n_seq_id[i] != 1) {
+            return;
+        }
+        const llama_seq_id seq_id = batch.seq_id[i][0];
+        if (seq_id < 0 || seq_id >= batch.n_tokens) {
+            return;
+        }
+        if (seq_id >= (llama_seq_id) len.size()) {
+            len.resize(seq_id + 1, 0);
+        }
+        ++len[seq_id];
+    }
+    if (len.empty()) {
+        return;
+    }
+
+    const int64_t n_seg     = len.size();
+    const int64_t n_seg_len = *std::max_element(len.begin(), len.end());
+    const int64_t n_tokens  = batch.n_tokens;
+
+    // blocked attention needs per-block masks, which only the cpu backend
+    // implements, and isn't worth the gathering unless it halves the work
+    const bool seg_attn = lctx.backends.size() == 1 && lctx.backends[0] == lctx.backend_cpu &&
+                          2*n_seg*n_seg_len*n_seg_len <= n_tokens*n_tokens;
+
+    // blocked pooling alone gathers n_seg*n_seg_len rows, which one long
+    // sequence among many short ones (or sparse seq_ids) can make far more
+    // than the dense inp_mean, and more than the worst-case graph reserved
+    if (!seg_attn && n_seg*n_seg_len > 2*n_tokens) {
+        return;
+    }
+
+    lctx.n_seg     = n_seg;
+    lctx.n_seg_len = n_seg_len;
+    lctx.seg_attn  = seg_attn;
+}
+
 static struct ggml_cgraph * llama_build_graph(
          llama_context & lctx,
      const llama_batch & batch,
                   bool   worst_case) {
     const auto & model = lctx.model;
 
+    if (worst_case) {
+        lctx.n_seg     = 0;
+        lctx.n_seg_len = 0;
+        lctx.seg_attn  = false;
+    } else {
+        llama_batch_segments(lctx, batch);
+    }
+
     // this callback allows us to apply custom logic to each tensor (e.g. ggml-alloc, offloading, etc.)
     llm_build_cb cb = [&](struct ggml_tensor * cur, const char * name, int il) {
         if (il >= 0) {
@@ -15092,7 +15301,69 @@ static void llama_set_inputs(llama_context & lctx, const llama_batch & batch) {
         }
     }
 
-    if (cparams.embeddings && cparams.pooling_type == LLAMA_POOLING_TYPE_MEAN) {
+    if (lctx.n_seg) {
+        const int64_t n_tokens  = batch.n_tokens;
+        const int64_t n_seg     = lctx.n_seg;
+        const int64_t n_seg_len = lctx.n_seg_len;
+
+        // place each token in the block of its sequence. padding slots
+        // point at token 0 and are masked out or given zero weight
+        std::vector<int32_t> len(n_seg, 0);
+        std::vector<int32_t> slot(n_tokens);
+        std::vector<int32_t> token(n_seg*n_seg_len, 0);
+        for (int i = 0; i < n_tokens; ++i) {
+            const llama_seq_id seq_id = batch.seq_id[i][0];
+            slot[i] = seq_id*n_seg_len + len[seq_id]++;
+            token[slot[i]] = i;
+        }
+
+        if (lctx.inp_seg_gather) {
+            ggml_backend_tensor_set(lctx.inp_seg_gather, token.data(), 0, token.size()*ggml_element_size(lctx.inp_seg_gather));
+        }
+
+        if (lctx.inp_seg_scatter) {
+            ggml_backend_tensor_set(lctx.inp_seg_scatter, slot.data(), 0, slot.size()*ggml_element_size(lctx.inp_seg_scatter));
+        }
+
+        if (lctx.inp_KQ_mask_seg) {
+            GGML_ASSERT(ggml_backend_buffer_is_host(lctx.inp_KQ_mask_seg->buffer));
+
+            float * data = (float *) lctx.inp_KQ_mask_seg->data;
+
+            for (int s = 0; s < n_seg; ++s) {
+                for (int j = 0; j < n_seg_len; ++j) {
+                    for (int i = 0; i < n_seg_len; ++i) {
+                        float f = -INFINITY;
+                        if (j < len[s] && i < len[s]) {
+                            if (hparams.use_alibi) {
+                                f = -std::abs(batch.pos[token[s*n_seg_len + i]] - batch.pos[token[s*n_seg_len + j]]);
+                            } else {
+                                f = 0.0f;
+                            }
+                        } else if (j >= len[s] && i == 0) {
+                            // padding rows are discarded, but mustn't be all -inf
+                            f = 0.0f;
+                        }
+                        data[(s*n_seg_len + j)*n_seg_len + i] = f;
+                    }
+                }
+            }
+        }
+
+        if (lctx.inp_mean_seg) {
+            GGML_ASSERT(ggml_backend_buffer_is_host(lctx.inp_mean_seg->buffer));
+
+            float * data = (float *) lctx.inp_mean_seg->data;
+
+            for (int s = 0; s < n_seg; ++s) {
+                for (int j = 0; j < n_seg_len; ++j) {
+                    data[s*n_seg_len + j] = j < len[s] ? 1.0f/float(len[s]) : 0.0f;
+                }
+            }
+        }
+    }
+
+    if (cparams.embeddings && cparams.pooling_type == LLAMA_POOLING_TYPE_MEAN && !lctx.n_seg) {
         const int64_t n_tokens = batch.n_tokens;
 
         GGML_ASSERT(lctx.inp_mean);
@@ -15359,15 +15630,21 @@ static size_t llama_output_reserve(llama_context & lctx, size_t n_outputs) {
 static void llama_graph_compute(
         llama_context & lctx,
           ggml_cgraph * gf,
-                  int   n_threads) {
+                  int   n_threads,
+                 bool   prefill = false) {
 
     // [jart] resource management
-    n_threads = g_core_manager.acquire(1, n_threads);
+    int node;
+    n_threads = g_core_manager.acquire(1, n_threads,
+                                       prefill ? CoreManager::kPrefillWeight
+                                               : CoreManager::kGenerateWeight);
+    CoreManager::last_acquired(&node);
     static ThreadLocal<void> cleanup(
-      [](void* n_threads) {
-          g_core_manager.release((intptr_t)n_threads);
+      [](void*) {
+          g_core_manager.release();
       });
     cleanup.set((void *)(intptr_t)n_threads);
+    ggml_numa_set_node(node);
 
 // #ifdef GGML_USE_METAL
     if (ggml_backend_is_metal(lctx.backend_metal)) {
@@ -15389,7 +15666,8 @@ static void llama_graph_compute(
 
     // [jart] resources management
     cleanup.set(nullptr);
-    g_core_manager.release((intptr_t)n_threads);
+    ggml_numa_set_node(-1);
+    g_core_manager.release();
 
     // fprintf(stderr, "splits: %d\n", ggml_backend_sched_get_n_splits(lctx.sched));
 }
@@ -15616,7 +15894,7 @@ static int llama_decode_internal(
 
         llama_set_inputs(lctx, u_batch);
 
-        llama_graph_compute(lctx, gf, n_threads);
+        llama_graph_compute(lctx, gf, n_threads, n_tokens > 2);
 
         // update the kv ring buffer
         {
@@ -15837,7 +16115,7 @@ static int llama_encode_internal(
 
     llama_set_inputs(lctx, batch);
 
-    llama_graph_compute(lctx, gf, n_threads);
+    llama_graph_compute(lctx, gf, n_threads, n_tokens > 2);
 
     // extract embeddings
     if (embd) {
@@ -17915,6 +18193,17 @@ uint32_t llama_n_seq_max(const struct llama_context * ctx) {
     return ctx->kv_self.size;
 }
 
+uint64_t llama_context_size(const struct llama_context * ctx) {
+    uint64_t size = ctx->kv_self.total_size();
+    if (ctx->buf_output) {
+        size += ggml_backend_buffer_get_size(ctx->buf_output);
+    }
+    for (ggml_backend_t backend : ctx->backends) {
+        size += ggml_backend_sched_get_buffer_size(ctx->sched, backend);
+    }
+    return size;
+}
+
 enum llama_vocab_type llama_vocab_type(const struct llama_model * model) {
     return model->vocab.type;
 }
@@ -19662,6 +19951,20 @@ int32_t llama_tokenize(
     return llama_tokenize_impl(model->vocab, text, text_len, tokens, n_tokens_max, add_special, parse_special);
 }
 
+int32_t llama_tokenize_batch(
+    const struct llama_model * model,
+                 const char ** texts,
+               const int32_t * text_lens,
+                     int32_t   n_texts,
+                 llama_token * tokens,
+                     int32_t   n_tokens_max,
+                     int32_t * offsets,
+                        bool   add_special,
+                        bool   parse_special,
+                     int32_t   n_threads) {
+    return llama_tokenize_batch_impl(model->vocab, texts, text_lens, n_texts, tokens, n_tokens_max, offsets, add_special, parse_special, n_threads);
+}
+
 int32_t llama_token_to_piece(
     const struct llama_model * model,
                  llama_token   token,
@@ -464,6 +464,9 @@ extern "C" {
     LLAMA_API uint32_t llama_n_ubatch   (const struct llama_context * ctx);
     LLAMA_API uint32_t llama_n_seq_max  (const struct llama_context * ctx);
 
+    // Returns the bytes a context has allocated for its KV cache, outputs and compute buffers
+    LLAMA_API uint64_t llama_context_size(const struct llama_context * ctx);
+
     LLAMA_API enum llama_pooling_type llama_pooling_type(const struct llama_context * ctx);
 
     LLAMA_API enum llama_vocab_type   llama_vocab_type  (const struct llama_model * model);
@@ -954,6 +957,27 @@ extern "C" {
                             bool   add_special,
                             bool   parse_special);
 
+    /// @details Convert many texts into tokens at once, spreading the work over a thread pool.
+    /// The tokens of texts[i] are stored at tokens[offsets[i]] through tokens[offsets[i + 1] - 1].
+    /// @param text_lens Byte length of each text, or NULL if the texts are NUL-terminated.
+    /// @param offsets Must have room for n_texts + 1 entries. It's filled in even on failure.
+    /// On failure, the tokens of each leading text that ends within n_tokens_max are still
+    /// stored, so a caller can grow the buffer and tokenize only the texts after them.
+    /// @param n_threads Number of threads to use, or zero to pick based on the amount of text.
+    /// @return Returns the total number of tokens on success, no more than n_tokens_max
+    /// @return Returns a negative number on failure - the number of tokens that would have been returned
+    LLAMA_API int32_t llama_tokenize_batch(
+        const struct llama_model * model,
+                     const char ** texts,
+                   const int32_t * text_lens,
+                         int32_t   n_texts,
+                     llama_token * tokens,
+                         int32_t   n_tokens_max,
+                         int32_t * offsets,
+                            bool   add_special,
+                            bool   parse_special,
+                         int32_t   n_threads);
+
     // Token Id -> Piece.
     // Uses the vocabulary in the provided context.
     // Does not write null terminator to the buffer.
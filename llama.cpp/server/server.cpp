@@ -2152,6 +2152,7 @@ static void server_print_usage(const char *argv0, const gpt_params &params,
     printf("                              - distribute: spread execution evenly over all nodes\n");
     printf("                              - isolate: only spawn threads on CPUs on the node that execution started on\n");
     printf("                              - numactl: use the CPU map provided my numactl\n");
+    printf("                              - interleave: like distribute, but also spread model weights over all nodes\n");
     // if (llama_supports_gpu_offload()) { // [jart] prevent init error
         printf("  -ngl N, --n-gpu-layers N\n");
         printf("                            number of layers to store in VRAM\n");
@@ -2651,6 +2652,7 @@ static void server_params_parse(int argc, char **argv, server_params &sparams,
                 /**/ if (value == "distribute" || value == "" ) { params.numa = GGML_NUMA_STRATEGY_DISTRIBUTE; }
                 else if (value == "isolate") { params.numa = GGML_NUMA_STRATEGY_ISOLATE; }
                 else if (value == "numactl") { params.numa = GGML_NUMA_STRATEGY_NUMACTL; }
+                else if (value == "interleave") { params.numa = GGML_NUMA_STRATEGY_INTERLEAVE; }
                 else { invalid_param = true; break; }
             }
         }
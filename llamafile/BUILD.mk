@@ -44,6 +44,10 @@ o/$(MODE)/llamafile/tokenize:				\
 		o/$(MODE)/llamafile/tokenize.o		\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 
+o/$(MODE)/llamafile/tokenize_bench:			\
+		o/$(MODE)/llamafile/tokenize_bench.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 o/$(MODE)/llamafile/curl:					\
 		o/$(MODE)/llamafile/curl.o			\
 		o/$(MODE)/llama.cpp/llama.cpp.a			\
@@ -63,8 +67,10 @@ o/$(MODE)/llamafile:						\
 		o/$(MODE)/llamafile/parse_cidr_test.runs	\
 		o/$(MODE)/llamafile/pool_cancel_test.runs	\
 		o/$(MODE)/llamafile/pool_test.runs		\
+		o/$(MODE)/llamafile/sgemm_quant_test.runs	\
 		o/$(MODE)/llamafile/json_test.runs		\
 		o/$(MODE)/llamafile/thread_test.runs		\
+		o/$(MODE)/llamafile/threadpool_test.runs	\
 		o/$(MODE)/llamafile/vmathf_test.runs		\
 
 ################################################################################
@@ -201,6 +207,10 @@ o/$(MODE)/llamafile/thread_test:			\
 		o/$(MODE)/llamafile/crash.o		\
 		o/$(MODE)/llamafile/dll3.o		\
 
+o/$(MODE)/llamafile/threadpool_test:			\
+		o/$(MODE)/llamafile/threadpool_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 o/$(MODE)/llamafile/sgemm_sss_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_sss_test.o: private CCFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test: private LDFLAGS += -fopenmp
@@ -218,6 +228,10 @@ o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 		o/$(MODE)/llamafile/sgemm_vecdot_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
 
+o/$(MODE)/llamafile/sgemm_quant_test:			\
+		o/$(MODE)/llamafile/sgemm_quant_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
 o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 		private LDFLAGS += -fopenmp
 
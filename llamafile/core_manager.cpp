@@ -20,65 +20,230 @@
 #include <assert.h>
 
 #include "llama.cpp/cores.h"
+#include "llama.cpp/ggml.h"
+#include "macros.h"
 
 CoreManager g_core_manager;
 
+static thread_local CoreManager::Claim t_claim;
+static thread_local int t_last_count;
+static thread_local int t_last_node = -1;
+
+static long now_nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 CoreManager::CoreManager()
     : used_(0),
       total_(cpu_get_num_math()),
+      nodes_(0),
+      claims_(nullptr),
+      node_used_(),
+      node_total_(),
       cv_(PTHREAD_COND_INITIALIZER),
       mu_(PTHREAD_MUTEX_INITIALIZER) {
 }
 
-static void unlock_mutex(void *arg) {
-    pthread_mutex_t *mu = (pthread_mutex_t *)arg;
-    pthread_mutex_unlock(mu);
+// threads stop competing for cores when they exit
+CoreManager::Claim::~Claim() {
+    if (!owner)
+        return;
+    CoreManager *cm = owner;
+    pthread_mutex_lock(&cm->mu_);
+    if (count) {
+        cm->charge(count, node, -1);
+        count = 0;
+    }
+    cm->unlink(this);
+    pthread_cond_broadcast(&cm->cv_);
+    pthread_mutex_unlock(&cm->mu_);
+}
+
+void CoreManager::link(Claim *c) {
+    if (c->owner)
+        return;
+    c->owner = this;
+    c->prev = nullptr;
+    c->next = claims_;
+    if (claims_)
+        claims_->prev = c;
+    claims_ = c;
+}
+
+void CoreManager::unlink(Claim *c) {
+    if (c->owner != this)
+        return;
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        claims_ = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    c->next = c->prev = nullptr;
+    c->owner = nullptr;
+}
+
+// returns sum of weights of threads competing for cores
+int CoreManager::demand(long now) {
+    int sum = 0;
+    for (Claim *c = claims_; c; c = c->next)
+        if (!c->expires || now < c->expires)
+            sum += c->weight;
+    return sum;
+}
+
+// numa topology is discovered after static initialization, so it gets
+// looked up the first time anyone asks for cores. our core budget then
+// gets divided between nodes in proportion to their hardware threads.
+void CoreManager::init_nodes() {
+    if (nodes_)
+        return;
+    int n = MIN(ggml_numa_get_n_nodes(), kMaxNodes);
+    int cpus = 0;
+    for (int i = 0; i < n; ++i)
+        cpus += ggml_numa_get_n_cpus(i);
+    if (n < 2 || !cpus) {
+        node_total_[0] = total_;
+        nodes_ = 1;
+        return;
+    }
+    for (int i = 0; i < n; ++i)
+        node_total_[i] = MAX(1, total_ * ggml_numa_get_n_cpus(i) / cpus);
+    nodes_ = n;
+}
+
+int CoreManager::free_on(int node) {
+    return node_total_[node] - node_used_[node];
+}
+
+// adds count cores to the tally of node. if node is -1, the cores were
+// taken from the whole machine, in which case nodes are filled in order
+void CoreManager::charge(int count, int node, int sign) {
+    used_ += sign * count;
+    if (node >= 0) {
+        node_used_[node] += sign * count;
+        return;
+    }
+    for (int i = 0; i < nodes_ && count > 0; ++i) {
+        int take = MIN(count, node_total_[i]);
+        node_used_[i] += sign * take;
+        count -= take;
+    }
 }
 
-int CoreManager::acquire(int need, int greed) {
+// called if thread is canceled while waiting for cores
+void CoreManager::abandon(void *arg) {
+    CoreManager *cm = (CoreManager *)arg;
+    cm->unlink(&t_claim);
+    pthread_cond_broadcast(&cm->cv_);
+    pthread_mutex_unlock(&cm->mu_);
+}
+
+// reserves between need and greed cores for the calling thread, which
+// is blocked until at least need cores are free. no more than the fair
+// share of the cores will be granted, based on weight. on numa systems
+// all cores come from the same node, unless the machine is idle and the
+// request wouldn't fit on a single node, so threads can stay local. the
+// node can be obtained afterwards by calling last_acquired().
+int CoreManager::acquire(int need, int greed, int weight) {
     npassert(need >= 1);
     npassert(greed >= need);
+    npassert(weight >= 1);
+    npassert(!t_claim.count);
 
     int got = 0;
+    int node = -1;
 
-    while (got < need) {
-        pthread_mutex_lock(&mu_);
-        pthread_cleanup_push(unlock_mutex, &mu_);
-        if (used_ < total_) {
-            ++got;
-            ++used_;
-        } else {
-            pthread_cond_wait(&cv_, &mu_);
-        }
-        pthread_cleanup_pop(true);
-    }
-
-    while (got < greed) {
-        errno_t err;
-        if (pthread_mutex_trylock(&mu_))
-            break;
-        if (used_ < total_) {
-            ++got;
-            ++used_;
+    pthread_mutex_lock(&mu_);
+    init_nodes();
+    link(&t_claim);
+    t_claim.weight = weight;
+    t_claim.expires = 0;
+    pthread_cleanup_push(abandon, this);
+    int biggest = 0;
+    for (int i = 0; i < nodes_; ++i)
+        biggest = MAX(biggest, node_total_[i]);
+    for (;;) {
+        int competition = demand(now_nanos());
+        int share = MAX(need, total_ * weight / competition);
+        int want = MIN(greed, share);
+        if (nodes_ == 1) {
+            if (total_ - used_ >= need) {
+                got = MIN(want, total_ - used_);
+                charge(got, -1, +1);
+                break;
+            }
         } else {
-            greed = got;
+            int best = 0;
+            for (int i = 1; i < nodes_; ++i)
+                if (free_on(i) > free_on(best))
+                    best = i;
+            if (want > biggest && competition == weight && !used_) {
+                got = MIN(want, total_);
+                charge(got, -1, +1);
+                break;
+            }
+            if (free_on(best) >= need) {
+                got = MIN(want, free_on(best));
+                node = best;
+                charge(got, node, +1);
+                break;
+            }
         }
-        pthread_mutex_unlock(&mu_);
+        pthread_cond_wait(&cv_, &mu_);
     }
+    t_claim.count = got;
+    t_claim.node = node;
+    pthread_cleanup_pop(false);
+    pthread_mutex_unlock(&mu_);
 
+    t_last_count = got;
+    t_last_node = node;
     return got;
 }
 
-void CoreManager::release(int count) {
-    bool ok;
+// gives back the cores held by the calling thread
+void CoreManager::release() {
+    if (!t_claim.count)
+        return;
+    bool ok = true;
     pthread_mutex_lock(&mu_);
-    if ((used_ -= count) >= 0) {
-        ok = true;
-    } else {
+    charge(t_claim.count, t_claim.node, -1);
+    t_claim.count = 0;
+    t_claim.expires = now_nanos() + kLingerNanos;
+    for (int i = 0; i < nodes_; ++i) {
+        if (node_used_[i] < 0) {
+            ok = false;
+            node_used_[i] = 0;
+        }
+    }
+    if (used_ < 0) {
         ok = false;
         used_ = 0;
     }
-    pthread_cond_signal(&cv_);
+    pthread_cond_broadcast(&cv_);
     pthread_mutex_unlock(&mu_);
     npassert(ok);
 }
+
+// returns number of cores currently held by all threads
+int CoreManager::used() {
+    pthread_mutex_lock(&mu_);
+    int res = used_;
+    pthread_mutex_unlock(&mu_);
+    return res;
+}
+
+// returns number of cores being managed
+int CoreManager::total() {
+    return total_;
+}
+
+// returns cores most recently acquired by calling thread, and its node
+int CoreManager::last_acquired(int *node) {
+    if (node)
+        *node = t_last_node;
+    return t_last_count;
+}
@@ -18,15 +18,57 @@
 #pragma once
 #include <pthread.h>
 
+// divides cpu cores between the threads that are evaluating graphs
+//
+// each caller receives a share of the cores that's proportional to its
+// weight, relative to everyone else who's competing for cores. threads
+// count as competing while they hold or wait for cores, and for a short
+// while after releasing them, since a request that's decoding will come
+// back for its next graph momentarily. shares are recomputed each time
+// cores are acquired, so allocations rebalance between graph evaluations
+// as requests come and go. cores are released by the thread that holds
+// them.
 class CoreManager {
   public:
+    static constexpr int kGenerateWeight = 1;
+    static constexpr int kPrefillWeight = 2;
+    static constexpr long kLingerNanos = 50000000;
+
+    struct Claim {
+        ~Claim();
+        Claim *next = nullptr;
+        Claim *prev = nullptr;
+        CoreManager *owner = nullptr;
+        int count = 0;
+        int node = -1;
+        int weight = 0;
+        long expires = 0; // zero means holding or waiting
+    };
+
     CoreManager();
-    int acquire(int, int);
-    void release(int);
+    int acquire(int, int, int);
+    void release();
+    int used();
+    int total();
+    static int last_acquired(int *);
 
   private:
+    static constexpr int kMaxNodes = 8;
+    static void abandon(void *);
+
+    void init_nodes();
+    int free_on(int);
+    int demand(long);
+    void charge(int, int, int);
+    void link(Claim *);
+    void unlink(Claim *);
+
     int used_;
     int total_;
+    int nodes_;
+    Claim *claims_;
+    int node_used_[kMaxNodes];
+    int node_total_[kMaxNodes];
     pthread_cond_t cv_;
     pthread_mutex_t mu_;
 };
@@ -47,6 +47,7 @@ bool FLAG_mmap = true;
 bool FLAG_no_display_prompt = false;
 bool FLAG_nocompile = false;
 bool FLAG_nologo = false;
+bool FLAG_pin_threads = false;
 bool FLAG_precise = false;
 bool FLAG_recompile = false;
 bool FLAG_tinyblas = false;
@@ -82,6 +83,7 @@ int FLAG_http_obuf_size = 1024 * 1024;
 int FLAG_keepalive = 5;
 int FLAG_main_gpu = 0;
 int FLAG_n_gpu_layers = -1;
+int FLAG_numa = GGML_NUMA_STRATEGY_DISABLED;
 int FLAG_slots = 1;
 int FLAG_split_mode = LLAMA_SPLIT_MODE_LAYER;
 int FLAG_threads = MIN(cpu_get_num_math(), 20);
@@ -516,6 +518,28 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--pin-threads")) {
+            FLAG_pin_threads = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--numa")) {
+            if (i == argc)
+                missing("--numa");
+            const char *value = argv[i++];
+            if (!strcmp(value, "distribute"))
+                FLAG_numa = GGML_NUMA_STRATEGY_DISTRIBUTE;
+            else if (!strcmp(value, "isolate"))
+                FLAG_numa = GGML_NUMA_STRATEGY_ISOLATE;
+            else if (!strcmp(value, "numactl"))
+                FLAG_numa = GGML_NUMA_STRATEGY_NUMACTL;
+            else if (!strcmp(value, "interleave"))
+                FLAG_numa = GGML_NUMA_STRATEGY_INTERLEAVE;
+            else
+                bad("--numa");
+            continue;
+        }
+
         //////////////////////////////////////////////////////////////////////
         // cpu flags
 
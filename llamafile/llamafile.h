@@ -17,6 +17,7 @@ extern bool FLAG_mmap;
 extern bool FLAG_no_display_prompt;
 extern bool FLAG_nocompile;
 extern bool FLAG_nologo;
+extern bool FLAG_pin_threads;
 extern bool FLAG_precise;
 extern bool FLAG_recompile;
 extern bool FLAG_tinyblas;
@@ -53,6 +54,7 @@ extern int FLAG_http_obuf_size;
 extern int FLAG_keepalive;
 extern int FLAG_main_gpu;
 extern int FLAG_n_gpu_layers;
+extern int FLAG_numa;
 extern int FLAG_slots;
 extern int FLAG_split_mode;
 extern int FLAG_threads;
@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include "client.h"
+#include "llama.cpp/base64.h"
 #include "llama.cpp/llama.h"
 #include "llamafile/json.h"
 #include "llamafile/server/cleanup.h"
@@ -36,9 +37,17 @@ struct EmbeddingParams
 {
     bool add_special;
     bool parse_special;
+    bool base64;
     std::string_view prompt;
     std::string content;
     std::string model;
+    std::vector<std::string> contents;
+    std::vector<std::string_view> prompts;
+    std::vector<const char*> texts;
+    std::vector<int32_t> text_lens;
+    std::vector<int32_t> offsets;
+    std::vector<int> counts;
+    std::string obuf;
 };
 
 void
@@ -80,6 +89,14 @@ Client::get_embedding_params(EmbeddingParams* params)
 {
     params->add_special = atob(or_empty(param("add_special")), true);
     params->parse_special = atob(or_empty(param("parse_special")), false);
+    params->base64 = false;
+    std::optional<std::string_view> encoding_format = param("encoding_format");
+    if (encoding_format.has_value()) {
+        if (encoding_format.value() == "base64")
+            params->base64 = true;
+        else if (encoding_format.value() != "float")
+            return send_error(400, "encoding_format must be float or base64");
+    }
 
     // try obtaining prompt (or its aliases) from request-uri
     std::optional<std::string_view> prompt = param("content");
@@ -122,21 +139,45 @@ Client::get_embedding_params(EmbeddingParams* params)
                 params->content = json.second["prompt"].getString();
             else if (json.second["input"].isString())
                 params->content = json.second["input"].getString();
+            else if (json.second["input"].isArray())
+                for (Json& input : json.second["input"].getArray()) {
+                    if (!input.isString())
+                        return send_error(400, "input array must have strings");
+                    params->contents.emplace_back(input.getString());
+                }
             else
                 return send_error(400, "JSON missing content/prompt/input key");
-            params->prompt = params->content;
+            if (params->contents.empty()) {
+                params->prompt = params->content;
+            } else {
+                if (params->contents.size() > 2048)
+                    return send_error(400, "input array has too many strings");
+                for (const std::string& content : params->contents)
+                    params->prompts.emplace_back(content);
+            }
             if (json.second["add_special"].isBool())
                 params->add_special = json.second["add_special"].getBool();
             if (json.second["parse_special"].isBool())
                 params->parse_special = json.second["parse_special"].getBool();
             if (json.second["model"].isString())
                 params->model = json.second["model"].getString();
+            if (json.second["encoding_format"].isString()) {
+                std::string& format =
+                  json.second["encoding_format"].getString();
+                if (format == "base64")
+                    params->base64 = true;
+                else if (format != "float")
+                    return send_error(
+                      400, "encoding_format must be float or base64");
+            }
         } else {
             return send_error(501, "Content Type Not Implemented");
         }
     } else {
         params->prompt = payload_;
     }
+    if (params->prompts.empty())
+        params->prompts.emplace_back(params->prompt);
     return true;
 }
 
@@ -160,29 +201,66 @@ Client::embedding()
     getrusage(RUSAGE_THREAD, &rustart);
     timespec started = timespec_real();
 
-    // turn text into tokens
-    auto toks = new std::vector<llama_token>(params->prompt.size() + 16);
+    // turn text into tokens, tokenizing all inputs at once in parallel
+    int n_inputs = params->prompts.size();
+    size_t bytes = 0;
+    for (std::string_view prompt : params->prompts) {
+        params->texts.emplace_back(prompt.data());
+        params->text_lens.emplace_back(prompt.size());
+        bytes += prompt.size();
+    }
+    params->offsets.resize(n_inputs + 1);
+    auto toks = new std::vector<llama_token>(bytes + 16 * n_inputs);
     defer_cleanup(cleanup_token_vector, toks);
-    int count = llama_tokenize(model_,
-                               params->prompt.data(),
-                               params->prompt.size(),
-                               &(*toks)[0],
-                               toks->size(),
-                               params->add_special,
-                               params->parse_special);
-    if (count < 0) {
-        SLOG("llama_tokenize failed");
+    // if the guess was too small, the inputs that fit are kept and only
+    // the rest are tokenized again, into a buffer of the reported size
+    int total = 0;
+    int done = 0;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int base = done ? params->offsets[done] : 0;
+        total = llama_tokenize_batch(model_,
+                                     &params->texts[done],
+                                     &params->text_lens[done],
+                                     n_inputs - done,
+                                     toks->data() + base,
+                                     toks->size() - base,
+                                     &params->offsets[done],
+                                     params->add_special,
+                                     params->parse_special,
+                                     0);
+        if (total == INT32_MIN)
+            break;
+        for (int i = done; i <= n_inputs; ++i)
+            params->offsets[i] += base;
+        if (total >= 0) {
+            total += base;
+            break;
+        }
+        while (done < n_inputs && params->offsets[done + 1] <= (int64_t)toks->size())
+            ++done;
+        toks->resize(base - (int64_t)total);
+    }
+    if (total < 0) {
+        SLOG("llama_tokenize_batch failed");
         return send_error(405);
     }
-    toks->resize(count);
-
-    if (toks->empty())
-        return send_error(400, "completely empty prompt disallowed");
+    toks->resize(total);
 
-    // truncate if exceeds model context size
+    // truncate inputs that exceed model context size
     const int n_ctx_train = llama_n_ctx_train(model_);
-    if (count > n_ctx_train)
-        count = n_ctx_train;
+    int count = 0;
+    for (int i = 0; i < n_inputs; ++i) {
+        int n = params->offsets[i + 1] - params->offsets[i];
+        if (!n)
+            return send_error(400, "completely empty prompt disallowed");
+        if (n > n_ctx_train)
+            n = n_ctx_train;
+        params->counts.emplace_back(n);
+        count += n;
+    }
+
+    // inputs are packed into batches no bigger than the model context
+    const int n_batch = count < n_ctx_train ? count : n_ctx_train;
 
     // initialize context
     llama_context_params cparams = {};
@@ -190,10 +268,10 @@ Client::embedding()
     cparams.embeddings_only = true;
     cparams.logits_all = true;
     cparams.seed = _rand64();
-    cparams.n_ctx = count;
-    cparams.n_batch = count;
-    cparams.n_ubatch = count;
-    cparams.n_seq_max = 1;
+    cparams.n_ctx = n_batch;
+    cparams.n_batch = n_batch;
+    cparams.n_ubatch = n_batch;
+    cparams.n_seq_max = n_inputs < n_batch ? n_inputs : n_batch;
     cparams.n_threads = 8;
     cparams.n_threads_batch = 8;
     cparams.attention_type = LLAMA_ATTENTION_TYPE_UNSPECIFIED;
@@ -212,35 +290,55 @@ Client::embedding()
     // initialize batch
     const int n_embd = llama_n_embd(model_);
     llama_batch* batch = new llama_batch;
-    *batch = llama_batch_init(count, 0, 1);
+    *batch = llama_batch_init(n_batch, 0, 1);
     defer_cleanup(cleanup_llama_batch, batch);
-    for (size_t i = 0; i < count; ++i)
-        add_token_to_batch(*batch, (*toks)[i], i, { 0 }, i == count - 1);
 
     // inference time
-    if (llama_decode(ctx, *batch) < 0) {
-        SLOG("llama_decode failed");
-        return send_error(500);
-    }
-    auto embeddings = new std::vector<float>(n_embd, 0);
+    auto embeddings = new std::vector<float>(n_inputs * n_embd, 0);
     defer_cleanup(cleanup_float_vector, embeddings);
-    for (int i = 0; i < batch->n_tokens; i++) {
-        if (!batch->logits[i])
-            continue;
-        const float* embd = llama_get_embeddings_ith(ctx, i);
-        if (!embd) {
-            SLOG("llama_get_embeddings_ith failed");
+    for (int first = 0, next = 0; first < n_inputs; first = next) {
+        batch->n_tokens = 0;
+        for (; next < n_inputs &&
+               batch->n_tokens + params->counts[next] <= n_batch;
+             ++next) {
+            const llama_token* input = &(*toks)[params->offsets[next]];
+            const int n = params->counts[next];
+            for (int i = 0; i < n; ++i)
+                add_token_to_batch(
+                  *batch, input[i], i, { next - first }, i == n - 1);
+        }
+        llama_kv_cache_clear(ctx);
+        if (llama_decode(ctx, *batch) < 0) {
+            SLOG("llama_decode failed");
             return send_error(500);
         }
-        normalize_embeddings(
-          embd, embeddings->data() + batch->seq_id[i][0] * n_embd, n_embd);
+        for (int i = 0; i < batch->n_tokens; i++) {
+            if (!batch->logits[i])
+                continue;
+            const float* embd = llama_get_embeddings_ith(ctx, i);
+            if (!embd) {
+                SLOG("llama_get_embeddings_ith failed");
+                return send_error(500);
+            }
+            normalize_embeddings(
+              embd,
+              embeddings->data() + (first + batch->seq_id[i][0]) * n_embd,
+              n_embd);
+        }
     }
 
     // determine how output json should look
     bool in_openai_mode = path() == "/v1/embeddings";
 
-    // serialize tokens to json
+    // serialize tokens to json, in a bigger buffer if there are many
+    // inputs, since each float may take up to ~16 bytes as json
     char* p = obuf_.p;
+    size_t need = 4096 + (size_t)n_inputs * (n_embd * 18 + 128);
+    if (need > obuf_.c) {
+        params->obuf.resize(need);
+        p = &params->obuf[0];
+    }
+    char* start = p;
     p = stpcpy(p, "{\n");
 
     // Here's what an OpenAI /v1/embedding response looks like:
@@ -280,9 +378,7 @@ Client::embedding()
         p = stpcpy(p, "    \"total_tokens\": ");
         p = encode_json(p, toks->size());
         p = stpcpy(p, "\n  },\n");
-        p = stpcpy(p, "  \"data\": [{\n");
-        p = stpcpy(p, "  \"object\": \"embedding\",\n");
-        p = stpcpy(p, "  \"index\": 0,\n");
+        p = stpcpy(p, "  \"data\": [");
     } else {
         p = stpcpy(p, "  \"add_special\": ");
         p = encode_bool(p, params->add_special);
@@ -298,19 +394,51 @@ Client::embedding()
         p = stpcpy(p, ",\n");
     }
 
-    p = stpcpy(p, "  \"embedding\": [");
-    for (size_t i = 0; i < embeddings->size(); ++i) {
-        if (i) {
-            *p++ = ',';
-            *p++ = ' ';
+    if (!in_openai_mode && n_inputs > 1)
+        p = stpcpy(p, "  \"embeddings\": [");
+    for (int j = 0; j < n_inputs; ++j) {
+        if (in_openai_mode) {
+            p = stpcpy(p, j ? ", {\n" : "{\n");
+            p = stpcpy(p, "  \"object\": \"embedding\",\n");
+            p = stpcpy(p, "  \"index\": ");
+            p = encode_json(p, j);
+            p = stpcpy(p, ",\n");
+            p = stpcpy(p, "  \"embedding\": ");
+        } else if (n_inputs > 1) {
+            p = stpcpy(p, j ? ",\n    " : "\n    ");
+        } else {
+            p = stpcpy(p, "  \"embedding\": ");
+        }
+        const float* embedding = embeddings->data() + j * n_embd;
+        if (params->base64) {
+            // little-endian float32, like openai's encoding_format
+            *p++ = '"';
+            p = base64::encode((const char*)embedding,
+                               (const char*)(embedding + n_embd),
+                               p);
+            *p++ = '"';
+        } else {
+            *p++ = '[';
+            for (int i = 0; i < n_embd; ++i) {
+                if (i) {
+                    *p++ = ',';
+                    *p++ = ' ';
+                }
+                p = encode_json(p, embedding[i]);
+            }
+            *p++ = ']';
         }
-        p = encode_json(p, (*embeddings)[i]);
+        if (in_openai_mode)
+            p = stpcpy(p, "\n  }");
     }
-    p = stpcpy(p, "]\n");
     if (in_openai_mode)
-        p = stpcpy(p, "  }]\n");
+        p = stpcpy(p, "]\n");
+    else if (n_inputs > 1)
+        p = stpcpy(p, "\n  ]\n");
+    else
+        p = stpcpy(p, "\n");
     p = stpcpy(p, "}\n");
-    std::string_view content(obuf_.p, p - obuf_.p);
+    std::string_view content(start, p - start);
 
     // collect statistics
     rusage ruend = {};
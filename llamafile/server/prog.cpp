@@ -68,6 +68,9 @@ main(int argc, char* argv[])
     if (!llamafile_has(argv, "--verbose"))
         FLAG_log_disable = true;
 
+    // numa placement must be decided before the weights get loaded
+    llama_numa_init((enum ggml_numa_strategy)FLAG_numa);
+
     // load model
     llama_model_params mparams = {
         .n_gpu_layers = FLAG_n_gpu_layers,
@@ -18,6 +18,7 @@
 #include "slot.h"
 #include "llama.cpp/llava/clip.h"
 #include "llama.cpp/llava/llava.h"
+#include "llamafile/core_manager.h"
 #include "llamafile/image.h"
 #include "llamafile/llama.h"
 #include "llamafile/llamafile.h"
@@ -176,6 +177,7 @@ Slot::eval_tokens(const std::vector<int>& tokens,
                            .all_pos_0 = used,
                            .all_pos_1 = 1 }))
             return decode_token_failed;
+        cores_ = CoreManager::last_acquired(&node_);
         for (int j = 0; j < n_eval; ++j)
             history_.emplace_back(toks[i + j]);
         used += n_eval;
@@ -221,6 +223,7 @@ Slot::eval_image(const std::string_view& bytes,
             llava_image_embed_free(image_embed);
             return decode_image_failed;
         }
+        cores_ = CoreManager::last_acquired(&node_);
         used += n_eval;
         processed += n_eval;
         if (progress)
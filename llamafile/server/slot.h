@@ -58,6 +58,8 @@ struct Slot
     llama_context* ctx_ = nullptr;
     std::vector<Atom> history_;
     std::string system_fingerprint_;
+    int cores_ = 0; // cpu cores granted for most recent decode
+    int node_ = -1; // numa node of those cores, or -1 if any
 
     ~Slot();
     Slot(int, llama_model*);
@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include "client.h"
+#include "llamafile/core_manager.h"
 #include "server.h"
 #include "slot.h"
 #include "slots.h"
@@ -39,6 +40,15 @@ Client::slotz()
     slot->dump(&dump);
     char* p = append_http_response_message(obuf_.p, 200);
     p = stpcpy(p, "Content-Type: text/plain\r\n");
+    p = stpcpy(p, "X-Slot-Cores: ");
+    p = FormatInt64(p, slot->cores_);
+    p = stpcpy(p, "\r\nX-Slot-Node: ");
+    p = FormatInt64(p, slot->node_);
+    p = stpcpy(p, "\r\nX-Cores-Used: ");
+    p = FormatInt64(p, g_core_manager.used());
+    p = stpcpy(p, "\r\nX-Cores-Total: ");
+    p = FormatInt64(p, g_core_manager.total());
+    p = stpcpy(p, "\r\n");
     return send_response(obuf_.p, p, dump);
 }
 
@@ -0,0 +1,105 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench.h"
+#include "llama.cpp/ggml.h"
+#include "macros.h"
+#include "numba.h"
+#include "sgemm.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// checks that llamafile_sgemm() agrees with ggml's own vec_dot for the
+// quantized weight types it claims to support. the reference is what a
+// ggml_mul_mat() would compute if llamafile_sgemm() returned false, so
+// any type that takes the fast path has to land within float roundoff
+
+#define ITERATIONS 30
+#define ALLOC(n) memalign(4096, n)
+
+static const ggml_type kTypes[] = {
+    GGML_TYPE_Q8_0, GGML_TYPE_Q4_0, GGML_TYPE_Q4_1, GGML_TYPE_Q5_0, GGML_TYPE_Q5_1,
+    GGML_TYPE_IQ4_NL, GGML_TYPE_Q2_K, GGML_TYPE_Q3_K, GGML_TYPE_Q4_K, GGML_TYPE_Q5_K,
+    GGML_TYPE_Q6_K, GGML_TYPE_IQ4_XS,
+};
+
+int test(ggml_type type, int m, int n, int k) {
+    ggml_type_traits_t tA = ggml_internal_get_type_traits(type);
+    ggml_type_traits_t tB = ggml_internal_get_type_traits(tA.vec_dot_type);
+    size_t lda = ggml_row_size(type, k);
+    size_t ldb = ggml_row_size(tA.vec_dot_type, k);
+    float *X = (float *)ALLOC(sizeof(float) * k * (m + n));
+    char *A = (char *)ALLOC(lda * m);
+    char *B = (char *)ALLOC(ldb * n);
+    float *C = (float *)ALLOC(sizeof(float) * m * n);
+    float *G = (float *)ALLOC(sizeof(float) * m * n);
+    randomize(X, k * (m + n));
+    ggml_quantize_chunk(type, X, A, 0, m, k, NULL);
+    for (int j = 0; j < n; ++j)
+        tB.from_float(X + k * (m + j), B + ldb * j, k);
+    broadcast(C, m * n, NAN);
+
+    for (int j = 0; j < n; ++j)
+        for (int i = 0; i < m; ++i)
+            tA.vec_dot(k, G + m * j + i, 0, A + lda * i, 0, B + ldb * j, 0, 1);
+
+    if (!llamafile_sgemm(m, n, k / tA.blck_size, A, lda / tA.type_size, B,
+                         ldb / tB.type_size, C, m, 0, 1, type, tA.vec_dot_type,
+                         GGML_TYPE_F32)) {
+        printf("%8s %12s\n", tA.type_name, "unsupported");
+    } else {
+        double err_worst = 0;
+        for (int j = 0; j < n; ++j)
+            for (int i = 0; i < m; ++i) {
+                float g = G[m * j + i];
+                float c = C[m * j + i];
+                if (isnan(c)) {
+                    fprintf(stderr, "%s:%d: %s: found nan in output matrix: i=%d j=%d\n",
+                            __FILE__, __LINE__, tA.type_name, i, j);
+                    return 3;
+                }
+                double err = fabs((double)g - c) / (fabs(g) + 1);
+                if (err > err_worst)
+                    err_worst = err;
+            }
+        BENCH(llamafile_sgemm(m, n, k / tA.blck_size, A, lda / tA.type_size, B,
+                              ldb / tB.type_size, C, m, 0, 1, type, tA.vec_dot_type,
+                              GGML_TYPE_F32));
+        printf("%8s %12g worst relative error\n", tA.type_name, err_worst);
+        if (err_worst > 1e-3) {
+            fprintf(stderr, "%s:%d: %s: llamafile_sgemm disagrees with vec_dot\n", __FILE__,
+                    __LINE__, tA.type_name);
+            return 4;
+        }
+    }
+
+    free(G);
+    free(C);
+    free(B);
+    free(A);
+    free(X);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    for (ggml_type type : kTypes)
+        if ((rc = test(type, 67, 13, 4096)))
+            return rc;
+    ggml_quantize_free();
+}
@@ -0,0 +1,117 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "macros.h"
+#include "micros.h"
+
+#include <cosmo.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "llama.cpp/cores.h"
+#include "llama.cpp/ggml.h"
+
+// measures how much time ggml_graph_compute() spends getting threads in
+// and out of a graph that does almost no work, which is roughly what it
+// costs per token on top of the math when generating text. pass a thread
+// count to go beyond the number of cores, e.g. `threadpool_test 64`
+
+#define ITERATIONS 300
+#define NODES 64
+#define N 64
+
+static struct ggml_cgraph *build(struct ggml_context *ctx, struct ggml_tensor **out) {
+    struct ggml_tensor *x = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, N);
+    struct ggml_tensor *y = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, N);
+    for (int i = 0; i < N; ++i) {
+        ((float *)x->data)[i] = i * .01f;
+        ((float *)y->data)[i] = 1.f / (i + 1);
+    }
+    // two interleaved chains, so that some barriers can be elided
+    struct ggml_tensor *z = x;
+    struct ggml_tensor *w = y;
+    for (int i = 0; i < NODES / 2; ++i) {
+        z = ggml_add(ctx, i & 1 ? ggml_scale(ctx, z, .5f) : z, y);
+        w = ggml_mul(ctx, w, x);
+    }
+    z = ggml_add(ctx, z, w);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, z);
+    *out = z;
+    return gf;
+}
+
+static long long run(struct ggml_cgraph *gf, int n_threads, struct ggml_threadpool *pool) {
+    struct ggml_cplan cplan = ggml_graph_plan(gf, n_threads);
+    cplan.n_threads = n_threads;
+    cplan.threadpool = pool;
+    void *work = malloc(cplan.work_size + 1);
+    cplan.work_data = (uint8_t *)work;
+    if (ggml_graph_compute(gf, &cplan) != GGML_STATUS_SUCCESS)
+        exit(1);
+    long long start = micros();
+    for (int i = 0; i < ITERATIONS; ++i)
+        if (ggml_graph_compute(gf, &cplan) != GGML_STATUS_SUCCESS)
+            exit(2);
+    long long took = (micros() - start + ITERATIONS - 1) / ITERATIONS;
+    free(work);
+    return took;
+}
+
+int main(int argc, char *argv[]) {
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 16 * 1024 * 1024,
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ false,
+    };
+    struct ggml_context *ctx = ggml_init(params);
+    struct ggml_tensor *out;
+    struct ggml_cgraph *gf = build(ctx, &out);
+
+    // compute the expected answer single threaded
+    run(gf, 1, NULL);
+    float want[N];
+    memcpy(want, out->data, sizeof(want));
+
+    int max_threads = argc > 1 ? atoi(argv[1]) : MIN(64, cpu_get_num_math());
+    printf("%8s %12s %12s\n", "threads", "tasks", "threadpool");
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        struct ggml_threadpool *pool = ggml_threadpool_new(n_threads);
+        if (!pool)
+            return 3;
+        long long tasks = run(gf, n_threads, NULL);
+        if (memcmp(want, out->data, sizeof(want)))
+            return 4;
+        memset(out->data, 0, sizeof(want));
+        long long pooled = run(gf, n_threads, pool);
+        if (memcmp(want, out->data, sizeof(want)))
+            return 5;
+        // graphs may use fewer threads than the pool owns
+        if (n_threads > 1) {
+            memset(out->data, 0, sizeof(want));
+            run(gf, n_threads / 2, pool);
+            if (memcmp(want, out->data, sizeof(want)))
+                return 6;
+        }
+        ggml_threadpool_free(pool);
+        printf("%8d %9lld us %9lld us\n", n_threads, tasks, pooled);
+    }
+
+    ggml_free(ctx);
+}
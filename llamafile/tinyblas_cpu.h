@@ -88,6 +88,11 @@ inline float unhalf(ggml_bf16_t d) {
     return GGML_BF16_TO_FP32(d);
 }
 
+// non-linear codebook of IQ4_NL quants (same as kvalues_iq4nl in ggml)
+alignas(16) static const int8_t iq4nl_values[16] = {
+    -127, -104, -83, -65, -49, -35, -22, -10, 1, 13, 25, 38, 53, 69, 89, 113,
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // MATRIX MEMORY INDEXING
 
@@ -118,6 +123,10 @@ template <>
 struct ggml_type_trait<block_q8_0> {
     static constexpr ggml_type id = GGML_TYPE_Q8_0;
 };
+template <>
+struct ggml_type_trait<block_iq4_nl> {
+    static constexpr ggml_type id = GGML_TYPE_IQ4_NL;
+};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // VECTORIZED ARITHMETIC OPERATIONS
@@ -764,6 +773,14 @@ class tinyBLAS_Q0_ARM {
         return vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(vld1q_u8(b->qs), 4)), vdupq_n_s8(0x8));
     }
 
+    inline int8x16_t load_lo(const block_iq4_nl *b) {
+        return vqtbl1q_s8(vld1q_s8(iq4nl_values), vandq_u8(vld1q_u8(b->qs), vdupq_n_u8(0x0f)));
+    }
+
+    inline int8x16_t load_hi(const block_iq4_nl *b) {
+        return vqtbl1q_s8(vld1q_s8(iq4nl_values), vshrq_n_u8(vld1q_u8(b->qs), 4));
+    }
+
     const TA *const A;
     const TB *const B;
     TC *const C;
@@ -982,6 +999,15 @@ class tinyBLAS_Q0_AVX2 {
                                _mm256_set1_epi8(8));
     }
 
+    inline __m256i load(const block_iq4_nl *b) {
+        __m128i x = _mm_loadu_si128((const __m128i *)b->qs);
+        __m128i m = _mm_set1_epi8(15);
+        __m128i v = _mm_load_si128((const __m128i *)iq4nl_values);
+        return _mm256_insertf128_si256(
+            _mm256_castsi128_si256(_mm_shuffle_epi8(v, _mm_and_si128(m, x))),
+            _mm_shuffle_epi8(v, _mm_and_si128(m, _mm_srli_epi16(x, 4))), 1);
+    }
+
     inline __m256 updot(__m256i u, __m256i s) {
         __m256i res;
 #if defined(__AVXVNNI__) || (defined(__AVX512VNNI__) && defined(__AVX512VL__))
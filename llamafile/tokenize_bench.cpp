@@ -0,0 +1,198 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile.h"
+#include "micros.h"
+
+#include <cosmo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "llama.cpp/llama.h"
+#include "llama.cpp/unicode.h"
+
+// measures how fast llama_tokenize() turns text into wordpiece tokens,
+// compared with the substring probing tokenizer it replaced, and checks
+// that both produce the same tokens. use it with a bert, nomic or mxbai
+// embedding model and a file of representative text, e.g.
+//
+//     o//llamafile/tokenize_bench -m all-MiniLM-L6-v2.F32.gguf -f corpus.txt
+
+#define ITERATIONS 10
+
+static std::unordered_map<std::string, llama_token> g_token_to_id;
+static int g_max_token_len;
+static llama_token g_unk;
+
+static bool is_chinese_char(uint32_t cpt) {
+    return (cpt >= 0x04E00 && cpt <= 0x09FFF) || //
+           (cpt >= 0x03400 && cpt <= 0x04DBF) || //
+           (cpt >= 0x20000 && cpt <= 0x2A6DF) || //
+           (cpt >= 0x2A700 && cpt <= 0x2B73F) || //
+           (cpt >= 0x2B740 && cpt <= 0x2B81F) || //
+           (cpt >= 0x2B920 && cpt <= 0x2CEAF) || //
+           (cpt >= 0x0F900 && cpt <= 0x0FAFF) || //
+           (cpt >= 0x2F800 && cpt <= 0x2FA1F);
+}
+
+static std::vector<std::string> reference_preprocess(const std::string &text) {
+    std::vector<uint32_t> cpts_nfd = unicode_cpts_normalize_nfd(unicode_cpts_from_utf8(text));
+    std::vector<std::string> words(1, "");
+    for (uint32_t cpt : cpts_nfd) {
+        auto flags = unicode_cpt_flags(cpt);
+        if (flags.is_whitespace) {
+            if (words.back().size())
+                words.emplace_back();
+            continue;
+        }
+        if (cpt == 0 || cpt == 0xFFFD || flags.is_control)
+            continue;
+        std::string s = unicode_cpt_to_utf8(unicode_tolower(cpt));
+        if (flags.is_punctuation || (cpt < 0x7F && flags.is_symbol) || is_chinese_char(cpt)) {
+            if (words.back().size())
+                words.emplace_back();
+            words.back() = s;
+            words.emplace_back();
+        } else {
+            words.back() += s;
+        }
+    }
+    if (!words.back().size())
+        words.pop_back();
+    return words;
+}
+
+static void reference_tokenize(const std::string &text, std::vector<llama_token> &output) {
+    for (const std::string &word : reference_preprocess(text)) {
+        std::string word1 = "\xe2\x96\x81" + word;
+        int n = word1.size();
+        size_t current_tokens = output.size();
+        for (int i = 0; i < n; ++i) {
+            bool match = false;
+            for (int j = std::min(n, i + g_max_token_len + 1); j > i; j--) {
+                auto it = g_token_to_id.find(word1.substr(i, j - i));
+                if (it != g_token_to_id.end()) {
+                    output.push_back(it->second);
+                    match = true;
+                    i = j - 1;
+                    break;
+                }
+            }
+            if (!match) {
+                output.resize(current_tokens);
+                break;
+            }
+        }
+        if (current_tokens == output.size())
+            output.push_back(g_unk);
+    }
+}
+
+static void tokenize(const llama_model *model, const std::string &text,
+                     std::vector<llama_token> &output) {
+    output.resize(text.size() + 1);
+    int n = llama_tokenize(model, text.data(), text.size(), output.data(), output.size(), false,
+                           false);
+    if (n < 0) {
+        fprintf(stderr, "error: failed to tokenize text\n");
+        exit(1);
+    }
+    output.resize(n);
+}
+
+int main(int argc, char **argv) {
+    llamafile_check_cpu();
+    FLAG_log_disable = true;
+    llamafile_get_flags(argc, argv);
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+    llama_model *model = llama_load_model_from_file(FLAG_model, mparams);
+    if (model == NULL)
+        return 3;
+    if (llama_vocab_type(model) != LLAMA_VOCAB_TYPE_WPM) {
+        fprintf(stderr, "%s: not a wordpiece (bert) vocabulary\n", FLAG_model);
+        return 4;
+    }
+
+    int n_vocab = llama_n_vocab(model);
+    for (llama_token id = 0; id < n_vocab; ++id) {
+        std::string text = llama_token_get_text(model, id);
+        g_max_token_len = std::max(g_max_token_len, (int)text.size());
+        g_token_to_id[text] = id;
+    }
+    g_unk = g_token_to_id.count("[UNK]") ? g_token_to_id["[UNK]"] : 0;
+
+    FILE *input;
+    if (FLAG_prompt) {
+        input = fmemopen((void *)FLAG_prompt, strlen(FLAG_prompt), "rb");
+    } else if (FLAG_file) {
+        if (!(input = fopen(FLAG_file, "rb"))) {
+            perror(FLAG_file);
+            return 1;
+        }
+    } else {
+        input = stdin;
+    }
+    std::vector<std::string> lines;
+    char *line;
+    size_t linelen;
+    while ((line = fgetln(input, &linelen)))
+        lines.emplace_back(line, linelen);
+    if (lines.empty()) {
+        fprintf(stderr, "error: no input text\n");
+        return 1;
+    }
+
+    // both tokenizers must agree before we compare their speed
+    std::vector<llama_token> want, got;
+    for (const std::string &text : lines) {
+        want.clear();
+        reference_tokenize(text, want);
+        tokenize(model, text, got);
+        if (want != got) {
+            fprintf(stderr, "error: tokenizers disagree on: %s", text.c_str());
+            return 5;
+        }
+    }
+
+    long long tokens = 0;
+    long long start = micros();
+    for (int i = 0; i < ITERATIONS; ++i)
+        for (const std::string &text : lines) {
+            want.clear();
+            reference_tokenize(text, want);
+            tokens += want.size();
+        }
+    long long reference_us = micros() - start;
+
+    start = micros();
+    for (int i = 0; i < ITERATIONS; ++i)
+        for (const std::string &text : lines)
+            tokenize(model, text, got);
+    long long trie_us = micros() - start;
+
+    printf("%12.0f tokens/sec substring probing\n", tokens * 1e6 / reference_us);
+    printf("%12.0f tokens/sec trie\n", tokens * 1e6 / trie_us);
+    printf("%12.2fx speedup\n", (double)reference_us / trie_us);
+
+    llama_free_model(model);
+}